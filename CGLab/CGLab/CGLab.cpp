@@ -4,6 +4,9 @@
 #include "framework.h"
 #include "CGLab.h"
 #include "app.h"
+#include "benchmarks.h"
+#include "modelCooker.h"
+#include "model.h"
 #include "imGui/imgui_impl_win32.h"
 
 
@@ -34,7 +37,77 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                      _In_ int       nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
+
+    // has to come before -cook, everything after -cook is the model path
+    if (wcsstr(lpCmdLine, L"-nomeshopt") != nullptr)
+    {
+        ModelCooker::SetMeshOptimization(false);
+    }
+
+    const WCHAR* pLodsArg = wcsstr(lpCmdLine, L"-lods");
+
+    if (pLodsArg != nullptr)
+    {
+        ModelCooker::SetLodLevelNum(static_cast<UINT>(_wtoi(pLodsArg + wcslen(L"-lods"))));
+    }
+
+    if (wcsstr(lpCmdLine, L"-meshlets") != nullptr)
+    {
+        ModelCooker::SetMeshletBuild(true);
+    }
+
+    if (wcsstr(lpCmdLine, L"-quantizedvertices") != nullptr)
+    {
+        Model::SetVertexFormat(VertexFormat::Quantized);
+    }
+    else if (wcsstr(lpCmdLine, L"-compactvertices") != nullptr)
+    {
+        Model::SetVertexFormat(VertexFormat::Compact);
+    }
+
+    if (wcsstr(lpCmdLine, L"-nopositionstream") != nullptr)
+    {
+        Model::SetPositionStream(false);
+    }
+
+    if (wcsstr(lpCmdLine, L"-benchmark") != nullptr)
+    {
+        FILE* pConsoleOut = nullptr;
+
+        AllocConsole();
+        freopen_s(&pConsoleOut, "CONOUT$", "w", stdout);
+
+        RunBenchmarks();
+
+        system("pause");
+        return 0;
+    }
+
+    const WCHAR* pCookArg = wcsstr(lpCmdLine, L"-cook");
+
+    if (pCookArg != nullptr)
+    {
+        FILE* pConsoleOut = nullptr;
+
+        AllocConsole();
+        freopen_s(&pConsoleOut, "CONOUT$", "w", stdout);
+
+        std::wstring pathToModel = pCookArg + wcslen(L"-cook");
+
+        size_t first = pathToModel.find_first_not_of(L" \t\"");
+        size_t last = pathToModel.find_last_not_of(L" \t\"");
+
+        pathToModel = first != std::wstring::npos ? pathToModel.substr(first, last - first + 1) : L"";
+
+        std::string path(WideCharToMultiByte(CP_UTF8, 0, pathToModel.c_str(), -1, nullptr, 0, nullptr, nullptr), '\0');
+        WideCharToMultiByte(CP_UTF8, 0, pathToModel.c_str(), -1, &path[0], static_cast<int>(path.size()), nullptr, nullptr);
+        path.resize(path.size() - 1);
+
+        bool isCooked = ModelCooker::CookToCache(path);
+
+        system("pause");
+        return isCooked ? 0 : 1;
+    }
 
     // TODO: Разместите код здесь.
 
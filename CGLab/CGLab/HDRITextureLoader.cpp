@@ -45,8 +45,8 @@ HDRITextureLoader::HDRITextureLoader(
 	, m_pInputLayout(nullptr)
 	, m_pToCubeVS(nullptr)
 	, m_pToCubePS(nullptr)
-	, m_pIrradiancePS(nullptr)
 	, m_pIrradianceVS(nullptr)
+	, m_pIrradiancePS(nullptr)
 	, m_pPrefilteredVS(nullptr)
 	, m_pPrefilteredPS(nullptr)
 	, m_pMinMagLinearSampler(nullptr)
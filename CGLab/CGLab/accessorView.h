@@ -0,0 +1,147 @@
+#pragma once
+#include "framework.h"
+#include "modelBuffers.h"
+
+
+template <class T>
+struct AccessorTraits;
+
+template <>
+struct AccessorTraits<UINT8>
+{
+	static constexpr int componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+	static constexpr int type = TINYGLTF_TYPE_SCALAR;
+};
+
+template <>
+struct AccessorTraits<INT16>
+{
+	static constexpr int componentType = TINYGLTF_COMPONENT_TYPE_SHORT;
+	static constexpr int type = TINYGLTF_TYPE_SCALAR;
+};
+
+template <>
+struct AccessorTraits<UINT16>
+{
+	static constexpr int componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+	static constexpr int type = TINYGLTF_TYPE_SCALAR;
+};
+
+template <>
+struct AccessorTraits<UINT32>
+{
+	static constexpr int componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
+	static constexpr int type = TINYGLTF_TYPE_SCALAR;
+};
+
+template <>
+struct AccessorTraits<DirectX::XMFLOAT2>
+{
+	static constexpr int componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+	static constexpr int type = TINYGLTF_TYPE_VEC2;
+};
+
+template <>
+struct AccessorTraits<DirectX::XMFLOAT3>
+{
+	static constexpr int componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+	static constexpr int type = TINYGLTF_TYPE_VEC3;
+};
+
+template <>
+struct AccessorTraits<DirectX::XMFLOAT4>
+{
+	static constexpr int componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+	static constexpr int type = TINYGLTF_TYPE_VEC4;
+};
+
+
+// Typed, strided view of a glTF accessor that reads straight from the buffer memory.
+// Bounds are validated once on creation, so element access is a single multiply-add.
+template <class T>
+class AccessorView
+{
+public:
+	AccessorView() = default;
+
+	AccessorView(const UINT8* pData, size_t count, size_t stride)
+		: m_pData(pData)
+		, m_count(count)
+		, m_stride(stride)
+	{}
+
+	static AccessorView Create(
+		const tinygltf::Model& model,
+		const tinygltf::Accessor& accessor,
+		ModelBuffers* pBuffers
+	)
+	{
+		return Create(model, accessor, pBuffers, 0, accessor.count);
+	}
+
+	// Elements [first, first + count) of the accessor, on a streamed buffer they stay
+	// mapped until ModelBuffers::ReleaseStreamedViews is called
+	static AccessorView Create(
+		const tinygltf::Model& model,
+		const tinygltf::Accessor& accessor,
+		ModelBuffers* pBuffers,
+		size_t first,
+		size_t count
+	)
+	{
+		if (accessor.componentType != AccessorTraits<T>::componentType
+			|| accessor.type != AccessorTraits<T>::type
+			|| accessor.sparse.isSparse
+			|| accessor.bufferView < 0
+			|| static_cast<size_t>(accessor.bufferView) >= model.bufferViews.size())
+		{
+			return AccessorView();
+		}
+
+		const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+		size_t stride = bufferView.byteStride != 0 ? bufferView.byteStride : sizeof(T);
+
+		if (stride < sizeof(T))
+		{
+			return AccessorView();
+		}
+
+		if (first > accessor.count || count > accessor.count - first)
+		{
+			return AccessorView();
+		}
+
+		BufferSpan elements = pBuffers->GetBufferViewRange(
+			model,
+			accessor.bufferView,
+			accessor.byteOffset + stride * first,
+			count > 0 ? stride * (count - 1) + sizeof(T) : 0
+		);
+
+		if (elements.pData == nullptr)
+		{
+			return AccessorView();
+		}
+
+		return AccessorView(elements.pData, count, stride);
+	}
+
+	inline bool IsValid() const { return m_pData != nullptr; }
+	inline size_t Count() const { return m_count; }
+	inline size_t Stride() const { return m_stride; }
+
+	inline T operator[](size_t idx) const
+	{
+		assert(idx < m_count);
+
+		T value;
+		std::memcpy(&value, m_pData + idx * m_stride, sizeof(T));
+
+		return value;
+	}
+
+private:
+	const UINT8* m_pData = nullptr;
+	size_t m_count = 0;
+	size_t m_stride = 0;
+};
@@ -99,10 +99,10 @@ void App::AddButtonHandle()
 
 
 App::App(HWND hWnd) 
-	: m_pRenderer(nullptr)
-	, m_isPressed(false)
-	, m_xMouse(0)
+	: m_xMouse(0)
 	, m_yMouse(0)
+	, m_isPressed(false)
+	, m_pRenderer(nullptr)
 {
 	auto renderer = Renderer::CreateRenderer(hWnd);
 	if (!renderer)
@@ -0,0 +1,909 @@
+#include "benchmarks.h"
+#include "accessorView.h"
+#include "vertexInterleave.h"
+#include "modelCooker.h"
+#include "textureDecoder.h"
+#include "threadPool.h"
+#include "meshlet.h"
+#include "frustumCulling.h"
+#include "instanceBvh.h"
+#include "occlusionCulling.h"
+#include "offsetAllocator.h"
+#include "jobSystem.h"
+#include "taskGraph.h"
+
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <thread>
+
+
+template <class Func>
+double measureBestTimeMs(UINT runNum, Func&& func)
+{
+	double bestTimeMs = DBL_MAX;
+
+	for (UINT i = 0; i < runNum; ++i)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		func();
+
+		double timeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		bestTimeMs = (std::min)(bestTimeMs, timeMs);
+	}
+
+	return bestTimeMs;
+}
+
+void printVerticesPerSecond(const char* name, size_t vertexNum, double timeMs)
+{
+	printf("  %-24s %8.2f ms  %8.1f Mverts/s\n", name, timeMs, vertexNum / (timeMs * 1000.0));
+}
+
+
+void benchmarkVertexInterleave()
+{
+	const size_t vertexNum = 1000000;
+	const UINT runNum = 10;
+
+	struct FloatVertex
+	{
+		float position[3];
+		float normal[3];
+		float tangent[4];
+		float texCoord[2];
+	};
+
+	struct QuantizedVertex
+	{
+		float position[3];
+		INT16 normal[4];
+		INT8 tangent[4];
+		UINT16 texCoord[2];
+	};
+
+	std::vector<FloatVertex> floatVertices(vertexNum);
+	std::vector<QuantizedVertex> quantizedVertices(vertexNum);
+
+	for (size_t i = 0; i < vertexNum; ++i)
+	{
+		float t = static_cast<float>(i) / vertexNum;
+
+		floatVertices[i] = {
+			{ t, 2.0f * t, 3.0f * t },
+			{ 0.0f, 1.0f, 0.0f },
+			{ 1.0f, 0.0f, 0.0f, 1.0f },
+			{ t, 1.0f - t }
+		};
+
+		quantizedVertices[i] = {
+			{ t, 2.0f * t, 3.0f * t },
+			{ 0, 32767, 0, 0 },
+			{ 127, 0, 0, 127 },
+			{ static_cast<UINT16>(t * 65535.0f), static_cast<UINT16>((1.0f - t) * 65535.0f) }
+		};
+	}
+
+	std::vector<Vertex> vertices(vertexNum);
+
+	printf("vertex interleave, %zu vertices, best of %u runs\n", vertexNum, runNum);
+
+	// per field copy through typed accessor views, float attributes only
+	{
+		const UINT8* pData = reinterpret_cast<const UINT8*>(floatVertices.data());
+		const size_t stride = sizeof(FloatVertex);
+
+		AccessorView<DirectX::XMFLOAT3> positions(pData + offsetof(FloatVertex, position), vertexNum, stride);
+		AccessorView<DirectX::XMFLOAT3> normals(pData + offsetof(FloatVertex, normal), vertexNum, stride);
+		AccessorView<DirectX::XMFLOAT4> tangents(pData + offsetof(FloatVertex, tangent), vertexNum, stride);
+		AccessorView<DirectX::XMFLOAT2> texCoords(pData + offsetof(FloatVertex, texCoord), vertexNum, stride);
+
+		double timeMs = measureBestTimeMs(runNum, [&]()
+			{
+				for (size_t i = 0; i < vertexNum; ++i)
+				{
+					Vertex& vertex = vertices[i];
+
+					vertex.position = positions[i];
+					vertex.normal = normals[i];
+					vertex.tangent = tangents[i];
+					vertex.texCoord = texCoords[i];
+				}
+			}
+		);
+
+		printVerticesPerSecond("accessor views, float", vertexNum, timeMs);
+	}
+
+	VertexStreams floatStreams;
+	{
+		const UINT8* pData = reinterpret_cast<const UINT8*>(floatVertices.data());
+		const size_t size = floatVertices.size() * sizeof(FloatVertex);
+		const size_t stride = sizeof(FloatVertex);
+
+		floatStreams.position = { pData + offsetof(FloatVertex, position), size - offsetof(FloatVertex, position), stride, TINYGLTF_COMPONENT_TYPE_FLOAT, 3, false };
+		floatStreams.normal = { pData + offsetof(FloatVertex, normal), size - offsetof(FloatVertex, normal), stride, TINYGLTF_COMPONENT_TYPE_FLOAT, 3, false };
+		floatStreams.tangent = { pData + offsetof(FloatVertex, tangent), size - offsetof(FloatVertex, tangent), stride, TINYGLTF_COMPONENT_TYPE_FLOAT, 4, false };
+		floatStreams.texCoord = { pData + offsetof(FloatVertex, texCoord), size - offsetof(FloatVertex, texCoord), stride, TINYGLTF_COMPONENT_TYPE_FLOAT, 2, false };
+	}
+
+	VertexStreams quantizedStreams;
+	{
+		const UINT8* pData = reinterpret_cast<const UINT8*>(quantizedVertices.data());
+		const size_t size = quantizedVertices.size() * sizeof(QuantizedVertex);
+		const size_t stride = sizeof(QuantizedVertex);
+
+		quantizedStreams.position = { pData + offsetof(QuantizedVertex, position), size - offsetof(QuantizedVertex, position), stride, TINYGLTF_COMPONENT_TYPE_FLOAT, 3, false };
+		quantizedStreams.normal = { pData + offsetof(QuantizedVertex, normal), size - offsetof(QuantizedVertex, normal), stride, TINYGLTF_COMPONENT_TYPE_SHORT, 3, true };
+		quantizedStreams.tangent = { pData + offsetof(QuantizedVertex, tangent), size - offsetof(QuantizedVertex, tangent), stride, TINYGLTF_COMPONENT_TYPE_BYTE, 4, true };
+		quantizedStreams.texCoord = { pData + offsetof(QuantizedVertex, texCoord), size - offsetof(QuantizedVertex, texCoord), stride, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, 2, true };
+	}
+
+	InterleaveKernel kernels[] = { InterleaveKernel::Scalar, InterleaveKernel::SSE, InterleaveKernel::AVX2 };
+
+	for (InterleaveKernel kernel : kernels)
+	{
+		if (kernel > GetBestInterleaveKernel())
+		{
+			continue;
+		}
+
+		char name[64];
+
+		double timeMs = measureBestTimeMs(runNum, [&]() { InterleaveVertices(floatStreams, vertexNum, vertices.data(), kernel); });
+		sprintf_s(name, "%s, float", GetInterleaveKernelName(kernel));
+		printVerticesPerSecond(name, vertexNum, timeMs);
+
+		timeMs = measureBestTimeMs(runNum, [&]() { InterleaveVertices(quantizedStreams, vertexNum, vertices.data(), kernel); });
+		sprintf_s(name, "%s, quantized", GetInterleaveKernelName(kernel));
+		printVerticesPerSecond(name, vertexNum, timeMs);
+	}
+}
+
+void benchmarkTextureDecode(const std::string& pathToModel)
+{
+	const UINT runNum = 3;
+
+	CookedModel cookedModel;
+
+	if (!ModelCooker::Cook(pathToModel, cookedModel))
+	{
+		printf("texture decode: failed to cook %s\n", pathToModel.c_str());
+		return;
+	}
+
+	TextureDecoder* pDecoder = TextureDecoder::Create(cookedModel.GetView(), pathToModel);
+
+	if (pDecoder == nullptr)
+	{
+		return;
+	}
+
+	printf("texture decode, %s, %u images\n", pathToModel.c_str(), pDecoder->ImageNum());
+
+	std::vector<DecodedImage> reference;
+	pDecoder->Decode(nullptr, reference);
+
+	double serialTimeMs = 0.0;
+
+	for (UINT i = 0; i < static_cast<UINT>(reference.size()); ++i)
+	{
+		const tinygltf::Image& image = reference[i].image;
+
+		printf("  image %-3u %5dx%-5d %8.2f ms%s\n", i, image.width, image.height, reference[i].decodeTimeMs, reference[i].isDecoded ? "" : "  failed");
+		serialTimeMs += reference[i].decodeTimeMs;
+	}
+
+	printf("  sum of per-image times   %8.2f ms\n", serialTimeMs);
+
+	UINT maxThreadNum = (std::max)(std::thread::hardware_concurrency(), 1u);
+	double oneThreadTimeMs = 0.0;
+
+	for (UINT threadNum = 1; ; threadNum = (std::min)(threadNum * 2, maxThreadNum))
+	{
+		ThreadPool* pPool = ThreadPool::Create(threadNum);
+		std::vector<DecodedImage> images;
+
+		double timeMs = measureBestTimeMs(runNum, [&]() { pDecoder->Decode(pPool, images); });
+
+		bool isSame = images.size() == reference.size();
+
+		for (size_t i = 0; isSame && i < images.size(); ++i)
+		{
+			isSame = images[i].isDecoded == reference[i].isDecoded && images[i].image.image == reference[i].image.image;
+		}
+
+		if (threadNum == 1)
+		{
+			oneThreadTimeMs = timeMs;
+		}
+
+		printf("  %2u threads %8.2f ms wall  %5.2fx%s\n", threadNum, timeMs, oneThreadTimeMs / timeMs, isSame ? "" : "  MISMATCH");
+
+		delete pPool;
+
+		if (threadNum == maxThreadNum)
+		{
+			break;
+		}
+	}
+
+	delete pDecoder;
+}
+
+void benchmarkMeshletCulling(const std::string& pathToModel)
+{
+	const UINT viewNum = 64;
+	const UINT runNum = 10;
+
+	// the benchmark run exits afterwards, so the cook setting is not restored
+	ModelCooker::SetMeshletBuild(true);
+
+	CookedModel cookedModel;
+
+	if (!ModelCooker::Cook(pathToModel, cookedModel))
+	{
+		printf("meshlet culling: failed to cook %s\n", pathToModel.c_str());
+		return;
+	}
+
+	if (cookedModel.meshlets.empty())
+	{
+		printf("meshlet culling: %s has no meshlets\n", pathToModel.c_str());
+		return;
+	}
+
+	DirectX::XMVECTOR boundsMin = DirectX::XMVectorReplicate(FLT_MAX);
+	DirectX::XMVECTOR boundsMax = DirectX::XMVectorReplicate(-FLT_MAX);
+
+	for (const auto& mesh : cookedModel.meshes)
+	{
+		DirectX::XMMATRIX modelMatrix = DirectX::XMLoadFloat4x4(&mesh.modelMatrix);
+
+		for (UINT32 i = 0; i < mesh.primitiveCount; ++i)
+		{
+			const CookedPrimitive& primitive = cookedModel.primitives[mesh.firstPrimitive + i];
+
+			for (UINT32 m = 0; m < primitive.meshletCount; ++m)
+			{
+				DirectX::XMVECTOR center = DirectX::XMVector3Transform(
+					DirectX::XMLoadFloat3(&cookedModel.meshlets[primitive.firstMeshlet + m].center),
+					modelMatrix
+				);
+
+				boundsMin = DirectX::XMVectorMin(boundsMin, center);
+				boundsMax = DirectX::XMVectorMax(boundsMax, center);
+			}
+		}
+	}
+
+	DirectX::XMVECTOR modelCenter = DirectX::XMVectorScale(DirectX::XMVectorAdd(boundsMin, boundsMax), 0.5f);
+	float modelRadius = 0.5f * DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(boundsMax, boundsMin)));
+
+	// cameras circle the model close enough that parts of it leave the frustum
+	std::vector<DirectX::XMFLOAT4> cameraPositions(viewNum);
+	std::vector<DirectX::XMMATRIX> vpMatrices(viewNum);
+
+	DirectX::XMMATRIX projMatrix = DirectX::XMMatrixPerspectiveFovLH(DirectX::XM_PIDIV2, 16.0f / 9.0f, 0.01f, 1000.0f);
+
+	for (UINT v = 0; v < viewNum; ++v)
+	{
+		float angle = DirectX::XM_2PI * v / viewNum;
+		float distance = modelRadius * (0.75f + v % 4 * 0.5f);
+
+		DirectX::XMVECTOR position = DirectX::XMVectorAdd(
+			modelCenter,
+			DirectX::XMVectorSet(cosf(angle) * distance, 0.25f * distance, sinf(angle) * distance, 0.0f)
+		);
+
+		DirectX::XMStoreFloat4(&cameraPositions[v], DirectX::XMVectorSetW(position, 1.0f));
+		vpMatrices[v] = DirectX::XMMatrixLookAtLH(position, modelCenter, DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) * projMatrix;
+	}
+
+	std::vector<IndexRange> ranges;
+	MeshletCullStats stats;
+
+	double timeMs = measureBestTimeMs(runNum, [&]()
+		{
+			stats = {};
+
+			for (UINT v = 0; v < viewNum; ++v)
+			{
+				for (const auto& mesh : cookedModel.meshes)
+				{
+					MeshletCullView view = CreateMeshletCullView(DirectX::XMLoadFloat4x4(&mesh.modelMatrix), vpMatrices[v], cameraPositions[v]);
+
+					for (UINT32 i = 0; i < mesh.primitiveCount; ++i)
+					{
+						const CookedPrimitive& primitive = cookedModel.primitives[mesh.firstPrimitive + i];
+
+						ranges.clear();
+						CullMeshlets(cookedModel.meshlets.data() + primitive.firstMeshlet, primitive.meshletCount, view, ranges, &stats);
+					}
+				}
+			}
+		}
+	);
+
+	printf("meshlet culling, %s, %zu meshlets, %u views, best of %u runs\n", pathToModel.c_str(), cookedModel.meshlets.size(), viewNum, runNum);
+	printf(
+		"  %8.2f ms  %8.0f meshlets/ms  frustum culled %4.1f%%  cone culled %4.1f%%\n",
+		timeMs,
+		stats.testedNum / timeMs,
+		100.0 * stats.frustumCulledNum / stats.testedNum,
+		100.0 * stats.coneCulledNum / stats.testedNum
+	);
+}
+
+void benchmarkFrustumCulling()
+{
+	const size_t instanceNums[] = { 1000, 10000, 100000 };
+	const UINT runNum = 20;
+
+	// instances scattered over a 1 km square around the camera, about a quarter is in view
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> size(0.5f, 5.0f);
+
+	DirectX::XMMATRIX vpMatrix = DirectX::XMMatrixLookToLH(
+		DirectX::XMVectorSet(0.0f, 2.0f, 0.0f, 1.0f),
+		DirectX::XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f),
+		DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)
+	) * DirectX::XMMatrixPerspectiveFovLH(DirectX::XM_PIDIV2, 16.0f / 9.0f, 0.01f, 1000.0f);
+
+	DirectX::XMFLOAT4 planes[FrustumPlaneNum];
+	ExtractFrustumPlanes(vpMatrix, planes);
+
+	printf("frustum culling, best of %u runs\n", runNum);
+
+	for (size_t instanceNum : instanceNums)
+	{
+		BoundsSoA bounds;
+		bounds.Resize(instanceNum);
+
+		for (size_t i = 0; i < instanceNum; ++i)
+		{
+			BoundingVolume volume;
+			volume.center = { position(random), size(random), position(random) };
+			volume.extents = { size(random), size(random), size(random) };
+
+			bounds.Set(i, volume);
+		}
+
+		std::vector<UINT32> reference;
+		CullBounds(bounds, planes, FrustumPlaneNum, reference, CullingKernel::Scalar);
+
+		CullingKernel kernels[] = { CullingKernel::Scalar, CullingKernel::SSE };
+
+		for (CullingKernel kernel : kernels)
+		{
+			std::vector<UINT32> visible;
+			visible.reserve(instanceNum + 4);
+
+			double timeMs = measureBestTimeMs(runNum, [&]()
+				{
+					visible.clear();
+					CullBounds(bounds, planes, FrustumPlaneNum, visible, kernel);
+				}
+			);
+
+			printf(
+				"  %-7s %7zu instances %8.3f ms  %10.0f instances/ms  %6zu visible%s\n",
+				GetCullingKernelName(kernel),
+				instanceNum,
+				timeMs,
+				instanceNum / timeMs,
+				visible.size(),
+				visible == reference ? "" : "  MISMATCH"
+			);
+		}
+	}
+}
+
+void benchmarkInstanceBvh()
+{
+	const size_t instanceNums[] = { 10000, 100000, 1000000 };
+	const UINT runNum = 5;
+	const UINT queryNum = 1000;
+	const UINT splitsNum = PSSMMaxSplitsNum;
+
+	ThreadPool* pPool = ThreadPool::Create();
+
+	printf("instance BVH, best of %u runs, %u threads\n", runNum, pPool->GetThreadNum());
+
+	for (size_t instanceNum : instanceNums)
+	{
+		// the world grows with the instance count, so the density stays the same
+		float worldSize = 10.0f * sqrtf(static_cast<float>(instanceNum));
+
+		std::mt19937 random(42);
+		std::uniform_real_distribution<float> position(-worldSize * 0.5f, worldSize * 0.5f);
+		std::uniform_real_distribution<float> height(0.0f, 20.0f);
+		std::uniform_real_distribution<float> size(0.5f, 5.0f);
+		std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+
+		BoundsSoA bounds;
+		bounds.Resize(instanceNum);
+
+		for (size_t i = 0; i < instanceNum; ++i)
+		{
+			BoundingVolume volume;
+			volume.center = { position(random), height(random), position(random) };
+			volume.extents = { size(random), size(random), size(random) };
+
+			bounds.Set(i, volume);
+		}
+
+		InstanceBvh bvh;
+
+		double serialBuildTimeMs = measureBestTimeMs(runNum, [&]() { bvh.Build(bounds); });
+		double parallelBuildTimeMs = measureBestTimeMs(runNum, [&]() { bvh.Build(bounds, pPool); });
+		double refitTimeMs = measureBestTimeMs(runNum, [&]() { bvh.Refit(bounds); });
+
+		printf(
+			"  %7zu instances %6zu nodes  build %8.2f ms  parallel build %8.2f ms  refit %6.2f ms\n",
+			instanceNum,
+			bvh.GetNodeNum(),
+			serialBuildTimeMs,
+			parallelBuildTimeMs,
+			refitTimeMs
+		);
+
+		// camera and light volumes in the middle of the world
+		DirectX::XMVECTOR cameraPosition = DirectX::XMVectorSet(0.0f, 10.0f, 0.0f, 1.0f);
+		DirectX::XMVECTOR cameraDirection = DirectX::XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+		DirectX::XMVECTOR lightDirection = DirectX::XMVector3Normalize(DirectX::XMVectorSet(0.3f, -1.0f, 0.2f, 0.0f));
+
+		DirectX::XMFLOAT4 cameraPlanes[FrustumPlaneNum];
+		ExtractFrustumPlanes(
+			DirectX::XMMatrixLookToLH(cameraPosition, cameraDirection, DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f))
+				* DirectX::XMMatrixPerspectiveFovLH(DirectX::XM_PIDIV2, 16.0f / 9.0f, 0.01f, 1000.0f),
+			cameraPlanes
+		);
+
+		DirectX::XMFLOAT4 splitPlanes[PSSMMaxSplitsNum * FrustumPlaneNum];
+
+		for (UINT splitIdx = 0; splitIdx < splitsNum; ++splitIdx)
+		{
+			float splitSize = 50.0f * static_cast<float>(1 << splitIdx);
+
+			ExtractFrustumPlanes(
+				DirectX::XMMatrixLookToLH(
+					DirectX::XMVectorSubtract(cameraPosition, DirectX::XMVectorScale(lightDirection, 100.0f)),
+					lightDirection,
+					DirectX::XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f)
+				) * DirectX::XMMatrixOrthographicLH(splitSize, splitSize, 0.0f, 200.0f),
+				splitPlanes + splitIdx * FrustumPlaneNum
+			);
+		}
+
+		std::vector<UINT32> flatVisible;
+		std::vector<UINT8> viewMasks;
+
+		double flatTimeMs = measureBestTimeMs(runNum, [&]()
+			{
+				flatVisible.clear();
+				CullBounds(bounds, cameraPlanes, FrustumPlaneNum, flatVisible, CullingKernel::Scalar);
+			}
+		);
+		double frustumTimeMs = measureBestTimeMs(runNum, [&]() { bvh.QueryFrustums(cameraPlanes, 1, FrustumPlaneNum, viewMasks); });
+
+		size_t bvhVisibleNum = 0;
+		bool isSame = true;
+
+		for (UINT32 instanceIdx : flatVisible)
+		{
+			isSame = isSame && viewMasks[instanceIdx] != 0;
+		}
+
+		for (UINT8 mask : viewMasks)
+		{
+			bvhVisibleNum += mask != 0 ? 1 : 0;
+		}
+
+		isSame = isSame && bvhVisibleNum == flatVisible.size();
+
+		double splitsTimeMs = measureBestTimeMs(runNum, [&]() { bvh.QueryFrustums(splitPlanes, splitsNum, FrustumPlaneNum - 1, viewMasks); });
+
+		size_t splitDrawNum = 0;
+
+		for (UINT8 mask : viewMasks)
+		{
+			for (UINT splitIdx = 0; splitIdx < splitsNum; ++splitIdx)
+			{
+				splitDrawNum += (mask >> splitIdx) & 1;
+			}
+		}
+
+		printf(
+			"    frustum   flat scalar %8.3f ms  BVH %8.3f ms  %6zu visible%s\n",
+			flatTimeMs,
+			frustumTimeMs,
+			bvhVisibleNum,
+			isSame ? "" : "  MISMATCH"
+		);
+		printf("    %u splits  BVH %8.3f ms  %6zu split draws\n", splitsNum, splitsTimeMs, splitDrawNum);
+
+		std::vector<DirectX::XMFLOAT3> queryPositions(queryNum);
+		std::vector<DirectX::XMFLOAT3> queryDirections(queryNum);
+
+		for (UINT queryIdx = 0; queryIdx < queryNum; ++queryIdx)
+		{
+			queryPositions[queryIdx] = { position(random), height(random), position(random) };
+
+			DirectX::XMVECTOR rayDirection = DirectX::XMVector3Normalize(DirectX::XMVectorSet(direction(random), direction(random), direction(random), 0.0f));
+			DirectX::XMStoreFloat3(&queryDirections[queryIdx], rayDirection);
+		}
+
+		// batches of independent queries are spread over the pool
+		std::vector<std::vector<UINT32>> results(queryNum);
+
+		double sphereTimeMs = measureBestTimeMs(runNum, [&]()
+			{
+				pPool->ParallelFor(queryNum, [&](UINT queryIdx)
+					{
+						results[queryIdx].clear();
+						bvh.QuerySphere(queryPositions[queryIdx], 10.0f, results[queryIdx]);
+					}
+				);
+			}
+		);
+
+		double rayTimeMs = measureBestTimeMs(runNum, [&]()
+			{
+				pPool->ParallelFor(queryNum, [&](UINT queryIdx)
+					{
+						results[queryIdx].clear();
+						bvh.QueryRay(queryPositions[queryIdx], queryDirections[queryIdx], 100.0f, results[queryIdx]);
+					}
+				);
+			}
+		);
+
+		printf(
+			"    %u spheres %8.3f ms  %8.0f queries/ms  %u rays %8.3f ms  %8.0f queries/ms\n",
+			queryNum,
+			sphereTimeMs,
+			queryNum / sphereTimeMs,
+			queryNum,
+			rayTimeMs,
+			queryNum / rayTimeMs
+		);
+	}
+
+	delete pPool;
+}
+
+
+void benchmarkOcclusionCulling()
+{
+	const UINT occluderNums[] = { 16, 256, 4096 };
+	const size_t occludeeNum = 100000;
+	const UINT runNum = 10;
+
+	ThreadPool* pPool = ThreadPool::Create();
+
+	printf("occlusion culling, 320x180 buffer, %zu occludees, best of %u runs, %u threads\n", occludeeNum, runNum, pPool->GetThreadNum());
+
+	DirectX::XMMATRIX vpMatrix = DirectX::XMMatrixLookToLH(
+		DirectX::XMVectorSet(0.0f, 2.0f, 0.0f, 1.0f),
+		DirectX::XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f),
+		DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)
+	) * DirectX::XMMatrixPerspectiveFovLH(DirectX::XM_PIDIV2, 16.0f / 9.0f, 0.01f, 1000.0f);
+	OcclusionMatrix occlusionVpMatrix = ToOcclusionMatrix(vpMatrix);
+
+	// boxes spread in front of the camera, the occluder walls stand between them
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> side(-200.0f, 200.0f);
+	std::uniform_real_distribution<float> depth(5.0f, 300.0f);
+	std::uniform_real_distribution<float> height(0.0f, 10.0f);
+	std::uniform_real_distribution<float> size(0.2f, 2.0f);
+
+	BoundsSoA bounds;
+	bounds.Resize(occludeeNum);
+
+	for (size_t i = 0; i < occludeeNum; ++i)
+	{
+		BoundingVolume volume;
+		volume.center = { side(random), height(random), depth(random) };
+		volume.extents = { size(random), size(random), size(random) };
+
+		bounds.Set(i, volume);
+	}
+
+	OcclusionBuffer* pBuffer = OcclusionBuffer::Create(320, 180);
+
+	for (UINT occluderNum : occluderNums)
+	{
+		// a row of wall quads at the same depth, each split into two triangles
+		std::vector<DirectX::XMFLOAT3> positions;
+		std::vector<UINT32> indices = { 0, 1, 2, 0, 2, 3 };
+
+		float wallWidth = 60.0f / occluderNum;
+
+		for (UINT occluderIdx = 0; occluderIdx < occluderNum; ++occluderIdx)
+		{
+			float left = -30.0f + occluderIdx * wallWidth;
+
+			positions.push_back({ left, 0.0f, 20.0f });
+			positions.push_back({ left, 6.0f, 20.0f });
+			positions.push_back({ left + wallWidth, 6.0f, 20.0f });
+			positions.push_back({ left + wallWidth, 0.0f, 20.0f });
+		}
+
+		auto addOccluders = [&]()
+		{
+			pBuffer->Clear();
+
+			for (UINT occluderIdx = 0; occluderIdx < occluderNum; ++occluderIdx)
+			{
+				pBuffer->AddOccluder(&positions[occluderIdx * 4].x, 4, indices.data(), indices.size(), occlusionVpMatrix);
+			}
+		};
+
+		double serialRasterTimeMs = measureBestTimeMs(runNum, [&]() { addOccluders(); pBuffer->Rasterize(); });
+		double parallelRasterTimeMs = measureBestTimeMs(runNum, [&]() { addOccluders(); pBuffer->Rasterize(pPool->GetJobSystem()); });
+
+		std::vector<UINT32> candidates;
+
+		auto resetCandidates = [&]()
+		{
+			candidates.resize(occludeeNum);
+			std::iota(candidates.begin(), candidates.end(), 0);
+		};
+
+		OcclusionBoxArrays boxes = bounds.GetOcclusionBoxes();
+
+		double serialTestTimeMs = measureBestTimeMs(runNum, [&]() { resetCandidates(); pBuffer->FilterVisible(boxes, occlusionVpMatrix, candidates); });
+		double parallelTestTimeMs = measureBestTimeMs(runNum, [&]() { resetCandidates(); pBuffer->FilterVisible(boxes, occlusionVpMatrix, candidates, pPool->GetJobSystem()); });
+
+		printf(
+			"  %5u occluders %5zu triangles  raster %7.3f ms  parallel %7.3f ms  tests %7.3f ms  parallel %7.3f ms  %6zu / %zu visible\n",
+			occluderNum,
+			pBuffer->GetTriangleNum(),
+			serialRasterTimeMs,
+			parallelRasterTimeMs,
+			serialTestTimeMs,
+			parallelTestTimeMs,
+			candidates.size(),
+			occludeeNum
+		);
+	}
+
+	delete pBuffer;
+	delete pPool;
+}
+
+
+void benchmarkOffsetAllocator()
+{
+	const UINT heapSize = 64 * 1024 * 1024;
+	const UINT operationNum = 1000000;
+	const UINT runNum = 5;
+
+	printf("offset allocator, %u operations, best of %u runs\n", operationNum, runNum);
+
+	// mesh sized requests and random frees, once half of the heap is in use only frees happen
+	std::mt19937 random(42);
+	std::uniform_int_distribution<UINT> size(16, 16384);
+
+	std::vector<UINT> sizes(operationNum);
+	std::vector<UINT> freeChoices(operationNum);
+
+	for (UINT i = 0; i < operationNum; ++i)
+	{
+		sizes[i] = size(random);
+		freeChoices[i] = random();
+	}
+
+	OffsetAllocator allocator;
+	std::vector<OffsetAllocator::Allocation> allocations;
+	UINT failedNum = 0;
+
+	double timeMs = measureBestTimeMs(runNum, [&]()
+		{
+			allocator.Reset(heapSize);
+			allocations.clear();
+			failedNum = 0;
+
+			for (UINT i = 0; i < operationNum; ++i)
+			{
+				bool isFree = !allocations.empty() && (allocator.GetFreeSize() < heapSize / 2 || freeChoices[i] % 2 == 0);
+
+				if (isFree)
+				{
+					size_t allocationIdx = freeChoices[i] % allocations.size();
+
+					allocator.Free(allocations[allocationIdx]);
+					allocations[allocationIdx] = allocations.back();
+					allocations.pop_back();
+				}
+				else
+				{
+					OffsetAllocator::Allocation allocation = allocator.Allocate(sizes[i]);
+
+					if (allocation.node != OffsetAllocator::InvalidNode)
+					{
+						allocations.push_back(allocation);
+					}
+					else
+					{
+						++failedNum;
+					}
+				}
+			}
+		}
+	);
+
+	printf(
+		"  %8.2f ms  %6.1f ns/op  %zu live  %u free blocks  largest free %u / %u  %u failed\n",
+		timeMs,
+		timeMs * 1e6 / operationNum,
+		allocations.size(),
+		allocator.GetFreeBlockNum(),
+		allocator.GetLargestFreeBlock(),
+		allocator.GetFreeSize(),
+		failedNum
+	);
+}
+
+void benchmarkJobSystem()
+{
+	const UINT jobNum = 100000;
+	const size_t itemNum = 4 * 1024 * 1024;
+	const UINT runNum = 5;
+
+	printf("job system, %u empty jobs and parallel for over %zu items, best of %u runs\n", jobNum, itemNum, runNum);
+
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> value(0.0f, 100.0f);
+
+	std::vector<float> values(itemNum);
+	std::vector<float> results(itemNum);
+
+	for (auto& v : values)
+	{
+		v = value(random);
+	}
+
+	auto work = [&](size_t begin, size_t end)
+	{
+		for (size_t itemIdx = begin; itemIdx < end; ++itemIdx)
+		{
+			results[itemIdx] = sqrtf(values[itemIdx]) * sinf(values[itemIdx]);
+		}
+	};
+
+	double serialTimeMs = measureBestTimeMs(runNum, [&]() { work(0, itemNum); });
+	printf("  serial %8.2f ms\n", serialTimeMs);
+
+	UINT maxThreadNum = (std::max)(std::thread::hardware_concurrency(), 1u);
+	std::vector<UINT> threadNums;
+
+	for (UINT threadNum = 1; threadNum < maxThreadNum; threadNum *= 2)
+	{
+		threadNums.push_back(threadNum);
+	}
+	threadNums.push_back(maxThreadNum);
+
+	const size_t grainSizes[] = { 1024, 16 * 1024, 256 * 1024 };
+
+	for (UINT threadNum : threadNums)
+	{
+		JobSystem* pJobSystem = JobSystem::Create(threadNum);
+
+		// the cost of queuing, stealing and finishing a job with nothing in it
+		double emptyTimeMs = measureBestTimeMs(runNum, [&]()
+			{
+				JobCounter counter;
+
+				for (UINT i = 0; i < jobNum; ++i)
+				{
+					pJobSystem->Run([]() {}, &counter);
+				}
+
+				pJobSystem->Wait(counter);
+			}
+		);
+
+		printf("  %2u threads  empty jobs %6.1f ns/job\n", threadNum, emptyTimeMs * 1e6 / jobNum);
+
+		for (size_t grainSize : grainSizes)
+		{
+			double timeMs = measureBestTimeMs(runNum, [&]() { pJobSystem->ParallelFor(itemNum, grainSize, work); });
+			printf("    grain %7zu  %8.2f ms  %5.2fx\n", grainSize, timeMs, serialTimeMs / timeMs);
+		}
+
+		delete pJobSystem;
+	}
+
+	// random graphs whose tasks run nested parallel loops, every task has to start
+	// after its dependencies finished and every loop has to cover its range once
+	const UINT graphNum = 200;
+	const UINT taskNum = 32;
+	const size_t sumNum = 10000;
+
+	JobSystem* pJobSystem = JobSystem::Create(maxThreadNum);
+
+	std::atomic<UINT> clock(0);
+	std::vector<UINT> startTimes(taskNum);
+	std::vector<UINT> finishTimes(taskNum);
+	std::vector<std::pair<UINT, UINT>> dependencies;
+	std::atomic<bool> isValid(true);
+
+	for (UINT graphIdx = 0; graphIdx < graphNum; ++graphIdx)
+	{
+		TaskGraph graph;
+		dependencies.clear();
+
+		for (UINT taskIdx = 0; taskIdx < taskNum; ++taskIdx)
+		{
+			graph.AddTask("stress", [&, taskIdx]()
+				{
+					startTimes[taskIdx] = clock.fetch_add(1);
+
+					std::atomic<size_t> sum(0);
+					pJobSystem->ParallelFor(sumNum, 64, [&](size_t begin, size_t end)
+						{
+							size_t rangeSum = 0;
+
+							for (size_t i = begin; i < end; ++i)
+							{
+								rangeSum += i;
+							}
+
+							sum.fetch_add(rangeSum);
+						}
+					);
+
+					if (sum.load() != sumNum * (sumNum - 1) / 2)
+					{
+						isValid.store(false);
+					}
+
+					finishTimes[taskIdx] = clock.fetch_add(1);
+				}
+			);
+		}
+
+		// dependencies only point to later tasks, so there is no cycle
+		for (UINT after = 1; after < taskNum; ++after)
+		{
+			for (UINT i = random() % 3; i > 0; --i)
+			{
+				UINT before = random() % after;
+
+				graph.AddDependency(before, after);
+				dependencies.push_back({ before, after });
+			}
+		}
+
+		graph.Run(graphIdx % 2 == 0 ? pJobSystem : nullptr);
+
+		for (const auto& dependency : dependencies)
+		{
+			if (finishTimes[dependency.first] >= startTimes[dependency.second])
+			{
+				isValid.store(false);
+			}
+		}
+	}
+
+	delete pJobSystem;
+
+	printf("  stress: %u graphs of %u tasks on %u threads  %s\n", graphNum, taskNum, maxThreadNum, isValid.load() ? "OK" : "FAILED");
+}
+
+
+void RunBenchmarks()
+{
+	benchmarkVertexInterleave();
+	benchmarkTextureDecode("data/models/artorias");
+	benchmarkMeshletCulling("data/models/artorias");
+	benchmarkFrustumCulling();
+	benchmarkInstanceBvh();
+	benchmarkOcclusionCulling();
+	benchmarkOffsetAllocator();
+	benchmarkJobSystem();
+}
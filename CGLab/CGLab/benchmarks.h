@@ -0,0 +1,5 @@
+#pragma once
+
+
+// Runs the CPU side microbenchmarks and prints the results to stdout
+void RunBenchmarks();
@@ -29,8 +29,6 @@ Bloom* Bloom::Create(RendererContext* pContext, UINT targetWidth, UINT targetHei
 
 Bloom::~Bloom()
 {
-	ReleasePingPongResources();
-
 	SafeRelease(m_pMinMagLinearSampler);
 	SafeRelease(m_pMinMagMipPointSampler);
 	SafeRelease(m_pBloomConstantBuffer);
@@ -193,89 +191,28 @@ HRESULT Bloom::CreateResources()
 
 	D3D11_SUBRESOURCE_DATA constBufferData = CreateDefaultSubresourceData(&bloomConstBuffer);
 
-	HRESULT hr = pDevice->CreateBuffer(&brighnessThresholdBufferDesc, &constBufferData, &m_pBloomConstantBuffer);
-
-	if (SUCCEEDED(hr))
-	{
-		hr = UpdatePingPongTextures();
-	}
-
-	return hr;
-}
-
-HRESULT Bloom::UpdatePingPongTextures()
-{
-	ID3D11Device* pDevice = m_pContext->GetDevice();
-
-	HRESULT hr = S_OK;
-
-	D3D11_TEXTURE2D_DESC textureDesc = CreateDefaultTexture2DDesc(
-		DXGI_FORMAT_R32G32B32A32_FLOAT,
-		m_blurTextureWidth, m_blurTextureHeight,
-		D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET
-	);
-
-	for (UINT i = 0; i < _countof(m_pingPongBlurTextures) && SUCCEEDED(hr); ++i)
-	{
-		hr = pDevice->CreateTexture2D(&textureDesc, nullptr, &m_pingPongBlurTextures[i]);
-
-		if (SUCCEEDED(hr))
-		{
-			hr = pDevice->CreateShaderResourceView(m_pingPongBlurTextures[i], nullptr, &m_pingPongBlurTexturesSRV[i]);
-		}
-
-		if (SUCCEEDED(hr))
-		{
-			hr = pDevice->CreateRenderTargetView(m_pingPongBlurTextures[i], nullptr, &m_pingPongBlurTexturesRTV[i]);
-		}
-	}
-
-	return hr;
+	return pDevice->CreateBuffer(&brighnessThresholdBufferDesc, &constBufferData, &m_pBloomConstantBuffer);
 }
 
 
 HRESULT Bloom::Resize(UINT newTargetWidth, UINT newTargetHeight)
 {
-	ReleasePingPongResources();
-
 	m_width = newTargetWidth;
 	m_height = newTargetHeight;
 	m_blurTextureWidth = m_width / 2;
 	m_blurTextureHeight = m_height / 2;
 
-	HRESULT hr = UpdatePingPongTextures();
-
-	if (SUCCEEDED(hr))
-	{
-		BloomConstantBuffer bloomConstBuffer = {};
-		bloomConstBuffer.pixelSizeThreshold = { 1.0f / m_blurTextureWidth, 1.0f / m_blurTextureHeight, m_brightnessThreshold, 0.0f };
+	BloomConstantBuffer bloomConstBuffer = {};
+	bloomConstBuffer.pixelSizeThreshold = { 1.0f / m_blurTextureWidth, 1.0f / m_blurTextureHeight, m_brightnessThreshold, 0.0f };
 
-		m_pContext->GetContext()->UpdateSubresource(m_pBloomConstantBuffer, 0, nullptr, &bloomConstBuffer, 0, 0);
-	}
+	m_pContext->GetContext()->UpdateSubresource(m_pBloomConstantBuffer, 0, nullptr, &bloomConstBuffer, 0, 0);
 
-	return hr;
+	return S_OK;
 }
 
 
-void Bloom::ReleasePingPongResources()
+void Bloom::SetBlurState()
 {
-	for (UINT i = 0; i < 2; ++i)
-	{
-		SafeRelease(m_pingPongBlurTextures[i]);
-		SafeRelease(m_pingPongBlurTexturesSRV[i]);
-		SafeRelease(m_pingPongBlurTexturesRTV[i]);
-	}
-}
-
-
-void Bloom::CalculateBloom(
-	ID3D11ShaderResourceView* pHDRTextureSRV,
-	ID3D11ShaderResourceView* pEmissiveSRV,
-	ID3D11RenderTargetView* pTargetTextureRTV
-)
-{
-	m_pContext->BeginEvent(L"Bloom");
-
 	ID3D11DeviceContext* pContext = m_pContext->GetContext();
 	pContext->ClearState();
 
@@ -304,23 +241,21 @@ void Bloom::CalculateBloom(
 	pContext->PSSetConstantBuffers(0, 1, &m_pBloomConstantBuffer);
 	ID3D11SamplerState* samplers[] = { m_pMinMagMipPointSampler, m_pMinMagLinearSampler };
 	pContext->PSSetSamplers(0, 2, samplers);
-
-	RenderBloomMask(pHDRTextureSRV, pEmissiveSRV);
-
-	Blur();
-
-	AddBloom(pTargetTextureRTV);
-
-	m_pContext->EndEvent();
 }
 
-void Bloom::RenderBloomMask(ID3D11ShaderResourceView* pHDRTextureSRV, ID3D11ShaderResourceView* pEmissiveSRV)
+void Bloom::RenderBloomMask(
+	ID3D11ShaderResourceView* pHDRTextureSRV,
+	ID3D11ShaderResourceView* pEmissiveSRV,
+	ID3D11RenderTargetView* pMaskRTV
+)
 {
 	m_pContext->BeginEvent(L"Bloom Mask");
 	
 	ID3D11DeviceContext* pContext = m_pContext->GetContext();
 
-	pContext->OMSetRenderTargets(1, &m_pingPongBlurTexturesRTV[0], nullptr);
+	SetBlurState();
+
+	pContext->OMSetRenderTargets(1, &pMaskRTV, nullptr);
 
 	pContext->VSSetShader(m_pBloomMaskVS, nullptr, 0);
 	pContext->PSSetShader(m_pBloomMaskPS, nullptr, 0);
@@ -335,18 +270,20 @@ void Bloom::RenderBloomMask(ID3D11ShaderResourceView* pHDRTextureSRV, ID3D11Shad
 	m_pContext->EndEvent();
 }
 
-void Bloom::Blur()
+void Bloom::Blur(ID3D11ShaderResourceView* const pBlurSRVs[2], ID3D11RenderTargetView* const pBlurRTVs[2])
 {
 	m_pContext->BeginEvent(L"Gauss Blur");
 
 	ID3D11DeviceContext* pContext = m_pContext->GetContext();
 
+	SetBlurState();
+
 	auto applyBlur = [&](UINT dstIdx, ID3D11VertexShader* pVS, ID3D11PixelShader* pPS)
 	{
 		UINT srcIdx = (dstIdx + 1) & 0x01u;
 
-		pContext->PSSetShaderResources(0, 1, &m_pingPongBlurTexturesSRV[srcIdx]);
-		pContext->OMSetRenderTargets(1, &m_pingPongBlurTexturesRTV[dstIdx], nullptr);
+		pContext->PSSetShaderResources(0, 1, &pBlurSRVs[srcIdx]);
+		pContext->OMSetRenderTargets(1, &pBlurRTVs[dstIdx], nullptr);
 
 		pContext->VSSetShader(pVS, nullptr, 0);
 		pContext->PSSetShader(pPS, nullptr, 0);
@@ -367,12 +304,14 @@ void Bloom::Blur()
 	m_pContext->EndEvent();
 }
 
-void Bloom::AddBloom(ID3D11RenderTargetView* pTargetRTV)
+void Bloom::AddBloom(ID3D11ShaderResourceView* pBlurSRV, ID3D11RenderTargetView* pTargetRTV)
 {
 	m_pContext->BeginEvent(L"Add Bloom");
 
 	ID3D11DeviceContext* pContext = m_pContext->GetContext();
 
+	SetBlurState();
+
 	D3D11_VIEWPORT viewport = {};
 	viewport.TopLeftY = 0;
 	viewport.TopLeftX = 0;
@@ -396,7 +335,7 @@ void Bloom::AddBloom(ID3D11RenderTargetView* pTargetRTV)
 	pContext->VSSetShader(m_pBloomVS, nullptr, 0);
 	pContext->PSSetShader(m_pBloomPS, nullptr, 0);
 
-	pContext->PSSetShaderResources(0, 1, &m_pingPongBlurTexturesSRV[0]);
+	pContext->PSSetShaderResources(0, 1, &pBlurSRV);
 
 	pContext->Draw(4, 0);
 
@@ -3,18 +3,28 @@
 #include "framework.h"
 #include "rendererContext.h"
 
+// The bloom steps are passes of the render graph, which owns the blur textures
 class Bloom
 {
 public:
+	static constexpr DXGI_FORMAT BlurTextureFormat = DXGI_FORMAT_R32G32B32A32_FLOAT;
+
 	static Bloom* Create(RendererContext* pContext, UINT targetWidth, UINT targetHeight);
 
 	HRESULT Resize(UINT newTargetWidth, UINT newTargetHeight);
 
-	void CalculateBloom(
+	inline UINT GetBlurTextureWidth() const { return m_blurTextureWidth; }
+	inline UINT GetBlurTextureHeight() const { return m_blurTextureHeight; }
+
+	// Writes the bright and emissive parts of the frame into a blur texture
+	void RenderBloomMask(
 		ID3D11ShaderResourceView* pHDRTextureSRV,
 		ID3D11ShaderResourceView* pEmissiveSRV,
-		ID3D11RenderTargetView* pTargetTextureRTV
+		ID3D11RenderTargetView* pMaskRTV
 	);
+	// Blurs the first texture of the pair, the second one holds the steps in between
+	void Blur(ID3D11ShaderResourceView* const pBlurSRVs[2], ID3D11RenderTargetView* const pBlurRTVs[2]);
+	void AddBloom(ID3D11ShaderResourceView* pBlurSRV, ID3D11RenderTargetView* pTargetRTV);
 
 	~Bloom();
 
@@ -24,13 +34,8 @@ private:
 	HRESULT CreatePipelineStateObjects();
 	HRESULT CreateResources();
 
-	HRESULT UpdatePingPongTextures();
-
-	void ReleasePingPongResources();
-
-	void RenderBloomMask(ID3D11ShaderResourceView* pHDRTextureSRV, ID3D11ShaderResourceView* pEmissiveSRV);
-	void Blur();
-	void AddBloom(ID3D11RenderTargetView* pTargetRTV);
+	// half size viewport, shared states and constants of all steps
+	void SetBlurState();
 
 private:
 	static constexpr float m_brightnessThreshold = 2.0f;
@@ -61,8 +66,4 @@ private:
 
 	ID3D11SamplerState* m_pMinMagMipPointSampler;
 	ID3D11SamplerState* m_pMinMagLinearSampler;
-
-	ID3D11Texture2D* m_pingPongBlurTextures[2] = { nullptr, nullptr };
-	ID3D11ShaderResourceView* m_pingPongBlurTexturesSRV[2] = { nullptr, nullptr };
-	ID3D11RenderTargetView* m_pingPongBlurTexturesRTV[2] = { nullptr, nullptr };
 };
\ No newline at end of file
@@ -0,0 +1,234 @@
+#include "constantRingBuffer.h"
+#include "rendererContext.h"
+
+#include <d3d11_1.h>
+#include <cassert>
+
+
+ConstantRingBuffer* ConstantRingBuffer::Create(RendererContext* pContext, UINT size)
+{
+	ConstantRingBuffer* pRing = new ConstantRingBuffer(pContext);
+
+	if (pRing->Init(size))
+	{
+		return pRing;
+	}
+
+	delete pRing;
+	return nullptr;
+}
+
+
+ConstantRingBuffer::ConstantRingBuffer(RendererContext* pContext)
+	: m_pContext(pContext)
+	, m_pContext1(nullptr)
+	, m_pBuffer(nullptr)
+	, m_pFallbackBuffer(nullptr)
+	, m_isMapped(false)
+	, m_totalOverflowNum(0)
+	, m_fenceValue(0)
+{}
+
+ConstantRingBuffer::~ConstantRingBuffer()
+{
+	for (auto& fence : m_pendingFences)
+	{
+		SafeRelease(fence.pQuery);
+	}
+
+	for (auto& pQuery : m_freeQueries)
+	{
+		SafeRelease(pQuery);
+	}
+
+	SafeRelease(m_pFallbackBuffer);
+	SafeRelease(m_pBuffer);
+	SafeRelease(m_pContext1);
+}
+
+
+bool ConstantRingBuffer::Init(UINT size)
+{
+	ID3D11Device* pDevice = m_pContext->GetDevice();
+
+	D3D11_BUFFER_DESC fallbackDesc = CreateDefaultBufferDesc(MaxAllocationSize, D3D11_BIND_CONSTANT_BUFFER);
+
+	if (FAILED(pDevice->CreateBuffer(&fallbackDesc, nullptr, &m_pFallbackBuffer)))
+	{
+		return false;
+	}
+
+	// the ring needs both offsets in the binds and no-overwrite maps of constant buffers
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	HRESULT hr = pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+
+	if (FAILED(hr) || !options.ConstantBufferOffsetting || !options.MapNoOverwriteOnDynamicConstantBuffer)
+	{
+		return true;
+	}
+
+	if (FAILED(m_pContext->GetContext()->QueryInterface(IID_PPV_ARGS(&m_pContext1))))
+	{
+		m_pContext1 = nullptr;
+		return true;
+	}
+
+	size = (size + ConstantAlignment - 1) / ConstantAlignment * ConstantAlignment;
+
+	D3D11_BUFFER_DESC bufferDesc = CreateDefaultBufferDesc(size, D3D11_BIND_CONSTANT_BUFFER);
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	if (FAILED(pDevice->CreateBuffer(&bufferDesc, nullptr, &m_pBuffer)))
+	{
+		SafeRelease(m_pContext1);
+		return true;
+	}
+
+	m_allocator.Reset(size);
+
+	return true;
+}
+
+
+void ConstantRingBuffer::BeginFrame()
+{
+	ID3D11DeviceContext* pContext = m_pContext->GetContext();
+
+	UINT64 completedValue = 0;
+
+	// queries signal in order, the first pending one bounds the rest
+	while (!m_pendingFences.empty()
+		&& pContext->GetData(m_pendingFences.front().pQuery, nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+	{
+		completedValue = m_pendingFences.front().value;
+
+		m_freeQueries.push_back(m_pendingFences.front().pQuery);
+		m_pendingFences.pop_front();
+	}
+
+	if (completedValue > 0)
+	{
+		m_allocator.ReleaseCompleted(completedValue);
+	}
+}
+
+void ConstantRingBuffer::EndFrame()
+{
+	if (!IsOffsetting())
+	{
+		return;
+	}
+
+	ID3D11Query* pQuery = nullptr;
+
+	if (!m_freeQueries.empty())
+	{
+		pQuery = m_freeQueries.back();
+		m_freeQueries.pop_back();
+	}
+	else
+	{
+		D3D11_QUERY_DESC queryDesc = {};
+		queryDesc.Query = D3D11_QUERY_EVENT;
+
+		m_pContext->GetDevice()->CreateQuery(&queryDesc, &pQuery);
+	}
+
+	// without a query the frame is never released and the ring falls back once full
+	if (pQuery == nullptr)
+	{
+		return;
+	}
+
+	m_pContext->GetContext()->End(pQuery);
+
+	m_allocator.FinishFrame(++m_fenceValue);
+	m_pendingFences.push_back({ pQuery, m_fenceValue });
+}
+
+
+ConstantAllocation ConstantRingBuffer::Allocate(const void* pData, UINT size)
+{
+	// the fallback buffer would cut larger blocks off, the ring rejects them too
+	// so whether a draw gets its constants does not depend on the ring being full
+	if (size > MaxAllocationSize)
+	{
+		assert(false);
+		return {};
+	}
+
+	if (!IsOffsetting())
+	{
+		return AllocateFallback(pData, size);
+	}
+
+	UINT alignedSize = (size + ConstantAlignment - 1) / ConstantAlignment * ConstantAlignment;
+	size_t offset = m_allocator.Allocate(alignedSize, ConstantAlignment);
+
+	if (offset == RingBufferAllocator::InvalidOffset)
+	{
+		++m_totalOverflowNum;
+		return AllocateFallback(pData, size);
+	}
+
+	ID3D11DeviceContext* pContext = m_pContext->GetContext();
+
+	// the first map renames the buffer, the space written later is never in use
+	D3D11_MAPPED_SUBRESOURCE mappedBuffer = {};
+	HRESULT hr = pContext->Map(m_pBuffer, 0, m_isMapped ? D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD, 0, &mappedBuffer);
+
+	if (FAILED(hr))
+	{
+		return AllocateFallback(pData, size);
+	}
+
+	memcpy(static_cast<UINT8*>(mappedBuffer.pData) + offset, pData, size);
+	pContext->Unmap(m_pBuffer, 0);
+
+	m_isMapped = true;
+
+	ConstantAllocation allocation;
+	allocation.pBuffer = m_pBuffer;
+	allocation.firstConstant = static_cast<UINT>(offset / 16);
+	allocation.constantNum = alignedSize / 16;
+
+	return allocation;
+}
+
+ConstantAllocation ConstantRingBuffer::AllocateFallback(const void* pData, UINT size)
+{
+	// constant buffers are updated as a whole
+	UINT8 data[MaxAllocationSize] = {};
+	memcpy(data, pData, size);
+
+	m_pContext->GetContext()->UpdateSubresource(m_pFallbackBuffer, 0, nullptr, data, 0, 0);
+
+	ConstantAllocation allocation;
+	allocation.pBuffer = m_pFallbackBuffer;
+
+	return allocation;
+}
+
+
+void ConstantRingBuffer::SetVS(UINT slot, const ConstantAllocation& allocation)
+{
+	if (allocation.constantNum == 0)
+	{
+		m_pContext->GetContext()->VSSetConstantBuffers(slot, 1, &allocation.pBuffer);
+		return;
+	}
+
+	m_pContext1->VSSetConstantBuffers1(slot, 1, &allocation.pBuffer, &allocation.firstConstant, &allocation.constantNum);
+}
+
+void ConstantRingBuffer::SetPS(UINT slot, const ConstantAllocation& allocation)
+{
+	if (allocation.constantNum == 0)
+	{
+		m_pContext->GetContext()->PSSetConstantBuffers(slot, 1, &allocation.pBuffer);
+		return;
+	}
+
+	m_pContext1->PSSetConstantBuffers1(slot, 1, &allocation.pBuffer, &allocation.firstConstant, &allocation.constantNum);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "framework.h"
+#include "ringBufferAllocator.h"
+
+#include <deque>
+
+class RendererContext;
+struct ID3D11DeviceContext1;
+struct ID3D11Query;
+
+
+// Constants of one draw, constantNum 0 binds the whole buffer
+struct ConstantAllocation
+{
+	ID3D11Buffer* pBuffer = nullptr;
+	UINT firstConstant = 0;
+	UINT constantNum = 0;
+
+	inline bool IsValid() const { return pBuffer != nullptr; }
+};
+
+
+// Per draw constants sub-allocated from one large dynamic constant buffer.
+// Every allocation is written with a no-overwrite map and bound with constant buffer
+// offsets (D3D11.1), the space of a frame is reused after an event query signals it is done.
+// Without offset support or with the ring full the constants go through a fallback
+// buffer updated for every allocation, as a single constant buffer would.
+class ConstantRingBuffer
+{
+public:
+	// offsets and sizes of bound ranges are multiples of 16 constants
+	static constexpr UINT ConstantAlignment = 256;
+	static constexpr UINT MaxAllocationSize = 1024;
+
+	static ConstantRingBuffer* Create(RendererContext* pContext, UINT size);
+
+	~ConstantRingBuffer();
+
+	// Frees the space of the frames the GPU has finished
+	void BeginFrame();
+	// Fences everything allocated since BeginFrame
+	void EndFrame();
+
+	// The fallback buffer only keeps its contents until the next allocation,
+	// so the constants have to be bound and drawn with before that.
+	// Blocks larger than MaxAllocationSize get an invalid allocation, their draw has to be skipped
+	ConstantAllocation Allocate(const void* pData, UINT size);
+
+	void SetVS(UINT slot, const ConstantAllocation& allocation);
+	void SetPS(UINT slot, const ConstantAllocation& allocation);
+
+	inline bool IsOffsetting() const { return m_pContext1 != nullptr; }
+	inline const RingBufferStats& GetStats() const { return m_allocator.GetStats(); }
+	// allocations past the ring of all frames so far
+	inline size_t GetTotalOverflowNum() const { return m_totalOverflowNum; }
+
+private:
+	struct Fence
+	{
+		ID3D11Query* pQuery;
+		UINT64 value;
+	};
+
+	ConstantRingBuffer(RendererContext* pContext);
+
+	bool Init(UINT size);
+
+	ConstantAllocation AllocateFallback(const void* pData, UINT size);
+
+private:
+	RendererContext* m_pContext;
+	ID3D11DeviceContext1* m_pContext1;
+
+	ID3D11Buffer* m_pBuffer;
+	ID3D11Buffer* m_pFallbackBuffer;
+	bool m_isMapped;
+
+	RingBufferAllocator m_allocator;
+	size_t m_totalOverflowNum;
+
+	UINT64 m_fenceValue;
+	std::deque<Fence> m_pendingFences;
+	std::vector<ID3D11Query*> m_freeQueries;
+};
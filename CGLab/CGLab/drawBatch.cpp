@@ -0,0 +1,304 @@
+#include "drawBatch.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <climits>
+
+
+static constexpr UINT DrawKeyLodShift = DrawKeyDepthBits;
+static constexpr UINT DrawKeyPrimitiveShift = DrawKeyLodShift + DrawKeyLodBits;
+static constexpr UINT DrawKeyMaterialShift = DrawKeyPrimitiveShift + DrawKeyPrimitiveBits;
+static constexpr UINT DrawKeyPermutationShift = DrawKeyMaterialShift + DrawKeyMaterialBits;
+static constexpr UINT DrawKeyPassShift = DrawKeyPermutationShift + DrawKeyPermutationBits;
+
+static_assert(DrawKeyPassShift + DrawKeyPassBits == 64, "draw key fields have to fill 64 bits");
+
+// below this many items a chunk costs more to start than to sort
+static constexpr size_t SortChunkSize = 4096;
+
+
+UINT64 keyField(UINT value, UINT bits, UINT shift)
+{
+	return (static_cast<UINT64>(value) & ((1ull << bits) - 1)) << shift;
+}
+
+UINT64 CreateDrawKey(DrawPass pass, UINT permutation, UINT material, UINT primitive, UINT lodIdx, float depth)
+{
+	UINT depthMax = (1u << DrawKeyDepthBits) - 1;
+	UINT depthValue = static_cast<UINT>((std::min)((std::max)(depth, 0.0f), 1.0f) * depthMax);
+
+	return keyField(static_cast<UINT>(pass), DrawKeyPassBits, DrawKeyPassShift)
+		| keyField(permutation, DrawKeyPermutationBits, DrawKeyPermutationShift)
+		| keyField(material, DrawKeyMaterialBits, DrawKeyMaterialShift)
+		| keyField(primitive, DrawKeyPrimitiveBits, DrawKeyPrimitiveShift)
+		| keyField(lodIdx, DrawKeyLodBits, DrawKeyLodShift)
+		| keyField(depthValue, DrawKeyDepthBits, 0);
+}
+
+UINT GetDrawKeyLod(UINT64 key)
+{
+	return static_cast<UINT>((key >> DrawKeyLodShift) & ((1ull << DrawKeyLodBits) - 1));
+}
+
+
+void DrawList::Clear()
+{
+	m_items.clear();
+	m_batches.clear();
+}
+
+DrawItem* DrawList::AddItems(size_t count)
+{
+	size_t firstItem = m_items.size();
+	m_items.resize(firstItem + count);
+
+	return m_items.data() + firstItem;
+}
+
+void DrawList::Build(UINT32 maxBatchSize, ThreadPool* pPool)
+{
+	m_batches.clear();
+
+	SortItems(pPool);
+
+	for (UINT32 itemIdx = 0; itemIdx < m_items.size(); ++itemIdx)
+	{
+		UINT64 batchKey = m_items[itemIdx].key >> DrawKeyDepthBits;
+
+		if (m_batches.empty()
+			|| (m_batches.back().key >> DrawKeyDepthBits) != batchKey
+			|| m_batches.back().itemCount >= maxBatchSize)
+		{
+			m_batches.push_back({ m_items[itemIdx].key, itemIdx, 0, itemIdx, 0 });
+		}
+
+		++m_batches.back().itemCount;
+		++m_batches.back().instanceNum;
+	}
+}
+
+void DrawList::SortItems(ThreadPool* pPool)
+{
+	UINT64 keysOr = 0;
+	UINT64 keysAnd = ~0ull;
+
+	for (const auto& item : m_items)
+	{
+		keysOr |= item.key;
+		keysAnd &= item.key;
+	}
+
+	// a byte that is the same in every key does not change the order
+	UINT64 changingBits = keysOr ^ keysAnd;
+
+	m_sortedItems.resize(m_items.size());
+
+	UINT chunkNum = static_cast<UINT>((m_items.size() + SortChunkSize - 1) / SortChunkSize);
+	m_chunkOffsets.resize(static_cast<size_t>(chunkNum) * 256);
+
+	for (UINT shift = 0; shift < 64; shift += 8)
+	{
+		if (((changingBits >> shift) & 0xFF) == 0)
+		{
+			continue;
+		}
+
+		auto countChunk = [&](UINT chunkIdx)
+		{
+			size_t* pCounts = m_chunkOffsets.data() + static_cast<size_t>(chunkIdx) * 256;
+			std::fill(pCounts, pCounts + 256, 0);
+
+			size_t end = (std::min)((chunkIdx + 1) * SortChunkSize, m_items.size());
+
+			for (size_t i = chunkIdx * SortChunkSize; i < end; ++i)
+			{
+				++pCounts[(m_items[i].key >> shift) & 0xFF];
+			}
+		};
+
+		auto scatterChunk = [&](UINT chunkIdx)
+		{
+			size_t* pOffsets = m_chunkOffsets.data() + static_cast<size_t>(chunkIdx) * 256;
+			size_t end = (std::min)((chunkIdx + 1) * SortChunkSize, m_items.size());
+
+			for (size_t i = chunkIdx * SortChunkSize; i < end; ++i)
+			{
+				m_sortedItems[pOffsets[(m_items[i].key >> shift) & 0xFF]++] = m_items[i];
+			}
+		};
+
+		if (pPool != nullptr)
+		{
+			pPool->ParallelFor(chunkNum, countChunk);
+		}
+		else
+		{
+			for (UINT chunkIdx = 0; chunkIdx < chunkNum; ++chunkIdx)
+			{
+				countChunk(chunkIdx);
+			}
+		}
+
+		// the items of a bucket are placed chunk after chunk, which keeps the sort stable
+		size_t offset = 0;
+
+		for (size_t bucket = 0; bucket < 256; ++bucket)
+		{
+			for (UINT chunkIdx = 0; chunkIdx < chunkNum; ++chunkIdx)
+			{
+				size_t& count = m_chunkOffsets[static_cast<size_t>(chunkIdx) * 256 + bucket];
+				size_t bucketSize = count;
+				count = offset;
+				offset += bucketSize;
+			}
+		}
+
+		if (pPool != nullptr)
+		{
+			pPool->ParallelFor(chunkNum, scatterChunk);
+		}
+		else
+		{
+			for (UINT chunkIdx = 0; chunkIdx < chunkNum; ++chunkIdx)
+			{
+				scatterChunk(chunkIdx);
+			}
+		}
+
+		m_items.swap(m_sortedItems);
+	}
+}
+
+
+size_t DrawStateStats::GetSetNum() const
+{
+	size_t setNumSum = 0;
+
+	for (size_t count : setNum)
+	{
+		setNumSum += count;
+	}
+
+	return setNumSum;
+}
+
+size_t DrawStateStats::GetSkippedNum() const
+{
+	size_t skippedNumSum = 0;
+
+	for (size_t count : skippedNum)
+	{
+		skippedNumSum += count;
+	}
+
+	return skippedNumSum;
+}
+
+
+DrawStateCache::DrawStateCache()
+	: m_pContext(nullptr)
+	, m_pVertexShader(nullptr)
+	, m_pPixelShader(nullptr)
+	, m_pInputLayout(nullptr)
+	, m_topology(D3D_PRIMITIVE_TOPOLOGY_UNDEFINED)
+	, m_textureSlot(0)
+	, m_textureNum(0)
+	, m_pTextures{}
+	, m_samplerSlot(0)
+	, m_pSampler(nullptr)
+{}
+
+
+void DrawStateCache::Reset(ID3D11DeviceContext* pContext)
+{
+	m_pContext = pContext;
+
+	m_pVertexShader = nullptr;
+	m_pPixelShader = nullptr;
+	m_pInputLayout = nullptr;
+	m_topology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+
+	// no slot range is known to be bound
+	m_textureNum = 0;
+	m_samplerSlot = UINT_MAX;
+	m_pSampler = nullptr;
+}
+
+void DrawStateCache::ResetStats()
+{
+	m_stats = {};
+}
+
+
+void DrawStateCache::SetVertexShader(ID3D11VertexShader* pShader)
+{
+	if (Count(DrawState::kVertexShader, m_pVertexShader != pShader))
+	{
+		m_pVertexShader = pShader;
+		m_pContext->VSSetShader(pShader, nullptr, 0);
+	}
+}
+
+void DrawStateCache::SetPixelShader(ID3D11PixelShader* pShader)
+{
+	if (Count(DrawState::kPixelShader, m_pPixelShader != pShader))
+	{
+		m_pPixelShader = pShader;
+		m_pContext->PSSetShader(pShader, nullptr, 0);
+	}
+}
+
+void DrawStateCache::SetInputLayout(ID3D11InputLayout* pInputLayout)
+{
+	if (Count(DrawState::kInputLayout, m_pInputLayout != pInputLayout))
+	{
+		m_pInputLayout = pInputLayout;
+		m_pContext->IASetInputLayout(pInputLayout);
+	}
+}
+
+void DrawStateCache::SetTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	if (Count(DrawState::kTopology, m_topology != topology))
+	{
+		m_topology = topology;
+		m_pContext->IASetPrimitiveTopology(topology);
+	}
+}
+
+void DrawStateCache::SetPixelTextures(UINT startSlot, UINT textureNum, ID3D11ShaderResourceView* const* ppTextures)
+{
+	textureNum = (std::min)(textureNum, MaxTextureNum);
+
+	bool isChanged = m_textureSlot != startSlot
+		|| m_textureNum != textureNum
+		|| !std::equal(ppTextures, ppTextures + textureNum, m_pTextures);
+
+	if (Count(DrawState::kTextures, isChanged))
+	{
+		m_textureSlot = startSlot;
+		m_textureNum = textureNum;
+		std::copy(ppTextures, ppTextures + textureNum, m_pTextures);
+
+		m_pContext->PSSetShaderResources(startSlot, textureNum, ppTextures);
+	}
+}
+
+void DrawStateCache::SetPixelSampler(UINT slot, ID3D11SamplerState* pSampler)
+{
+	if (Count(DrawState::kSampler, m_samplerSlot != slot || m_pSampler != pSampler))
+	{
+		m_samplerSlot = slot;
+		m_pSampler = pSampler;
+		m_pContext->PSSetSamplers(slot, 1, &pSampler);
+	}
+}
+
+
+bool DrawStateCache::Count(DrawState state, bool isChanged)
+{
+	size_t* pCounts = isChanged ? m_stats.setNum : m_stats.skippedNum;
+	++pCounts[static_cast<UINT>(state)];
+
+	return isChanged;
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include "framework.h"
+
+class ThreadPool;
+
+// Draw keys order the draws of a pass from the most to the least expensive state change:
+// pass | shader permutation | material | primitive | LOD | depth.
+// The primitive number also groups the primitives of one mesh, which share its buffers.
+// Draws that only differ by depth are instances of one batch.
+enum class DrawPass : UINT
+{
+	kShadow = 0,
+	kScene = 1
+};
+
+static constexpr UINT DrawKeyPassBits = 2;
+static constexpr UINT DrawKeyPermutationBits = 2;
+static constexpr UINT DrawKeyMaterialBits = 16;
+static constexpr UINT DrawKeyPrimitiveBits = 20;
+static constexpr UINT DrawKeyLodBits = 4;
+static constexpr UINT DrawKeyDepthBits = 20;
+
+// Every field is masked to its bits, depth is in [0, 1] from near to far
+UINT64 CreateDrawKey(DrawPass pass, UINT permutation, UINT material, UINT primitive, UINT lodIdx, float depth);
+UINT GetDrawKeyLod(UINT64 key);
+
+
+// One instance of something to draw
+struct DrawItem
+{
+	UINT64 key;
+	UINT32 instanceIdx;
+	UINT32 param;
+};
+
+// firstInstance and instanceNum start out as the item range,
+// passes that expand items into several instances overwrite them
+struct DrawBatch
+{
+	UINT64 key;
+	UINT32 firstItem;
+	UINT32 itemCount;
+
+	UINT32 firstInstance;
+	UINT32 instanceNum;
+};
+
+// Packets of one pass, sorted by key and cut into instanced batches
+class DrawList
+{
+public:
+	void Clear();
+	inline void Add(UINT64 key, UINT32 instanceIdx, UINT32 param) { m_items.push_back({ key, instanceIdx, param }); }
+	// Appends count items left for the caller to fill, e.g. a chunk per thread
+	DrawItem* AddItems(size_t count);
+
+	// Radix sorts the items and cuts them into batches of keys equal above the depth,
+	// maxBatchSize 1 gives one batch per item. The sort runs on the pool when one is given
+	void Build(UINT32 maxBatchSize, ThreadPool* pPool = nullptr);
+
+	inline const std::vector<DrawItem>& GetItems() const { return m_items; }
+	inline std::vector<DrawBatch>& GetBatches() { return m_batches; }
+
+private:
+	// stable LSD sort a byte at a time, bytes equal in all keys are skipped,
+	// every chunk of items counts and scatters its own keys
+	void SortItems(ThreadPool* pPool);
+
+private:
+	std::vector<DrawItem> m_items;
+	std::vector<DrawItem> m_sortedItems;
+	std::vector<size_t> m_chunkOffsets;
+	std::vector<DrawBatch> m_batches;
+};
+
+
+enum class DrawState : UINT
+{
+	kVertexShader,
+	kPixelShader,
+	kInputLayout,
+	kTopology,
+	kTextures,
+	kSampler,
+
+	kCount
+};
+
+struct DrawStateStats
+{
+	size_t setNum[static_cast<UINT>(DrawState::kCount)] = {};
+	size_t skippedNum[static_cast<UINT>(DrawState::kCount)] = {};
+
+	size_t GetSetNum() const;
+	size_t GetSkippedNum() const;
+};
+
+// Submits the pipeline state of the draws and skips every set of the state already bound
+class DrawStateCache
+{
+public:
+	static constexpr UINT MaxTextureNum = 4;
+
+	DrawStateCache();
+
+	// Forgets the bound state, e.g. after ClearState or binds past the cache
+	void Reset(ID3D11DeviceContext* pContext);
+	void ResetStats();
+
+	void SetVertexShader(ID3D11VertexShader* pShader);
+	void SetPixelShader(ID3D11PixelShader* pShader);
+	void SetInputLayout(ID3D11InputLayout* pInputLayout);
+	void SetTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void SetPixelTextures(UINT startSlot, UINT textureNum, ID3D11ShaderResourceView* const* ppTextures);
+	void SetPixelSampler(UINT slot, ID3D11SamplerState* pSampler);
+
+	inline const DrawStateStats& GetStats() const { return m_stats; }
+
+private:
+	bool Count(DrawState state, bool isChanged);
+
+private:
+	ID3D11DeviceContext* m_pContext;
+
+	ID3D11VertexShader* m_pVertexShader;
+	ID3D11PixelShader* m_pPixelShader;
+	ID3D11InputLayout* m_pInputLayout;
+	D3D11_PRIMITIVE_TOPOLOGY m_topology;
+
+	UINT m_textureSlot;
+	UINT m_textureNum;
+	ID3D11ShaderResourceView* m_pTextures[MaxTextureNum];
+
+	UINT m_samplerSlot;
+	ID3D11SamplerState* m_pSampler;
+
+	DrawStateStats m_stats;
+};
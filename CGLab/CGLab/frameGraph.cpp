@@ -0,0 +1,83 @@
+#include "frameGraph.h"
+
+
+FrameTextures AddFramePasses(RenderGraph& graph, const FrameGraphDesc& desc, FramePasses passes)
+{
+	FrameTextures textures;
+
+	textures.backBuffer = graph.ImportTexture("Back buffer", desc.createTextureDesc(FrameTextureType::kBackBuffer, desc.width, desc.height));
+
+	RenderGraphTextureDesc shadowMapDesc = desc.createTextureDesc(FrameTextureType::kShadowMap, desc.shadowMapSize, desc.shadowMapSize);
+	shadowMapDesc.arraySize = desc.shadowSplitNum;
+	shadowMapDesc.clearValue[0] = 1.0f;
+	textures.shadowMap = graph.CreateTexture("Shadow map", shadowMapDesc);
+
+	RenderGraphTextureDesc depthDesc = desc.createTextureDesc(FrameTextureType::kDepth, desc.width, desc.height);
+	depthDesc.clearValue[0] = 1.0f;
+	textures.depth = graph.CreateTexture("Depth", depthDesc);
+
+	RenderGraphTextureDesc hdrDesc = desc.createTextureDesc(FrameTextureType::kHDR, desc.width, desc.height);
+	hdrDesc.clearValue[0] = 0.1f;
+	hdrDesc.clearValue[1] = 0.1f;
+	hdrDesc.clearValue[2] = 0.1f;
+	hdrDesc.clearValue[3] = 1.0f;
+	textures.hdr = graph.CreateTexture("HDR", hdrDesc);
+
+	textures.emissive = graph.CreateTexture("Emissive", desc.createTextureDesc(FrameTextureType::kEmissive, desc.width, desc.height));
+
+	RenderGraphTextureDesc blurDesc = desc.createTextureDesc(FrameTextureType::kBloomBlur, desc.bloomBlurWidth, desc.bloomBlurHeight);
+	textures.bloomBlur = graph.CreateTexture("Bloom blur", blurDesc);
+	textures.bloomBlurTemp = graph.CreateTexture("Bloom blur temp", blurDesc);
+
+	RenderGraphTextureDesc exposureDesc = desc.createTextureDesc(FrameTextureType::kExposure, desc.exposureSize, desc.exposureSize);
+	exposureDesc.mipLevels = 0;
+	for (uint32_t size = desc.exposureSize; size > 0; size >>= 1)
+	{
+		++exposureDesc.mipLevels;
+	}
+	textures.exposure = graph.CreateTexture("Exposure", exposureDesc);
+
+	RenderGraph::PassId pass = graph.AddPass("Shadow map", std::move(passes.shadowMap));
+	graph.Modify(pass, textures.shadowMap);
+
+	pass = graph.AddPass("Environment", std::move(passes.environment));
+	graph.Modify(pass, textures.hdr);
+	graph.Modify(pass, textures.depth);
+
+	pass = graph.AddPass("Scene", std::move(passes.scene));
+	graph.Read(pass, textures.shadowMap);
+	graph.Modify(pass, textures.hdr);
+	graph.Modify(pass, textures.depth);
+	graph.Modify(pass, textures.emissive);
+
+	if (desc.isBloom)
+	{
+		pass = graph.AddPass("Bloom mask", std::move(passes.bloomMask));
+		graph.Read(pass, textures.hdr);
+		graph.Read(pass, textures.emissive);
+		graph.Write(pass, textures.bloomBlur);
+
+		pass = graph.AddPass("Bloom blur", std::move(passes.bloomBlur));
+		graph.Modify(pass, textures.bloomBlur);
+		graph.Write(pass, textures.bloomBlurTemp);
+
+		pass = graph.AddPass("Add bloom", std::move(passes.addBloom));
+		graph.Read(pass, textures.bloomBlur);
+		graph.Modify(pass, textures.hdr);
+	}
+
+	pass = graph.AddPass("Average brightness", std::move(passes.averageBrightness));
+	graph.Read(pass, textures.hdr);
+	graph.Write(pass, textures.exposure);
+
+	// the exposure read back from the brightness pass scales the tone mapping
+	pass = graph.AddPass("Tone mapping", std::move(passes.toneMapping));
+	graph.Read(pass, textures.hdr);
+	graph.Read(pass, textures.exposure);
+	graph.Write(pass, textures.backBuffer);
+
+	pass = graph.AddPass("ImGui", std::move(passes.imGui));
+	graph.Modify(pass, textures.backBuffer);
+
+	return textures;
+}
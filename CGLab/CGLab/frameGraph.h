@@ -0,0 +1,65 @@
+#pragma once
+#include "renderGraph.h"
+
+
+// What a texture of the frame holds, the backend picks its format and bind flags
+enum class FrameTextureType
+{
+	kBackBuffer,
+	kShadowMap,
+	kDepth,
+	kHDR,
+	kEmissive,
+	kBloomBlur,
+	kExposure
+};
+
+struct FrameGraphDesc
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+
+	uint32_t shadowMapSize = 0;
+	uint32_t shadowSplitNum = 0;
+	uint32_t bloomBlurWidth = 0;
+	uint32_t bloomBlurHeight = 0;
+	// square with all mips
+	uint32_t exposureSize = 0;
+
+	bool isBloom = true;
+
+	// desc of a texture with the format, bind flags and texel size of the backend,
+	// the frame sets the array size, mips and clear values
+	std::function<RenderGraphTextureDesc(FrameTextureType type, uint32_t width, uint32_t height)> createTextureDesc;
+};
+
+// What every pass of the frame runs, the functions of passes left out may be empty
+struct FramePasses
+{
+	RenderGraph::PassFunction shadowMap;
+	RenderGraph::PassFunction environment;
+	RenderGraph::PassFunction scene;
+	RenderGraph::PassFunction bloomMask;
+	RenderGraph::PassFunction bloomBlur;
+	RenderGraph::PassFunction addBloom;
+	RenderGraph::PassFunction averageBrightness;
+	RenderGraph::PassFunction toneMapping;
+	RenderGraph::PassFunction imGui;
+};
+
+struct FrameTextures
+{
+	RenderGraph::ResourceId backBuffer;
+	RenderGraph::ResourceId shadowMap;
+	RenderGraph::ResourceId depth;
+	RenderGraph::ResourceId hdr;
+	RenderGraph::ResourceId emissive;
+	RenderGraph::ResourceId bloomBlur;
+	RenderGraph::ResourceId bloomBlurTemp;
+	RenderGraph::ResourceId exposure;
+};
+
+
+// Declares the textures and passes of a frame in an empty graph. The renderer
+// and the tests share it, so the tests check the layout the renderer runs
+FrameTextures AddFramePasses(RenderGraph& graph, const FrameGraphDesc& desc, FramePasses passes);
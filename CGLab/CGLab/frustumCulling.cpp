@@ -0,0 +1,287 @@
+#include "frustumCulling.h"
+
+#include <algorithm>
+#include <immintrin.h>
+
+
+void ComputeBounds(const Vertex* pVertices, size_t count, DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax)
+{
+	if (count == 0)
+	{
+		boundsMin = boundsMax = { 0.0f, 0.0f, 0.0f };
+		return;
+	}
+
+	DirectX::XMVECTOR minPosition = DirectX::XMLoadFloat3(&pVertices[0].position);
+	DirectX::XMVECTOR maxPosition = minPosition;
+
+	for (size_t i = 1; i < count; ++i)
+	{
+		DirectX::XMVECTOR position = DirectX::XMLoadFloat3(&pVertices[i].position);
+
+		minPosition = DirectX::XMVectorMin(minPosition, position);
+		maxPosition = DirectX::XMVectorMax(maxPosition, position);
+	}
+
+	DirectX::XMStoreFloat3(&boundsMin, minPosition);
+	DirectX::XMStoreFloat3(&boundsMax, maxPosition);
+}
+
+BoundingVolume TransformBounds(
+	const DirectX::XMFLOAT3& boundsMin,
+	const DirectX::XMFLOAT3& boundsMax,
+	const DirectX::XMMATRIX& matrix
+)
+{
+	DirectX::XMVECTOR localMin = DirectX::XMLoadFloat3(&boundsMin);
+	DirectX::XMVECTOR localMax = DirectX::XMLoadFloat3(&boundsMax);
+
+	DirectX::XMVECTOR center = DirectX::XMVectorScale(DirectX::XMVectorAdd(localMin, localMax), 0.5f);
+	DirectX::XMVECTOR extents = DirectX::XMVectorScale(DirectX::XMVectorSubtract(localMax, localMin), 0.5f);
+
+	// every local axis adds its absolute projection to the world extents (Arvo 1990)
+	DirectX::XMVECTOR worldExtents = DirectX::XMVectorAdd(
+		DirectX::XMVectorAdd(
+			DirectX::XMVectorScale(DirectX::XMVectorAbs(matrix.r[0]), DirectX::XMVectorGetX(extents)),
+			DirectX::XMVectorScale(DirectX::XMVectorAbs(matrix.r[1]), DirectX::XMVectorGetY(extents))
+		),
+		DirectX::XMVectorScale(DirectX::XMVectorAbs(matrix.r[2]), DirectX::XMVectorGetZ(extents))
+	);
+
+	float scale = (std::max)({
+		DirectX::XMVectorGetX(DirectX::XMVector3Length(matrix.r[0])),
+		DirectX::XMVectorGetX(DirectX::XMVector3Length(matrix.r[1])),
+		DirectX::XMVectorGetX(DirectX::XMVector3Length(matrix.r[2]))
+	});
+
+	BoundingVolume bounds;
+	DirectX::XMStoreFloat3(&bounds.center, DirectX::XMVector3Transform(center, matrix));
+	DirectX::XMStoreFloat3(&bounds.extents, worldExtents);
+	bounds.radius = scale * DirectX::XMVectorGetX(DirectX::XMVector3Length(extents));
+
+	return bounds;
+}
+
+
+void ExtractFrustumPlanes(const DirectX::XMMATRIX& vpMatrix, DirectX::XMFLOAT4 planes[FrustumPlaneNum])
+{
+	DirectX::XMFLOAT4X4 m;
+	DirectX::XMStoreFloat4x4(&m, vpMatrix);
+
+	// Gribb and Hartmann plane extraction
+	DirectX::XMFLOAT4 clipPlanes[FrustumPlaneNum] =
+	{
+		{ m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41 },	// left
+		{ m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41 },	// right
+		{ m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42 },	// bottom
+		{ m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42 },	// top
+		{ m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43 },	// far
+		{ m._13, m._23, m._33, m._43 }									// near
+	};
+
+	for (UINT i = 0; i < FrustumPlaneNum; ++i)
+	{
+		DirectX::XMVECTOR plane = DirectX::XMLoadFloat4(&clipPlanes[i]);
+		DirectX::XMStoreFloat4(&planes[i], DirectX::XMPlaneNormalize(plane));
+	}
+}
+
+OcclusionMatrix ToOcclusionMatrix(const DirectX::XMMATRIX& matrix)
+{
+	DirectX::XMFLOAT4X4 m;
+	DirectX::XMStoreFloat4x4(&m, matrix);
+
+	OcclusionMatrix occlusionMatrix;
+
+	for (UINT row = 0; row < 4; ++row)
+	{
+		for (UINT column = 0; column < 4; ++column)
+		{
+			occlusionMatrix.m[row][column] = m.m[row][column];
+		}
+	}
+
+	return occlusionMatrix;
+}
+
+
+void BoundsSoA::Resize(size_t newCount)
+{
+	size_t paddedCount = (newCount + 3) & ~static_cast<size_t>(3);
+
+	centerX.resize(paddedCount, 0.0f);
+	centerY.resize(paddedCount, 0.0f);
+	centerZ.resize(paddedCount, 0.0f);
+	extentX.resize(paddedCount, 0.0f);
+	extentY.resize(paddedCount, 0.0f);
+	extentZ.resize(paddedCount, 0.0f);
+
+	count = newCount;
+}
+
+void BoundsSoA::Set(size_t idx, const BoundingVolume& bounds)
+{
+	assert(idx < count);
+
+	centerX[idx] = bounds.center.x;
+	centerY[idx] = bounds.center.y;
+	centerZ[idx] = bounds.center.z;
+	extentX[idx] = bounds.extents.x;
+	extentY[idx] = bounds.extents.y;
+	extentZ[idx] = bounds.extents.z;
+}
+
+bool BoundsSoA::Update(size_t idx, const BoundingVolume& bounds)
+{
+	assert(idx < count);
+
+	bool isChanged =
+		centerX[idx] != bounds.center.x || centerY[idx] != bounds.center.y || centerZ[idx] != bounds.center.z ||
+		extentX[idx] != bounds.extents.x || extentY[idx] != bounds.extents.y || extentZ[idx] != bounds.extents.z;
+
+	Set(idx, bounds);
+
+	return isChanged;
+}
+
+OcclusionBoxArrays BoundsSoA::GetOcclusionBoxes() const
+{
+	return { centerX.data(), centerY.data(), centerZ.data(), extentX.data(), extentY.data(), extentZ.data() };
+}
+
+
+void cullScalar(const BoundsSoA& bounds, const DirectX::XMFLOAT4* pPlanes, UINT planeNum, std::vector<UINT32>& visible)
+{
+	for (size_t i = 0; i < bounds.count; ++i)
+	{
+		bool isVisible = true;
+
+		for (UINT p = 0; p < planeNum && isVisible; ++p)
+		{
+			const DirectX::XMFLOAT4& plane = pPlanes[p];
+
+			float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+			float radius = fabsf(plane.x) * bounds.extentX[i] + fabsf(plane.y) * bounds.extentY[i] + fabsf(plane.z) * bounds.extentZ[i];
+
+			isVisible = distance + radius >= 0.0f;
+		}
+
+		if (isVisible)
+		{
+			visible.push_back(static_cast<UINT32>(i));
+		}
+	}
+}
+
+void cullSSE(const BoundsSoA& bounds, const DirectX::XMFLOAT4* pPlanes, UINT planeNum, std::vector<UINT32>& visible)
+{
+	__m128 planeX[FrustumPlaneNum];
+	__m128 planeY[FrustumPlaneNum];
+	__m128 planeZ[FrustumPlaneNum];
+	__m128 planeW[FrustumPlaneNum];
+	__m128 absPlaneX[FrustumPlaneNum];
+	__m128 absPlaneY[FrustumPlaneNum];
+	__m128 absPlaneZ[FrustumPlaneNum];
+
+	for (UINT p = 0; p < planeNum; ++p)
+	{
+		planeX[p] = _mm_set1_ps(pPlanes[p].x);
+		planeY[p] = _mm_set1_ps(pPlanes[p].y);
+		planeZ[p] = _mm_set1_ps(pPlanes[p].z);
+		planeW[p] = _mm_set1_ps(pPlanes[p].w);
+		absPlaneX[p] = _mm_set1_ps(fabsf(pPlanes[p].x));
+		absPlaneY[p] = _mm_set1_ps(fabsf(pPlanes[p].y));
+		absPlaneZ[p] = _mm_set1_ps(fabsf(pPlanes[p].z));
+	}
+
+	// indices are written for all 4 lanes and only the visible ones are kept
+	size_t firstOut = visible.size();
+	visible.resize(firstOut + bounds.count + 4);
+
+	UINT32* pOut = visible.data() + firstOut;
+	size_t outNum = 0;
+
+	const __m128 zero = _mm_setzero_ps();
+
+	for (size_t i = 0; i < bounds.count; i += 4)
+	{
+		__m128 centerX = _mm_loadu_ps(bounds.centerX.data() + i);
+		__m128 centerY = _mm_loadu_ps(bounds.centerY.data() + i);
+		__m128 centerZ = _mm_loadu_ps(bounds.centerZ.data() + i);
+		__m128 extentX = _mm_loadu_ps(bounds.extentX.data() + i);
+		__m128 extentY = _mm_loadu_ps(bounds.extentY.data() + i);
+		__m128 extentZ = _mm_loadu_ps(bounds.extentZ.data() + i);
+
+		__m128 isVisible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for (UINT p = 0; p < planeNum; ++p)
+		{
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(planeX[p], centerX), _mm_mul_ps(planeY[p], centerY)),
+				_mm_add_ps(_mm_mul_ps(planeZ[p], centerZ), planeW[p])
+			);
+			__m128 radius = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(absPlaneX[p], extentX), _mm_mul_ps(absPlaneY[p], extentY)),
+				_mm_mul_ps(absPlaneZ[p], extentZ)
+			);
+
+			isVisible = _mm_and_ps(isVisible, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+		}
+
+		int mask = _mm_movemask_ps(isVisible);
+
+		// the padding lanes of the last group
+		if (i + 4 > bounds.count)
+		{
+			mask &= (1 << (bounds.count - i)) - 1;
+		}
+
+		for (UINT k = 0; k < 4; ++k)
+		{
+			pOut[outNum] = static_cast<UINT32>(i + k);
+			outNum += (mask >> k) & 1;
+		}
+	}
+
+	visible.resize(firstOut + outNum);
+}
+
+
+const char* GetCullingKernelName(CullingKernel kernel)
+{
+	switch (kernel)
+	{
+	case CullingKernel::Scalar:
+		return "scalar";
+
+	case CullingKernel::SSE:
+		return "SSE";
+
+	default:
+		break;
+	}
+
+	return "unknown";
+}
+
+void CullBounds(
+	const BoundsSoA& bounds,
+	const DirectX::XMFLOAT4* pPlanes,
+	UINT planeNum,
+	std::vector<UINT32>& visible,
+	CullingKernel kernel
+)
+{
+	assert(planeNum <= FrustumPlaneNum);
+
+	switch (kernel)
+	{
+	case CullingKernel::SSE:
+		cullSSE(bounds, pPlanes, planeNum, visible);
+		break;
+
+	default:
+		cullScalar(bounds, pPlanes, planeNum, visible);
+		break;
+	}
+}
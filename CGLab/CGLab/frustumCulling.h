@@ -0,0 +1,73 @@
+#pragma once
+#include "framework.h"
+#include "rendererContext.h"
+#include "occlusionCulling.h"
+
+
+// World space bounds of a draw, the sphere encloses the box
+struct BoundingVolume
+{
+	DirectX::XMFLOAT3 center = { 0.0f, 0.0f, 0.0f };
+	float radius = 0.0f;
+	DirectX::XMFLOAT3 extents = { 0.0f, 0.0f, 0.0f };
+};
+
+void ComputeBounds(const Vertex* pVertices, size_t count, DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax);
+
+// Box and sphere around a local box after the transform
+BoundingVolume TransformBounds(
+	const DirectX::XMFLOAT3& boundsMin,
+	const DirectX::XMFLOAT3& boundsMax,
+	const DirectX::XMMATRIX& matrix
+);
+
+
+// Normalized planes of a view projection with 0 <= z <= w, normals point inside.
+// The near plane is the last one, shadow casters in front of a light frustum
+// still cast, so depth passes test only the first FrustumPlaneNum - 1 planes.
+static constexpr UINT FrustumPlaneNum = 6;
+
+void ExtractFrustumPlanes(const DirectX::XMMATRIX& vpMatrix, DirectX::XMFLOAT4 planes[FrustumPlaneNum]);
+
+// The occlusion buffer takes plain matrices
+OcclusionMatrix ToOcclusionMatrix(const DirectX::XMMATRIX& matrix);
+
+
+// Boxes of many instances in SoA layout, the arrays are padded to a multiple of 4
+struct BoundsSoA
+{
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> extentX;
+	std::vector<float> extentY;
+	std::vector<float> extentZ;
+
+	size_t count = 0;
+
+	void Resize(size_t newCount);
+	void Set(size_t idx, const BoundingVolume& bounds);
+	// Same as Set, returns whether the box changed
+	bool Update(size_t idx, const BoundingVolume& bounds);
+
+	// the arrays for OcclusionBuffer::FilterVisible
+	OcclusionBoxArrays GetOcclusionBoxes() const;
+};
+
+enum class CullingKernel
+{
+	Scalar,
+	SSE		// 4 boxes per iteration
+};
+
+const char* GetCullingKernelName(CullingKernel kernel);
+
+// Appends the indices of the boxes that are inside or intersect all planes,
+// in increasing order
+void CullBounds(
+	const BoundsSoA& bounds,
+	const DirectX::XMFLOAT4* pPlanes,
+	UINT planeNum,
+	std::vector<UINT32>& visible,
+	CullingKernel kernel = CullingKernel::SSE
+);
@@ -0,0 +1,261 @@
+#include "geometryPool.h"
+#include "rendererContext.h"
+
+#include <algorithm>
+
+
+// the first buffer of a heap, every growth doubles it
+static constexpr UINT HeapInitialBytes = 4 * 1024 * 1024;
+
+
+D3D11_BOX createBufferBox(UINT offset, UINT count, UINT stride)
+{
+	D3D11_BOX box = {};
+	box.left = offset * stride;
+	box.right = (offset + count) * stride;
+	box.top = 0;
+	box.bottom = 1;
+	box.front = 0;
+	box.back = 1;
+
+	return box;
+}
+
+
+GeometryPool* GeometryPool::Create(RendererContext* pContext)
+{
+	return new GeometryPool(pContext);
+}
+
+
+GeometryPool::GeometryPool(RendererContext* pContext)
+	: m_pContext(pContext)
+{}
+
+GeometryPool::~GeometryPool()
+{
+	for (auto& heap : m_heaps)
+	{
+		SafeRelease(heap.pBuffer);
+	}
+}
+
+
+HRESULT GeometryPool::Upload(UINT stride, UINT bindFlag, UINT count, const void* pData, GeometryRange& range)
+{
+	range = {};
+
+	if (count == 0)
+	{
+		return S_OK;
+	}
+
+	UINT heapIdx = FindHeap(stride, bindFlag);
+	Heap& heap = m_heaps[heapIdx];
+
+	OffsetAllocator::Allocation allocation = heap.allocator.Allocate(count);
+
+	if (allocation.node == OffsetAllocator::InvalidNode)
+	{
+		HRESULT hr = GrowHeap(heap, heap.allocator.GetSize() + count);
+
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+
+		allocation = heap.allocator.Allocate(count);
+	}
+
+	D3D11_BOX box = createBufferBox(allocation.offset, count, stride);
+	m_pContext->GetContext()->UpdateSubresource(heap.pBuffer, 0, &box, pData, 0, 0);
+
+	range.heapIdx = heapIdx;
+	range.offset = allocation.offset;
+	range.count = count;
+	range.node = allocation.node;
+
+	SetOwner(heap, allocation.node, &range);
+
+	return S_OK;
+}
+
+void GeometryPool::Free(GeometryRange& range)
+{
+	if (range.heapIdx == GeometryRange::InvalidHeap)
+	{
+		return;
+	}
+
+	Heap& heap = m_heaps[range.heapIdx];
+
+	heap.allocator.Free({ range.offset, range.node });
+	heap.owners[range.node] = nullptr;
+
+	range = {};
+}
+
+
+HRESULT GeometryPool::Defragment()
+{
+	HRESULT hr = S_OK;
+
+	for (size_t heapIdx = 0; heapIdx < m_heaps.size() && SUCCEEDED(hr); ++heapIdx)
+	{
+		hr = DefragmentHeap(m_heaps[heapIdx]);
+	}
+
+	return hr;
+}
+
+
+GeometryPoolStats GeometryPool::GetStats() const
+{
+	GeometryPoolStats stats;
+	stats.heapNum = static_cast<UINT>(m_heaps.size());
+
+	for (const auto& heap : m_heaps)
+	{
+		const OffsetAllocator& allocator = heap.allocator;
+
+		stats.freeBlockNum += allocator.GetFreeBlockNum();
+		stats.capacityBytes += static_cast<size_t>(allocator.GetSize()) * heap.stride;
+		stats.usedBytes += static_cast<size_t>(allocator.GetSize() - allocator.GetFreeSize()) * heap.stride;
+
+		for (const GeometryRange* pRange : heap.owners)
+		{
+			stats.rangeNum += pRange != nullptr ? 1 : 0;
+		}
+	}
+
+	return stats;
+}
+
+
+UINT GeometryPool::FindHeap(UINT stride, UINT bindFlag)
+{
+	for (UINT heapIdx = 0; heapIdx < m_heaps.size(); ++heapIdx)
+	{
+		if (m_heaps[heapIdx].stride == stride && m_heaps[heapIdx].bindFlag == bindFlag)
+		{
+			return heapIdx;
+		}
+	}
+
+	// the buffer is created by the first growth
+	m_heaps.emplace_back();
+	m_heaps.back().stride = stride;
+	m_heaps.back().bindFlag = bindFlag;
+
+	return static_cast<UINT>(m_heaps.size()) - 1;
+}
+
+HRESULT GeometryPool::CreateHeapBuffer(const Heap& heap, UINT capacity, ID3D11Buffer** ppBuffer) const
+{
+	D3D11_BUFFER_DESC bufferDesc = CreateDefaultBufferDesc(capacity * heap.stride, heap.bindFlag);
+
+	return m_pContext->GetDevice()->CreateBuffer(&bufferDesc, nullptr, ppBuffer);
+}
+
+HRESULT GeometryPool::GrowHeap(Heap& heap, UINT minCapacity)
+{
+	UINT oldCapacity = heap.allocator.GetSize();
+	UINT capacity = (std::max)(oldCapacity > 0 ? oldCapacity * 2 : HeapInitialBytes / heap.stride, minCapacity);
+
+	ID3D11Buffer* pBuffer = nullptr;
+	HRESULT hr = CreateHeapBuffer(heap, capacity, &pBuffer);
+
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	// the ranges keep their offsets, so the old contents are copied as a whole
+	if (heap.pBuffer != nullptr)
+	{
+		D3D11_BOX box = createBufferBox(0, oldCapacity, heap.stride);
+		m_pContext->GetContext()->CopySubresourceRegion(pBuffer, 0, 0, 0, 0, heap.pBuffer, 0, &box);
+
+		SafeRelease(heap.pBuffer);
+	}
+
+	heap.pBuffer = pBuffer;
+	heap.allocator.Grow(capacity);
+
+	return S_OK;
+}
+
+HRESULT GeometryPool::DefragmentHeap(Heap& heap)
+{
+	std::vector<GeometryRange*> ranges;
+	UINT usedSize = 0;
+	UINT rangesEnd = 0;
+
+	for (GeometryRange* pRange : heap.owners)
+	{
+		if (pRange != nullptr)
+		{
+			ranges.push_back(pRange);
+			usedSize += pRange->count;
+			rangesEnd = (std::max)(rangesEnd, pRange->offset + pRange->count);
+		}
+	}
+
+	// already packed
+	if (rangesEnd == usedSize)
+	{
+		return S_OK;
+	}
+
+	std::sort(ranges.begin(), ranges.end(), [](const GeometryRange* pLeft, const GeometryRange* pRight)
+		{
+			return pLeft->offset < pRight->offset;
+		}
+	);
+
+	// copies within one buffer must not overlap, the ranges move into a new one
+	UINT capacity = heap.allocator.GetSize();
+
+	ID3D11Buffer* pBuffer = nullptr;
+	HRESULT hr = CreateHeapBuffer(heap, capacity, &pBuffer);
+
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	// allocations from a single free block come out in order, right after each other
+	heap.allocator.Reset(capacity);
+	heap.owners.clear();
+
+	ID3D11DeviceContext* pContext = m_pContext->GetContext();
+
+	for (GeometryRange* pRange : ranges)
+	{
+		OffsetAllocator::Allocation allocation = heap.allocator.Allocate(pRange->count);
+
+		D3D11_BOX box = createBufferBox(pRange->offset, pRange->count, heap.stride);
+		pContext->CopySubresourceRegion(pBuffer, 0, allocation.offset * heap.stride, 0, 0, heap.pBuffer, 0, &box);
+
+		pRange->offset = allocation.offset;
+		pRange->node = allocation.node;
+
+		SetOwner(heap, allocation.node, pRange);
+	}
+
+	SafeRelease(heap.pBuffer);
+	heap.pBuffer = pBuffer;
+
+	return S_OK;
+}
+
+
+void GeometryPool::SetOwner(Heap& heap, UINT32 node, GeometryRange* pRange)
+{
+	if (node >= heap.owners.size())
+	{
+		heap.owners.resize(node + 1, nullptr);
+	}
+
+	heap.owners[node] = pRange;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "framework.h"
+#include "offsetAllocator.h"
+
+class RendererContext;
+
+
+// Part of a pool buffer, offset and count are in elements of the buffer stride,
+// so they go straight into the base vertex and start index of the draws
+struct GeometryRange
+{
+	static constexpr UINT InvalidHeap = ~0u;
+
+	UINT heapIdx = InvalidHeap;
+	UINT offset = 0;
+	UINT count = 0;
+	UINT32 node = OffsetAllocator::InvalidNode;
+};
+
+struct GeometryPoolStats
+{
+	UINT heapNum = 0;
+	UINT rangeNum = 0;
+	UINT freeBlockNum = 0;
+
+	size_t capacityBytes = 0;
+	size_t usedBytes = 0;
+};
+
+
+// Shared vertex and index buffers for all meshes.
+// Every stride and bind flag pair gets one heap, a buffer that grows by doubling and
+// whose ranges are handed out by an OffsetAllocator. Meshes of one vertex format and
+// index size therefore share their buffers and only differ by offsets in the draws.
+class GeometryPool
+{
+public:
+	static GeometryPool* Create(RendererContext* pContext);
+
+	~GeometryPool();
+
+	// Sub-allocates count elements and copies pData into them.
+	// The pool keeps a pointer to range and patches it when ranges move,
+	// so the range has to stay at its address until it is freed.
+	HRESULT Upload(UINT stride, UINT bindFlag, UINT count, const void* pData, GeometryRange& range);
+	void Free(GeometryRange& range);
+
+	// Moves the ranges of every fragmented heap to the start of a new buffer
+	HRESULT Defragment();
+
+	inline ID3D11Buffer* GetBuffer(const GeometryRange& range) const { return m_heaps[range.heapIdx].pBuffer; }
+
+	GeometryPoolStats GetStats() const;
+
+private:
+	struct Heap
+	{
+		ID3D11Buffer* pBuffer = nullptr;
+		UINT stride = 0;
+		UINT bindFlag = 0;
+
+		OffsetAllocator allocator;
+		// the range owning every allocator node, nullptr for free ones
+		std::vector<GeometryRange*> owners;
+	};
+
+	GeometryPool(RendererContext* pContext);
+
+	UINT FindHeap(UINT stride, UINT bindFlag);
+	HRESULT CreateHeapBuffer(const Heap& heap, UINT capacity, ID3D11Buffer** ppBuffer) const;
+	HRESULT GrowHeap(Heap& heap, UINT minCapacity);
+	HRESULT DefragmentHeap(Heap& heap);
+
+	void SetOwner(Heap& heap, UINT32 node, GeometryRange* pRange);
+
+private:
+	RendererContext* m_pContext;
+
+	std::vector<Heap> m_heaps;
+};
@@ -0,0 +1,656 @@
+#include "instanceBvh.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+static constexpr UINT BinNum = 16;
+static constexpr UINT32 MaxLeafSize = 4;
+
+// a node test costs about as much as an instance test
+static constexpr float TraversalCost = 1.0f;
+
+// deeper ranges become leaves of any size, the traversal stacks are sized for this
+static constexpr UINT MaxDepth = 48;
+static constexpr UINT StackSize = 64;
+
+// smaller subtrees are not worth a task of their own
+static constexpr UINT32 ParallelMinInstanceNum = 4096;
+
+
+enum class Containment
+{
+	Outside,
+	Intersects,
+	Inside
+};
+
+// The same plane test as CullBounds
+Containment classifyBox(const DirectX::XMFLOAT4* pPlanes, UINT planeNum, const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents)
+{
+	Containment result = Containment::Inside;
+
+	for (UINT p = 0; p < planeNum; ++p)
+	{
+		const DirectX::XMFLOAT4& plane = pPlanes[p];
+
+		float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		float radius = fabsf(plane.x) * extents.x + fabsf(plane.y) * extents.y + fabsf(plane.z) * extents.z;
+
+		if (distance + radius < 0.0f)
+		{
+			return Containment::Outside;
+		}
+
+		if (distance - radius < 0.0f)
+		{
+			result = Containment::Intersects;
+		}
+	}
+
+	return result;
+}
+
+bool isSphereTouchingBox(const DirectX::XMFLOAT3& sphereCenter, float radius, const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents)
+{
+	float dx = (std::max)(fabsf(sphereCenter.x - center.x) - extents.x, 0.0f);
+	float dy = (std::max)(fabsf(sphereCenter.y - center.y) - extents.y, 0.0f);
+	float dz = (std::max)(fabsf(sphereCenter.z - center.z) - extents.z, 0.0f);
+
+	return dx * dx + dy * dy + dz * dz <= radius * radius;
+}
+
+// Slab test of the segment [0, maxDistance] along the ray
+bool isRayHittingBox(
+	const DirectX::XMFLOAT3& origin,
+	const DirectX::XMFLOAT3& invDirection,
+	float maxDistance,
+	const DirectX::XMFLOAT3& center,
+	const DirectX::XMFLOAT3& extents
+)
+{
+	float originAxes[3] = { origin.x, origin.y, origin.z };
+	float invDirectionAxes[3] = { invDirection.x, invDirection.y, invDirection.z };
+	float centerAxes[3] = { center.x, center.y, center.z };
+	float extentAxes[3] = { extents.x, extents.y, extents.z };
+
+	float tMin = 0.0f;
+	float tMax = maxDistance;
+
+	for (UINT axis = 0; axis < 3; ++axis)
+	{
+		float t1 = (centerAxes[axis] - extentAxes[axis] - originAxes[axis]) * invDirectionAxes[axis];
+		float t2 = (centerAxes[axis] + extentAxes[axis] - originAxes[axis]) * invDirectionAxes[axis];
+
+		tMin = (std::max)(tMin, (std::min)(t1, t2));
+		tMax = (std::min)(tMax, (std::max)(t1, t2));
+	}
+
+	return tMin <= tMax;
+}
+
+float halfArea(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax)
+{
+	float dx = boundsMax.x - boundsMin.x;
+	float dy = boundsMax.y - boundsMin.y;
+	float dz = boundsMax.z - boundsMin.z;
+
+	return dx * dy + dy * dz + dz * dx;
+}
+
+void growBox(DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax, const DirectX::XMFLOAT3& otherMin, const DirectX::XMFLOAT3& otherMax)
+{
+	boundsMin = { (std::min)(boundsMin.x, otherMin.x), (std::min)(boundsMin.y, otherMin.y), (std::min)(boundsMin.z, otherMin.z) };
+	boundsMax = { (std::max)(boundsMax.x, otherMax.x), (std::max)(boundsMax.y, otherMax.y), (std::max)(boundsMax.z, otherMax.z) };
+}
+
+// Twice the box center, only compared with others of its kind
+float doubledCenter(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, UINT axis)
+{
+	switch (axis)
+	{
+	case 0:
+		return boundsMin.x + boundsMax.x;
+
+	case 1:
+		return boundsMin.y + boundsMax.y;
+
+	default:
+		break;
+	}
+
+	return boundsMin.z + boundsMax.z;
+}
+
+
+InstanceBvh::InstanceBvh()
+	: m_parallelDepth(0)
+{}
+
+
+void InstanceBvh::Build(const BoundsSoA& bounds, ThreadPool* pPool)
+{
+	m_nodes.clear();
+
+	if (bounds.count == 0)
+	{
+		m_instanceIndices.clear();
+		m_leafBoxes.clear();
+		return;
+	}
+
+	std::vector<BuildItem> items(bounds.count);
+
+	for (size_t idx = 0; idx < bounds.count; ++idx)
+	{
+		items[idx].boundsMin = { bounds.centerX[idx] - bounds.extentX[idx], bounds.centerY[idx] - bounds.extentY[idx], bounds.centerZ[idx] - bounds.extentZ[idx] };
+		items[idx].boundsMax = { bounds.centerX[idx] + bounds.extentX[idx], bounds.centerY[idx] + bounds.extentY[idx], bounds.centerZ[idx] + bounds.extentZ[idx] };
+		items[idx].instanceIdx = static_cast<UINT32>(idx);
+	}
+
+	// a binary tree with single instance leaves has 2n - 1 nodes
+	m_nodes.reserve(2 * bounds.count);
+	m_nodes.push_back({});
+
+	// about 4 subtrees per thread balance the uneven splits
+	UINT threadNum = pPool != nullptr ? pPool->GetThreadNum() : 1;
+
+	m_parallelDepth = 0;
+	while ((1u << m_parallelDepth) < threadNum * 4)
+	{
+		++m_parallelDepth;
+	}
+
+	std::vector<BuildTask> tasks;
+	BuildNode(items, m_nodes, 0, 0, static_cast<UINT32>(bounds.count), 0, threadNum > 1 ? &tasks : nullptr);
+
+	if (!tasks.empty())
+	{
+		std::vector<std::vector<Node>> subtrees(tasks.size());
+
+		pPool->ParallelFor(static_cast<UINT>(tasks.size()), [&](UINT taskIdx)
+			{
+				const BuildTask& task = tasks[taskIdx];
+				std::vector<Node>& nodes = subtrees[taskIdx];
+
+				nodes.reserve(2 * task.count);
+				nodes.push_back({});
+
+				BuildNode(items, nodes, 0, task.first, task.count, task.depth, nullptr);
+			}
+		);
+
+		// the subtree root replaces its task node and the rest is appended
+		for (size_t taskIdx = 0; taskIdx < tasks.size(); ++taskIdx)
+		{
+			std::vector<Node>& nodes = subtrees[taskIdx];
+			UINT32 base = static_cast<UINT32>(m_nodes.size());
+
+			for (auto& node : nodes)
+			{
+				if (node.count == 0)
+				{
+					node.leftOrFirst += base - 1;
+				}
+			}
+
+			m_nodes[tasks[taskIdx].nodeIdx] = nodes[0];
+			m_nodes.insert(m_nodes.end(), nodes.begin() + 1, nodes.end());
+		}
+	}
+
+	m_instanceIndices.resize(bounds.count);
+
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		m_instanceIndices[i] = items[i].instanceIdx;
+	}
+
+	FillLeafBoxes(bounds);
+}
+
+void InstanceBvh::BuildNode(
+	std::vector<BuildItem>& items,
+	std::vector<Node>& nodes,
+	UINT32 nodeIdx,
+	UINT32 first,
+	UINT32 count,
+	UINT depth,
+	std::vector<BuildTask>* pDeferredTasks
+)
+{
+	if (pDeferredTasks != nullptr && depth == m_parallelDepth && count >= ParallelMinInstanceNum)
+	{
+		pDeferredTasks->push_back({ nodeIdx, first, count, depth });
+		return;
+	}
+
+	Node node = {};
+	node.boundsMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+	node.boundsMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	for (UINT32 i = first; i < first + count; ++i)
+	{
+		growBox(node.boundsMin, node.boundsMax, items[i].boundsMin, items[i].boundsMax);
+	}
+
+	UINT32 leftCount = SplitRange(items, node, first, count, depth);
+
+	if (leftCount == 0)
+	{
+		node.leftOrFirst = first;
+		node.count = count;
+		nodes[nodeIdx] = node;
+
+		return;
+	}
+
+	UINT32 leftIdx = static_cast<UINT32>(nodes.size());
+
+	node.leftOrFirst = leftIdx;
+	node.count = 0;
+	nodes[nodeIdx] = node;
+
+	nodes.resize(nodes.size() + 2);
+
+	BuildNode(items, nodes, leftIdx, first, leftCount, depth + 1, pDeferredTasks);
+	BuildNode(items, nodes, leftIdx + 1, first + leftCount, count - leftCount, depth + 1, pDeferredTasks);
+}
+
+UINT32 InstanceBvh::SplitRange(std::vector<BuildItem>& items, const Node& node, UINT32 first, UINT32 count, UINT depth) const
+{
+	if (count <= 1 || depth >= MaxDepth)
+	{
+		return 0;
+	}
+
+	float centerMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float centerMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	for (UINT32 i = first; i < first + count; ++i)
+	{
+		for (UINT axis = 0; axis < 3; ++axis)
+		{
+			float center = doubledCenter(items[i].boundsMin, items[i].boundsMax, axis);
+
+			centerMin[axis] = (std::min)(centerMin[axis], center);
+			centerMax[axis] = (std::max)(centerMax[axis], center);
+		}
+	}
+
+	struct Bin
+	{
+		DirectX::XMFLOAT3 boundsMin;
+		DirectX::XMFLOAT3 boundsMax;
+		UINT32 count;
+	};
+
+	Bin bins[3][BinNum];
+	float scales[3];
+
+	for (UINT axis = 0; axis < 3; ++axis)
+	{
+		for (auto& bin : bins[axis])
+		{
+			bin = { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX }, 0 };
+		}
+
+		float extent = centerMax[axis] - centerMin[axis];
+		scales[axis] = extent > 0.0f ? BinNum / extent : 0.0f;
+	}
+
+	// all three axes are binned in one pass over the items
+	for (UINT32 i = first; i < first + count; ++i)
+	{
+		const BuildItem& item = items[i];
+
+		for (UINT axis = 0; axis < 3; ++axis)
+		{
+			UINT binIdx = (std::min)(static_cast<UINT>((doubledCenter(item.boundsMin, item.boundsMax, axis) - centerMin[axis]) * scales[axis]), BinNum - 1);
+			Bin& bin = bins[axis][binIdx];
+
+			growBox(bin.boundsMin, bin.boundsMax, item.boundsMin, item.boundsMax);
+			++bin.count;
+		}
+	}
+
+	float bestCost = FLT_MAX;
+	UINT bestAxis = 0;
+	UINT bestSplit = 0;
+
+	for (UINT axis = 0; axis < 3; ++axis)
+	{
+		if (scales[axis] == 0.0f)
+		{
+			continue;
+		}
+
+		// the right side of every split plane, swept from the last bin
+		float rightAreas[BinNum - 1];
+		UINT32 rightCounts[BinNum - 1];
+
+		Bin accumulated = { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX }, 0 };
+
+		for (UINT binIdx = BinNum - 1; binIdx > 0; --binIdx)
+		{
+			growBox(accumulated.boundsMin, accumulated.boundsMax, bins[axis][binIdx].boundsMin, bins[axis][binIdx].boundsMax);
+			accumulated.count += bins[axis][binIdx].count;
+
+			rightAreas[binIdx - 1] = accumulated.count > 0 ? halfArea(accumulated.boundsMin, accumulated.boundsMax) : 0.0f;
+			rightCounts[binIdx - 1] = accumulated.count;
+		}
+
+		accumulated = { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX }, 0 };
+
+		for (UINT binIdx = 0; binIdx < BinNum - 1; ++binIdx)
+		{
+			growBox(accumulated.boundsMin, accumulated.boundsMax, bins[axis][binIdx].boundsMin, bins[axis][binIdx].boundsMax);
+			accumulated.count += bins[axis][binIdx].count;
+
+			if (accumulated.count == 0 || rightCounts[binIdx] == 0)
+			{
+				continue;
+			}
+
+			float cost = halfArea(accumulated.boundsMin, accumulated.boundsMax) * accumulated.count + rightAreas[binIdx] * rightCounts[binIdx];
+
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = binIdx + 1;
+			}
+		}
+	}
+
+	// all centers coincide, any split is as good as another
+	if (bestCost == FLT_MAX)
+	{
+		return count <= MaxLeafSize ? 0 : count / 2;
+	}
+
+	// costs are compared multiplied by the node area, flat nodes have none
+	float area = halfArea(node.boundsMin, node.boundsMax);
+
+	if (count <= MaxLeafSize && count * area <= TraversalCost * area + bestCost)
+	{
+		return 0;
+	}
+
+	float scale = scales[bestAxis];
+
+	auto middle = std::partition(
+		items.begin() + first,
+		items.begin() + first + count,
+		[&](const BuildItem& item)
+		{
+			return (std::min)(static_cast<UINT>((doubledCenter(item.boundsMin, item.boundsMax, bestAxis) - centerMin[bestAxis]) * scale), BinNum - 1) < bestSplit;
+		}
+	);
+
+	return static_cast<UINT32>(middle - (items.begin() + first));
+}
+
+void InstanceBvh::FillLeafBoxes(const BoundsSoA& bounds)
+{
+	m_leafBoxes.resize(m_instanceIndices.size());
+
+	for (size_t i = 0; i < m_instanceIndices.size(); ++i)
+	{
+		UINT32 idx = m_instanceIndices[i];
+
+		m_leafBoxes[i].center = { bounds.centerX[idx], bounds.centerY[idx], bounds.centerZ[idx] };
+		m_leafBoxes[i].extents = { bounds.extentX[idx], bounds.extentY[idx], bounds.extentZ[idx] };
+	}
+}
+
+
+void InstanceBvh::Refit(const BoundsSoA& bounds)
+{
+	assert(bounds.count == m_instanceIndices.size());
+
+	FillLeafBoxes(bounds);
+
+	// children follow their parents, so the reverse order is bottom up
+	for (size_t nodeIdx = m_nodes.size(); nodeIdx-- > 0;)
+	{
+		Node& node = m_nodes[nodeIdx];
+
+		node.boundsMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+		node.boundsMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		if (node.count > 0)
+		{
+			for (UINT32 i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+			{
+				const Box& box = m_leafBoxes[i];
+
+				growBox(
+					node.boundsMin, node.boundsMax,
+					{ box.center.x - box.extents.x, box.center.y - box.extents.y, box.center.z - box.extents.z },
+					{ box.center.x + box.extents.x, box.center.y + box.extents.y, box.center.z + box.extents.z }
+				);
+			}
+		}
+		else
+		{
+			const Node& left = m_nodes[node.leftOrFirst];
+			const Node& right = m_nodes[node.leftOrFirst + 1];
+
+			growBox(node.boundsMin, node.boundsMax, left.boundsMin, left.boundsMax);
+			growBox(node.boundsMin, node.boundsMax, right.boundsMin, right.boundsMax);
+		}
+	}
+}
+
+
+void InstanceBvh::QueryFrustums(
+	const DirectX::XMFLOAT4* pPlanes,
+	UINT viewNum,
+	UINT planeNum,
+	std::vector<UINT8>& viewMasks
+) const
+{
+	assert(viewNum <= MaxViewNum && planeNum <= FrustumPlaneNum);
+
+	viewMasks.assign(m_instanceIndices.size(), 0);
+
+	if (m_nodes.empty() || viewNum == 0)
+	{
+		return;
+	}
+
+	// views still to test and views that contain the whole node
+	struct StackEntry
+	{
+		UINT32 nodeIdx;
+		UINT testMask;
+		UINT insideMask;
+	};
+
+	StackEntry stack[StackSize];
+	UINT stackSize = 0;
+
+	stack[stackSize++] = { 0, (1u << viewNum) - 1, 0 };
+
+	while (stackSize > 0)
+	{
+		StackEntry entry = stack[--stackSize];
+		const Node& node = m_nodes[entry.nodeIdx];
+
+		UINT testMask = entry.testMask;
+		UINT insideMask = entry.insideMask;
+
+		if (testMask != 0)
+		{
+			DirectX::XMFLOAT3 center = {
+				(node.boundsMin.x + node.boundsMax.x) * 0.5f,
+				(node.boundsMin.y + node.boundsMax.y) * 0.5f,
+				(node.boundsMin.z + node.boundsMax.z) * 0.5f
+			};
+			DirectX::XMFLOAT3 extents = {
+				(node.boundsMax.x - node.boundsMin.x) * 0.5f,
+				(node.boundsMax.y - node.boundsMin.y) * 0.5f,
+				(node.boundsMax.z - node.boundsMin.z) * 0.5f
+			};
+
+			for (UINT viewIdx = 0; viewIdx < viewNum; ++viewIdx)
+			{
+				UINT viewBit = 1u << viewIdx;
+
+				if ((testMask & viewBit) == 0)
+				{
+					continue;
+				}
+
+				Containment containment = classifyBox(pPlanes + viewIdx * FrustumPlaneNum, planeNum, center, extents);
+
+				if (containment != Containment::Intersects)
+				{
+					testMask &= ~viewBit;
+					insideMask |= containment == Containment::Inside ? viewBit : 0;
+				}
+			}
+		}
+
+		if ((testMask | insideMask) == 0)
+		{
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			stack[stackSize++] = { node.leftOrFirst + 1, testMask, insideMask };
+			stack[stackSize++] = { node.leftOrFirst, testMask, insideMask };
+
+			continue;
+		}
+
+		for (UINT32 i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+		{
+			const Box& box = m_leafBoxes[i];
+			UINT mask = insideMask;
+
+			for (UINT viewIdx = 0; viewIdx < viewNum; ++viewIdx)
+			{
+				UINT viewBit = 1u << viewIdx;
+
+				if ((testMask & viewBit) != 0
+					&& classifyBox(pPlanes + viewIdx * FrustumPlaneNum, planeNum, box.center, box.extents) != Containment::Outside)
+				{
+					mask |= viewBit;
+				}
+			}
+
+			viewMasks[m_instanceIndices[i]] = static_cast<UINT8>(mask);
+		}
+	}
+}
+
+void InstanceBvh::QuerySphere(const DirectX::XMFLOAT3& center, float radius, std::vector<UINT32>& result) const
+{
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	UINT32 stack[StackSize];
+	UINT stackSize = 0;
+
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = m_nodes[stack[--stackSize]];
+
+		DirectX::XMFLOAT3 nodeCenter = {
+			(node.boundsMin.x + node.boundsMax.x) * 0.5f,
+			(node.boundsMin.y + node.boundsMax.y) * 0.5f,
+			(node.boundsMin.z + node.boundsMax.z) * 0.5f
+		};
+		DirectX::XMFLOAT3 nodeExtents = {
+			(node.boundsMax.x - node.boundsMin.x) * 0.5f,
+			(node.boundsMax.y - node.boundsMin.y) * 0.5f,
+			(node.boundsMax.z - node.boundsMin.z) * 0.5f
+		};
+
+		if (!isSphereTouchingBox(center, radius, nodeCenter, nodeExtents))
+		{
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			stack[stackSize++] = node.leftOrFirst + 1;
+			stack[stackSize++] = node.leftOrFirst;
+
+			continue;
+		}
+
+		for (UINT32 i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+		{
+			if (isSphereTouchingBox(center, radius, m_leafBoxes[i].center, m_leafBoxes[i].extents))
+			{
+				result.push_back(m_instanceIndices[i]);
+			}
+		}
+	}
+}
+
+void InstanceBvh::QueryRay(
+	const DirectX::XMFLOAT3& origin,
+	const DirectX::XMFLOAT3& direction,
+	float maxDistance,
+	std::vector<UINT32>& result
+) const
+{
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	DirectX::XMFLOAT3 invDirection = { 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+
+	UINT32 stack[StackSize];
+	UINT stackSize = 0;
+
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = m_nodes[stack[--stackSize]];
+
+		DirectX::XMFLOAT3 nodeCenter = {
+			(node.boundsMin.x + node.boundsMax.x) * 0.5f,
+			(node.boundsMin.y + node.boundsMax.y) * 0.5f,
+			(node.boundsMin.z + node.boundsMax.z) * 0.5f
+		};
+		DirectX::XMFLOAT3 nodeExtents = {
+			(node.boundsMax.x - node.boundsMin.x) * 0.5f,
+			(node.boundsMax.y - node.boundsMin.y) * 0.5f,
+			(node.boundsMax.z - node.boundsMin.z) * 0.5f
+		};
+
+		if (!isRayHittingBox(origin, invDirection, maxDistance, nodeCenter, nodeExtents))
+		{
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			stack[stackSize++] = node.leftOrFirst + 1;
+			stack[stackSize++] = node.leftOrFirst;
+
+			continue;
+		}
+
+		for (UINT32 i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+		{
+			if (isRayHittingBox(origin, invDirection, maxDistance, m_leafBoxes[i].center, m_leafBoxes[i].extents))
+			{
+				result.push_back(m_instanceIndices[i]);
+			}
+		}
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include "framework.h"
+#include "frustumCulling.h"
+
+class ThreadPool;
+
+
+// Binned SAH hierarchy over the boxes of a BoundsSoA.
+// Instances keep their indices in the SoA, the tree is refitted when boxes move
+// and rebuilt when instances are added or removed.
+class InstanceBvh
+{
+public:
+	// Up to this many views are tested in one frustum traversal
+	static constexpr UINT MaxViewNum = 8;
+
+public:
+	InstanceBvh();
+
+	// The top levels are split on the calling thread, the subtrees below are built on the pool
+	void Build(const BoundsSoA& bounds, ThreadPool* pPool = nullptr);
+	// Recomputes the node boxes for moved instances, the topology is kept
+	void Refit(const BoundsSoA& bounds);
+
+	inline size_t GetInstanceNum() const { return m_instanceIndices.size(); }
+	inline size_t GetNodeNum() const { return m_nodes.size(); }
+
+	// pPlanes holds FrustumPlaneNum planes per view, the first planeNum of them are tested.
+	// viewMasks gets one bit per view for every instance.
+	void QueryFrustums(
+		const DirectX::XMFLOAT4* pPlanes,
+		UINT viewNum,
+		UINT planeNum,
+		std::vector<UINT8>& viewMasks
+	) const;
+
+	// Append the indices of the instances whose boxes are touched
+	void QuerySphere(const DirectX::XMFLOAT3& center, float radius, std::vector<UINT32>& result) const;
+	void QueryRay(
+		const DirectX::XMFLOAT3& origin,
+		const DirectX::XMFLOAT3& direction,
+		float maxDistance,
+		std::vector<UINT32>& result
+	) const;
+
+private:
+	// An inner node has count 0 and its children at leftOrFirst and leftOrFirst + 1,
+	// children always follow their parent in m_nodes
+	struct Node
+	{
+		DirectX::XMFLOAT3 boundsMin;
+		UINT32 leftOrFirst;
+		DirectX::XMFLOAT3 boundsMax;
+		UINT32 count;
+	};
+
+	// same center and extents as in the SoA, so instances pass the same tests as with CullBounds
+	struct Box
+	{
+		DirectX::XMFLOAT3 center;
+		DirectX::XMFLOAT3 extents;
+	};
+
+	// instance boxes are copied next to their indices, so the partitions stream through memory
+	struct BuildItem
+	{
+		DirectX::XMFLOAT3 boundsMin;
+		UINT32 instanceIdx;
+		DirectX::XMFLOAT3 boundsMax;
+	};
+
+	struct BuildTask
+	{
+		UINT32 nodeIdx;
+		UINT32 first;
+		UINT32 count;
+		UINT depth;
+	};
+
+	void BuildNode(
+		std::vector<BuildItem>& items,
+		std::vector<Node>& nodes,
+		UINT32 nodeIdx,
+		UINT32 first,
+		UINT32 count,
+		UINT depth,
+		std::vector<BuildTask>* pDeferredTasks
+	);
+	// Partitions the range by the best SAH split, returns the size of the left part or 0 for a leaf
+	UINT32 SplitRange(std::vector<BuildItem>& items, const Node& node, UINT32 first, UINT32 count, UINT depth) const;
+
+	void FillLeafBoxes(const BoundsSoA& bounds);
+
+private:
+	std::vector<Node> m_nodes;
+
+	// instance indices and their boxes in leaf order
+	std::vector<UINT32> m_instanceIndices;
+	std::vector<Box> m_leafBoxes;
+
+	UINT m_parallelDepth;
+};
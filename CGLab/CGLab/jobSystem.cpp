@@ -0,0 +1,341 @@
+#include "jobSystem.h"
+
+#include <algorithm>
+
+
+// a worker tries this many times to find a job before it goes to sleep
+static constexpr uint32_t IdleSpinNum = 64;
+
+// the system a worker thread belongs to, other threads are the owner of every system
+static thread_local const JobSystem* s_pThreadJobSystem = nullptr;
+static thread_local uint32_t s_threadIdx = 0;
+
+
+JobSystem::JobDeque::JobDeque()
+	: m_top(0)
+	, m_bottom(0)
+{
+	for (auto& job : m_jobs)
+	{
+		job.store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+
+bool JobSystem::JobDeque::Push(Job* pJob)
+{
+	int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+	int64_t top = m_top.load(std::memory_order_acquire);
+
+	if (bottom - top >= Capacity)
+	{
+		return false;
+	}
+
+	// thieves that see the new bottom see the job and what it was filled with
+	m_jobs[bottom & (Capacity - 1)].store(pJob, std::memory_order_relaxed);
+	m_bottom.store(bottom + 1, std::memory_order_release);
+
+	return true;
+}
+
+JobSystem::Job* JobSystem::JobDeque::Pop()
+{
+	int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+	m_bottom.store(bottom, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t top = m_top.load(std::memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* pJob = m_jobs[bottom & (Capacity - 1)].load(std::memory_order_relaxed);
+
+	// the last job may be stolen at the same time, the top decides who gets it
+	if (top == bottom)
+	{
+		if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			pJob = nullptr;
+		}
+
+		m_bottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+
+	return pJob;
+}
+
+JobSystem::Job* JobSystem::JobDeque::Steal()
+{
+	int64_t top = m_top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+	if (top >= bottom)
+	{
+		return nullptr;
+	}
+
+	Job* pJob = m_jobs[top & (Capacity - 1)].load(std::memory_order_relaxed);
+
+	if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+	{
+		return nullptr;
+	}
+
+	return pJob;
+}
+
+
+JobSystem* JobSystem::Create(uint32_t threadNum)
+{
+	JobSystem* pJobSystem = new JobSystem();
+
+	if (pJobSystem->Init(threadNum))
+	{
+		return pJobSystem;
+	}
+
+	delete pJobSystem;
+	return nullptr;
+}
+
+
+JobSystem::JobSystem()
+	: m_sleepingNum(0)
+	, m_queuedJobNum(0)
+	, m_isStopping(false)
+{}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isStopping.store(true);
+	}
+	m_wakeCV.notify_all();
+
+	for (auto& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+
+bool JobSystem::Init(uint32_t threadNum)
+{
+	if (threadNum == 0)
+	{
+		threadNum = (std::max)(std::thread::hardware_concurrency(), 1u);
+	}
+
+	for (uint32_t threadIdx = 0; threadIdx < threadNum; ++threadIdx)
+	{
+		m_threads.push_back(std::make_unique<ThreadData>());
+		m_threads.back()->jobs = std::make_unique<Job[]>(JobPoolSize);
+	}
+
+	for (uint32_t threadIdx = 1; threadIdx < threadNum; ++threadIdx)
+	{
+		m_workers.emplace_back(&JobSystem::WorkerLoop, this, threadIdx);
+	}
+
+	return true;
+}
+
+
+uint32_t JobSystem::GetThreadIdx() const
+{
+	return s_pThreadJobSystem == this ? s_threadIdx : 0;
+}
+
+JobSystem::Job* JobSystem::AllocateJob(uint32_t threadIdx)
+{
+	ThreadData& thread = *m_threads[threadIdx];
+	Job* pJob = &thread.jobs[thread.nextJob++ & (JobPoolSize - 1)];
+
+	// the pool wrapped around onto a job that is still queued or running, it may be one
+	// waiting further up this very stack, so the slot is not waited for
+	if (!pJob->isFree.load(std::memory_order_acquire))
+	{
+		pJob = new Job();
+		pJob->isHeap = true;
+	}
+
+	pJob->isFree.store(false, std::memory_order_relaxed);
+
+	return pJob;
+}
+
+
+void JobSystem::Run(JobFunction function, JobCounter* pCounter)
+{
+	uint32_t threadIdx = GetThreadIdx();
+
+	if (pCounter != nullptr)
+	{
+		pCounter->value.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	Job* pJob = AllocateJob(threadIdx);
+	pJob->function = std::move(function);
+	pJob->pCounter = pCounter;
+
+	if (!m_threads[threadIdx]->deque.Push(pJob))
+	{
+		Execute(pJob);
+		return;
+	}
+
+	// pairs with the sleeping count of the workers, one of the two sees the other
+	m_queuedJobNum.fetch_add(1, std::memory_order_seq_cst);
+
+	if (m_sleepingNum.load(std::memory_order_seq_cst) > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_wakeCV.notify_one();
+	}
+}
+
+void JobSystem::Wait(const JobCounter& counter)
+{
+	uint32_t threadIdx = GetThreadIdx();
+
+	while (!counter.IsDone())
+	{
+		Job* pJob = FindJob(threadIdx);
+
+		if (pJob != nullptr)
+		{
+			Execute(pJob);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+
+void JobSystem::ParallelFor(size_t count, size_t grainSize, const RangeFunction& task)
+{
+	grainSize = (std::max)(grainSize, size_t(1));
+
+	if (m_threads.size() == 1 || count <= grainSize)
+	{
+		for (size_t begin = 0; begin < count; begin += grainSize)
+		{
+			task(begin, (std::min)(begin + grainSize, count));
+		}
+		return;
+	}
+
+	JobCounter counter;
+	RunRange(0, count, grainSize, task, counter);
+	Wait(counter);
+}
+
+void JobSystem::RunRange(size_t begin, size_t end, size_t grainSize, const RangeFunction& task, JobCounter& counter)
+{
+	// the lower half stays on this thread until it fits the grain
+	while (end - begin > grainSize)
+	{
+		size_t middle = begin + (end - begin) / 2;
+
+		Run([this, middle, end, grainSize, &task, &counter]()
+			{
+				RunRange(middle, end, grainSize, task, counter);
+			},
+			&counter
+		);
+
+		end = middle;
+	}
+
+	task(begin, end);
+}
+
+
+JobSystem::Job* JobSystem::FindJob(uint32_t threadIdx)
+{
+	Job* pJob = m_threads[threadIdx]->deque.Pop();
+
+	uint32_t threadNum = static_cast<uint32_t>(m_threads.size());
+
+	for (uint32_t i = 1; pJob == nullptr && i < threadNum; ++i)
+	{
+		pJob = m_threads[(threadIdx + i) % threadNum]->deque.Steal();
+	}
+
+	if (pJob != nullptr)
+	{
+		m_queuedJobNum.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	return pJob;
+}
+
+void JobSystem::Execute(Job* pJob)
+{
+	pJob->function();
+	pJob->function = nullptr;
+
+	// the counter may be gone as soon as it is done, the slot as soon as it is free
+	JobCounter* pCounter = pJob->pCounter;
+
+	if (pJob->isHeap)
+	{
+		delete pJob;
+	}
+	else
+	{
+		pJob->isFree.store(true, std::memory_order_release);
+	}
+
+	if (pCounter != nullptr)
+	{
+		pCounter->value.fetch_sub(1, std::memory_order_acq_rel);
+	}
+}
+
+
+void JobSystem::WorkerLoop(uint32_t threadIdx)
+{
+	s_pThreadJobSystem = this;
+	s_threadIdx = threadIdx;
+
+	uint32_t idleNum = 0;
+
+	while (!m_isStopping.load(std::memory_order_acquire))
+	{
+		Job* pJob = FindJob(threadIdx);
+
+		if (pJob != nullptr)
+		{
+			Execute(pJob);
+			idleNum = 0;
+			continue;
+		}
+
+		if (++idleNum < IdleSpinNum)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		idleNum = 0;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		m_sleepingNum.fetch_add(1, std::memory_order_seq_cst);
+		m_wakeCV.wait(lock, [this]()
+			{
+				return m_queuedJobNum.load(std::memory_order_seq_cst) > 0 || m_isStopping.load(std::memory_order_relaxed);
+			}
+		);
+		m_sleepingNum.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Jobs still to finish, every job started with the counter decrements it once done
+struct JobCounter
+{
+	std::atomic<uint32_t> value{ 0 };
+
+	inline bool IsDone() const { return value.load(std::memory_order_acquire) == 0; }
+};
+
+
+// Work stealing job system. Every thread pushes and pops its jobs at the bottom of its own
+// Chase-Lev deque, idle threads steal the oldest jobs from the top of the others.
+// Jobs are started and waited for from the owner thread (any thread that is not a worker,
+// one at a time) or from other jobs. A waiting thread runs jobs until its counter is done,
+// so jobs may wait for the jobs they start.
+class JobSystem
+{
+public:
+	using JobFunction = std::function<void()>;
+	using RangeFunction = std::function<void(size_t begin, size_t end)>;
+
+	// job slots of a thread, jobs started while all of them are in use go to the heap
+	static constexpr size_t JobPoolSize = 4096;
+
+	// threadNum counts the owner thread, 0 picks the hardware thread count
+	static JobSystem* Create(uint32_t threadNum = 0);
+
+	~JobSystem();
+
+	inline uint32_t GetThreadNum() const { return static_cast<uint32_t>(m_threads.size()); }
+
+	// Queues the job on the deque of the calling thread. The counter is incremented at once
+	// and decremented when the job is done, a full deque runs the job right away
+	void Run(JobFunction function, JobCounter* pCounter = nullptr);
+	// Runs jobs until the counter is done
+	void Wait(const JobCounter& counter);
+
+	// Calls task for ranges of [0, count) of at most grainSize items and returns when all are done.
+	// The range is halved and the upper halves are queued, so thieves take the largest parts
+	void ParallelFor(size_t count, size_t grainSize, const RangeFunction& task);
+
+private:
+	// slots are reused once the job in them is done, jobs that find their slot busy are allocated on the heap
+	struct Job
+	{
+		JobFunction function;
+		JobCounter* pCounter = nullptr;
+		std::atomic<bool> isFree{ true };
+		bool isHeap = false;
+	};
+
+	// Fixed size Chase-Lev deque of one thread, only its owner pushes and pops
+	class JobDeque
+	{
+	public:
+		static constexpr int64_t Capacity = 4096;
+
+		JobDeque();
+
+		// false when the deque is full
+		bool Push(Job* pJob);
+		// newest job of the owner
+		Job* Pop();
+		// oldest job, nullptr when empty or lost to another thief
+		Job* Steal();
+
+	private:
+		alignas(64) std::atomic<int64_t> m_top;
+		alignas(64) std::atomic<int64_t> m_bottom;
+		std::atomic<Job*> m_jobs[Capacity];
+	};
+
+	struct alignas(64) ThreadData
+	{
+		JobDeque deque;
+
+		std::unique_ptr<Job[]> jobs;
+		size_t nextJob = 0;
+	};
+
+	JobSystem();
+
+	bool Init(uint32_t threadNum);
+
+	uint32_t GetThreadIdx() const;
+	Job* AllocateJob(uint32_t threadIdx);
+
+	// pops from the own deque first, then steals from the others
+	Job* FindJob(uint32_t threadIdx);
+	void Execute(Job* pJob);
+
+	void RunRange(size_t begin, size_t end, size_t grainSize, const RangeFunction& task, JobCounter& counter);
+
+	void WorkerLoop(uint32_t threadIdx);
+
+private:
+	// the owner thread is 0, worker i is i
+	std::vector<std::unique_ptr<ThreadData>> m_threads;
+	std::vector<std::thread> m_workers;
+
+	// idle workers sleep until a job is queued
+	std::mutex m_mutex;
+	std::condition_variable m_wakeCV;
+	std::atomic<uint32_t> m_sleepingNum;
+	std::atomic<int64_t> m_queuedJobNum;
+	std::atomic<bool> m_isStopping;
+};
@@ -1492,6 +1492,19 @@ namespace tinygltf {
 
         bool GetPreserveImageChannels() const { return preserve_image_channels_; }
 
+        ///
+        /// Specify whether external buffer files(.bin) and the GLB BIN chunk are
+        /// copied into `Buffer::data` or not(default = true).
+        /// When false, `Buffer::data` of such buffers is left empty and the user
+        /// is responsible for resolving `Buffer::uri` or the BIN chunk. Data URIs
+        /// are always decoded.
+        ///
+        void SetLoadBufferData(bool onoff) {
+            load_buffer_data_ = onoff;
+        }
+
+        bool GetLoadBufferData() const { return load_buffer_data_; }
+
     private:
         ///
         /// Loads glTF asset from string(memory).
@@ -1514,6 +1527,9 @@ namespace tinygltf {
         bool preserve_image_channels_ = false;  /// Default false(expand channels to
                                                 /// RGBA) for backward compatibility.
 
+        bool load_buffer_data_ = true;  /// Default true(copy .bin files and the
+                                        /// GLB BIN chunk into Buffer::data).
+
         // Warning & error messages
         std::string warn_;
         std::string err_;
@@ -4234,7 +4250,7 @@ namespace tinygltf {
         FsCallbacks* fs, const URICallbacks* uri_cb,
         const std::string& basedir, bool is_binary = false,
         const unsigned char* bin_data = nullptr,
-        size_t bin_size = 0) {
+        size_t bin_size = 0, bool load_data = true) {
         size_t byteLength;
         if (!ParseUnsignedProperty(&byteLength, err, o, "byteLength", true,
             "Buffer")) {
@@ -4277,7 +4293,7 @@ namespace tinygltf {
                         return false;
                     }
                 }
-                else {
+                else if (load_data) {
                     // External .bin file.
                     std::string decoded_uri;
                     if (!uri_cb->decode(buffer->uri, &decoded_uri, uri_cb->user_data)) {
@@ -4312,8 +4328,10 @@ namespace tinygltf {
                 }
 
                 // Read buffer data
-                buffer->data.resize(static_cast<size_t>(byteLength));
-                memcpy(&(buffer->data.at(0)), bin_data, static_cast<size_t>(byteLength));
+                if (load_data) {
+                    buffer->data.resize(static_cast<size_t>(byteLength));
+                    memcpy(&(buffer->data.at(0)), bin_data, static_cast<size_t>(byteLength));
+                }
             }
 
         }
@@ -4328,7 +4346,7 @@ namespace tinygltf {
                     return false;
                 }
             }
-            else {
+            else if (load_data) {
                 // Assume external .bin file.
                 std::string decoded_uri;
                 if (!uri_cb->decode(buffer->uri, &decoded_uri, uri_cb->user_data)) {
@@ -5889,7 +5907,8 @@ namespace tinygltf {
                 Buffer buffer;
                 if (!ParseBuffer(&buffer, err, o,
                     store_original_json_for_extras_and_extensions_, &fs,
-                    &uri_cb, base_dir, is_binary_, bin_data_, bin_size_)) {
+                    &uri_cb, base_dir, is_binary_, bin_data_, bin_size_,
+                    load_buffer_data_)) {
                     return false;
                 }
 
@@ -6191,6 +6210,23 @@ namespace tinygltf {
                     }
                     const Buffer& buffer = model->buffers[size_t(bufferView.buffer)];
 
+                    const unsigned char* buffer_data =
+                        buffer.data.empty() ? nullptr : buffer.data.data();
+
+                    if (buffer_data == nullptr && is_binary_ && buffer.uri.empty()) {
+                        // GLB BIN chunk is not copied(see SetLoadBufferData()),
+                        // but it is still valid here.
+                        buffer_data = bin_data_;
+                    }
+
+                    if (buffer_data == nullptr) {
+                        // Buffer is not loaded(see SetLoadBufferData()),
+                        // leave the image for the user to decode.
+                        model->images.emplace_back(std::move(image));
+                        ++idx;
+                        return true;
+                    }
+
                     if (*LoadImageData == nullptr) {
                         if (err) {
                             (*err) += "No LoadImageData callback specified.\n";
@@ -6199,7 +6235,7 @@ namespace tinygltf {
                     }
                     bool ret = LoadImageData(
                         &image, idx, err, warn, image.width, image.height,
-                        &buffer.data[bufferView.byteOffset],
+                        buffer_data + bufferView.byteOffset,
                         static_cast<int>(bufferView.byteLength), load_image_user_data);
                     if (!ret) {
                         return false;
@@ -0,0 +1,131 @@
+#include "mappedFile.h"
+
+
+MappedFile* MappedFile::Open(const std::string& fileName, bool mapWholeFile)
+{
+	MappedFile* pFile = new MappedFile();
+
+	if (pFile->Init(fileName, mapWholeFile))
+	{
+		return pFile;
+	}
+
+	delete pFile;
+	return nullptr;
+}
+
+
+MappedFile::MappedFile()
+	: m_file(INVALID_HANDLE_VALUE)
+	, m_mapping(nullptr)
+	, m_pData(nullptr)
+	, m_size(0)
+{}
+
+MappedFile::~MappedFile()
+{
+	if (m_pData != nullptr)
+	{
+		UnmapViewOfFile(m_pData);
+	}
+
+	if (m_mapping != nullptr)
+	{
+		CloseHandle(m_mapping);
+	}
+
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+	}
+}
+
+
+bool MappedFile::Init(const std::string& fileName, bool mapWholeFile)
+{
+	m_fileName = fileName;
+
+	m_file = CreateFileA(
+		fileName.c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+		nullptr
+	);
+
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize = {};
+
+	if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		return false;
+	}
+
+	m_size = static_cast<size_t>(fileSize.QuadPart);
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (m_mapping == nullptr)
+	{
+		return false;
+	}
+
+	if (!mapWholeFile)
+	{
+		return true;
+	}
+
+	m_pData = static_cast<const UINT8*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+
+	return m_pData != nullptr;
+}
+
+
+MappedRange MappedFile::MapRange(size_t offset, size_t size) const
+{
+	MappedRange range;
+
+	if (size == 0 || offset + size > m_size)
+	{
+		return range;
+	}
+
+	SYSTEM_INFO systemInfo = {};
+	GetSystemInfo(&systemInfo);
+
+	// view offsets must be multiples of the allocation granularity
+	UINT64 viewOffset = offset - offset % systemInfo.dwAllocationGranularity;
+	size_t viewSize = size + static_cast<size_t>(offset - viewOffset);
+
+	range.pView = static_cast<const UINT8*>(MapViewOfFile(
+		m_mapping,
+		FILE_MAP_READ,
+		static_cast<DWORD>(viewOffset >> 32),
+		static_cast<DWORD>(viewOffset & 0xFFFFFFFF),
+		viewSize
+	));
+
+	if (range.pView != nullptr)
+	{
+		range.pData = range.pView + (offset - viewOffset);
+		range.size = size;
+	}
+
+	return range;
+}
+
+void MappedFile::UnmapRange(MappedRange& range)
+{
+	if (range.pView != nullptr)
+	{
+		UnmapViewOfFile(range.pView);
+	}
+
+	range = MappedRange();
+}
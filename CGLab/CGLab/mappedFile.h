@@ -0,0 +1,40 @@
+#pragma once
+#include "framework.h"
+
+
+struct MappedRange
+{
+	const UINT8* pView = nullptr;
+	const UINT8* pData = nullptr;
+	size_t size = 0;
+};
+
+
+class MappedFile
+{
+public:
+	static MappedFile* Open(const std::string& fileName, bool mapWholeFile = true);
+
+	~MappedFile();
+
+	inline const std::string& GetFileName() const { return m_fileName; }
+	inline const UINT8* GetData() const { return m_pData; }
+	inline size_t GetSize() const { return m_size; }
+
+	MappedRange MapRange(size_t offset, size_t size) const;
+	static void UnmapRange(MappedRange& range);
+
+private:
+	MappedFile();
+
+	bool Init(const std::string& fileName, bool mapWholeFile);
+
+private:
+	std::string m_fileName;
+
+	HANDLE m_file;
+	HANDLE m_mapping;
+
+	const UINT8* m_pData;
+	size_t m_size;
+};
@@ -0,0 +1,373 @@
+#include "meshCache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+
+struct MeshCacheSection
+{
+	UINT64 offset;
+	UINT64 count;
+};
+
+struct MeshCacheHeader
+{
+	UINT32 magic;
+	UINT32 version;
+	UINT64 sourceHash;
+	UINT32 cookFlags;
+	UINT32 reserved;
+	UINT64 fileSize;
+	double coldLoadTimeMs;
+
+	MeshCacheSection meshes;
+	MeshCacheSection primitives;
+	MeshCacheSection lods;
+	MeshCacheSection meshlets;
+	MeshCacheSection samplers;
+	MeshCacheSection images;
+	MeshCacheSection vertices;
+	MeshCacheSection indexData;
+	MeshCacheSection strings;
+	MeshCacheSection blobs;
+};
+
+static constexpr UINT64 MeshCacheAlignment = 16;
+
+static constexpr UINT64 FNVOffsetBasis = 0xCBF29CE484222325ull;
+static constexpr UINT64 FNVPrime = 0x100000001B3ull;
+
+
+UINT64 hashFNV1a(UINT64 hash, const void* pData, size_t size)
+{
+	const UINT8* pBytes = static_cast<const UINT8*>(pData);
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= pBytes[i];
+		hash *= FNVPrime;
+	}
+
+	return hash;
+}
+
+UINT64 alignOffset(UINT64 offset)
+{
+	return (offset + MeshCacheAlignment - 1) / MeshCacheAlignment * MeshCacheAlignment;
+}
+
+template <class T>
+MeshCacheSection placeSection(const std::vector<T>& data, UINT64& offset)
+{
+	MeshCacheSection section = { alignOffset(offset), data.size() };
+	offset = section.offset + data.size() * sizeof(T);
+
+	return section;
+}
+
+template <class T>
+void writeSection(std::ofstream& file, const MeshCacheSection& section, const std::vector<T>& data)
+{
+	static const char padding[MeshCacheAlignment] = {};
+
+	UINT64 position = static_cast<UINT64>(file.tellp());
+	file.write(padding, static_cast<std::streamsize>(section.offset - position));
+	file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(T)));
+}
+
+template <class T>
+bool readSection(const MappedFile* pFile, const MeshCacheSection& section, CookedArray<T>& array)
+{
+	if (section.offset % MeshCacheAlignment != 0
+		|| section.offset > pFile->GetSize()
+		|| section.count > (pFile->GetSize() - section.offset) / sizeof(T))
+	{
+		return false;
+	}
+
+	array.pData = reinterpret_cast<const T*>(pFile->GetData() + section.offset);
+	array.count = static_cast<size_t>(section.count);
+
+	return true;
+}
+
+bool validateView(const CookedModelView& view)
+{
+	if (view.strings.count > 0 && view.strings[view.strings.count - 1] != '\0')
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < view.meshes.count; ++i)
+	{
+		const CookedMesh& mesh = view.meshes[i];
+		UINT64 indexSize = mesh.indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(UINT16) : sizeof(UINT32);
+
+		if ((mesh.indexFormat != DXGI_FORMAT_R16_UINT && mesh.indexFormat != DXGI_FORMAT_R32_UINT)
+			|| static_cast<UINT64>(mesh.firstVertex) + mesh.vertexCount > view.vertices.count
+			|| mesh.indexDataOffset + mesh.indexCount * indexSize > view.indexData.count
+			|| static_cast<UINT64>(mesh.firstPrimitive) + mesh.primitiveCount > view.primitives.count)
+		{
+			return false;
+		}
+
+		for (UINT32 j = 0; j < mesh.primitiveCount; ++j)
+		{
+			const CookedPrimitive& primitive = view.primitives[mesh.firstPrimitive + j];
+
+			if (static_cast<UINT64>(primitive.firstIndex) + primitive.indexCount > mesh.indexCount
+				|| primitive.baseVertex < 0
+				|| static_cast<UINT32>(primitive.baseVertex) > mesh.vertexCount
+				|| primitive.lodCount >= MaxLodNum
+				|| static_cast<UINT64>(primitive.firstLod) + primitive.lodCount > view.lods.count
+				|| static_cast<UINT64>(primitive.firstMeshlet) + primitive.meshletCount > view.meshlets.count)
+			{
+				return false;
+			}
+
+			for (UINT32 k = 0; k < primitive.meshletCount; ++k)
+			{
+				const CookedMeshlet& meshlet = view.meshlets[primitive.firstMeshlet + k];
+
+				if (static_cast<UINT64>(meshlet.firstIndex) + meshlet.indexCount > mesh.indexCount)
+				{
+					return false;
+				}
+			}
+
+			for (UINT32 k = 0; k < primitive.lodCount; ++k)
+			{
+				const CookedLod& lod = view.lods[primitive.firstLod + k];
+
+				if (static_cast<UINT64>(lod.firstIndex) + lod.indexCount > mesh.indexCount)
+				{
+					return false;
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < view.primitives.count; ++i)
+	{
+		const CookedPrimitive& primitive = view.primitives[i];
+		INT32 images[] = { primitive.colorImage, primitive.normalImage, primitive.metalicRoughnessImage, primitive.emissiveImage };
+
+		for (INT32 imageIdx : images)
+		{
+			if (imageIdx != CookedNone && (imageIdx < 0 || static_cast<size_t>(imageIdx) >= view.images.count))
+			{
+				return false;
+			}
+		}
+
+		if (primitive.sampler != CookedNone && (primitive.sampler < 0 || static_cast<size_t>(primitive.sampler) >= view.samplers.count))
+		{
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < view.images.count; ++i)
+	{
+		const CookedImage& image = view.images[i];
+
+		if (image.fileNameOffset == CookedInlineImage)
+		{
+			if (image.dataOffset > view.blobs.count || image.dataSize > view.blobs.count - image.dataOffset)
+			{
+				return false;
+			}
+		}
+		else if (image.fileNameOffset >= view.strings.count)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+UINT32 CookedModel::AddString(const std::string& str)
+{
+	UINT32 offset = static_cast<UINT32>(strings.size());
+	strings.insert(strings.end(), str.c_str(), str.c_str() + str.size() + 1);
+
+	return offset;
+}
+
+CookedModelView CookedModel::GetView() const
+{
+	CookedModelView view;
+
+	view.meshes = { meshes.data(), meshes.size() };
+	view.primitives = { primitives.data(), primitives.size() };
+	view.lods = { lods.data(), lods.size() };
+	view.meshlets = { meshlets.data(), meshlets.size() };
+	view.samplers = { samplers.data(), samplers.size() };
+	view.images = { images.data(), images.size() };
+	view.vertices = { vertices.data(), vertices.size() };
+	view.indexData = { indexData.data(), indexData.size() };
+	view.strings = { strings.data(), strings.size() };
+	view.blobs = { blobs.data(), blobs.size() };
+
+	return view;
+}
+
+
+MeshCache* MeshCache::Open(const std::string& fileName, UINT64 sourceHash, UINT32 cookFlags)
+{
+	MeshCache* pCache = new MeshCache();
+
+	if (pCache->Init(fileName, sourceHash, cookFlags))
+	{
+		return pCache;
+	}
+
+	delete pCache;
+	return nullptr;
+}
+
+bool MeshCache::Write(
+	const std::string& fileName,
+	const CookedModel& model,
+	UINT64 sourceHash,
+	double coldLoadTimeMs
+)
+{
+	MeshCacheHeader header = {};
+	header.magic = MeshCacheMagic;
+	header.version = MeshCacheVersion;
+	header.sourceHash = sourceHash;
+	header.cookFlags = model.cookFlags;
+	header.coldLoadTimeMs = coldLoadTimeMs;
+
+	UINT64 offset = sizeof(MeshCacheHeader);
+
+	header.meshes = placeSection(model.meshes, offset);
+	header.primitives = placeSection(model.primitives, offset);
+	header.lods = placeSection(model.lods, offset);
+	header.meshlets = placeSection(model.meshlets, offset);
+	header.samplers = placeSection(model.samplers, offset);
+	header.images = placeSection(model.images, offset);
+	header.vertices = placeSection(model.vertices, offset);
+	header.indexData = placeSection(model.indexData, offset);
+	header.strings = placeSection(model.strings, offset);
+	header.blobs = placeSection(model.blobs, offset);
+
+	header.fileSize = offset;
+
+	std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	writeSection(file, header.meshes, model.meshes);
+	writeSection(file, header.primitives, model.primitives);
+	writeSection(file, header.lods, model.lods);
+	writeSection(file, header.meshlets, model.meshlets);
+	writeSection(file, header.samplers, model.samplers);
+	writeSection(file, header.images, model.images);
+	writeSection(file, header.vertices, model.vertices);
+	writeSection(file, header.indexData, model.indexData);
+	writeSection(file, header.strings, model.strings);
+	writeSection(file, header.blobs, model.blobs);
+
+	return file.good();
+}
+
+std::string MeshCache::GetFileName(const std::string& pathToModel)
+{
+	return pathToModel + "/scene.cgmesh";
+}
+
+UINT64 MeshCache::ComputeSourceHash(const std::string& pathToModel)
+{
+	namespace fs = std::filesystem;
+
+	std::error_code ec;
+	std::vector<fs::path> files;
+
+	for (fs::recursive_directory_iterator it(pathToModel, ec), end; !ec && it != end; it.increment(ec))
+	{
+		if (it->is_regular_file(ec) && it->path().extension() != ".cgmesh")
+		{
+			files.push_back(it->path());
+		}
+	}
+
+	// directory iteration order is unspecified
+	std::sort(files.begin(), files.end());
+
+	UINT64 hash = FNVOffsetBasis;
+
+	for (const auto& path : files)
+	{
+		std::string name = path.lexically_relative(pathToModel).generic_string();
+		UINT64 size = static_cast<UINT64>(fs::file_size(path, ec));
+		INT64 writeTime = static_cast<INT64>(fs::last_write_time(path, ec).time_since_epoch().count());
+
+		hash = hashFNV1a(hash, name.c_str(), name.size() + 1);
+		hash = hashFNV1a(hash, &size, sizeof(size));
+		hash = hashFNV1a(hash, &writeTime, sizeof(writeTime));
+	}
+
+	return hash;
+}
+
+
+MeshCache::MeshCache()
+	: m_pFile(nullptr)
+	, m_coldLoadTimeMs(0.0)
+{}
+
+MeshCache::~MeshCache()
+{
+	delete m_pFile;
+}
+
+
+bool MeshCache::Init(const std::string& fileName, UINT64 sourceHash, UINT32 cookFlags)
+{
+	if (!std::filesystem::exists(fileName))
+	{
+		return false;
+	}
+
+	m_pFile = MappedFile::Open(fileName);
+
+	if (m_pFile == nullptr || m_pFile->GetSize() < sizeof(MeshCacheHeader))
+	{
+		return false;
+	}
+
+	MeshCacheHeader header;
+	memcpy(&header, m_pFile->GetData(), sizeof(header));
+
+	if (header.magic != MeshCacheMagic
+		|| header.version != MeshCacheVersion
+		|| header.sourceHash != sourceHash
+		|| header.cookFlags != cookFlags
+		|| header.fileSize != m_pFile->GetSize())
+	{
+		return false;
+	}
+
+	m_coldLoadTimeMs = header.coldLoadTimeMs;
+
+	return readSection(m_pFile, header.meshes, m_view.meshes)
+		&& readSection(m_pFile, header.primitives, m_view.primitives)
+		&& readSection(m_pFile, header.lods, m_view.lods)
+		&& readSection(m_pFile, header.meshlets, m_view.meshlets)
+		&& readSection(m_pFile, header.samplers, m_view.samplers)
+		&& readSection(m_pFile, header.images, m_view.images)
+		&& readSection(m_pFile, header.vertices, m_view.vertices)
+		&& readSection(m_pFile, header.indexData, m_view.indexData)
+		&& readSection(m_pFile, header.strings, m_view.strings)
+		&& readSection(m_pFile, header.blobs, m_view.blobs)
+		&& validateView(m_view);
+}
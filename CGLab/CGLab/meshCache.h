@@ -0,0 +1,192 @@
+#pragma once
+#include "framework.h"
+#include "rendererContext.h"
+#include "mappedFile.h"
+
+
+// Cooked model layout shared by the .cgmesh files and the in-memory cook result.
+// Every record is POD and refers to other data by index or offset only,
+// so a mapped file is used in place.
+
+static constexpr UINT32 MeshCacheMagic = 0x48534D43; // "CMSH"
+static constexpr UINT32 MeshCacheVersion = 4;
+
+// cook settings a cache was written with, a mismatch makes it stale
+static constexpr UINT32 CookOptimizedMeshes = 0x1;
+static constexpr UINT32 CookMeshLods = 0x2;
+static constexpr UINT32 CookMeshlets = 0x4;
+static constexpr UINT32 CookLodLevelShift = 8;	// the LOD level count is kept above the flags
+
+// including the full detail level
+static constexpr UINT32 MaxLodNum = 8;
+
+static constexpr INT32 CookedNone = -1;
+static constexpr UINT32 CookedInlineImage = 0xFFFFFFFF;
+
+struct CookedMesh
+{
+	DirectX::XMFLOAT4X4 modelMatrix;
+
+	UINT32 firstVertex;
+	UINT32 vertexCount;
+
+	UINT64 indexDataOffset;
+	UINT32 indexCount;
+	UINT32 indexFormat;
+
+	UINT32 firstPrimitive;
+	UINT32 primitiveCount;
+};
+
+struct CookedPrimitive
+{
+	UINT32 firstIndex;
+	UINT32 indexCount;
+	INT32 baseVertex;
+	UINT32 topology;
+
+	INT32 colorImage;
+	INT32 normalImage;
+	INT32 metalicRoughnessImage;
+	INT32 emissiveImage;
+	INT32 sampler;
+
+	// simplified versions, the full detail range is not part of them
+	UINT32 firstLod;
+	UINT32 lodCount;
+
+	// clusters of the full detail range, none for other topologies or when not cooked
+	UINT32 firstMeshlet;
+	UINT32 meshletCount;
+
+	DirectX::XMFLOAT3 boundsMin;
+	DirectX::XMFLOAT3 boundsMax;
+};
+
+// Index range of a simplified primitive, it shares the vertices and the base vertex of the full one
+struct CookedLod
+{
+	UINT32 firstIndex;
+	UINT32 indexCount;
+	float error;		// largest collapse distance in model units
+	UINT32 reserved;
+};
+
+// Run of consecutive triangles of a primitive with the bounds used to cull it,
+// firstIndex is relative to the mesh index range like the primitive one
+struct CookedMeshlet
+{
+	UINT32 firstIndex;
+	UINT32 indexCount;
+
+	DirectX::XMFLOAT3 center;
+	float radius;
+
+	// the outward normals of all triangles lie in the cone around coneAxis,
+	// coneCutoff is the sine of its half angle and 1 when the cone is too wide to cull
+	DirectX::XMFLOAT3 coneAxis;
+	float coneCutoff;
+};
+
+// Encoded image, either a range of a source file relative to the model directory
+// or, for fileNameOffset == CookedInlineImage, a range of the blob data
+struct CookedImage
+{
+	UINT32 fileNameOffset;
+	UINT32 reserved;
+	UINT64 dataOffset;
+	UINT64 dataSize;
+};
+
+
+template <class T>
+struct CookedArray
+{
+	const T* pData = nullptr;
+	size_t count = 0;
+
+	inline const T& operator[](size_t idx) const
+	{
+		assert(idx < count);
+		return pData[idx];
+	}
+
+	inline size_t Size() const { return count; }
+};
+
+struct CookedModelView
+{
+	CookedArray<CookedMesh> meshes;
+	CookedArray<CookedPrimitive> primitives;
+	CookedArray<CookedLod> lods;
+	CookedArray<CookedMeshlet> meshlets;
+	CookedArray<D3D11_SAMPLER_DESC> samplers;
+	CookedArray<CookedImage> images;
+	CookedArray<Vertex> vertices;
+	CookedArray<UINT8> indexData;
+	CookedArray<char> strings;
+	CookedArray<UINT8> blobs;
+
+	inline const char* GetString(UINT32 offset) const
+	{
+		assert(offset < strings.count);
+		return strings.pData + offset;
+	}
+};
+
+struct CookedModel
+{
+	std::vector<CookedMesh> meshes;
+	std::vector<CookedPrimitive> primitives;
+	std::vector<CookedLod> lods;
+	std::vector<CookedMeshlet> meshlets;
+	std::vector<D3D11_SAMPLER_DESC> samplers;
+	std::vector<CookedImage> images;
+	std::vector<Vertex> vertices;
+	std::vector<UINT8> indexData;
+	std::vector<char> strings;
+	std::vector<UINT8> blobs;
+
+	UINT32 cookFlags = 0;
+
+	UINT32 AddString(const std::string& str);
+
+	CookedModelView GetView() const;
+};
+
+
+class MeshCache
+{
+public:
+	// Returns nullptr if the file is missing, truncated, of another version or stale
+	static MeshCache* Open(const std::string& fileName, UINT64 sourceHash, UINT32 cookFlags);
+
+	static bool Write(
+		const std::string& fileName,
+		const CookedModel& model,
+		UINT64 sourceHash,
+		double coldLoadTimeMs
+	);
+
+	static std::string GetFileName(const std::string& pathToModel);
+
+	// Hash of names, sizes and write times of every source file in the model directory
+	static UINT64 ComputeSourceHash(const std::string& pathToModel);
+
+	~MeshCache();
+
+	inline const CookedModelView& GetView() const { return m_view; }
+	inline double GetColdLoadTimeMs() const { return m_coldLoadTimeMs; }
+	inline size_t GetSize() const { return m_pFile->GetSize(); }
+
+private:
+	MeshCache();
+
+	bool Init(const std::string& fileName, UINT64 sourceHash, UINT32 cookFlags);
+
+private:
+	MappedFile* m_pFile;
+
+	CookedModelView m_view;
+	double m_coldLoadTimeMs;
+};
@@ -0,0 +1,353 @@
+#include "meshOptimizer.h"
+
+#include <algorithm>
+
+
+VertexCacheStats AnalyzeVertexCache(
+	const UINT32* pIndices,
+	size_t indexCount,
+	size_t vertexCount,
+	UINT cacheSize
+)
+{
+	VertexCacheStats stats;
+
+	if (indexCount < 3 || vertexCount == 0)
+	{
+		return stats;
+	}
+
+	// a vertex is in the cache while fewer than cacheSize misses happened since it was loaded
+	std::vector<size_t> loadTime(vertexCount, 0);
+	std::vector<bool> isUsed(vertexCount, false);
+
+	size_t misses = 0;
+	size_t usedVertexCount = 0;
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		UINT32 index = pIndices[i];
+
+		if (!isUsed[index])
+		{
+			isUsed[index] = true;
+			++usedVertexCount;
+		}
+		else if (misses - loadTime[index] < cacheSize)
+		{
+			continue;
+		}
+
+		++misses;
+		loadTime[index] = misses;
+	}
+
+	stats.acmr = static_cast<float>(misses) / (indexCount / 3);
+	stats.atvr = static_cast<float>(misses) / usedVertexCount;
+
+	return stats;
+}
+
+
+void MeshOptimizationStats::Add(
+	const VertexCacheStats& primitiveBefore,
+	const VertexCacheStats& primitiveAfter,
+	size_t primitiveTriangleCount
+)
+{
+	if (primitiveTriangleCount == 0)
+	{
+		return;
+	}
+
+	float weight = static_cast<float>(primitiveTriangleCount) / (triangleCount + primitiveTriangleCount);
+
+	before.acmr += (primitiveBefore.acmr - before.acmr) * weight;
+	before.atvr += (primitiveBefore.atvr - before.atvr) * weight;
+	after.acmr += (primitiveAfter.acmr - after.acmr) * weight;
+	after.atvr += (primitiveAfter.atvr - after.atvr) * weight;
+
+	triangleCount += primitiveTriangleCount;
+}
+
+
+void OptimizeVertexCache(
+	UINT32* pIndices,
+	size_t indexCount,
+	size_t vertexCount,
+	std::vector<size_t>& clusters,
+	UINT cacheSize
+)
+{
+	clusters.clear();
+
+	size_t triangleCount = indexCount / 3;
+
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// vertex -> triangles adjacency
+	std::vector<UINT32> liveTriangles(vertexCount, 0);
+
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		++liveTriangles[pIndices[i]];
+	}
+
+	std::vector<size_t> adjacencyOffsets(vertexCount + 1, 0);
+
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+
+	std::vector<UINT32> adjacency(triangleCount * 3);
+	std::vector<size_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		adjacency[adjacencyFill[pIndices[i]]++] = static_cast<UINT32>(i / 3);
+	}
+
+	std::vector<UINT32> sourceIndices(pIndices, pIndices + triangleCount * 3);
+	std::vector<bool> isEmitted(triangleCount, false);
+	std::vector<size_t> cacheTime(vertexCount, 0);
+	std::vector<UINT32> deadEnds;
+	std::vector<UINT32> candidates;
+
+	size_t time = cacheSize + 1;
+	size_t outIdx = 0;
+	size_t scanCursor = 0;
+
+	INT64 fanVertex = sourceIndices[0];
+	clusters.push_back(0);
+
+	while (fanVertex >= 0)
+	{
+		candidates.clear();
+
+		for (size_t a = adjacencyOffsets[fanVertex]; a < adjacencyOffsets[fanVertex + 1]; ++a)
+		{
+			UINT32 triangle = adjacency[a];
+
+			if (isEmitted[triangle])
+			{
+				continue;
+			}
+
+			for (UINT k = 0; k < 3; ++k)
+			{
+				UINT32 v = sourceIndices[triangle * 3 + k];
+
+				pIndices[outIdx++] = v;
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+
+				--liveTriangles[v];
+
+				if (time - cacheTime[v] > cacheSize)
+				{
+					cacheTime[v] = time++;
+				}
+			}
+
+			isEmitted[triangle] = true;
+		}
+
+		// prefer the candidate that stays in the cache while all its triangles are emitted
+		fanVertex = -1;
+		size_t bestPriority = 0;
+
+		for (UINT32 v : candidates)
+		{
+			if (liveTriangles[v] == 0)
+			{
+				continue;
+			}
+
+			size_t priority = 0;
+
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+			{
+				priority = time - cacheTime[v];
+			}
+
+			if (priority > bestPriority)
+			{
+				fanVertex = v;
+				bestPriority = priority;
+			}
+		}
+
+		if (fanVertex >= 0)
+		{
+			continue;
+		}
+
+		// dead end, the next fan starts from a cold cache
+		while (!deadEnds.empty() && fanVertex < 0)
+		{
+			UINT32 v = deadEnds.back();
+			deadEnds.pop_back();
+
+			if (liveTriangles[v] > 0)
+			{
+				fanVertex = v;
+			}
+		}
+
+		while (fanVertex < 0 && scanCursor < vertexCount)
+		{
+			if (liveTriangles[scanCursor] > 0)
+			{
+				fanVertex = static_cast<INT64>(scanCursor);
+			}
+			++scanCursor;
+		}
+
+		if (fanVertex >= 0)
+		{
+			clusters.push_back(outIdx);
+		}
+	}
+}
+
+
+DirectX::XMVECTOR GetOutwardNormal(const Vertex* pVertices, const UINT32* pTriangle)
+{
+	DirectX::XMVECTOR p0 = DirectX::XMLoadFloat3(&pVertices[pTriangle[0]].position);
+	DirectX::XMVECTOR p1 = DirectX::XMLoadFloat3(&pVertices[pTriangle[1]].position);
+	DirectX::XMVECTOR p2 = DirectX::XMLoadFloat3(&pVertices[pTriangle[2]].position);
+
+	return DirectX::XMVector3Cross(DirectX::XMVectorSubtract(p2, p0), DirectX::XMVectorSubtract(p1, p0));
+}
+
+void OptimizeOverdraw(
+	UINT32* pIndices,
+	size_t indexCount,
+	const Vertex* pVertices,
+	size_t vertexCount,
+	const std::vector<size_t>& clusters
+)
+{
+	size_t triangleIndexCount = indexCount - indexCount % 3;
+
+	if (clusters.size() < 2 || vertexCount == 0)
+	{
+		return;
+	}
+
+	struct Cluster
+	{
+		size_t begin;
+		size_t end;
+		float sortKey;
+	};
+
+	std::vector<Cluster> sortedClusters(clusters.size());
+
+	DirectX::XMVECTOR meshCenter = DirectX::XMVectorZero();
+
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		meshCenter = DirectX::XMVectorAdd(meshCenter, DirectX::XMLoadFloat3(&pVertices[v].position));
+	}
+	meshCenter = DirectX::XMVectorScale(meshCenter, 1.0f / vertexCount);
+
+	for (size_t c = 0; c < clusters.size(); ++c)
+	{
+		Cluster& cluster = sortedClusters[c];
+		cluster.begin = clusters[c];
+		cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : triangleIndexCount;
+
+		DirectX::XMVECTOR center = DirectX::XMVectorZero();
+		DirectX::XMVECTOR normal = DirectX::XMVectorZero();
+		float area = 0.0f;
+
+		for (size_t i = cluster.begin; i < cluster.end; i += 3)
+		{
+			DirectX::XMVECTOR p0 = DirectX::XMLoadFloat3(&pVertices[pIndices[i + 0]].position);
+			DirectX::XMVECTOR p1 = DirectX::XMLoadFloat3(&pVertices[pIndices[i + 1]].position);
+			DirectX::XMVECTOR p2 = DirectX::XMLoadFloat3(&pVertices[pIndices[i + 2]].position);
+
+			DirectX::XMVECTOR triangleNormal = GetOutwardNormal(pVertices, pIndices + i);
+			float triangleArea = DirectX::XMVectorGetX(DirectX::XMVector3Length(triangleNormal));
+
+			DirectX::XMVECTOR triangleCenter = DirectX::XMVectorScale(DirectX::XMVectorAdd(DirectX::XMVectorAdd(p0, p1), p2), 1.0f / 3.0f);
+
+			center = DirectX::XMVectorAdd(center, DirectX::XMVectorScale(triangleCenter, triangleArea));
+			normal = DirectX::XMVectorAdd(normal, triangleNormal);
+			area += triangleArea;
+		}
+
+		cluster.sortKey = 0.0f;
+
+		if (area > 0.0f)
+		{
+			center = DirectX::XMVectorScale(center, 1.0f / area);
+
+			cluster.sortKey = DirectX::XMVectorGetX(DirectX::XMVector3Dot(
+				DirectX::XMVectorSubtract(center, meshCenter),
+				DirectX::XMVector3Normalize(normal)
+			));
+		}
+	}
+
+	std::stable_sort(
+		sortedClusters.begin(),
+		sortedClusters.end(),
+		[](const Cluster& lhs, const Cluster& rhs) { return lhs.sortKey > rhs.sortKey; }
+	);
+
+	std::vector<UINT32> sourceIndices(pIndices, pIndices + triangleIndexCount);
+	size_t outIdx = 0;
+
+	for (const auto& cluster : sortedClusters)
+	{
+		std::copy(sourceIndices.begin() + cluster.begin, sourceIndices.begin() + cluster.end, pIndices + outIdx);
+		outIdx += cluster.end - cluster.begin;
+	}
+}
+
+
+void OptimizeVertexFetch(
+	UINT32* pIndices,
+	size_t indexCount,
+	Vertex* pVertices,
+	size_t vertexCount
+)
+{
+	const UINT32 unassigned = UINT32_MAX;
+
+	std::vector<UINT32> remap(vertexCount, unassigned);
+	UINT32 nextVertex = 0;
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		UINT32& newIndex = remap[pIndices[i]];
+
+		if (newIndex == unassigned)
+		{
+			newIndex = nextVertex++;
+		}
+
+		pIndices[i] = newIndex;
+	}
+
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		if (remap[v] == unassigned)
+		{
+			remap[v] = nextVertex++;
+		}
+	}
+
+	std::vector<Vertex> sourceVertices(pVertices, pVertices + vertexCount);
+
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		pVertices[remap[v]] = sourceVertices[v];
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "framework.h"
+#include "rendererContext.h"
+
+
+// Triangle list post-processing run by the cooker. Indices are relative to
+// the given vertex range and keep their winding.
+
+static constexpr UINT VertexCacheSize = 16;
+
+struct VertexCacheStats
+{
+	float acmr = 0.0f;	// transformed vertices per triangle
+	float atvr = 0.0f;	// transformed vertices per referenced vertex
+};
+
+// Triangle weighted ACMR and ATVR over several primitives
+struct MeshOptimizationStats
+{
+	VertexCacheStats before;
+	VertexCacheStats after;
+	size_t triangleCount = 0;
+
+	void Add(const VertexCacheStats& primitiveBefore, const VertexCacheStats& primitiveAfter, size_t primitiveTriangleCount);
+};
+
+// Simulates a FIFO post-transform cache of cacheSize entries
+VertexCacheStats AnalyzeVertexCache(
+	const UINT32* pIndices,
+	size_t indexCount,
+	size_t vertexCount,
+	UINT cacheSize = VertexCacheSize
+);
+
+// Tipsify reordering (Sander et al. 2007). clusters receives the first index
+// of every run that started after the cache was effectively flushed.
+void OptimizeVertexCache(
+	UINT32* pIndices,
+	size_t indexCount,
+	size_t vertexCount,
+	std::vector<size_t>& clusters,
+	UINT cacheSize = VertexCacheSize
+);
+
+// Normal of a cooked triangle pointing out of the mesh, its length is twice the area.
+// Cooked triangles are wound for the mirrored view, so the edges are crossed the other way round
+DirectX::XMVECTOR GetOutwardNormal(const Vertex* pVertices, const UINT32* pTriangle);
+
+// Orders the clusters so that the outward facing ones are drawn first and
+// occlude the rest, triangles inside a cluster keep their order
+void OptimizeOverdraw(
+	UINT32* pIndices,
+	size_t indexCount,
+	const Vertex* pVertices,
+	size_t vertexCount,
+	const std::vector<size_t>& clusters
+);
+
+// Moves the vertices into first use order so that fetches walk memory linearly,
+// unreferenced vertices end up at the back
+void OptimizeVertexFetch(
+	UINT32* pIndices,
+	size_t indexCount,
+	Vertex* pVertices,
+	size_t vertexCount
+);
@@ -0,0 +1,394 @@
+#include "meshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+
+// penalties for collapsing across differing attributes, relative to the squared mesh extent
+static constexpr double NormalWeight = 1e-3;
+static constexpr double TexCoordWeight = 1e-3;
+
+// a collapse may not turn a triangle by more than about 75 degrees
+static constexpr double MinFlipCos = 0.25;
+
+
+struct Quadric
+{
+	// upper triangle of the symmetric 4x4 plane matrix
+	double a2, ab, ac, ad;
+	double b2, bc, bd;
+	double c2, cd;
+	double d2;
+
+	double weight;
+};
+
+void addPlane(Quadric& q, double a, double b, double c, double d, double weight)
+{
+	q.a2 += a * a * weight;
+	q.ab += a * b * weight;
+	q.ac += a * c * weight;
+	q.ad += a * d * weight;
+	q.b2 += b * b * weight;
+	q.bc += b * c * weight;
+	q.bd += b * d * weight;
+	q.c2 += c * c * weight;
+	q.cd += c * d * weight;
+	q.d2 += d * d * weight;
+	q.weight += weight;
+}
+
+void addQuadric(Quadric& q, const Quadric& other)
+{
+	q.a2 += other.a2;
+	q.ab += other.ab;
+	q.ac += other.ac;
+	q.ad += other.ad;
+	q.b2 += other.b2;
+	q.bc += other.bc;
+	q.bd += other.bd;
+	q.c2 += other.c2;
+	q.cd += other.cd;
+	q.d2 += other.d2;
+	q.weight += other.weight;
+}
+
+// Weighted mean of the squared distances to the accumulated planes
+double evaluateQuadric(const Quadric& q, const DirectX::XMFLOAT3& p)
+{
+	if (q.weight <= 0.0)
+	{
+		return 0.0;
+	}
+
+	double x = p.x;
+	double y = p.y;
+	double z = p.z;
+
+	double error =
+		q.a2 * x * x + 2.0 * q.ab * x * y + 2.0 * q.ac * x * z + 2.0 * q.ad * x +
+		q.b2 * y * y + 2.0 * q.bc * y * z + 2.0 * q.bd * y +
+		q.c2 * z * z + 2.0 * q.cd * z +
+		q.d2;
+
+	return (std::max)(error, 0.0) / q.weight;
+}
+
+void triangleNormal(const DirectX::XMFLOAT3& p0, const DirectX::XMFLOAT3& p1, const DirectX::XMFLOAT3& p2, double normal[3])
+{
+	double e1[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+	double e2[3] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+
+	normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+double squaredDistance(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+{
+	double dx = a.x - b.x;
+	double dy = a.y - b.y;
+	double dz = a.z - b.z;
+
+	return dx * dx + dy * dy + dz * dz;
+}
+
+double squaredDistance(const DirectX::XMFLOAT2& a, const DirectX::XMFLOAT2& b)
+{
+	double dx = a.x - b.x;
+	double dy = a.y - b.y;
+
+	return dx * dx + dy * dy;
+}
+
+
+float SimplifyMesh(
+	const UINT32* pIndices,
+	size_t indexCount,
+	const Vertex* pVertices,
+	size_t vertexCount,
+	size_t targetIndexCount,
+	std::vector<UINT32>& result
+)
+{
+	result.assign(pIndices, pIndices + (indexCount - indexCount % 3));
+
+	if (vertexCount == 0 || result.size() <= targetIndexCount)
+	{
+		return 0.0f;
+	}
+
+	// edges used by a single triangle are open, more than two make the mesh non-manifold there
+	std::unordered_map<UINT64, UINT32> edgeUses;
+	edgeUses.reserve(result.size());
+
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		for (UINT k = 0; k < 3; ++k)
+		{
+			UINT32 a = result[i + k];
+			UINT32 b = result[i + (k + 1) % 3];
+
+			++edgeUses[(static_cast<UINT64>((std::min)(a, b)) << 32) | (std::max)(a, b)];
+		}
+	}
+
+	std::vector<bool> isLocked(vertexCount, false);
+
+	for (const auto& edge : edgeUses)
+	{
+		if (edge.second != 2)
+		{
+			isLocked[static_cast<UINT32>(edge.first >> 32)] = true;
+			isLocked[static_cast<UINT32>(edge.first)] = true;
+		}
+	}
+
+	std::vector<Quadric> quadrics(vertexCount, Quadric{});
+
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		const DirectX::XMFLOAT3& p0 = pVertices[result[i + 0]].position;
+		const DirectX::XMFLOAT3& p1 = pVertices[result[i + 1]].position;
+		const DirectX::XMFLOAT3& p2 = pVertices[result[i + 2]].position;
+
+		double normal[3];
+		triangleNormal(p0, p1, p2, normal);
+
+		double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+		if (length <= 0.0)
+		{
+			continue;
+		}
+
+		double a = normal[0] / length;
+		double b = normal[1] / length;
+		double c = normal[2] / length;
+		double d = -(a * p0.x + b * p0.y + c * p0.z);
+		double area = length * 0.5;
+
+		for (UINT k = 0; k < 3; ++k)
+		{
+			addPlane(quadrics[result[i + k]], a, b, c, d, area);
+		}
+	}
+
+	DirectX::XMFLOAT3 boundsMin = pVertices[0].position;
+	DirectX::XMFLOAT3 boundsMax = pVertices[0].position;
+
+	for (size_t v = 1; v < vertexCount; ++v)
+	{
+		const DirectX::XMFLOAT3& p = pVertices[v].position;
+
+		boundsMin = { (std::min)(boundsMin.x, p.x), (std::min)(boundsMin.y, p.y), (std::min)(boundsMin.z, p.z) };
+		boundsMax = { (std::max)(boundsMax.x, p.x), (std::max)(boundsMax.y, p.y), (std::max)(boundsMax.z, p.z) };
+	}
+
+	double extent2 = squaredDistance(boundsMin, boundsMax);
+
+	struct Collapse
+	{
+		UINT32 from;
+		UINT32 to;
+		double cost;
+		double error;
+	};
+
+	std::vector<Collapse> collapses;
+	std::vector<UINT32> remap(vertexCount);
+	std::vector<bool> isTouched(vertexCount);
+
+	std::vector<size_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<UINT32> adjacency;
+
+	double maxError = 0.0;
+
+	while (result.size() > targetIndexCount)
+	{
+		size_t triangleCount = result.size() / 3;
+
+		// vertex -> triangles of the current index list
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+
+		for (UINT32 index : result)
+		{
+			++adjacencyOffsets[index + 1];
+		}
+
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+
+		adjacency.resize(result.size());
+		std::vector<size_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+
+		for (size_t i = 0; i < result.size(); ++i)
+		{
+			adjacency[adjacencyFill[result[i]]++] = static_cast<UINT32>(i / 3);
+		}
+
+		// cheapest collapse of every movable vertex along one of its edges
+		std::vector<Collapse> bestCollapses(vertexCount, { 0, 0, -1.0, 0.0 });
+
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (UINT k = 0; k < 3; ++k)
+			{
+				UINT32 edge[2] = { result[i + k], result[i + (k + 1) % 3] };
+
+				for (UINT e = 0; e < 2; ++e)
+				{
+					UINT32 from = edge[e];
+					UINT32 to = edge[1 - e];
+
+					if (isLocked[from])
+					{
+						continue;
+					}
+
+					Quadric q = quadrics[from];
+					addQuadric(q, quadrics[to]);
+
+					const Vertex& fromVertex = pVertices[from];
+					const Vertex& toVertex = pVertices[to];
+
+					double error = evaluateQuadric(q, toVertex.position);
+					double cost = error + extent2 * (
+						NormalWeight * squaredDistance(fromVertex.normal, toVertex.normal) +
+						TexCoordWeight * squaredDistance(fromVertex.texCoord, toVertex.texCoord)
+					);
+
+					Collapse& best = bestCollapses[from];
+
+					if (best.cost < 0.0 || cost < best.cost)
+					{
+						best = { from, to, cost, error };
+					}
+				}
+			}
+		}
+
+		collapses.clear();
+
+		for (const auto& collapse : bestCollapses)
+		{
+			if (collapse.cost >= 0.0)
+			{
+				collapses.push_back(collapse);
+			}
+		}
+
+		std::sort(
+			collapses.begin(),
+			collapses.end(),
+			[](const Collapse& lhs, const Collapse& rhs) { return lhs.cost < rhs.cost; }
+		);
+
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			remap[v] = static_cast<UINT32>(v);
+		}
+		std::fill(isTouched.begin(), isTouched.end(), false);
+
+		// an interior collapse removes two triangles
+		size_t collapseBudget = (triangleCount - targetIndexCount / 3 + 1) / 2;
+		size_t collapseNum = 0;
+
+		for (const auto& collapse : collapses)
+		{
+			if (collapseNum >= collapseBudget)
+			{
+				break;
+			}
+
+			if (isTouched[collapse.from] || isTouched[collapse.to])
+			{
+				continue;
+			}
+
+			// the triangles that keep existing must not flip or fold over
+			bool isValid = true;
+
+			for (size_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && isValid; ++a)
+			{
+				const UINT32* pTriangle = &result[adjacency[a] * 3];
+
+				if (pTriangle[0] == collapse.to || pTriangle[1] == collapse.to || pTriangle[2] == collapse.to)
+				{
+					continue;
+				}
+
+				DirectX::XMFLOAT3 before[3];
+				DirectX::XMFLOAT3 after[3];
+
+				for (UINT k = 0; k < 3; ++k)
+				{
+					before[k] = pVertices[pTriangle[k]].position;
+					after[k] = pTriangle[k] == collapse.from ? pVertices[collapse.to].position : before[k];
+				}
+
+				double normalBefore[3];
+				double normalAfter[3];
+				triangleNormal(before[0], before[1], before[2], normalBefore);
+				triangleNormal(after[0], after[1], after[2], normalAfter);
+
+				double dot = normalBefore[0] * normalAfter[0] + normalBefore[1] * normalAfter[1] + normalBefore[2] * normalAfter[2];
+				double lengthBefore = sqrt(normalBefore[0] * normalBefore[0] + normalBefore[1] * normalBefore[1] + normalBefore[2] * normalBefore[2]);
+				double lengthAfter = sqrt(normalAfter[0] * normalAfter[0] + normalAfter[1] * normalAfter[1] + normalAfter[2] * normalAfter[2]);
+
+				isValid = dot > MinFlipCos * lengthBefore * lengthAfter;
+			}
+
+			if (!isValid)
+			{
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+			maxError = (std::max)(maxError, collapse.error);
+
+			// the neighbourhood changed, its other collapses wait for the next pass
+			for (size_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; ++a)
+			{
+				const UINT32* pTriangle = &result[adjacency[a] * 3];
+
+				isTouched[pTriangle[0]] = true;
+				isTouched[pTriangle[1]] = true;
+				isTouched[pTriangle[2]] = true;
+			}
+
+			++collapseNum;
+		}
+
+		if (collapseNum == 0)
+		{
+			break;
+		}
+
+		size_t outIdx = 0;
+
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			UINT32 i0 = remap[result[i + 0]];
+			UINT32 i1 = remap[result[i + 1]];
+			UINT32 i2 = remap[result[i + 2]];
+
+			if (i0 == i1 || i1 == i2 || i0 == i2)
+			{
+				continue;
+			}
+
+			result[outIdx++] = i0;
+			result[outIdx++] = i1;
+			result[outIdx++] = i2;
+		}
+
+		result.resize(outIdx);
+	}
+
+	return static_cast<float>(sqrt(maxError));
+}
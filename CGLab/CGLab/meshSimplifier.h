@@ -0,0 +1,18 @@
+#pragma once
+#include "framework.h"
+#include "rendererContext.h"
+
+
+// Quadric error metric simplification (Garland and Heckbert 1997) of a triangle list.
+// Vertices collapse onto neighbours, so the result indexes the same vertex range.
+// Vertices on open edges are never moved, this covers mesh borders as well as UV and
+// normal seams, since the split vertices of a seam do not share edges.
+// Returns the largest collapse error as a distance in model units.
+float SimplifyMesh(
+	const UINT32* pIndices,
+	size_t indexCount,
+	const Vertex* pVertices,
+	size_t vertexCount,
+	size_t targetIndexCount,
+	std::vector<UINT32>& result
+);
@@ -0,0 +1,244 @@
+#include "meshlet.h"
+#include "frustumCulling.h"
+#include "meshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+// cones this wide hardly ever face away as a whole, testing them is wasted time
+static constexpr float MinConeDot = 0.1f;
+
+
+UINT countNewVertices(const UINT32* pTriangle, const std::vector<size_t>& vertexMarks, size_t meshletNum)
+{
+	UINT newVertexNum = 0;
+
+	for (UINT k = 0; k < 3; ++k)
+	{
+		bool isKnown = vertexMarks[pTriangle[k]] == meshletNum;
+
+		for (UINT j = 0; j < k; ++j)
+		{
+			isKnown = isKnown || pTriangle[j] == pTriangle[k];
+		}
+
+		newVertexNum += isKnown ? 0 : 1;
+	}
+
+	return newVertexNum;
+}
+
+void computeMeshletBounds(const UINT32* pIndices, const Vertex* pVertices, CookedMeshlet& meshlet)
+{
+	const UINT32* pMeshletIndices = pIndices + meshlet.firstIndex;
+
+	DirectX::XMVECTOR minPosition = DirectX::XMVectorReplicate(FLT_MAX);
+	DirectX::XMVECTOR maxPosition = DirectX::XMVectorReplicate(-FLT_MAX);
+
+	for (UINT i = 0; i < meshlet.indexCount; ++i)
+	{
+		DirectX::XMVECTOR position = DirectX::XMLoadFloat3(&pVertices[pMeshletIndices[i]].position);
+
+		minPosition = DirectX::XMVectorMin(minPosition, position);
+		maxPosition = DirectX::XMVectorMax(maxPosition, position);
+	}
+
+	DirectX::XMVECTOR center = DirectX::XMVectorScale(DirectX::XMVectorAdd(minPosition, maxPosition), 0.5f);
+	float radius = 0.0f;
+
+	for (UINT i = 0; i < meshlet.indexCount; ++i)
+	{
+		DirectX::XMVECTOR position = DirectX::XMLoadFloat3(&pVertices[pMeshletIndices[i]].position);
+
+		radius = (std::max)(radius, DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(position, center))));
+	}
+
+	DirectX::XMStoreFloat3(&meshlet.center, center);
+	meshlet.radius = radius;
+
+	DirectX::XMVECTOR axis = DirectX::XMVectorZero();
+
+	for (UINT i = 0; i < meshlet.indexCount; i += 3)
+	{
+		DirectX::XMVECTOR normal = GetOutwardNormal(pVertices, pMeshletIndices + i);
+
+		if (DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(normal)) > 0.0f)
+		{
+			axis = DirectX::XMVectorAdd(axis, DirectX::XMVector3Normalize(normal));
+		}
+	}
+
+	meshlet.coneAxis = { 0.0f, 0.0f, 1.0f };
+	meshlet.coneCutoff = 1.0f;
+
+	if (DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(axis)) <= 0.0f)
+	{
+		return;
+	}
+
+	axis = DirectX::XMVector3Normalize(axis);
+	float minDot = 1.0f;
+
+	for (UINT i = 0; i < meshlet.indexCount; i += 3)
+	{
+		DirectX::XMVECTOR normal = GetOutwardNormal(pVertices, pMeshletIndices + i);
+
+		if (DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(normal)) > 0.0f)
+		{
+			minDot = (std::min)(minDot, DirectX::XMVectorGetX(DirectX::XMVector3Dot(axis, DirectX::XMVector3Normalize(normal))));
+		}
+	}
+
+	DirectX::XMStoreFloat3(&meshlet.coneAxis, axis);
+
+	if (minDot > MinConeDot)
+	{
+		meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+	}
+}
+
+
+void BuildMeshlets(
+	const UINT32* pIndices,
+	size_t indexCount,
+	const Vertex* pVertices,
+	size_t vertexCount,
+	std::vector<CookedMeshlet>& meshlets
+)
+{
+	size_t triangleIndexCount = indexCount - indexCount % 3;
+
+	if (triangleIndexCount == 0 || vertexCount == 0)
+	{
+		return;
+	}
+
+	// a vertex belongs to the current meshlet when it is marked with its number
+	const size_t unmarked = SIZE_MAX;
+	std::vector<size_t> vertexMarks(vertexCount, unmarked);
+
+	size_t firstMeshlet = meshlets.size();
+	size_t meshletNum = 0;
+	UINT meshletVertexNum = 0;
+
+	CookedMeshlet meshlet = {};
+
+	for (size_t i = 0; i < triangleIndexCount; i += 3)
+	{
+		UINT newVertexNum = countNewVertices(pIndices + i, vertexMarks, meshletNum);
+
+		if (meshlet.indexCount > 0
+			&& (meshletVertexNum + newVertexNum > MeshletMaxVertexNum || meshlet.indexCount / 3 + 1 > MeshletMaxTriangleNum))
+		{
+			meshlets.push_back(meshlet);
+
+			meshlet = {};
+			meshlet.firstIndex = static_cast<UINT32>(i);
+
+			++meshletNum;
+			meshletVertexNum = 0;
+			newVertexNum = countNewVertices(pIndices + i, vertexMarks, meshletNum);
+		}
+
+		for (UINT k = 0; k < 3; ++k)
+		{
+			vertexMarks[pIndices[i + k]] = meshletNum;
+		}
+
+		meshletVertexNum += newVertexNum;
+		meshlet.indexCount += 3;
+	}
+
+	meshlets.push_back(meshlet);
+
+	for (size_t m = firstMeshlet; m < meshlets.size(); ++m)
+	{
+		computeMeshletBounds(pIndices, pVertices, meshlets[m]);
+	}
+}
+
+
+MeshletCullView CreateMeshletCullView(
+	const DirectX::XMMATRIX& modelMatrix,
+	const DirectX::XMMATRIX& vpMatrix,
+	const DirectX::XMFLOAT4& cameraPosition
+)
+{
+	MeshletCullView view;
+
+	ExtractFrustumPlanes(DirectX::XMMatrixMultiply(modelMatrix, vpMatrix), view.planes);
+
+	DirectX::XMVECTOR position = DirectX::XMVector3Transform(
+		DirectX::XMLoadFloat4(&cameraPosition),
+		DirectX::XMMatrixInverse(nullptr, modelMatrix)
+	);
+	DirectX::XMStoreFloat3(&view.cameraPosition, position);
+
+	return view;
+}
+
+void CullMeshlets(
+	const CookedMeshlet* pMeshlets,
+	size_t meshletCount,
+	const MeshletCullView& view,
+	std::vector<IndexRange>& ranges,
+	MeshletCullStats* pStats
+)
+{
+	size_t frustumCulledNum = 0;
+	size_t coneCulledNum = 0;
+
+	for (size_t m = 0; m < meshletCount; ++m)
+	{
+		const CookedMeshlet& meshlet = pMeshlets[m];
+
+		bool isVisible = true;
+
+		for (UINT i = 0; i < 6 && isVisible; ++i)
+		{
+			const DirectX::XMFLOAT4& plane = view.planes[i];
+
+			isVisible = plane.x * meshlet.center.x + plane.y * meshlet.center.y + plane.z * meshlet.center.z + plane.w >= -meshlet.radius;
+		}
+
+		if (!isVisible)
+		{
+			++frustumCulledNum;
+			continue;
+		}
+
+		// the whole sphere sees the back of every triangle in the cone (meshoptimizer's test)
+		if (meshlet.coneCutoff < 1.0f)
+		{
+			float dx = meshlet.center.x - view.cameraPosition.x;
+			float dy = meshlet.center.y - view.cameraPosition.y;
+			float dz = meshlet.center.z - view.cameraPosition.z;
+
+			float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+			float dot = dx * meshlet.coneAxis.x + dy * meshlet.coneAxis.y + dz * meshlet.coneAxis.z;
+
+			if (dot >= meshlet.coneCutoff * distance + meshlet.radius)
+			{
+				++coneCulledNum;
+				continue;
+			}
+		}
+
+		if (!ranges.empty() && ranges.back().firstIndex + ranges.back().indexCount == meshlet.firstIndex)
+		{
+			ranges.back().indexCount += meshlet.indexCount;
+		}
+		else
+		{
+			ranges.push_back({ meshlet.firstIndex, meshlet.indexCount });
+		}
+	}
+
+	if (pStats != nullptr)
+	{
+		pStats->testedNum += meshletCount;
+		pStats->frustumCulledNum += frustumCulledNum;
+		pStats->coneCulledNum += coneCulledNum;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "framework.h"
+#include "meshCache.h"
+
+
+// Meshlets split a triangle list into small clusters that are culled on their own.
+// A meshlet is a run of consecutive triangles, so the cooked index order is kept
+// and visible neighbours merge into one draw.
+
+static constexpr UINT MeshletMaxVertexNum = 64;
+static constexpr UINT MeshletMaxTriangleNum = 124;
+
+// Scans the triangles in order and starts a new meshlet when the vertex or triangle
+// limit would be exceeded. Meshlet index ranges are relative to pIndices.
+void BuildMeshlets(
+	const UINT32* pIndices,
+	size_t indexCount,
+	const Vertex* pVertices,
+	size_t vertexCount,
+	std::vector<CookedMeshlet>& meshlets
+);
+
+
+// Frustum planes and viewpoint in the model space of one mesh
+struct MeshletCullView
+{
+	DirectX::XMFLOAT4 planes[6];
+	DirectX::XMFLOAT3 cameraPosition;
+};
+
+struct MeshletCullStats
+{
+	size_t testedNum = 0;
+	size_t frustumCulledNum = 0;
+	size_t coneCulledNum = 0;
+};
+
+struct IndexRange
+{
+	UINT firstIndex;
+	UINT indexCount;
+};
+
+MeshletCullView CreateMeshletCullView(
+	const DirectX::XMMATRIX& modelMatrix,
+	const DirectX::XMMATRIX& vpMatrix,
+	const DirectX::XMFLOAT4& cameraPosition
+);
+
+// Appends the index ranges of the meshlets that are inside the frustum and
+// not entirely back facing, adjacent visible meshlets share one range
+void CullMeshlets(
+	const CookedMeshlet* pMeshlets,
+	size_t meshletCount,
+	const MeshletCullView& view,
+	std::vector<IndexRange>& ranges,
+	MeshletCullStats* pStats = nullptr
+);
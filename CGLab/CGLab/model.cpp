@@ -1,94 +1,158 @@
 #include "model.h"
-#include "WICTextureLoader.h"
+#include "textureDecoder.h"
+#include "threadPool.h"
 
-#include <fstream>
+#include <chrono>
+#include <unordered_map>
 
-D3D11_TEXTURE_ADDRESS_MODE defineAddressMode(int gltfAddressMode)
+
+// occluders are drawn on the CPU, finer LODs than this cost more than they hide
+static constexpr UINT OccluderMaxTriangleNum = 256;
+
+
+DXGI_FORMAT defineImageFormat(const tinygltf::Image& image)
 {
-	switch (gltfAddressMode)
+	if (image.component != 4)
 	{
-	case TINYGLTF_TEXTURE_WRAP_REPEAT:
-		return D3D11_TEXTURE_ADDRESS_WRAP;
+		return DXGI_FORMAT_UNKNOWN;
+	}
 
-	case TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE:
-		return D3D11_TEXTURE_ADDRESS_CLAMP;
+	switch (image.bits)
+	{
+	case 8:
+		return DXGI_FORMAT_R8G8B8A8_UNORM;
 
-	case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT:
-		return D3D11_TEXTURE_ADDRESS_MIRROR;
+	case 16:
+		return DXGI_FORMAT_R16G16B16A16_UNORM;
 
 	default:
 		break;
 	}
 
-	return D3D11_TEXTURE_ADDRESS_WRAP;
+	return DXGI_FORMAT_UNKNOWN;
 }
 
-D3D11_PRIMITIVE_TOPOLOGY defineTopology(int gltfTopology)
+HRESULT createTextureFromImage(
+	ID3D11Device* pDevice,
+	const tinygltf::Image& image,
+	ID3D11Texture2D** ppTexture,
+	ID3D11ShaderResourceView** ppTextureSRV
+)
 {
-	switch (gltfTopology)
-	{
-	case TINYGLTF_MODE_POINTS:
-		return D3D11_PRIMITIVE_TOPOLOGY_POINTLIST;
+	DXGI_FORMAT format = defineImageFormat(image);
 
-	case TINYGLTF_MODE_LINE:
-		return D3D11_PRIMITIVE_TOPOLOGY_LINELIST;
+	if (format == DXGI_FORMAT_UNKNOWN || image.image.empty())
+	{
+		return E_FAIL;
+	}
 
-	case TINYGLTF_MODE_LINE_STRIP:
-		return D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP;
+	D3D11_TEXTURE2D_DESC textureDesc = CreateDefaultTexture2DDesc(
+		format,
+		static_cast<UINT>(image.width),
+		static_cast<UINT>(image.height),
+		D3D11_BIND_SHADER_RESOURCE
+	);
 
-	case TINYGLTF_MODE_TRIANGLES:
-		return D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	D3D11_SUBRESOURCE_DATA textureData = CreateDefaultSubresourceData(image.image.data());
+	textureData.SysMemPitch = static_cast<UINT>(image.width * image.component * (image.bits / 8));
 
-	case TINYGLTF_MODE_TRIANGLE_STRIP:
-		return D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
+	HRESULT hr = pDevice->CreateTexture2D(&textureDesc, &textureData, ppTexture);
 
-	default:
-		break;
+	if (SUCCEEDED(hr))
+	{
+		hr = pDevice->CreateShaderResourceView(*ppTexture, nullptr, ppTextureSRV);
 	}
-	
-	assert(false);
-	return D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+
+	return hr;
 }
 
-char* loadBinaryFile(const std::string& fileName)
+
+void PrintModelLoadStats(const std::string& pathToModel, const ModelLoadStats& stats)
 {
-	std::ifstream inFile;
-	inFile.open(fileName, std::ios::binary);
+	printf(
+		"%s: read %zu bytes from %u files, mapped %zu bytes from %u files, streamed %zu bytes (peak %zu), %u meshes with 16-bit and %u with 32-bit indices, decoded %u images in %.2f ms (%.2f ms wall on %u threads), total load time %.2f ms\n",
+		pathToModel.c_str(),
+		stats.bytesRead,
+		stats.filesRead,
+		stats.bytesMapped,
+		stats.filesMapped,
+		stats.bytesStreamed,
+		stats.peakStreamedBytes,
+		stats.meshes16BitIndices,
+		stats.meshes32BitIndices,
+		stats.imagesDecoded,
+		stats.decodeTimeMs,
+		stats.decodeWallTimeMs,
+		stats.decodeThreadNum,
+		stats.totalTimeMs
+	);
 
-	if (!inFile.is_open())
+	std::string cacheFileName = MeshCache::GetFileName(pathToModel);
+
+	if (stats.isCacheHit)
 	{
-		return nullptr;
+		printf(
+			"%s: cold prepare %.2f ms, warm prepare %.2f ms from %s (%.1fx)\n",
+			pathToModel.c_str(),
+			stats.coldLoadTimeMs,
+			stats.prepareTimeMs,
+			cacheFileName.c_str(),
+			stats.coldLoadTimeMs / (std::max)(stats.prepareTimeMs, 0.001)
+		);
+	}
+	else
+	{
+		printf("%s: cold prepare %.2f ms, cooked to %s\n", pathToModel.c_str(), stats.coldLoadTimeMs, cacheFileName.c_str());
 	}
 
-	inFile.seekg(0, std::ios::end);
-	size_t fileSize = inFile.tellg();
-	inFile.seekg(0, std::ios::beg);
+	const VertexCompressionStats& vertexStats = stats.vertexCompression;
 
-	char* pData = static_cast<char*>(std::malloc(fileSize));
+	if (stats.vertexFormat != VertexFormat::Float && vertexStats.vertexCount > 0)
+	{
+		printf(
+			"%s: %s vertices %zu -> %zu bytes, normal error max %.4f deg avg %.4f deg, tangent error max %.4f deg, uv error max %.3f texels at %u, position error max %f\n",
+			pathToModel.c_str(),
+			GetVertexFormatName(stats.vertexFormat),
+			vertexStats.sourceBytes,
+			vertexStats.compressedBytes,
+			vertexStats.maxNormalErrorDeg,
+			vertexStats.normalErrorSumDeg / vertexStats.vertexCount,
+			vertexStats.maxTangentErrorDeg,
+			vertexStats.maxTexCoordErrorTexels,
+			VertexCompressionStats::VertexErrorTextureSize,
+			vertexStats.maxPositionError
+		);
+	}
 
-	if (pData == nullptr)
+	if (stats.positionStreamBytes > 0)
 	{
-		inFile.close();
-		return nullptr;
+		printf(
+			"%s: position stream %zu bytes next to %zu bytes of vertices, depth passes fetch %u instead of %u bytes per vertex\n",
+			pathToModel.c_str(),
+			stats.positionStreamBytes,
+			stats.vertexBufferBytes,
+			GetPositionStride(stats.vertexFormat),
+			GetVertexStride(stats.vertexFormat)
+		);
 	}
+}
 
-	inFile.read(pData, fileSize);
-	inFile.close();
 
-	return pData;
-}
+VertexFormat Model::s_vertexFormat = VertexFormat::Float;
+bool Model::s_hasPositionStream = true;
 
 
 Model* Model::CreateModel(
 	RendererContext* pContext,
-	const tinygltf::Model& model,
+	const CookedModelView& cookedModel,
 	const std::string& pathToModel,
-	const DirectX::XMMATRIX& initMatrix
+	const DirectX::XMMATRIX& initMatrix,
+	ModelLoadStats* pStats
 )
 {
-	Model* pModel = new Model(pathToModel);
+	Model* pModel = new Model(pContext, pathToModel);
 
-	if (pModel->Init(pContext, model, initMatrix))
+	if (pModel->Init(cookedModel, initMatrix, pStats))
 	{
 		return pModel;
 	}
@@ -98,9 +162,10 @@ Model* Model::CreateModel(
 }
 
 
-Model::Model(const std::string& pathToModel)
-	: m_pathToModel(pathToModel)
-	, m_pModelData(nullptr)
+Model::Model(RendererContext* pContext, const std::string& pathToModel)
+	: m_pContext(pContext)
+	, m_pathToModel(pathToModel)
+	, m_isResident(false)
 {}
 
 Model::~Model()
@@ -139,447 +204,505 @@ Model::Primitive Model::GetPrimitive(UINT idx) const
 }
 
 
-bool Model::Init(RendererContext* pContext, const tinygltf::Model& model, const DirectX::XMMATRIX& initMatrix)
+void Model::SetVertexFormat(VertexFormat format)
 {
-	HRESULT hr = S_OK;
-
-	m_pModelData = loadBinaryFile(m_pathToModel + "/" + model.buffers[0].uri);
+	s_vertexFormat = format;
+}
 
-	if (m_pModelData == nullptr)
-	{
-		hr = E_FAIL;
-	}
+VertexFormat Model::GetVertexFormat()
+{
+	return s_vertexFormat;
+}
 
-	if (SUCCEEDED(hr))
-	{
-		LoadTextures(pContext, model);
-	}
+void Model::SetPositionStream(bool isEnabled)
+{
+	s_hasPositionStream = isEnabled;
+}
 
-	if (SUCCEEDED(hr))
-	{
-		hr = LoadSamplers(pContext, model);
-	}
+bool Model::HasPositionStream()
+{
+	return s_hasPositionStream;
+}
 
-	if (SUCCEEDED(hr))
-	{
-		DirectX::XMMATRIX mat = DirectX::XMMatrixIdentity();
-		mat.r[0].m128_f32[0] = -mat.r[0].m128_f32[0];
 
-		ParseNode(pContext, model, 0, mat * initMatrix);
-	}
+bool Model::Init(
+	const CookedModelView& cookedModel,
+	const DirectX::XMMATRIX& initMatrix,
+	ModelLoadStats* pStats
+)
+{
+	LoadTextures(cookedModel, pStats);
 
-	std::free(m_pModelData);
+	HRESULT hr = LoadSamplers(cookedModel);
 
 	if (SUCCEEDED(hr))
 	{
-		SetUpPrimitives(model);
+		hr = LoadMeshes(cookedModel, initMatrix, pStats);
 	}
 
+	m_isResident = SUCCEEDED(hr);
+
 	return SUCCEEDED(hr);
 }
 
-HRESULT Model::ParseNode(
-	RendererContext* pContext,
-	const tinygltf::Model& model,
-	UINT nodeIdx,
-	const DirectX::XMMATRIX& prevMatrix
-)
+
+HRESULT Model::LoadTextures(const CookedModelView& cookedModel, ModelLoadStats* pStats)
 {
-	const tinygltf::Node& currentNode = model.nodes[nodeIdx];
+	TextureDecoder* pDecoder = TextureDecoder::Create(cookedModel, m_pathToModel, pStats);
 
-	float translation[3] = { 0.0f, 0.0f, 0.0f };
-	if (!currentNode.translation.empty())
+	if (pDecoder == nullptr)
 	{
-		for (UINT i = 0; i < _countof(translation); ++i)
-		{
-			translation[i] = static_cast<float>(currentNode.translation[i]);
-		}
+		return E_FAIL;
 	}
 
-	float rotation[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-	if (!currentNode.rotation.empty())
-	{
-		for (UINT i = 0; i < _countof(rotation); ++i)
-		{
-			rotation[i] = static_cast<float>(currentNode.rotation[i]);
-		}
-	}
+	// decoding is spread over the pool, the device is only used from this thread
+	std::vector<DecodedImage> images;
+	ThreadPool* pPool = m_pContext->GetThreadPool();
 
-	float scale[3] = { 1.0f, 1.0f, 1.0f };
-	if (!currentNode.scale.empty())
-	{
-		for (UINT i = 0; i < _countof(scale); ++i)
-		{
-			scale[i] = static_cast<float>(currentNode.scale[i]);
-		}
-	}
+	auto decodeStart = std::chrono::steady_clock::now();
+	pDecoder->Decode(pPool, images);
+	double decodeWallTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodeStart).count();
 
-	float matrix[16] = {};
-	memset(matrix, 0, sizeof(matrix));
-	matrix[0] = matrix[5] = matrix[10] = matrix[15] = 1.0f;
-	if (!currentNode.matrix.empty())
-	{
-		for (UINT i = 0; i < _countof(matrix); ++i)
-		{
-			matrix[i] = static_cast<float>(currentNode.matrix[i]);
-		}
-	}
+	ReserveTextures(static_cast<UINT>(images.size()));
 
-	DirectX::XMMATRIX currentNodeMatrix =
-		DirectX::XMMatrixScaling(scale[0], scale[1], scale[2]) *
-		DirectX::XMMatrixRotationQuaternion({ rotation[0], rotation[1], rotation[2], rotation[3] }) *
-		DirectX::XMMatrixTranslation(translation[0], translation[1], translation[2]) *
-		DirectX::XMMATRIX(matrix) *
-		prevMatrix;
+	HRESULT hr = S_OK;
 
-	if (currentNode.mesh != -1)
+	for (UINT i = 0; i < static_cast<UINT>(images.size()); ++i)
 	{
-		if (FAILED(LoadMesh(
-			pContext,
-			model,
-			currentNode.mesh,
-			currentNodeMatrix
-		)))
+		HRESULT textureHR = UploadTexture(i, images[i], pStats);
+
+		if (FAILED(textureHR))
 		{
-			return E_FAIL;
+			hr = textureHR;
 		}
 	}
 
-	for (UINT childIdx : currentNode.children)
+	if (pStats != nullptr)
 	{
-		if (FAILED(ParseNode(pContext, model, childIdx, currentNodeMatrix)))
-		{
-			return E_FAIL;
-		}
+		pStats->decodeWallTimeMs += decodeWallTimeMs;
+		pStats->decodeThreadNum = pPool != nullptr ? pPool->GetThreadNum() : 1;
 	}
 
-	return S_OK;
-}
+	delete pDecoder;
 
+	return hr;
+}
 
-HRESULT Model::LoadTextures(RendererContext* pContext, const tinygltf::Model& model)
+HRESULT Model::LoadSamplers(const CookedModelView& cookedModel)
 {
 	HRESULT hr = S_OK;
 
-	for (const auto& imageData : model.images)
+	for (UINT i = 0; i < cookedModel.samplers.Size(); ++i)
 	{
-		std::string pathToTexture = m_pathToModel + "/" + imageData.uri;
-		Texture texture = { nullptr, nullptr };
+		ID3D11SamplerState* pSamplerState = nullptr;
 
-		hr = CreateWICTextureFromFile(
-			pContext->GetDevice(),
-			pContext->GetContext(),
-			std::wstring(pathToTexture.begin(), pathToTexture.end()).c_str(),
-			(ID3D11Resource**)&texture.pTexture,
-			&texture.pTextureSRV
-		);
+		hr = m_pContext->GetDevice()->CreateSamplerState(&cookedModel.samplers[i], &pSamplerState);
 
 		if (FAILED(hr))
 		{
 			break;
 		}
 
-		m_modelTextures.push_back(texture);
+		m_modelSampelers.push_back(pSamplerState);
 	}
 
 	return hr;
 }
 
-HRESULT Model::LoadSamplers(RendererContext* pContext, const tinygltf::Model& model)
+HRESULT Model::LoadMeshes(
+	const CookedModelView& cookedModel,
+	const DirectX::XMMATRIX& initMatrix,
+	ModelLoadStats* pStats
+)
 {
 	HRESULT hr = S_OK;
 
-	for (const auto& samplerData : model.samplers)
+	for (UINT meshIdx = 0; meshIdx < cookedModel.meshes.Size() && SUCCEEDED(hr); ++meshIdx)
 	{
-		D3D11_SAMPLER_DESC samplerDesc = {};
-		samplerDesc.MipLODBias = 0;
-		samplerDesc.MinLOD = 0;
-		samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-		samplerDesc.AddressU = defineAddressMode(samplerData.wrapS);
-		samplerDesc.AddressV = defineAddressMode(samplerData.wrapT);
-		samplerDesc.AddressW = samplerDesc.AddressU;
-
-		switch (samplerData.minFilter)
-		{
-		case TINYGLTF_TEXTURE_FILTER_NEAREST:
-		case TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_NEAREST:
-			samplerDesc.Filter = samplerData.magFilter == TINYGLTF_TEXTURE_FILTER_NEAREST ?
-				D3D11_FILTER_MIN_MAG_MIP_POINT :
-				D3D11_FILTER_MIN_POINT_MAG_LINEAR_MIP_POINT;
-			break;
-
-		case TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_NEAREST:
-		case TINYGLTF_TEXTURE_FILTER_LINEAR:
-			samplerDesc.Filter = samplerData.magFilter == TINYGLTF_TEXTURE_FILTER_NEAREST ?
-				D3D11_FILTER_MIN_LINEAR_MAG_MIP_POINT :
-				D3D11_FILTER_MIN_MAG_LINEAR_MIP_POINT;
-			break;
-
-		case TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_LINEAR:
-			samplerDesc.Filter = samplerData.magFilter == TINYGLTF_TEXTURE_FILTER_NEAREST ?
-				D3D11_FILTER_MIN_MAG_POINT_MIP_LINEAR :
-				D3D11_FILTER_MIN_POINT_MAG_MIP_LINEAR;
-			break;
-
-		case TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_LINEAR:
-			samplerDesc.Filter = samplerData.magFilter == TINYGLTF_TEXTURE_FILTER_NEAREST ?
-				D3D11_FILTER_MIN_LINEAR_MAG_POINT_MIP_LINEAR :
-				D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-			break;
+		hr = UploadMesh(cookedModel, meshIdx, initMatrix, pStats);
+	}
 
-		default:
-			samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-			break;
-		}
+	return hr;
+}
 
-		ID3D11SamplerState* pSamplerState = nullptr;
 
-		hr = pContext->GetDevice()->CreateSamplerState(&samplerDesc, &pSamplerState);
+void Model::ReserveTextures(UINT imageNum)
+{
+	// failed images stay as empty slots, so image indices remain valid
+	m_modelTextures.resize(imageNum, { nullptr, nullptr, true });
+}
 
-		if (FAILED(hr))
-		{
-			break;
-		}
+HRESULT Model::UploadTexture(UINT imageIdx, DecodedImage& image, ModelLoadStats* pStats)
+{
+	Texture& texture = m_modelTextures[imageIdx];
+	HRESULT hr = E_FAIL;
 
-		m_modelSampelers.push_back(pSamplerState);
+	if (image.isDecoded)
+	{
+		hr = createTextureFromImage(
+			m_pContext->GetDevice(),
+			image.image,
+			&texture.pTexture,
+			&texture.pTextureSRV
+		);
 	}
 
+	FinishTexture(imageIdx, image, hr, pStats);
+
 	return hr;
 }
 
-HRESULT Model::LoadMesh(
-	RendererContext* pContext,
-	const tinygltf::Model& model,
-	UINT meshIdx,
-	const DirectX::XMMATRIX& modelMatrix
-)
+bool Model::StreamTexture(UINT imageIdx, DecodedImage& image, UINT& nextRow, size_t& budget, ModelLoadStats* pStats)
 {
-	const tinygltf::Mesh& mesh = model.meshes[meshIdx];
+	Texture& texture = m_modelTextures[imageIdx];
+	const tinygltf::Image& pixels = image.image;
+
+	DXGI_FORMAT format = defineImageFormat(pixels);
 
-	if (mesh.primitives.size() > 1)
+	if (!image.isDecoded || format == DXGI_FORMAT_UNKNOWN || pixels.image.empty())
 	{
-		assert(false);
+		FinishTexture(imageIdx, image, E_FAIL, pStats);
+		return true;
 	}
 
-	UINT positionIdx = mesh.primitives[0].attributes.at("POSITION");
-	UINT normalIdx = mesh.primitives[0].attributes.at("NORMAL");
-	UINT tangentIdx = mesh.primitives[0].attributes.at("TANGENT");
-	UINT texCoordIdx = mesh.primitives[0].attributes.at("TEXCOORD_0");
-	UINT indicesIdx = mesh.primitives[0].indices;
+	HRESULT hr = S_OK;
 
-	const tinygltf::Accessor& positionDataAccessor = model.accessors[positionIdx];
-	const tinygltf::Accessor& normalDataAccessor = model.accessors[normalIdx];
-	const tinygltf::Accessor& tangentDataAccessor = model.accessors[tangentIdx];
-	const tinygltf::Accessor& texCoordDataAccessor = model.accessors[texCoordIdx];
-	const tinygltf::Accessor& indicesDataAccessor = model.accessors[indicesIdx];
+	if (texture.pTexture == nullptr)
+	{
+		D3D11_TEXTURE2D_DESC textureDesc = CreateDefaultTexture2DDesc(
+			format,
+			static_cast<UINT>(pixels.width),
+			static_cast<UINT>(pixels.height),
+			D3D11_BIND_SHADER_RESOURCE
+		);
 
-	std::vector<UINT16> indicesData = LoadUInt16Data(model.bufferViews[indicesDataAccessor.bufferView], indicesDataAccessor);
+		hr = m_pContext->GetDevice()->CreateTexture2D(&textureDesc, nullptr, &texture.pTexture);
+	}
 
-	for (size_t i = 0; i + 2 < indicesData.size(); i += 3)
+	if (SUCCEEDED(hr))
 	{
-		std::swap(indicesData[i + 1], indicesData[i + 2]);
+		UINT height = static_cast<UINT>(pixels.height);
+		UINT rowPitch = static_cast<UINT>(pixels.width * pixels.component * (pixels.bits / 8));
+
+		// at least one row per call, so a tiny budget still makes progress
+		UINT rowNum = static_cast<UINT>((std::min)(budget / rowPitch, static_cast<size_t>(height - nextRow)));
+		rowNum = (std::max)(rowNum, 1u);
+
+		D3D11_BOX box = { 0, nextRow, 0, static_cast<UINT>(pixels.width), nextRow + rowNum, 1 };
+
+		m_pContext->GetContext()->UpdateSubresource(
+			texture.pTexture,
+			0,
+			&box,
+			pixels.image.data() + static_cast<size_t>(nextRow) * rowPitch,
+			rowPitch,
+			0
+		);
+
+		nextRow += rowNum;
+		budget -= (std::min)(budget, static_cast<size_t>(rowNum) * rowPitch);
+
+		if (nextRow < height)
+		{
+			return false;
+		}
+
+		hr = m_pContext->GetDevice()->CreateShaderResourceView(texture.pTexture, nullptr, &texture.pTextureSRV);
 	}
 
-	const std::vector<float>& positionData = LoadFloatData(model.bufferViews[positionDataAccessor.bufferView], positionDataAccessor);
-	const std::vector<float>& normalData = LoadFloatData(model.bufferViews[normalDataAccessor.bufferView], normalDataAccessor);
-	const std::vector<float>& tangentData = LoadFloatData(model.bufferViews[tangentDataAccessor.bufferView], tangentDataAccessor);
-	const std::vector<float>& texCoordData = LoadFloatData(model.bufferViews[texCoordDataAccessor.bufferView], texCoordDataAccessor);
+	FinishTexture(imageIdx, image, hr, pStats);
+
+	return true;
+}
 
+void Model::FinishTexture(UINT imageIdx, DecodedImage& image, HRESULT hr, ModelLoadStats* pStats)
+{
+	Texture& texture = m_modelTextures[imageIdx];
+
+	if (image.isDecoded && pStats != nullptr)
 	{
-		assert(positionData.size() % 3 == 0);
-		assert(positionData.size() == normalData.size());
-		assert(normalData.size() / 3 == tangentData.size() / 4);
-		assert(positionData.size() / 3 == texCoordData.size() / 2);
+		pStats->decodeTimeMs += image.decodeTimeMs;
+		++pStats->imagesDecoded;
 	}
 
-	std::vector<Vertex> vertices;
-	vertices.resize(positionData.size() / 3);
-
-	for (UINT i = 0; i < vertices.size(); ++i)
+	if (FAILED(hr))
 	{
-		Vertex& vertex = vertices[i];
+		printf("%s: failed to load image %u %s\n", m_pathToModel.c_str(), imageIdx, image.error.c_str());
 
-		vertex.position = { positionData[3 * i + 0], positionData[3 * i + 1], positionData[3 * i + 2] };
-		vertex.normal = { normalData[3 * i + 0], normalData[3 * i + 1], normalData[3 * i + 2] };
-		vertex.tangent = { tangentData[4 * i + 0], tangentData[4 * i + 1], tangentData[4 * i + 2], tangentData[4 * i + 3] };
-		vertex.texCoord = { texCoordData[2 * i + 0], texCoordData[2 * i + 1] };
+		SafeRelease(texture.pTextureSRV);
+		SafeRelease(texture.pTexture);
 	}
 
-	Mesh* pMesh = CreateMesh(pContext, vertices, indicesData);
+	texture.isPending = false;
 
-	if (pMesh == nullptr)
+	// the pixels are on the GPU now
+	image.image.image.clear();
+	image.image.image.shrink_to_fit();
+
+	for (UINT i = 0; i < PrimitiveNum(); ++i)
 	{
-		return E_FAIL;
+		ResolvePrimitiveTextures(i);
 	}
-
-	pMesh->modelMatrix = modelMatrix;
-	m_modelMeshes.push_back(pMesh);
-
-	return S_OK;
 }
 
-
-void Model::SetUpPrimitives(const tinygltf::Model& model)
+HRESULT Model::UploadMesh(
+	const CookedModelView& cookedModel,
+	UINT meshIdx,
+	const DirectX::XMMATRIX& initMatrix,
+	ModelLoadStats* pStats
+)
 {
-	assert(m_modelMeshes.size() == model.meshes.size());
+	const CookedMesh& cookedMesh = cookedModel.meshes[meshIdx];
 
-	m_primitives.resize(m_modelMeshes.size());
+	Mesh* pMesh = CreateMesh(cookedModel, cookedMesh, pStats);
 
-	for (UINT i = 0; i < m_primitives.size(); ++i)
+	if (pMesh == nullptr)
 	{
-		const tinygltf::Material& material = model.materials[model.meshes[i].primitives[0].material];
-		Primitive& primitive = m_primitives[i];
+		return E_FAIL;
+	}
 
-		primitive.pMesh = m_modelMeshes[i];
-		primitive.topology = defineTopology(model.meshes[i].primitives[0].mode);
+	pMesh->modelMatrix = DirectX::XMLoadFloat4x4(&cookedMesh.modelMatrix) * initMatrix;
+	m_modelMeshes.push_back(pMesh);
 
-		int idx = -1;
-		if ((idx = material.pbrMetallicRoughness.baseColorTexture.index) != -1)
+	if (pStats != nullptr)
+	{
+		if (pMesh->indexFormat == DXGI_FORMAT_R16_UINT)
 		{
-			primitive.pColorTextureSRV = m_modelTextures[model.textures[idx].source].pTextureSRV;
-			primitive.pSamplerState = m_modelSampelers[model.textures[idx].sampler];
+			++pStats->meshes16BitIndices;
 		}
 		else
 		{
-			// TODO
-			// material without textures
-			assert(false);
-			continue;
+			++pStats->meshes32BitIndices;
+		}
+	}
+
+	DirectX::XMVECTOR meshBoundsMin = DirectX::XMVectorReplicate(FLT_MAX);
+	DirectX::XMVECTOR meshBoundsMax = DirectX::XMVectorReplicate(-FLT_MAX);
+
+	for (UINT i = 0; i < cookedMesh.primitiveCount; ++i)
+	{
+		const CookedPrimitive& cookedPrimitive = cookedModel.primitives[cookedMesh.firstPrimitive + i];
+		Primitive primitive;
+
+		primitive.pMesh = pMesh;
+		primitive.firstIndex = cookedPrimitive.firstIndex;
+		primitive.indexCount = cookedPrimitive.indexCount;
+		primitive.baseVertex = cookedPrimitive.baseVertex;
+		primitive.lods[0] = { cookedPrimitive.firstIndex, cookedPrimitive.indexCount };
+
+		for (UINT lodIdx = 0; lodIdx < cookedPrimitive.lodCount; ++lodIdx)
+		{
+			const CookedLod& cookedLod = cookedModel.lods[cookedPrimitive.firstLod + lodIdx];
+			primitive.lods[primitive.lodCount++] = { cookedLod.firstIndex, cookedLod.indexCount };
 		}
 
-		if ((idx = material.normalTexture.index) != -1)
+		primitive.firstMeshlet = static_cast<UINT>(m_meshlets.size());
+		primitive.meshletCount = cookedPrimitive.meshletCount;
+
+		for (UINT meshletIdx = 0; meshletIdx < cookedPrimitive.meshletCount; ++meshletIdx)
 		{
-			primitive.pNormalTextureSRV = m_modelTextures[model.textures[idx].source].pTextureSRV;
+			m_meshlets.push_back(cookedModel.meshlets[cookedPrimitive.firstMeshlet + meshletIdx]);
 		}
 
-		if ((idx = material.pbrMetallicRoughness.metallicRoughnessTexture.index) != -1)
+		primitive.boundsMin = cookedPrimitive.boundsMin;
+		primitive.boundsMax = cookedPrimitive.boundsMax;
+		primitive.worldBounds = TransformBounds(primitive.boundsMin, primitive.boundsMax, pMesh->modelMatrix);
+
+		meshBoundsMin = DirectX::XMVectorMin(meshBoundsMin, DirectX::XMLoadFloat3(&primitive.boundsMin));
+		meshBoundsMax = DirectX::XMVectorMax(meshBoundsMax, DirectX::XMLoadFloat3(&primitive.boundsMax));
+
+		primitive.topology = static_cast<D3D11_PRIMITIVE_TOPOLOGY>(cookedPrimitive.topology);
+
+		if (primitive.topology == D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
 		{
-			primitive.pMetalicRoughnessTextureSRV = m_modelTextures[model.textures[idx].source].pTextureSRV;
+			BuildOccluder(cookedModel, cookedMesh, pMesh, primitive);
 		}
-		if ((idx = material.emissiveTexture.index) != -1)
+
+		if (cookedPrimitive.sampler != CookedNone && static_cast<size_t>(cookedPrimitive.sampler) < m_modelSampelers.size())
 		{
-			primitive.pEmissiveTextureSRV = m_modelTextures[model.textures[idx].source].pTextureSRV;
+			primitive.pSamplerState = m_modelSampelers[cookedPrimitive.sampler];
 		}
-	}
-}
 
+		m_primitives.push_back(primitive);
+		m_primitiveImages.push_back({
+			cookedPrimitive.colorImage,
+			cookedPrimitive.normalImage,
+			cookedPrimitive.metalicRoughnessImage,
+			cookedPrimitive.emissiveImage
+		});
 
-std::vector<float> Model::LoadFloatData(const tinygltf::BufferView& bufferView, const tinygltf::Accessor& accessor) const
-{
-	UINT numPerVert = 0;
+		ResolvePrimitiveTextures(PrimitiveNum() - 1);
+	}
 
-	switch (accessor.type)
+	if (cookedMesh.primitiveCount > 0)
 	{
-	case TINYGLTF_TYPE_VEC4:
-		numPerVert = 4;
-		break;
+		DirectX::XMStoreFloat3(&pMesh->boundsMin, meshBoundsMin);
+		DirectX::XMStoreFloat3(&pMesh->boundsMax, meshBoundsMax);
+	}
 
-	case TINYGLTF_TYPE_VEC3:
-		numPerVert = 3;
-		break;
+	return S_OK;
+}
 
-	case TINYGLTF_TYPE_VEC2:
-		numPerVert = 2;
-		break;
 
-	case TINYGLTF_TYPE_SCALAR:
-		numPerVert = 1;
-		break;
+void Model::BuildOccluder(const CookedModelView& cookedModel, const CookedMesh& cookedMesh, const Mesh* pMesh, Primitive& primitive)
+{
+	// the most detailed LOD within the budget, the coarsest one otherwise
+	UINT lodIdx = 0;
 
-	default:
-		assert(false);
-		return std::vector<float>();
+	while (lodIdx + 1 < primitive.lodCount && primitive.lods[lodIdx].indexCount / 3 > OccluderMaxTriangleNum)
+	{
+		++lodIdx;
 	}
 
-	size_t dataOffset = bufferView.byteOffset + accessor.byteOffset;
+	const Lod& lod = primitive.lods[lodIdx];
 
-	std::vector<float> floatVector;
-	floatVector.resize(numPerVert * accessor.count);
+	const UINT8* pIndexData = cookedModel.indexData.pData + cookedMesh.indexDataOffset;
+	const Vertex* pVertices = cookedModel.vertices.pData + cookedMesh.firstVertex;
+	bool is16Bit = cookedMesh.indexFormat == DXGI_FORMAT_R16_UINT;
 
-	std::memcpy(floatVector.data(), m_pModelData + dataOffset, floatVector.size() * sizeof(float));
+	primitive.firstOccluderVertex = static_cast<UINT>(m_occluderPositions.size());
+	primitive.firstOccluderIndex = static_cast<UINT>(m_occluderIndices.size());
 
-	return floatVector;
-}
+	std::unordered_map<UINT32, UINT32> remap;
 
-std::vector<UINT16> Model::LoadUInt16Data(const tinygltf::BufferView& bufferView, const tinygltf::Accessor& accessor) const
-{
-	size_t dataOffset = bufferView.byteOffset + accessor.byteOffset;
+	for (UINT i = lod.firstIndex; i < lod.firstIndex + lod.indexCount - lod.indexCount % 3; ++i)
+	{
+		UINT32 index = is16Bit
+			? reinterpret_cast<const UINT16*>(pIndexData)[i]
+			: reinterpret_cast<const UINT32*>(pIndexData)[i];
+		UINT32 vertexIdx = static_cast<UINT32>(static_cast<INT>(index) + primitive.baseVertex);
 
-	std::vector<UINT16> uint16Vector;
-	uint16Vector.resize(accessor.count);
+		auto it = remap.find(vertexIdx);
 
-	switch (accessor.componentType)
-	{
-	case TINYGLTF_COMPONENT_TYPE_SHORT:
-		for (UINT i = 0; i < uint16Vector.size(); ++i)
+		if (it == remap.end())
 		{
-			short value = 0;
-			std::memcpy(&value, m_pModelData + dataOffset + i * sizeof(short), sizeof(short));
-
-			uint16Vector[i] = static_cast<UINT16>(value);
+			it = remap.emplace(vertexIdx, static_cast<UINT32>(remap.size())).first;
+
+			DirectX::XMFLOAT3 position;
+			DirectX::XMStoreFloat3(
+				&position,
+				DirectX::XMVector3Transform(DirectX::XMLoadFloat3(&pVertices[vertexIdx].position), pMesh->modelMatrix)
+			);
+			m_occluderPositions.push_back(position);
 		}
-		break;
 
+		m_occluderIndices.push_back(it->second);
+	}
 
-	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-		for (UINT i = 0; i < uint16Vector.size(); ++i)
-		{
-			unsigned short value = 0;
-			std::memcpy(&value, m_pModelData + dataOffset + i * sizeof(unsigned short), sizeof(unsigned short));
+	primitive.occluderVertexCount = static_cast<UINT>(m_occluderPositions.size()) - primitive.firstOccluderVertex;
+	primitive.occluderIndexCount = static_cast<UINT>(m_occluderIndices.size()) - primitive.firstOccluderIndex;
+}
 
-			uint16Vector[i] = static_cast<UINT16>(value);
-		}
-		break;
 
-	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-		for (UINT i = 0; i < uint16Vector.size(); ++i)
-		{
-			unsigned int value = 0;
-			std::memcpy(&value, m_pModelData + dataOffset + i * sizeof(unsigned int), sizeof(unsigned int));
+ID3D11ShaderResourceView* Model::GetTextureSRV(INT32 imageIdx, PlaceholderTexture placeholder) const
+{
+	// the material has no such texture, its default is bound instead
+	if (imageIdx == CookedNone || static_cast<size_t>(imageIdx) >= m_modelTextures.size())
+	{
+		return m_pContext->GetPlaceholderTextureSRV(placeholder);
+	}
 
-			uint16Vector[i] = static_cast<UINT16>(value);
-		}
-		break;
+	const Texture& texture = m_modelTextures[imageIdx];
 
-	default:
-		assert(false);
-		return std::vector<UINT16>();
-	}
+	return texture.isPending ? m_pContext->GetPlaceholderTextureSRV(placeholder) : texture.pTextureSRV;
+}
 
-	return uint16Vector;
+void Model::ResolvePrimitiveTextures(UINT primitiveIdx)
+{
+	Primitive& primitive = m_primitives[primitiveIdx];
+	const PrimitiveImages& images = m_primitiveImages[primitiveIdx];
+
+	primitive.pColorTextureSRV = GetTextureSRV(images.color, PlaceholderTexture::Color);
+	primitive.pNormalTextureSRV = GetTextureSRV(images.normal, PlaceholderTexture::Normal);
+	primitive.pMetalicRoughnessTextureSRV = GetTextureSRV(images.metalicRoughness, PlaceholderTexture::MetalicRoughness);
+	primitive.pEmissiveTextureSRV = GetTextureSRV(images.emissive, PlaceholderTexture::Emissive);
 }
 
 
-Mesh* Model::CreateMesh(RendererContext* pContext, const std::vector<Vertex>& vertexData, const std::vector<UINT16>& indexData) const
+Mesh* Model::CreateMesh(const CookedModelView& cookedModel, const CookedMesh& cookedMesh, ModelLoadStats* pStats) const
 {
-	ID3D11Device* pDevice = pContext->GetDevice();
+	GeometryPool* pPool = m_pContext->GetGeometryPool();
+
 	Mesh* pMesh = new Mesh();
+	pMesh->pGeometryPool = pPool;
+
+	const Vertex* pVertices = cookedModel.vertices.pData + cookedMesh.firstVertex;
+	const void* pVertexData = pVertices;
+
+	// the cache keeps float vertices, compressed ones only live on the GPU
+	std::vector<BYTE> compressedVertices;
+	pMesh->vertexFormat = s_vertexFormat;
+
+	if (s_vertexFormat != VertexFormat::Float)
+	{
+		CompressVertices(
+			pVertices,
+			cookedMesh.vertexCount,
+			s_vertexFormat,
+			compressedVertices,
+			pMesh->dequantization,
+			pStats != nullptr ? &pStats->vertexCompression : nullptr
+		);
+		pVertexData = compressedVertices.data();
+
+		if (pStats != nullptr)
+		{
+			pStats->vertexFormat = s_vertexFormat;
+		}
+	}
 
-	D3D11_BUFFER_DESC vertexBufferDesc = CreateDefaultBufferDesc(
-		static_cast<UINT>(vertexData.size()) * sizeof(Vertex),
-		D3D11_BIND_VERTEX_BUFFER
+	HRESULT hr = pPool->Upload(
+		GetVertexStride(s_vertexFormat),
+		D3D11_BIND_VERTEX_BUFFER,
+		cookedMesh.vertexCount,
+		pVertexData,
+		pMesh->vertexRange
 	);
-	D3D11_SUBRESOURCE_DATA vertexBufferData = CreateDefaultSubresourceData(vertexData.data());
 
-	HRESULT hr = pDevice->CreateBuffer(&vertexBufferDesc, &vertexBufferData, &pMesh->pVertexBuffer);
+	if (SUCCEEDED(hr) && s_hasPositionStream)
+	{
+		std::vector<BYTE> positions;
+		ExtractPositionStream(pVertexData, cookedMesh.vertexCount, s_vertexFormat, positions);
+
+		hr = pPool->Upload(
+			GetPositionStride(s_vertexFormat),
+			D3D11_BIND_VERTEX_BUFFER,
+			cookedMesh.vertexCount,
+			positions.data(),
+			pMesh->positionRange
+		);
+
+		if (SUCCEEDED(hr) && pStats != nullptr)
+		{
+			pStats->positionStreamBytes += positions.size();
+		}
+	}
 
 	if (SUCCEEDED(hr))
 	{
-		D3D11_BUFFER_DESC indexBufferDesc = CreateDefaultBufferDesc(
-			static_cast<UINT>(indexData.size()) * sizeof(UINT16),
-			D3D11_BIND_INDEX_BUFFER
-		);
-		D3D11_SUBRESOURCE_DATA indexBufferData = CreateDefaultSubresourceData(indexData.data());
+		if (pStats != nullptr)
+		{
+			pStats->vertexBufferBytes += cookedMesh.vertexCount * GetVertexStride(s_vertexFormat);
+		}
 
-		pMesh->indexCount = static_cast<UINT>(indexData.size());
+		pMesh->indexCount = cookedMesh.indexCount;
+		pMesh->indexFormat = static_cast<DXGI_FORMAT>(cookedMesh.indexFormat);
 
-		hr = pDevice->CreateBuffer(&indexBufferDesc, &indexBufferData, &pMesh->pIndexBuffer);
+		UINT indexSize = pMesh->indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(UINT16) : sizeof(UINT32);
+
+		hr = pPool->Upload(
+			indexSize,
+			D3D11_BIND_INDEX_BUFFER,
+			cookedMesh.indexCount,
+			cookedModel.indexData.pData + cookedMesh.indexDataOffset,
+			pMesh->indexRange
+		);
 	}
 
 	if (FAILED(hr))
 	{
 		delete pMesh;
-		pMesh = nullptr;
+		return nullptr;
 	}
 
 	return pMesh;
@@ -1,29 +1,115 @@
 #pragma once
 #include "rendererContext.h"
+#include "meshCache.h"
+#include "textureDecoder.h"
+#include "vertexCompression.h"
+#include "frustumCulling.h"
+#include "geometryPool.h"
 
 struct Mesh
 {
-	ID3D11Buffer* pVertexBuffer = nullptr;
-	ID3D11Buffer* pIndexBuffer = nullptr;
+	// ranges of the shared pool buffers, the offsets go into the draws
+	GeometryPool* pGeometryPool = nullptr;
+	GeometryRange vertexRange;
+	GeometryRange indexRange;
+	// optional position-only copy of the vertices for depth passes
+	GeometryRange positionRange;
 	UINT indexCount = 0;
+	DXGI_FORMAT indexFormat = DXGI_FORMAT_R16_UINT;
 	DirectX::XMMATRIX modelMatrix = DirectX::XMMatrixIdentity();
 
+	// local space
+	DirectX::XMFLOAT3 boundsMin = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 boundsMax = { 0.0f, 0.0f, 0.0f };
+
+	VertexFormat vertexFormat = VertexFormat::Float;
+	VertexDequantization dequantization;
+
 	bool hasShadow = true;
 
 	~Mesh()
 	{
-		SafeRelease(pIndexBuffer);
-		SafeRelease(pVertexBuffer);
+		if (pGeometryPool != nullptr)
+		{
+			pGeometryPool->Free(positionRange);
+			pGeometryPool->Free(indexRange);
+			pGeometryPool->Free(vertexRange);
+		}
 	}
 };
 
+struct ModelLoadStats
+{
+	size_t bytesRead = 0;
+	UINT filesRead = 0;
+
+	size_t bytesMapped = 0;
+	UINT filesMapped = 0;
+
+	size_t bytesStreamed = 0;
+	size_t peakStreamedBytes = 0;
+
+	UINT meshes16BitIndices = 0;
+	UINT meshes32BitIndices = 0;
+
+	UINT imagesDecoded = 0;
+	double decodeTimeMs = 0.0;
+	double decodeWallTimeMs = 0.0;
+	UINT decodeThreadNum = 0;
+
+	bool isCacheHit = false;
+	double coldLoadTimeMs = 0.0;
+	double prepareTimeMs = 0.0;
+
+	VertexFormat vertexFormat = VertexFormat::Float;
+	VertexCompressionStats vertexCompression;
+
+	size_t vertexBufferBytes = 0;
+	size_t positionStreamBytes = 0;
+
+	double totalTimeMs = 0.0;
+};
+
+void PrintModelLoadStats(const std::string& pathToModel, const ModelLoadStats& stats);
+
+
 class Model
 {
 public:
+	struct Lod
+	{
+		UINT firstIndex = 0;
+		UINT indexCount = 0;
+	};
+
 	struct Primitive
 	{
 		Mesh* pMesh = nullptr;
 
+		UINT firstIndex = 0;
+		UINT indexCount = 0;
+		INT baseVertex = 0;
+
+		// lods[0] is the full detail range above, the others share its base vertex
+		UINT lodCount = 1;
+		Lod lods[MaxLodNum];
+
+		// meshlets of the full detail range in GetMeshlets()
+		UINT firstMeshlet = 0;
+		UINT meshletCount = 0;
+
+		// world space triangles of a coarse LOD for CPU occlusion culling,
+		// the indices are relative to firstOccluderVertex
+		UINT firstOccluderVertex = 0;
+		UINT occluderVertexCount = 0;
+		UINT firstOccluderIndex = 0;
+		UINT occluderIndexCount = 0;
+
+		DirectX::XMFLOAT3 boundsMin = { 0.0f, 0.0f, 0.0f };
+		DirectX::XMFLOAT3 boundsMax = { 0.0f, 0.0f, 0.0f };
+		// the local bounds transformed by the mesh model matrix
+		BoundingVolume worldBounds;
+
 		ID3D11ShaderResourceView* pColorTextureSRV = nullptr;
 		ID3D11ShaderResourceView* pNormalTextureSRV = nullptr;
 		ID3D11ShaderResourceView* pMetalicRoughnessTextureSRV = nullptr;
@@ -37,53 +123,91 @@ public:
 public:
 	static Model* CreateModel(
 		RendererContext* pContext,
-		const tinygltf::Model& model,
+		const CookedModelView& cookedModel,
 		const std::string& pathToModel,
-		const DirectX::XMMATRIX& initMatrix = DirectX::XMMatrixIdentity()
+		const DirectX::XMMATRIX& initMatrix = DirectX::XMMatrixIdentity(),
+		ModelLoadStats* pStats = nullptr
 	);
 
 	~Model();
 
 	inline UINT PrimitiveNum() const { return static_cast<UINT>(m_primitives.size()); };
 
+	// false while the model is still streaming in
+	inline bool IsResident() const { return m_isResident; }
+
 	Primitive GetPrimitive(UINT idx) const;
+	inline const CookedMeshlet* GetMeshlets() const { return m_meshlets.data(); }
+	inline const DirectX::XMFLOAT3* GetOccluderPositions() const { return m_occluderPositions.data(); }
+	inline const UINT32* GetOccluderIndices() const { return m_occluderIndices.data(); }
+
+	// Layout of the vertex buffers of models created afterwards
+	static void SetVertexFormat(VertexFormat format);
+	static VertexFormat GetVertexFormat();
+
+	// Whether meshes get a position stream for depth passes
+	static void SetPositionStream(bool isEnabled);
+	static bool HasPositionStream();
 
 private:
-	Model(const std::string& pathToModel);
+	friend class ModelLoader;
 
-	bool Init(RendererContext* pContext, const tinygltf::Model& model, const DirectX::XMMATRIX& initMatrix);
+	Model(RendererContext* pContext, const std::string& pathToModel);
 
-	HRESULT ParseNode(
-		RendererContext* pContext,
-		const tinygltf::Model& model,
-		UINT nodeIdx,
-		const DirectX::XMMATRIX& prevMatrix
+	bool Init(
+		const CookedModelView& cookedModel,
+		const DirectX::XMMATRIX& initMatrix,
+		ModelLoadStats* pStats
 	);
 
-	HRESULT LoadTextures(RendererContext* pContext, const tinygltf::Model& model);
-	HRESULT LoadSamplers(RendererContext* pContext, const tinygltf::Model& model);
-	HRESULT LoadMesh(
-		RendererContext* pContext,
-		const tinygltf::Model& model,
-		UINT meshidx,
-		const DirectX::XMMATRIX& modelMatrix
+	HRESULT LoadTextures(const CookedModelView& cookedModel, ModelLoadStats* pStats);
+	HRESULT LoadSamplers(const CookedModelView& cookedModel);
+	HRESULT LoadMeshes(
+		const CookedModelView& cookedModel,
+		const DirectX::XMMATRIX& initMatrix,
+		ModelLoadStats* pStats
 	);
 
-	void SetUpPrimitives(const tinygltf::Model& model);
+	// single steps of LoadTextures and LoadMeshes, ModelLoader spreads them over frames
+	void ReserveTextures(UINT imageNum);
+	HRESULT UploadTexture(UINT imageIdx, DecodedImage& image, ModelLoadStats* pStats);
+	// Uploads rows from nextRow on until the budget is used up, returns true once the texture is done
+	bool StreamTexture(UINT imageIdx, DecodedImage& image, UINT& nextRow, size_t& budget, ModelLoadStats* pStats);
+	void FinishTexture(UINT imageIdx, DecodedImage& image, HRESULT hr, ModelLoadStats* pStats);
+	HRESULT UploadMesh(
+		const CookedModelView& cookedModel,
+		UINT meshIdx,
+		const DirectX::XMMATRIX& initMatrix,
+		ModelLoadStats* pStats
+	);
 
-	std::vector<float> LoadFloatData(const tinygltf::BufferView& bufferView, const tinygltf::Accessor& accessor) const;
-	std::vector<UINT16> LoadUInt16Data(const tinygltf::BufferView& bufferView, const tinygltf::Accessor& accessor) const;
+	ID3D11ShaderResourceView* GetTextureSRV(INT32 imageIdx, PlaceholderTexture placeholder) const;
+	void ResolvePrimitiveTextures(UINT primitiveIdx);
 
-	Mesh* CreateMesh(RendererContext* pContext, const std::vector<Vertex>& vertexData, const std::vector<UINT16>& indexData) const;
+	Mesh* CreateMesh(const CookedModelView& cookedModel, const CookedMesh& cookedMesh, ModelLoadStats* pStats) const;
+	void BuildOccluder(const CookedModelView& cookedModel, const CookedMesh& cookedMesh, const Mesh* pMesh, Primitive& primitive);
 
 private:
 	struct Texture
 	{
 		ID3D11Texture2D* pTexture;
 		ID3D11ShaderResourceView* pTextureSRV;
+		bool isPending;
+	};
+
+	struct PrimitiveImages
+	{
+		INT32 color;
+		INT32 normal;
+		INT32 metalicRoughness;
+		INT32 emissive;
 	};
 
 private:
+	static VertexFormat s_vertexFormat;
+	static bool s_hasPositionStream;
+
+	RendererContext* m_pContext;
 	std::string m_pathToModel;
 
 	std::vector<Texture> m_modelTextures;
@@ -91,6 +215,10 @@ private:
 	std::vector<Mesh*> m_modelMeshes;
 
 	std::vector<Primitive> m_primitives;
+	std::vector<PrimitiveImages> m_primitiveImages;
+	std::vector<CookedMeshlet> m_meshlets;
+	std::vector<DirectX::XMFLOAT3> m_occluderPositions;
+	std::vector<UINT32> m_occluderIndices;
 
-	char* m_pModelData;
+	bool m_isResident;
 };
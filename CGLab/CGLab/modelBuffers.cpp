@@ -0,0 +1,310 @@
+#include "modelBuffers.h"
+#include "model.h"
+
+
+static constexpr UINT32 GLBMagic = 0x46546C67; // "glTF"
+static constexpr UINT32 GLBChunkJSON = 0x4E4F534A;
+static constexpr UINT32 GLBChunkBIN = 0x004E4942;
+
+UINT32 readUInt32(const UINT8* pData)
+{
+	UINT32 value = 0;
+	memcpy(&value, pData, sizeof(value));
+
+	return value;
+}
+
+bool findGLBBinChunk(const MappedFile* pContainer, BufferSpan& binChunk)
+{
+	const size_t headerSize = 12;
+	const size_t chunkHeaderSize = 8;
+
+	if (pContainer == nullptr
+		|| pContainer->GetData() == nullptr
+		|| pContainer->GetSize() < headerSize + chunkHeaderSize)
+	{
+		return false;
+	}
+
+	const UINT8* pData = pContainer->GetData();
+	size_t size = (std::min)(static_cast<size_t>(readUInt32(pData + 8)), pContainer->GetSize());
+
+	if (readUInt32(pData) != GLBMagic || readUInt32(pData + 4) != 2)
+	{
+		return false;
+	}
+
+	size_t offset = headerSize;
+
+	while (offset + chunkHeaderSize <= size)
+	{
+		size_t chunkLength = readUInt32(pData + offset);
+		UINT32 chunkType = readUInt32(pData + offset + 4);
+
+		offset += chunkHeaderSize;
+
+		if (chunkLength > size - offset)
+		{
+			return false;
+		}
+
+		if (chunkType == GLBChunkBIN)
+		{
+			binChunk = { pData + offset, chunkLength };
+			return true;
+		}
+
+		offset += chunkLength;
+	}
+
+	return false;
+}
+
+
+ModelBuffers* ModelBuffers::Create(
+	const tinygltf::Model& model,
+	const std::string& pathToModel,
+	const MappedFile* pContainer,
+	ModelLoadStats* pStats
+)
+{
+	ModelBuffers* pBuffers = new ModelBuffers();
+
+	if (pBuffers->Init(model, pathToModel, pContainer, pStats))
+	{
+		return pBuffers;
+	}
+
+	delete pBuffers;
+	return nullptr;
+}
+
+
+ModelBuffers::ModelBuffers()
+	: m_streamedBytes(0)
+	, m_bytesStreamed(0)
+	, m_peakStreamedBytes(0)
+{}
+
+ModelBuffers::~ModelBuffers()
+{
+	ReleaseStreamedViews();
+
+	for (auto& buffer : m_buffers)
+	{
+		MappedFile::UnmapRange(buffer.range);
+		delete buffer.pFile;
+	}
+}
+
+
+bool ModelBuffers::Init(
+	const tinygltf::Model& model,
+	const std::string& pathToModel,
+	const MappedFile* pContainer,
+	ModelLoadStats* pStats
+)
+{
+	m_buffers.resize(model.buffers.size());
+
+	for (size_t i = 0; i < model.buffers.size(); ++i)
+	{
+		const tinygltf::Buffer& gltfBuffer = model.buffers[i];
+		Buffer& buffer = m_buffers[i];
+
+		// data URIs are always decoded by tinygltf
+		if (!gltfBuffer.data.empty())
+		{
+			buffer.span = { gltfBuffer.data.data(), gltfBuffer.data.size() };
+			continue;
+		}
+
+		// only the first buffer may refer to the GLB BIN chunk
+		if (gltfBuffer.uri.empty())
+		{
+			if (i != 0 || !findGLBBinChunk(pContainer, buffer.span))
+			{
+				printf("buffer %zu has no data\n", i);
+				return false;
+			}
+
+			buffer.fileName = pContainer->GetFileName();
+			buffer.fileOffset = static_cast<UINT64>(buffer.span.pData - pContainer->GetData());
+
+			if (buffer.fileName.compare(0, pathToModel.size() + 1, pathToModel + "/") == 0)
+			{
+				buffer.fileName.erase(0, pathToModel.size() + 1);
+			}
+			continue;
+		}
+
+		std::string fileName;
+
+		if (!tinygltf::URIDecode(gltfBuffer.uri, &fileName, nullptr))
+		{
+			return false;
+		}
+
+		buffer.pFile = MappedFile::Open(pathToModel + "/" + fileName, false);
+		buffer.fileName = fileName;
+
+		if (buffer.pFile == nullptr)
+		{
+			printf("failed to open buffer %s\n", fileName.c_str());
+			return false;
+		}
+
+		if (buffer.pFile->GetSize() > StreamingThreshold)
+		{
+			buffer.isStreamed = true;
+			continue;
+		}
+
+		buffer.range = buffer.pFile->MapRange(0, buffer.pFile->GetSize());
+
+		if (buffer.range.pData == nullptr)
+		{
+			return false;
+		}
+
+		buffer.span = { buffer.range.pData, buffer.range.size };
+
+		if (pStats != nullptr)
+		{
+			pStats->bytesMapped += buffer.range.size;
+			++pStats->filesMapped;
+		}
+	}
+
+	return true;
+}
+
+
+const ModelBuffers::Buffer* ModelBuffers::FindBuffer(const tinygltf::Model& model, int bufferViewIdx) const
+{
+	if (bufferViewIdx < 0 || static_cast<size_t>(bufferViewIdx) >= model.bufferViews.size())
+	{
+		return nullptr;
+	}
+
+	const tinygltf::BufferView& bufferView = model.bufferViews[bufferViewIdx];
+
+	if (bufferView.buffer < 0 || static_cast<size_t>(bufferView.buffer) >= m_buffers.size())
+	{
+		return nullptr;
+	}
+
+	return &m_buffers[bufferView.buffer];
+}
+
+BufferSpan ModelBuffers::GetBufferView(const tinygltf::Model& model, int bufferViewIdx)
+{
+	if (bufferViewIdx < 0 || static_cast<size_t>(bufferViewIdx) >= model.bufferViews.size())
+	{
+		return BufferSpan();
+	}
+
+	return GetBufferViewRange(model, bufferViewIdx, 0, model.bufferViews[bufferViewIdx].byteLength);
+}
+
+BufferSpan ModelBuffers::GetBufferViewRange(const tinygltf::Model& model, int bufferViewIdx, size_t offset, size_t size)
+{
+	const Buffer* pBuffer = FindBuffer(model, bufferViewIdx);
+
+	if (pBuffer == nullptr)
+	{
+		return BufferSpan();
+	}
+
+	const tinygltf::BufferView& bufferView = model.bufferViews[bufferViewIdx];
+
+	if (offset > bufferView.byteLength || size > bufferView.byteLength - offset)
+	{
+		return BufferSpan();
+	}
+
+	if (!pBuffer->isStreamed)
+	{
+		if (pBuffer->span.pData == nullptr || bufferView.byteOffset + bufferView.byteLength > pBuffer->span.size)
+		{
+			return BufferSpan();
+		}
+
+		return { pBuffer->span.pData + bufferView.byteOffset + offset, size };
+	}
+
+	if (size > StreamingWindowSize)
+	{
+		printf("%zu bytes of bufferView %d are more than a streaming window\n", size, bufferViewIdx);
+		return BufferSpan();
+	}
+
+	// ranges inside a window already mapped, e.g. interleaved attributes, share it
+	for (const auto& view : m_streamedViews)
+	{
+		if (view.bufferViewIdx == bufferViewIdx && view.offset <= offset && offset + size <= view.offset + view.range.size)
+		{
+			return { view.range.pData + (offset - view.offset), size };
+		}
+	}
+
+	MappedRange range = pBuffer->pFile->MapRange(bufferView.byteOffset + offset, size);
+
+	if (range.pData == nullptr)
+	{
+		return BufferSpan();
+	}
+
+	m_streamedViews.push_back({ bufferViewIdx, offset, range });
+
+	m_streamedBytes += range.size;
+	m_bytesStreamed += range.size;
+	m_peakStreamedBytes = (std::max)(m_peakStreamedBytes, m_streamedBytes);
+
+	return { range.pData, size };
+}
+
+size_t ModelBuffers::GetMaxRangeSize(const tinygltf::Model& model, int bufferViewIdx) const
+{
+	const Buffer* pBuffer = FindBuffer(model, bufferViewIdx);
+
+	if (pBuffer == nullptr)
+	{
+		return 0;
+	}
+
+	size_t byteLength = model.bufferViews[bufferViewIdx].byteLength;
+
+	return pBuffer->isStreamed ? (std::min)(byteLength, StreamingWindowSize) : byteLength;
+}
+
+bool ModelBuffers::GetBufferViewLocation(
+	const tinygltf::Model& model,
+	int bufferViewIdx,
+	std::string& fileName,
+	UINT64& fileOffset
+) const
+{
+	const Buffer* pBuffer = FindBuffer(model, bufferViewIdx);
+
+	if (pBuffer == nullptr || pBuffer->fileName.empty())
+	{
+		return false;
+	}
+
+	fileName = pBuffer->fileName;
+	fileOffset = pBuffer->fileOffset + model.bufferViews[bufferViewIdx].byteOffset;
+
+	return true;
+}
+
+void ModelBuffers::ReleaseStreamedViews()
+{
+	for (auto& view : m_streamedViews)
+	{
+		MappedFile::UnmapRange(view.range);
+	}
+	m_streamedViews.clear();
+
+	m_streamedBytes = 0;
+}
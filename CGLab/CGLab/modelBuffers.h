@@ -0,0 +1,100 @@
+#pragma once
+#include "framework.h"
+#include "tiny_gltf.h"
+#include "mappedFile.h"
+
+#include <vector>
+
+struct ModelLoadStats;
+
+
+struct BufferSpan
+{
+	const UINT8* pData = nullptr;
+	size_t size = 0;
+};
+
+
+// Resolves glTF buffers by index: data URIs are used as decoded by tinygltf,
+// external .bin files are memory mapped and the GLB BIN chunk is read in place.
+// Buffers above StreamingThreshold are never mapped whole, the ranges read from them are
+// mapped in windows of at most StreamingWindowSize bytes until ReleaseStreamedViews() is
+// called. Larger bufferViews of those buffers have to be read range by range, releasing
+// the windows in between keeps the mapped bytes bounded.
+class ModelBuffers
+{
+public:
+	static constexpr size_t StreamingThreshold = 256 * 1024 * 1024;
+	static constexpr size_t StreamingWindowSize = 32 * 1024 * 1024;
+
+	static ModelBuffers* Create(
+		const tinygltf::Model& model,
+		const std::string& pathToModel,
+		const MappedFile* pContainer,
+		ModelLoadStats* pStats
+	);
+
+	~ModelBuffers();
+
+	// Empty for a bufferView of a streamed buffer larger than StreamingWindowSize
+	BufferSpan GetBufferView(const tinygltf::Model& model, int bufferViewIdx);
+	// Bytes [offset, offset + size) of the bufferView, for a streamed buffer at most StreamingWindowSize
+	BufferSpan GetBufferViewRange(const tinygltf::Model& model, int bufferViewIdx, size_t offset, size_t size);
+	// Bytes of the bufferView that GetBufferViewRange returns at once
+	size_t GetMaxRangeSize(const tinygltf::Model& model, int bufferViewIdx) const;
+
+	// Location of the bufferView in its source file, false for data URI buffers
+	bool GetBufferViewLocation(
+		const tinygltf::Model& model,
+		int bufferViewIdx,
+		std::string& fileName,
+		UINT64& fileOffset
+	) const;
+	void ReleaseStreamedViews();
+
+	inline size_t GetBytesStreamed() const { return m_bytesStreamed; }
+	inline size_t GetPeakStreamedBytes() const { return m_peakStreamedBytes; }
+
+private:
+	ModelBuffers();
+
+	bool Init(
+		const tinygltf::Model& model,
+		const std::string& pathToModel,
+		const MappedFile* pContainer,
+		ModelLoadStats* pStats
+	);
+
+private:
+	struct Buffer
+	{
+		BufferSpan span;
+
+		MappedFile* pFile = nullptr;
+		MappedRange range;
+
+		std::string fileName;
+		UINT64 fileOffset = 0;
+
+		bool isStreamed = false;
+	};
+
+	// mapped window of a bufferView of a streamed buffer
+	struct StreamedView
+	{
+		int bufferViewIdx;
+		size_t offset;
+		MappedRange range;
+	};
+
+	const Buffer* FindBuffer(const tinygltf::Model& model, int bufferViewIdx) const;
+
+private:
+	std::vector<Buffer> m_buffers;
+
+	std::vector<StreamedView> m_streamedViews;
+	size_t m_streamedBytes;
+
+	size_t m_bytesStreamed;
+	size_t m_peakStreamedBytes;
+};
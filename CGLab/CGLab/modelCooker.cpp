@@ -0,0 +1,1090 @@
+#include "modelCooker.h"
+#include "model.h"
+#include "vertexInterleave.h"
+#include "accessorView.h"
+#include "meshOptimizer.h"
+#include "meshSimplifier.h"
+#include "meshlet.h"
+#include "frustumCulling.h"
+
+#include <chrono>
+
+
+bool countingReadWholeFile(
+	std::vector<unsigned char>* pOut,
+	std::string* pErr,
+	const std::string& filePath,
+	void* pUserData
+)
+{
+	bool res = tinygltf::ReadWholeFile(pOut, pErr, filePath, nullptr);
+
+	if (res && pUserData != nullptr)
+	{
+		ModelLoadStats* pStats = static_cast<ModelLoadStats*>(pUserData);
+
+		pStats->bytesRead += pOut->size();
+		++pStats->filesRead;
+	}
+
+	return res;
+}
+
+// Images are decoded from the cooked data, only data URI images keep their encoded bytes here.
+// Images stored in buffers are referenced by their location instead. Nothing is decoded,
+// so the requested size, warnings and user data of the tinygltf callback are not needed.
+bool keepEncodedImageData(
+	tinygltf::Image* pImage,
+	const int imageIdx,
+	std::string* pErr,
+	std::string* pWarn,
+	int reqWidth,
+	int reqHeight,
+	const unsigned char* pBytes,
+	int size,
+	void* pUserData
+)
+{
+	UNREFERENCED_PARAMETER(pWarn);
+	UNREFERENCED_PARAMETER(reqWidth);
+	UNREFERENCED_PARAMETER(reqHeight);
+	UNREFERENCED_PARAMETER(pUserData);
+
+	if (pImage->bufferView != -1)
+	{
+		return true;
+	}
+
+	if (pBytes == nullptr || size <= 0)
+	{
+		if (pErr != nullptr)
+		{
+			*pErr += "image " + std::to_string(imageIdx) + " has no data\n";
+		}
+
+		return false;
+	}
+
+	pImage->image.assign(pBytes, pBytes + size);
+	pImage->as_is = true;
+
+	return true;
+}
+
+D3D11_TEXTURE_ADDRESS_MODE defineAddressMode(int gltfAddressMode)
+{
+	switch (gltfAddressMode)
+	{
+	case TINYGLTF_TEXTURE_WRAP_REPEAT:
+		return D3D11_TEXTURE_ADDRESS_WRAP;
+
+	case TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE:
+		return D3D11_TEXTURE_ADDRESS_CLAMP;
+
+	case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT:
+		return D3D11_TEXTURE_ADDRESS_MIRROR;
+
+	default:
+		break;
+	}
+
+	return D3D11_TEXTURE_ADDRESS_WRAP;
+}
+
+D3D11_PRIMITIVE_TOPOLOGY defineTopology(int gltfTopology)
+{
+	switch (gltfTopology)
+	{
+	case TINYGLTF_MODE_POINTS:
+		return D3D11_PRIMITIVE_TOPOLOGY_POINTLIST;
+
+	case TINYGLTF_MODE_LINE:
+		return D3D11_PRIMITIVE_TOPOLOGY_LINELIST;
+
+	case TINYGLTF_MODE_LINE_STRIP:
+		return D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP;
+
+	case TINYGLTF_MODE_TRIANGLES:
+		return D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+	case TINYGLTF_MODE_TRIANGLE_STRIP:
+		return D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
+
+	default:
+		break;
+	}
+	
+	assert(false);
+	return D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+}
+
+// elements of the accessor read at once, all of them unless its buffer is streamed
+size_t getChunkElementNum(const tinygltf::Model& model, const tinygltf::Accessor& accessor, ModelBuffers* pBuffers)
+{
+	int componentSize = tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(accessor.componentType));
+	int componentNum = tinygltf::GetNumComponentsInType(static_cast<uint32_t>(accessor.type));
+
+	if (componentSize <= 0
+		|| componentNum <= 0
+		|| accessor.bufferView < 0
+		|| static_cast<size_t>(accessor.bufferView) >= model.bufferViews.size())
+	{
+		return 0;
+	}
+
+	size_t elementSize = static_cast<size_t>(componentSize * componentNum);
+	size_t stride = model.bufferViews[accessor.bufferView].byteStride != 0 ? model.bufferViews[accessor.bufferView].byteStride : elementSize;
+	size_t maxRangeSize = pBuffers->GetMaxRangeSize(model, accessor.bufferView);
+
+	return maxRangeSize >= elementSize ? (maxRangeSize - elementSize) / stride + 1 : 0;
+}
+
+// vertices [first, first + count) of the accessor
+bool createAttributeStream(
+	const tinygltf::Model& model,
+	const tinygltf::Accessor& accessor,
+	ModelBuffers* pBuffers,
+	size_t first,
+	size_t count,
+	AttributeStream& stream
+)
+{
+	if (accessor.sparse.isSparse
+		|| accessor.bufferView < 0
+		|| static_cast<size_t>(accessor.bufferView) >= model.bufferViews.size()
+		|| count == 0)
+	{
+		return false;
+	}
+
+	int componentSize = tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(accessor.componentType));
+	int componentNum = tinygltf::GetNumComponentsInType(static_cast<uint32_t>(accessor.type));
+
+	if (componentSize <= 0 || componentNum <= 0)
+	{
+		return false;
+	}
+
+	const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+
+	size_t elementSize = static_cast<size_t>(componentSize * componentNum);
+	size_t stride = bufferView.byteStride != 0 ? bufferView.byteStride : elementSize;
+
+	BufferSpan vertexData = pBuffers->GetBufferViewRange(
+		model,
+		accessor.bufferView,
+		accessor.byteOffset + stride * first,
+		stride * (count - 1) + elementSize
+	);
+
+	if (vertexData.pData == nullptr)
+	{
+		return false;
+	}
+
+	stream.pData = vertexData.pData;
+	stream.size = vertexData.size;
+	stream.stride = stride;
+	stream.componentType = accessor.componentType;
+	stream.componentNum = static_cast<UINT>(componentNum);
+	stream.normalized = accessor.normalized;
+
+	return true;
+}
+
+// Interleaves the vertices in chunks whose streams fit one streaming window each,
+// the windows are released after every chunk
+bool interleaveAccessors(
+	const tinygltf::Model& model,
+	const tinygltf::Accessor& position,
+	const tinygltf::Accessor& normal,
+	const tinygltf::Accessor& tangent,
+	const tinygltf::Accessor& texCoord,
+	ModelBuffers* pBuffers,
+	Vertex* pVertices
+)
+{
+	size_t vertexCount = position.count;
+	size_t chunkVertexNum = (std::min)({
+		getChunkElementNum(model, position, pBuffers),
+		getChunkElementNum(model, normal, pBuffers),
+		getChunkElementNum(model, tangent, pBuffers),
+		getChunkElementNum(model, texCoord, pBuffers)
+	});
+
+	if (chunkVertexNum == 0)
+	{
+		return vertexCount == 0;
+	}
+
+	for (size_t first = 0; first < vertexCount; first += chunkVertexNum)
+	{
+		size_t count = (std::min)(chunkVertexNum, vertexCount - first);
+
+		VertexStreams streams;
+
+		bool isValid = createAttributeStream(model, position, pBuffers, first, count, streams.position)
+			&& createAttributeStream(model, normal, pBuffers, first, count, streams.normal)
+			&& createAttributeStream(model, tangent, pBuffers, first, count, streams.tangent)
+			&& createAttributeStream(model, texCoord, pBuffers, first, count, streams.texCoord)
+			&& IsValidAttributeStream(streams.position, 3, count)
+			&& IsValidAttributeStream(streams.normal, 3, count)
+			&& IsValidAttributeStream(streams.tangent, 4, count)
+			&& IsValidAttributeStream(streams.texCoord, 2, count);
+
+		if (isValid)
+		{
+			InterleaveVertices(streams, count, pVertices + first);
+		}
+
+		pBuffers->ReleaseStreamedViews();
+
+		if (!isValid)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+template <class T>
+bool copyIndices(
+	const tinygltf::Model& model,
+	const tinygltf::Accessor& accessor,
+	ModelBuffers* pBuffers,
+	std::vector<UINT32>& indices
+)
+{
+	// whole triangles in every chunk, so the winding swap stays inside one
+	size_t chunkIndexNum = getChunkElementNum(model, accessor, pBuffers);
+	chunkIndexNum -= chunkIndexNum >= 3 ? chunkIndexNum % 3 : 0;
+
+	indices.resize(accessor.count);
+
+	if (chunkIndexNum == 0)
+	{
+		return indices.empty();
+	}
+
+	size_t triangleIndicesCount = indices.size() - indices.size() % 3;
+
+	for (size_t first = 0; first < indices.size(); first += chunkIndexNum)
+	{
+		size_t count = (std::min)(chunkIndexNum, indices.size() - first);
+		AccessorView<T> indicesView = AccessorView<T>::Create(model, accessor, pBuffers, first, count);
+
+		if (!indicesView.IsValid())
+		{
+			pBuffers->ReleaseStreamedViews();
+			return false;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			// the second and the third index of a triangle swap places
+			size_t corner = first + i < triangleIndicesCount ? i % 3 : 0;
+			size_t sourceIdx = corner == 1 ? i + 1 : (corner == 2 ? i - 1 : i);
+
+			indices[first + i] = static_cast<UINT32>(indicesView[sourceIdx]);
+		}
+
+		pBuffers->ReleaseStreamedViews();
+	}
+
+	return true;
+}
+
+
+bool ModelCooker::s_optimizeMeshes = true;
+UINT ModelCooker::s_lodLevelNum = 4;
+bool ModelCooker::s_buildMeshlets = false;
+
+
+bool ModelCooker::Cook(const std::string& pathToModel, CookedModel& cookedModel, ModelLoadStats* pStats)
+{
+	tinygltf::TinyGLTF loader;
+	tinygltf::Model model;
+
+	std::string err;
+	std::string warn;
+
+	tinygltf::FsCallbacks fsCallbacks = {};
+	fsCallbacks.FileExists = &tinygltf::FileExists;
+	fsCallbacks.ExpandFilePath = &tinygltf::ExpandFilePath;
+	fsCallbacks.ReadWholeFile = &countingReadWholeFile;
+	fsCallbacks.WriteWholeFile = &tinygltf::WriteWholeFile;
+	fsCallbacks.user_data = pStats;
+
+	loader.SetFsCallbacks(fsCallbacks);
+	loader.SetImageLoader(&keepEncodedImageData, nullptr);
+	loader.SetLoadBufferData(false);
+
+	// single file assets are parsed in place, the BIN chunk is never copied
+	MappedFile* pContainer = nullptr;
+	bool isLoaded = false;
+
+	std::string glbFileName = pathToModel + "/scene.glb";
+
+	if (tinygltf::FileExists(glbFileName, nullptr))
+	{
+		pContainer = MappedFile::Open(glbFileName);
+
+		if (pContainer != nullptr)
+		{
+			if (pStats != nullptr)
+			{
+				pStats->bytesMapped += pContainer->GetSize();
+				++pStats->filesMapped;
+			}
+
+			isLoaded = loader.LoadBinaryFromMemory(
+				&model,
+				&err,
+				&warn,
+				pContainer->GetData(),
+				static_cast<unsigned int>(pContainer->GetSize()),
+				pathToModel
+			);
+		}
+	}
+	else
+	{
+		isLoaded = loader.LoadASCIIFromFile(&model, &err, &warn, pathToModel + "/scene.gltf");
+	}
+
+	if (!err.empty())
+	{
+		printf("erros: %s\n", err.c_str());
+	}
+	if (!warn.empty())
+	{
+		printf("warnings: %s\n", warn.c_str());
+	}
+
+	bool res = false;
+
+	if (isLoaded)
+	{
+		cookedModel.cookFlags = GetCookFlags();
+
+		ModelCooker cooker(model, pathToModel, cookedModel);
+
+		res = cooker.Init(pContainer, pStats) && cooker.CookModel(pStats);
+	}
+
+	delete pContainer;
+
+	return res;
+}
+
+bool ModelCooker::LoadCooked(
+	const std::string& pathToModel,
+	MeshCache*& pCache,
+	CookedModel& cookedModel,
+	ModelLoadStats& stats
+)
+{
+	auto prepareStart = std::chrono::steady_clock::now();
+
+	std::string cacheFileName = MeshCache::GetFileName(pathToModel);
+	UINT64 sourceHash = MeshCache::ComputeSourceHash(pathToModel);
+
+	pCache = MeshCache::Open(cacheFileName, sourceHash, GetCookFlags());
+
+	bool res = pCache != nullptr;
+
+	if (res)
+	{
+		stats.isCacheHit = true;
+		stats.coldLoadTimeMs = pCache->GetColdLoadTimeMs();
+		stats.bytesMapped += pCache->GetSize();
+		++stats.filesMapped;
+	}
+	else
+	{
+		res = Cook(pathToModel, cookedModel, &stats);
+
+		stats.coldLoadTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - prepareStart).count();
+
+		if (res && !MeshCache::Write(cacheFileName, cookedModel, sourceHash, stats.coldLoadTimeMs))
+		{
+			printf("%s: failed to write %s\n", pathToModel.c_str(), cacheFileName.c_str());
+		}
+	}
+
+	stats.prepareTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - prepareStart).count();
+
+	return res;
+}
+
+bool ModelCooker::CookToCache(const std::string& pathToModel)
+{
+	auto cookStart = std::chrono::steady_clock::now();
+
+	CookedModel cookedModel;
+	UINT64 sourceHash = MeshCache::ComputeSourceHash(pathToModel);
+
+	if (!Cook(pathToModel, cookedModel))
+	{
+		printf("%s: cook failed\n", pathToModel.c_str());
+		return false;
+	}
+
+	double cookTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cookStart).count();
+	std::string cacheFileName = MeshCache::GetFileName(pathToModel);
+
+	if (!MeshCache::Write(cacheFileName, cookedModel, sourceHash, cookTimeMs))
+	{
+		printf("%s: failed to write %s\n", pathToModel.c_str(), cacheFileName.c_str());
+		return false;
+	}
+
+	printf(
+		"%s: cooked %zu meshes, %zu primitives, %zu vertices, %zu images in %.2f ms\n",
+		pathToModel.c_str(),
+		cookedModel.meshes.size(),
+		cookedModel.primitives.size(),
+		cookedModel.vertices.size(),
+		cookedModel.images.size(),
+		cookTimeMs
+	);
+
+	return true;
+}
+
+
+void ModelCooker::SetMeshOptimization(bool isEnabled)
+{
+	s_optimizeMeshes = isEnabled;
+}
+
+void ModelCooker::SetLodLevelNum(UINT lodLevelNum)
+{
+	s_lodLevelNum = (std::min)((std::max)(lodLevelNum, 1u), MaxLodNum);
+}
+
+void ModelCooker::SetMeshletBuild(bool isEnabled)
+{
+	s_buildMeshlets = isEnabled;
+}
+
+UINT32 ModelCooker::GetCookFlags()
+{
+	UINT32 flags = s_optimizeMeshes ? CookOptimizedMeshes : 0;
+
+	if (s_lodLevelNum > 1)
+	{
+		flags |= CookMeshLods | (s_lodLevelNum << CookLodLevelShift);
+	}
+
+	if (s_buildMeshlets)
+	{
+		flags |= CookMeshlets;
+	}
+
+	return flags;
+}
+
+
+ModelCooker::ModelCooker(const tinygltf::Model& model, const std::string& pathToModel, CookedModel& cookedModel)
+	: m_model(model)
+	, m_pathToModel(pathToModel)
+	, m_cookedModel(cookedModel)
+	, m_pBuffers(nullptr)
+{}
+
+ModelCooker::~ModelCooker()
+{
+	delete m_pBuffers;
+}
+
+
+bool ModelCooker::Init(const MappedFile* pContainer, ModelLoadStats* pStats)
+{
+	m_pBuffers = ModelBuffers::Create(m_model, m_pathToModel, pContainer, pStats);
+
+	return m_pBuffers != nullptr;
+}
+
+
+bool ModelCooker::CookModel(ModelLoadStats* pStats)
+{
+	if (!CookImages())
+	{
+		return false;
+	}
+
+	CookSamplers();
+
+	DirectX::XMMATRIX mat = DirectX::XMMatrixIdentity();
+	mat.r[0].m128_f32[0] = -mat.r[0].m128_f32[0];
+
+	bool res = true;
+
+	if (!m_model.scenes.empty())
+	{
+		const tinygltf::Scene& scene = m_model.scenes[m_model.defaultScene >= 0 ? m_model.defaultScene : 0];
+
+		for (int nodeIdx : scene.nodes)
+		{
+			res = res && ParseNode(nodeIdx, mat);
+		}
+	}
+	else if (!m_model.nodes.empty())
+	{
+		res = ParseNode(0, mat);
+	}
+
+	if (pStats != nullptr)
+	{
+		pStats->bytesStreamed += m_pBuffers->GetBytesStreamed();
+		pStats->peakStreamedBytes = (std::max)(pStats->peakStreamedBytes, m_pBuffers->GetPeakStreamedBytes());
+	}
+
+	return res;
+}
+
+bool ModelCooker::CookImages()
+{
+	for (UINT i = 0; i < m_model.images.size(); ++i)
+	{
+		const tinygltf::Image& image = m_model.images[i];
+
+		CookedImage cookedImage = {};
+		std::string fileName;
+
+		if (image.bufferView != -1)
+		{
+			if (m_pBuffers->GetBufferViewLocation(m_model, image.bufferView, fileName, cookedImage.dataOffset))
+			{
+				cookedImage.fileNameOffset = AddFileName(fileName);
+				cookedImage.dataSize = m_model.bufferViews[image.bufferView].byteLength;
+			}
+			else
+			{
+				BufferSpan imageData = m_pBuffers->GetBufferView(m_model, image.bufferView);
+
+				if (imageData.pData == nullptr)
+				{
+					return false;
+				}
+
+				cookedImage.fileNameOffset = CookedInlineImage;
+				cookedImage.dataOffset = m_cookedModel.blobs.size();
+				cookedImage.dataSize = imageData.size;
+
+				m_cookedModel.blobs.insert(m_cookedModel.blobs.end(), imageData.pData, imageData.pData + imageData.size);
+			}
+		}
+		else if (image.as_is)
+		{
+			cookedImage.fileNameOffset = CookedInlineImage;
+			cookedImage.dataOffset = m_cookedModel.blobs.size();
+			cookedImage.dataSize = image.image.size();
+
+			m_cookedModel.blobs.insert(m_cookedModel.blobs.end(), image.image.begin(), image.image.end());
+		}
+		else if (!image.uri.empty() && tinygltf::URIDecode(image.uri, &fileName, nullptr))
+		{
+			// the whole file
+			cookedImage.fileNameOffset = AddFileName(fileName);
+		}
+		else
+		{
+			printf("image %u has no data\n", i);
+			return false;
+		}
+
+		m_cookedModel.images.push_back(cookedImage);
+	}
+
+	m_pBuffers->ReleaseStreamedViews();
+
+	return true;
+}
+
+void ModelCooker::CookSamplers()
+{
+	for (const auto& samplerData : m_model.samplers)
+	{
+		D3D11_SAMPLER_DESC samplerDesc = {};
+		samplerDesc.MipLODBias = 0;
+		samplerDesc.MinLOD = 0;
+		samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+		samplerDesc.AddressU = defineAddressMode(samplerData.wrapS);
+		samplerDesc.AddressV = defineAddressMode(samplerData.wrapT);
+		samplerDesc.AddressW = samplerDesc.AddressU;
+
+		switch (samplerData.minFilter)
+		{
+		case TINYGLTF_TEXTURE_FILTER_NEAREST:
+		case TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_NEAREST:
+			samplerDesc.Filter = samplerData.magFilter == TINYGLTF_TEXTURE_FILTER_NEAREST ?
+				D3D11_FILTER_MIN_MAG_MIP_POINT :
+				D3D11_FILTER_MIN_POINT_MAG_LINEAR_MIP_POINT;
+			break;
+
+		case TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_NEAREST:
+		case TINYGLTF_TEXTURE_FILTER_LINEAR:
+			samplerDesc.Filter = samplerData.magFilter == TINYGLTF_TEXTURE_FILTER_NEAREST ?
+				D3D11_FILTER_MIN_LINEAR_MAG_MIP_POINT :
+				D3D11_FILTER_MIN_MAG_LINEAR_MIP_POINT;
+			break;
+
+		case TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_LINEAR:
+			samplerDesc.Filter = samplerData.magFilter == TINYGLTF_TEXTURE_FILTER_NEAREST ?
+				D3D11_FILTER_MIN_MAG_POINT_MIP_LINEAR :
+				D3D11_FILTER_MIN_POINT_MAG_MIP_LINEAR;
+			break;
+
+		case TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_LINEAR:
+			samplerDesc.Filter = samplerData.magFilter == TINYGLTF_TEXTURE_FILTER_NEAREST ?
+				D3D11_FILTER_MIN_LINEAR_MAG_POINT_MIP_LINEAR :
+				D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+			break;
+
+		default:
+			samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+			break;
+		}
+
+		m_cookedModel.samplers.push_back(samplerDesc);
+	}
+}
+
+
+bool ModelCooker::ParseNode(UINT nodeIdx, const DirectX::XMMATRIX& prevMatrix)
+{
+	const tinygltf::Node& currentNode = m_model.nodes[nodeIdx];
+
+	float translation[3] = { 0.0f, 0.0f, 0.0f };
+	if (!currentNode.translation.empty())
+	{
+		for (UINT i = 0; i < _countof(translation); ++i)
+		{
+			translation[i] = static_cast<float>(currentNode.translation[i]);
+		}
+	}
+
+	float rotation[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	if (!currentNode.rotation.empty())
+	{
+		for (UINT i = 0; i < _countof(rotation); ++i)
+		{
+			rotation[i] = static_cast<float>(currentNode.rotation[i]);
+		}
+	}
+
+	float scale[3] = { 1.0f, 1.0f, 1.0f };
+	if (!currentNode.scale.empty())
+	{
+		for (UINT i = 0; i < _countof(scale); ++i)
+		{
+			scale[i] = static_cast<float>(currentNode.scale[i]);
+		}
+	}
+
+	float matrix[16] = {};
+	memset(matrix, 0, sizeof(matrix));
+	matrix[0] = matrix[5] = matrix[10] = matrix[15] = 1.0f;
+	if (!currentNode.matrix.empty())
+	{
+		for (UINT i = 0; i < _countof(matrix); ++i)
+		{
+			matrix[i] = static_cast<float>(currentNode.matrix[i]);
+		}
+	}
+
+	DirectX::XMMATRIX currentNodeMatrix =
+		DirectX::XMMatrixScaling(scale[0], scale[1], scale[2]) *
+		DirectX::XMMatrixRotationQuaternion({ rotation[0], rotation[1], rotation[2], rotation[3] }) *
+		DirectX::XMMatrixTranslation(translation[0], translation[1], translation[2]) *
+		DirectX::XMMATRIX(matrix) *
+		prevMatrix;
+
+	if (currentNode.mesh != -1)
+	{
+		if (!CookMesh(currentNode.mesh, currentNodeMatrix))
+		{
+			return false;
+		}
+	}
+
+	for (UINT childIdx : currentNode.children)
+	{
+		if (!ParseNode(childIdx, currentNodeMatrix))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ModelCooker::CookMesh(UINT meshIdx, const DirectX::XMMATRIX& modelMatrix)
+{
+	const tinygltf::Mesh& mesh = m_model.meshes[meshIdx];
+
+	// all primitives of the mesh share one vertex and one index range
+	CookedMesh cookedMesh = {};
+	DirectX::XMStoreFloat4x4(&cookedMesh.modelMatrix, modelMatrix);
+	cookedMesh.firstVertex = static_cast<UINT32>(m_cookedModel.vertices.size());
+	cookedMesh.firstPrimitive = static_cast<UINT32>(m_cookedModel.primitives.size());
+
+	std::vector<UINT32> indices;
+	size_t maxPrimitiveVertexCount = 0;
+
+	MeshOptimizationStats optimizationStats;
+	std::vector<size_t> lodTriangleCounts;
+	size_t meshletNum = 0;
+	size_t meshletTriangleNum = 0;
+
+	for (const auto& gltfPrimitive : mesh.primitives)
+	{
+		UINT positionIdx = gltfPrimitive.attributes.at("POSITION");
+		UINT normalIdx = gltfPrimitive.attributes.at("NORMAL");
+		UINT tangentIdx = gltfPrimitive.attributes.at("TANGENT");
+		UINT texCoordIdx = gltfPrimitive.attributes.at("TEXCOORD_0");
+
+		if (gltfPrimitive.indices < 0)
+		{
+			return false;
+		}
+
+		size_t vertexCount = m_model.accessors[positionIdx].count;
+
+		if (m_model.accessors[normalIdx].count != vertexCount
+			|| m_model.accessors[tangentIdx].count != vertexCount
+			|| m_model.accessors[texCoordIdx].count != vertexCount)
+		{
+			return false;
+		}
+
+		std::vector<UINT32> primitiveIndices;
+
+		if (!LoadIndexData(m_model.accessors[gltfPrimitive.indices], primitiveIndices))
+		{
+			return false;
+		}
+
+		for (UINT32 index : primitiveIndices)
+		{
+			if (index >= vertexCount)
+			{
+				return false;
+			}
+		}
+
+		size_t firstVertex = m_cookedModel.vertices.size();
+
+		CookedPrimitive primitive = {};
+		primitive.firstIndex = static_cast<UINT32>(indices.size());
+		primitive.indexCount = static_cast<UINT32>(primitiveIndices.size());
+		primitive.baseVertex = static_cast<INT32>(firstVertex - cookedMesh.firstVertex);
+		primitive.topology = static_cast<UINT32>(defineTopology(gltfPrimitive.mode));
+
+		CookMaterial(gltfPrimitive.material, primitive);
+
+		m_cookedModel.vertices.resize(firstVertex + vertexCount);
+
+		if (!interleaveAccessors(
+			m_model,
+			m_model.accessors[positionIdx],
+			m_model.accessors[normalIdx],
+			m_model.accessors[tangentIdx],
+			m_model.accessors[texCoordIdx],
+			m_pBuffers,
+			m_cookedModel.vertices.data() + firstVertex))
+		{
+			return false;
+		}
+
+		ComputeBounds(m_cookedModel.vertices.data() + firstVertex, vertexCount, primitive.boundsMin, primitive.boundsMax);
+
+		if (s_optimizeMeshes && primitive.topology == D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
+		{
+			OptimizePrimitive(m_cookedModel.vertices.data() + firstVertex, vertexCount, primitiveIndices, optimizationStats);
+		}
+
+		indices.insert(indices.end(), primitiveIndices.begin(), primitiveIndices.end());
+
+		if (s_buildMeshlets && primitive.topology == D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
+		{
+			CookPrimitiveMeshlets(m_cookedModel.vertices.data() + firstVertex, vertexCount, primitiveIndices, primitive);
+
+			meshletNum += primitive.meshletCount;
+			meshletTriangleNum += primitiveIndices.size() / 3;
+		}
+
+		if (s_lodLevelNum > 1 && primitive.topology == D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
+		{
+			CookPrimitiveLods(m_cookedModel.vertices.data() + firstVertex, vertexCount, indices, primitive, lodTriangleCounts);
+		}
+
+		maxPrimitiveVertexCount = (std::max)(maxPrimitiveVertexCount, vertexCount);
+		m_cookedModel.primitives.push_back(primitive);
+	}
+
+	m_pBuffers->ReleaseStreamedViews();
+
+	if (optimizationStats.triangleCount > 0)
+	{
+		printf(
+			"%s: mesh %u, %zu triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+			m_pathToModel.c_str(),
+			meshIdx,
+			optimizationStats.triangleCount,
+			optimizationStats.before.acmr,
+			optimizationStats.after.acmr,
+			optimizationStats.before.atvr,
+			optimizationStats.after.atvr
+		);
+	}
+
+	if (meshletNum > 0)
+	{
+		printf(
+			"%s: mesh %u, %zu meshlets, %.1f triangles per meshlet\n",
+			m_pathToModel.c_str(),
+			meshIdx,
+			meshletNum,
+			static_cast<double>(meshletTriangleNum) / meshletNum
+		);
+	}
+
+	if (lodTriangleCounts.size() > 1)
+	{
+		std::string lodTriangles;
+
+		for (size_t count : lodTriangleCounts)
+		{
+			lodTriangles += (lodTriangles.empty() ? "" : " / ") + std::to_string(count);
+		}
+
+		printf("%s: mesh %u, LOD triangles %s\n", m_pathToModel.c_str(), meshIdx, lodTriangles.c_str());
+	}
+
+	cookedMesh.vertexCount = static_cast<UINT32>(m_cookedModel.vertices.size() - cookedMesh.firstVertex);
+	cookedMesh.primitiveCount = static_cast<UINT32>(m_cookedModel.primitives.size() - cookedMesh.firstPrimitive);
+	cookedMesh.indexCount = static_cast<UINT32>(indices.size());
+
+	if (cookedMesh.primitiveCount == 0)
+	{
+		return true;
+	}
+
+	std::vector<UINT8>& indexData = m_cookedModel.indexData;
+
+	// keep every mesh index range 4 byte aligned
+	indexData.resize((indexData.size() + 3) & ~static_cast<size_t>(3));
+	cookedMesh.indexDataOffset = indexData.size();
+
+	// indices are relative to the primitive base vertex, so 16-bit
+	// indices are enough while every primitive fits in 65536 vertices
+	if (maxPrimitiveVertexCount <= 0x10000)
+	{
+		cookedMesh.indexFormat = DXGI_FORMAT_R16_UINT;
+		indexData.resize(indexData.size() + indices.size() * sizeof(UINT16));
+
+		UINT16* pIndices = reinterpret_cast<UINT16*>(indexData.data() + cookedMesh.indexDataOffset);
+
+		for (size_t i = 0; i < indices.size(); ++i)
+		{
+			pIndices[i] = static_cast<UINT16>(indices[i]);
+		}
+	}
+	else
+	{
+		cookedMesh.indexFormat = DXGI_FORMAT_R32_UINT;
+		indexData.resize(indexData.size() + indices.size() * sizeof(UINT32));
+
+		memcpy(indexData.data() + cookedMesh.indexDataOffset, indices.data(), indices.size() * sizeof(UINT32));
+	}
+
+	m_cookedModel.meshes.push_back(cookedMesh);
+
+	return true;
+}
+
+void ModelCooker::OptimizePrimitive(
+	Vertex* pVertices,
+	size_t vertexCount,
+	std::vector<UINT32>& indices,
+	MeshOptimizationStats& stats
+) const
+{
+	VertexCacheStats before = AnalyzeVertexCache(indices.data(), indices.size(), vertexCount);
+
+	std::vector<size_t> clusters;
+
+	OptimizeVertexCache(indices.data(), indices.size(), vertexCount, clusters);
+	OptimizeOverdraw(indices.data(), indices.size(), pVertices, vertexCount, clusters);
+	OptimizeVertexFetch(indices.data(), indices.size(), pVertices, vertexCount);
+
+	VertexCacheStats after = AnalyzeVertexCache(indices.data(), indices.size(), vertexCount);
+
+	stats.Add(before, after, indices.size() / 3);
+}
+
+void ModelCooker::CookPrimitiveMeshlets(
+	const Vertex* pVertices,
+	size_t vertexCount,
+	const std::vector<UINT32>& primitiveIndices,
+	CookedPrimitive& primitive
+)
+{
+	std::vector<CookedMeshlet>& meshlets = m_cookedModel.meshlets;
+
+	primitive.firstMeshlet = static_cast<UINT32>(meshlets.size());
+
+	BuildMeshlets(primitiveIndices.data(), primitiveIndices.size(), pVertices, vertexCount, meshlets);
+
+	primitive.meshletCount = static_cast<UINT32>(meshlets.size() - primitive.firstMeshlet);
+
+	for (size_t m = primitive.firstMeshlet; m < meshlets.size(); ++m)
+	{
+		meshlets[m].firstIndex += primitive.firstIndex;
+	}
+}
+
+void ModelCooker::CookMaterial(int materialIdx, CookedPrimitive& primitive) const
+{
+	primitive.colorImage = CookedNone;
+	primitive.normalImage = CookedNone;
+	primitive.metalicRoughnessImage = CookedNone;
+	primitive.emissiveImage = CookedNone;
+	primitive.sampler = CookedNone;
+
+	// missing textures and samplers stay CookedNone, the renderer binds its defaults instead
+	if (materialIdx < 0)
+	{
+		return;
+	}
+
+	const tinygltf::Material& material = m_model.materials[materialIdx];
+
+	int idx = -1;
+	if ((idx = material.pbrMetallicRoughness.baseColorTexture.index) != -1)
+	{
+		primitive.colorImage = m_model.textures[idx].source;
+		primitive.sampler = m_model.textures[idx].sampler;
+	}
+
+	if ((idx = material.normalTexture.index) != -1)
+	{
+		primitive.normalImage = m_model.textures[idx].source;
+	}
+
+	if ((idx = material.pbrMetallicRoughness.metallicRoughnessTexture.index) != -1)
+	{
+		primitive.metalicRoughnessImage = m_model.textures[idx].source;
+	}
+	if ((idx = material.emissiveTexture.index) != -1)
+	{
+		primitive.emissiveImage = m_model.textures[idx].source;
+	}
+}
+
+
+bool ModelCooker::LoadIndexData(const tinygltf::Accessor& accessor, std::vector<UINT32>& indices)
+{
+	switch (accessor.componentType)
+	{
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		return copyIndices<UINT8>(m_model, accessor, m_pBuffers, indices);
+
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+		return copyIndices<UINT16>(m_model, accessor, m_pBuffers, indices);
+
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+		return copyIndices<UINT32>(m_model, accessor, m_pBuffers, indices);
+
+	default:
+		break;
+	}
+
+	assert(false);
+	return false;
+}
+
+UINT32 ModelCooker::AddFileName(const std::string& fileName)
+{
+	auto it = m_fileNames.find(fileName);
+
+	if (it == m_fileNames.end())
+	{
+		it = m_fileNames.emplace(fileName, m_cookedModel.AddString(fileName)).first;
+	}
+
+	return it->second;
+}
+
+void ModelCooker::CookPrimitiveLods(
+	const Vertex* pVertices,
+	size_t vertexCount,
+	std::vector<UINT32>& indices,
+	CookedPrimitive& primitive,
+	std::vector<size_t>& lodTriangleCounts
+)
+{
+	// below this a level saves less than its draw call costs
+	static constexpr size_t minLodTriangleNum = 64;
+
+	primitive.firstLod = static_cast<UINT32>(m_cookedModel.lods.size());
+	primitive.lodCount = 0;
+
+	std::vector<UINT32> sourceIndices(
+		indices.begin() + primitive.firstIndex,
+		indices.begin() + primitive.firstIndex + primitive.indexCount
+	);
+	std::vector<UINT32> lodIndices;
+	std::vector<size_t> clusters;
+
+	std::vector<size_t> triangleCounts = { sourceIndices.size() / 3 };
+	float error = 0.0f;
+
+	for (UINT level = 1; level < s_lodLevelNum; ++level)
+	{
+		size_t targetIndexCount = sourceIndices.size() / 6 * 3;
+
+		if (targetIndexCount < minLodTriangleNum * 3)
+		{
+			break;
+		}
+
+		// every level starts from the previous one, so the errors add up
+		error += SimplifyMesh(sourceIndices.data(), sourceIndices.size(), pVertices, vertexCount, targetIndexCount, lodIndices);
+
+		// locked borders and seams stop the collapses early, such a level is barely cheaper
+		if (lodIndices.size() > sourceIndices.size() * 3 / 4)
+		{
+			break;
+		}
+
+		if (s_optimizeMeshes)
+		{
+			OptimizeVertexCache(lodIndices.data(), lodIndices.size(), vertexCount, clusters);
+		}
+
+		CookedLod lod = {};
+		lod.firstIndex = static_cast<UINT32>(indices.size());
+		lod.indexCount = static_cast<UINT32>(lodIndices.size());
+		lod.error = error;
+
+		indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+		m_cookedModel.lods.push_back(lod);
+		++primitive.lodCount;
+
+		triangleCounts.push_back(lodIndices.size() / 3);
+		sourceIndices.swap(lodIndices);
+	}
+
+	// primitives with a shorter chain stay at their last level
+	lodTriangleCounts.resize(s_lodLevelNum, 0);
+
+	for (UINT level = 0; level < s_lodLevelNum; ++level)
+	{
+		lodTriangleCounts[level] += triangleCounts[(std::min)(static_cast<size_t>(level), triangleCounts.size() - 1)];
+	}
+}
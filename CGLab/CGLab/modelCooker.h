@@ -0,0 +1,86 @@
+#pragma once
+#include "framework.h"
+#include "meshCache.h"
+#include "modelBuffers.h"
+
+struct ModelLoadStats;
+struct MeshOptimizationStats;
+
+
+// Turns scene.glb or scene.gltf of a model directory into a CookedModel:
+// interleaved vertices, final-winding indices, flattened node transforms,
+// material bindings, sampler descs and encoded image locations.
+class ModelCooker
+{
+public:
+	static bool Cook(const std::string& pathToModel, CookedModel& cookedModel, ModelLoadStats* pStats = nullptr);
+
+	// Maps the up to date mesh cache of the model, or cooks the sources and refreshes
+	// the cache. On a cache hit pCache holds the cooked data, cookedModel otherwise.
+	static bool LoadCooked(
+		const std::string& pathToModel,
+		MeshCache*& pCache,
+		CookedModel& cookedModel,
+		ModelLoadStats& stats
+	);
+
+	// Offline cook step, writes the mesh cache next to the model sources
+	static bool CookToCache(const std::string& pathToModel);
+
+	// Vertex cache, overdraw and vertex fetch reordering of triangle lists, on by default
+	static void SetMeshOptimization(bool isEnabled);
+	// Length of the LOD chain of every triangle list including the full detail level,
+	// each level has about half the triangles of the previous one. 1 turns LODs off.
+	static void SetLodLevelNum(UINT lodLevelNum);
+	// Meshlets with culling bounds for the full detail range of every triangle list, off by default
+	static void SetMeshletBuild(bool isEnabled);
+	static UINT32 GetCookFlags();
+
+	~ModelCooker();
+
+private:
+	ModelCooker(const tinygltf::Model& model, const std::string& pathToModel, CookedModel& cookedModel);
+
+	bool Init(const MappedFile* pContainer, ModelLoadStats* pStats);
+
+	bool CookModel(ModelLoadStats* pStats);
+	bool CookImages();
+	void CookSamplers();
+
+	bool ParseNode(UINT nodeIdx, const DirectX::XMMATRIX& prevMatrix);
+	bool CookMesh(UINT meshIdx, const DirectX::XMMATRIX& modelMatrix);
+	void OptimizePrimitive(Vertex* pVertices, size_t vertexCount, std::vector<UINT32>& indices, MeshOptimizationStats& stats) const;
+	// Appends the simplified index ranges of the primitive to indices
+	void CookPrimitiveLods(
+		const Vertex* pVertices,
+		size_t vertexCount,
+		std::vector<UINT32>& indices,
+		CookedPrimitive& primitive,
+		std::vector<size_t>& lodTriangleCounts
+	);
+	void CookPrimitiveMeshlets(
+		const Vertex* pVertices,
+		size_t vertexCount,
+		const std::vector<UINT32>& primitiveIndices,
+		CookedPrimitive& primitive
+	);
+	void CookMaterial(int materialIdx, CookedPrimitive& primitive) const;
+
+	bool LoadIndexData(const tinygltf::Accessor& accessor, std::vector<UINT32>& indices);
+
+	UINT32 AddFileName(const std::string& fileName);
+
+private:
+	static bool s_optimizeMeshes;
+	static UINT s_lodLevelNum;
+	static bool s_buildMeshlets;
+
+private:
+	const tinygltf::Model& m_model;
+	std::string m_pathToModel;
+
+	CookedModel& m_cookedModel;
+	ModelBuffers* m_pBuffers;
+
+	std::unordered_map<std::string, UINT32> m_fileNames;
+};
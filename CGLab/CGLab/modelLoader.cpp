@@ -0,0 +1,259 @@
+#include "modelLoader.h"
+#include "modelCooker.h"
+#include "threadPool.h"
+
+
+ModelLoader* ModelLoader::Create(RendererContext* pContext, size_t uploadBudget)
+{
+	ModelLoader* pLoader = new ModelLoader(pContext, uploadBudget);
+
+	if (pLoader->Init())
+	{
+		return pLoader;
+	}
+
+	delete pLoader;
+	return nullptr;
+}
+
+
+ModelLoader::ModelLoader(RendererContext* pContext, size_t uploadBudget)
+	: m_pContext(pContext)
+	, m_pDecodePool(nullptr)
+	, m_uploadBudget((std::max)(uploadBudget, s_minUploadBudget))
+	, m_lastFrameUploadBytes(0)
+	, m_isStopping(false)
+{}
+
+ModelLoader::~ModelLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isStopping = true;
+	}
+	m_queueCV.notify_all();
+
+	if (m_loaderThread.joinable())
+	{
+		m_loaderThread.join();
+	}
+
+	// unfinished models stay with their owner as they are
+	for (auto* pJob : m_jobs)
+	{
+		delete pJob->pCache;
+		delete pJob;
+	}
+
+	delete m_pDecodePool;
+}
+
+
+bool ModelLoader::Init()
+{
+	// the context pool belongs to the render thread, decoding gets its own workers
+	m_pDecodePool = ThreadPool::Create();
+
+	if (m_pDecodePool == nullptr)
+	{
+		return false;
+	}
+
+	m_loaderThread = std::thread(&ModelLoader::LoaderLoop, this);
+
+	return true;
+}
+
+
+Model* ModelLoader::LoadModelAsync(const std::string& pathToModel, const DirectX::XMMATRIX& initMatrix)
+{
+	Job* pJob = new Job();
+
+	pJob->pModel = new Model(m_pContext, pathToModel);
+	pJob->pathToModel = pathToModel;
+	DirectX::XMStoreFloat4x4(&pJob->initMatrix, initMatrix);
+	pJob->loadStart = std::chrono::steady_clock::now();
+
+	m_jobs.push_back(pJob);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(pJob);
+	}
+	m_queueCV.notify_one();
+
+	return pJob->pModel;
+}
+
+
+void ModelLoader::ProcessUploads()
+{
+	size_t budget = m_uploadBudget;
+
+	for (size_t i = 0; i < m_jobs.size() && budget > 0; )
+	{
+		Job* pJob = m_jobs[i];
+
+		if (UploadJob(pJob, budget))
+		{
+			FinishJob(pJob);
+			m_jobs.erase(m_jobs.begin() + i);
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	m_lastFrameUploadBytes = m_uploadBudget - budget;
+}
+
+
+void ModelLoader::LoaderLoop()
+{
+	for (;;)
+	{
+		Job* pJob = nullptr;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_queueCV.wait(lock, [this]() { return m_isStopping || !m_queue.empty(); });
+
+			if (m_isStopping)
+			{
+				return;
+			}
+
+			pJob = m_queue.front();
+			m_queue.pop_front();
+		}
+
+		PrepareJob(pJob);
+	}
+}
+
+void ModelLoader::PrepareJob(Job* pJob)
+{
+	if (!ModelCooker::LoadCooked(pJob->pathToModel, pJob->pCache, pJob->cookedModel, pJob->stats))
+	{
+		pJob->stage.store(JobStage::Failed, std::memory_order_release);
+		return;
+	}
+
+	pJob->cookedView = pJob->pCache != nullptr ? pJob->pCache->GetView() : pJob->cookedModel.GetView();
+
+	// meshes can go up while the images are still decoding
+	pJob->stage.store(JobStage::Cooked, std::memory_order_release);
+
+	TextureDecoder* pDecoder = TextureDecoder::Create(pJob->cookedView, pJob->pathToModel, &pJob->stats);
+
+	if (pDecoder != nullptr)
+	{
+		auto decodeStart = std::chrono::steady_clock::now();
+		pDecoder->Decode(m_pDecodePool, pJob->images);
+		pJob->decodeWallTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodeStart).count();
+
+		delete pDecoder;
+	}
+
+	// a failed decoder leaves every image failed, the slots are still released
+	pJob->images.resize(pJob->cookedView.images.Size());
+
+	pJob->stage.store(JobStage::Decoded, std::memory_order_release);
+}
+
+
+bool ModelLoader::UploadJob(Job* pJob, size_t& budget)
+{
+	JobStage stage = pJob->stage.load(std::memory_order_acquire);
+
+	if (stage == JobStage::Failed)
+	{
+		return true;
+	}
+
+	if (stage == JobStage::Queued)
+	{
+		return false;
+	}
+
+	// the loader thread is done with a job only once it is decoded
+	if (pJob->isFailed)
+	{
+		return stage == JobStage::Decoded;
+	}
+
+	Model* pModel = pJob->pModel;
+	const CookedModelView& cookedModel = pJob->cookedView;
+
+	if (!pJob->isStarted)
+	{
+		if (FAILED(pModel->LoadSamplers(cookedModel)))
+		{
+			pJob->isFailed = true;
+			return stage == JobStage::Decoded;
+		}
+
+		pModel->ReserveTextures(static_cast<UINT>(cookedModel.images.Size()));
+		pJob->isStarted = true;
+	}
+
+	DirectX::XMMATRIX initMatrix = DirectX::XMLoadFloat4x4(&pJob->initMatrix);
+
+	while (pJob->nextMesh < cookedModel.meshes.Size() && budget > 0)
+	{
+		const CookedMesh& cookedMesh = cookedModel.meshes[pJob->nextMesh];
+		size_t indexSize = cookedMesh.indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(UINT16) : sizeof(UINT32);
+		size_t meshSize = cookedMesh.vertexCount * GetVertexStride(Model::GetVertexFormat()) + cookedMesh.indexCount * indexSize;
+
+		if (Model::HasPositionStream())
+		{
+			meshSize += cookedMesh.vertexCount * GetPositionStride(Model::GetVertexFormat());
+		}
+
+		if (FAILED(pModel->UploadMesh(cookedModel, pJob->nextMesh, initMatrix, &pJob->stats)))
+		{
+			printf("%s: failed to create mesh %u\n", pJob->pathToModel.c_str(), pJob->nextMesh);
+		}
+
+		++pJob->nextMesh;
+		budget -= (std::min)(budget, meshSize);
+	}
+
+	if (stage != JobStage::Decoded)
+	{
+		return false;
+	}
+
+	while (pJob->nextImage < pJob->images.size() && budget > 0)
+	{
+		if (pModel->StreamTexture(pJob->nextImage, pJob->images[pJob->nextImage], pJob->nextImageRow, budget, &pJob->stats))
+		{
+			++pJob->nextImage;
+			pJob->nextImageRow = 0;
+		}
+	}
+
+	return pJob->nextMesh == cookedModel.meshes.Size() && pJob->nextImage == pJob->images.size();
+}
+
+void ModelLoader::FinishJob(Job* pJob)
+{
+	if (pJob->isFailed || pJob->stage.load(std::memory_order_acquire) == JobStage::Failed)
+	{
+		printf("%s: failed to load\n", pJob->pathToModel.c_str());
+	}
+	else
+	{
+		pJob->pModel->m_isResident = true;
+
+		pJob->stats.decodeWallTimeMs = pJob->decodeWallTimeMs;
+		pJob->stats.decodeThreadNum = m_pDecodePool->GetThreadNum();
+		pJob->stats.totalTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pJob->loadStart).count();
+
+		PrintModelLoadStats(pJob->pathToModel, pJob->stats);
+	}
+
+	delete pJob->pCache;
+	delete pJob;
+}
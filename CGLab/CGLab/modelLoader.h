@@ -0,0 +1,103 @@
+#pragma once
+#include "framework.h"
+#include "model.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+class ThreadPool;
+
+
+// Loads models in the background. Reading, cooking and decoding run on a loader
+// thread, GPU resources are created by ProcessUploads on the render thread
+// within a per frame byte budget. Returned models start empty and fill up
+// mesh by mesh, pending textures are bound as placeholders.
+class ModelLoader
+{
+public:
+	static ModelLoader* Create(RendererContext* pContext, size_t uploadBudget);
+
+	~ModelLoader();
+
+	// Returns immediately, the renderer owns the model
+	Model* LoadModelAsync(const std::string& pathToModel, const DirectX::XMMATRIX& initMatrix = DirectX::XMMatrixIdentity());
+
+	// Called once per frame from the thread that owns the device
+	void ProcessUploads();
+
+	inline size_t GetUploadBudget() const { return m_uploadBudget; }
+	inline void SetUploadBudget(size_t uploadBudget) { m_uploadBudget = (std::max)(uploadBudget, s_minUploadBudget); }
+
+	inline size_t GetLastFrameUploadBytes() const { return m_lastFrameUploadBytes; }
+	inline UINT GetPendingModelNum() const { return static_cast<UINT>(m_jobs.size()); }
+
+private:
+	enum class JobStage
+	{
+		Queued,
+		Cooked,
+		Decoded,
+		Failed
+	};
+
+	struct Job
+	{
+		Model* pModel = nullptr;
+		std::string pathToModel;
+		DirectX::XMFLOAT4X4 initMatrix;
+
+		std::atomic<JobStage> stage{ JobStage::Queued };
+
+		MeshCache* pCache = nullptr;
+		CookedModel cookedModel;
+		CookedModelView cookedView;
+
+		std::vector<DecodedImage> images;
+		double decodeWallTimeMs = 0.0;
+
+		// owned by the render thread
+		bool isStarted = false;
+		bool isFailed = false;
+		UINT nextMesh = 0;
+		UINT nextImage = 0;
+		UINT nextImageRow = 0;
+
+		ModelLoadStats stats;
+		std::chrono::steady_clock::time_point loadStart;
+	};
+
+private:
+	ModelLoader(RendererContext* pContext, size_t uploadBudget);
+
+	bool Init();
+
+	void LoaderLoop();
+	void PrepareJob(Job* pJob);
+
+	// Returns true when the job has nothing left to upload
+	bool UploadJob(Job* pJob, size_t& budget);
+	void FinishJob(Job* pJob);
+
+private:
+	static constexpr size_t s_minUploadBudget = 64 * 1024;
+
+	RendererContext* m_pContext;
+	ThreadPool* m_pDecodePool;
+
+	size_t m_uploadBudget;
+	size_t m_lastFrameUploadBytes;
+
+	// jobs in submission order, the loader thread picks them up one by one
+	std::vector<Job*> m_jobs;
+	std::deque<Job*> m_queue;
+
+	std::mutex m_mutex;
+	std::condition_variable m_queueCV;
+	bool m_isStopping;
+
+	std::thread m_loaderThread;
+};
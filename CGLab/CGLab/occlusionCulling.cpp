@@ -0,0 +1,411 @@
+#include "occlusionCulling.h"
+#include "jobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <immintrin.h>
+
+
+static constexpr uint32_t FullTileCoverage = 0xFFFFFFFF;
+
+// triangles thinner than this cover no pixel centers anyway
+static constexpr float MinTriangleArea = 1e-6f;
+
+// candidates are tested in chunks of this size on the pool
+static constexpr size_t TestChunkSize = 256;
+
+
+// clip = (x, y, z, 1) * matrix
+void transformPoint(const OcclusionMatrix& matrix, float x, float y, float z, float clip[4])
+{
+	__m128 result = _mm_loadu_ps(matrix.m[3]);
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(x), _mm_loadu_ps(matrix.m[0])));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(y), _mm_loadu_ps(matrix.m[1])));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(z), _mm_loadu_ps(matrix.m[2])));
+
+	_mm_storeu_ps(clip, result);
+}
+
+
+OcclusionBuffer* OcclusionBuffer::Create(uint32_t width, uint32_t height)
+{
+	OcclusionBuffer* pBuffer = new OcclusionBuffer();
+
+	if (pBuffer->Init(width, height))
+	{
+		return pBuffer;
+	}
+
+	delete pBuffer;
+	return nullptr;
+}
+
+
+OcclusionBuffer::OcclusionBuffer()
+	: m_tileNumX(0)
+	, m_tileNumY(0)
+{}
+
+
+bool OcclusionBuffer::Init(uint32_t width, uint32_t height)
+{
+	if (width == 0 || height == 0)
+	{
+		return false;
+	}
+
+	m_tileNumX = (width + OcclusionTileWidth - 1) / OcclusionTileWidth;
+	m_tileNumY = (height + OcclusionTileHeight - 1) / OcclusionTileHeight;
+
+	m_tileDepths.resize(static_cast<size_t>(m_tileNumX) * m_tileNumY);
+	m_workDepths.resize(m_tileDepths.size());
+	m_workMasks.resize(m_tileDepths.size());
+
+	Clear();
+
+	return true;
+}
+
+
+void OcclusionBuffer::Clear()
+{
+	std::fill(m_tileDepths.begin(), m_tileDepths.end(), 1.0f);
+	std::fill(m_workDepths.begin(), m_workDepths.end(), 0.0f);
+	std::fill(m_workMasks.begin(), m_workMasks.end(), 0);
+
+	m_triangles.clear();
+}
+
+
+void OcclusionBuffer::AddOccluder(
+	const float* pPositions,
+	size_t vertexCount,
+	const uint32_t* pIndices,
+	size_t indexCount,
+	const OcclusionMatrix& mvpMatrix
+)
+{
+	m_clipPositions.resize(vertexCount);
+
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		const float* pPosition = pPositions + i * 3;
+		transformPoint(mvpMatrix, pPosition[0], pPosition[1], pPosition[2], &m_clipPositions[i].x);
+	}
+
+	float width = static_cast<float>(GetWidth());
+	float height = static_cast<float>(GetHeight());
+
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		float x[3], y[3], z[3];
+		bool isInFront = true;
+
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			const ClipPosition& clip = m_clipPositions[pIndices[i + k]];
+
+			isInFront = isInFront && clip.z >= 0.0f && clip.w > 0.0f;
+
+			if (isInFront)
+			{
+				x[k] = (clip.x / clip.w * 0.5f + 0.5f) * width;
+				y[k] = (0.5f - clip.y / clip.w * 0.5f) * height;
+				z[k] = clip.z / clip.w;
+			}
+		}
+
+		if (!isInFront)
+		{
+			continue;
+		}
+
+		float minX = (std::min)({ x[0], x[1], x[2] });
+		float maxX = (std::max)({ x[0], x[1], x[2] });
+		float minY = (std::min)({ y[0], y[1], y[2] });
+		float maxY = (std::max)({ y[0], y[1], y[2] });
+
+		if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+		{
+			continue;
+		}
+
+		float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+
+		if (fabsf(area) < MinTriangleArea)
+		{
+			continue;
+		}
+
+		Triangle triangle;
+
+		// either winding is an occluder, the edges are flipped to be positive inside
+		float sign = area > 0.0f ? -1.0f : 1.0f;
+
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			uint32_t next = (k + 1) % 3;
+
+			triangle.edgeA[k] = sign * (y[next] - y[k]);
+			triangle.edgeB[k] = sign * (x[k] - x[next]);
+			triangle.edgeC[k] = sign * (x[next] * y[k] - x[k] * y[next]);
+		}
+
+		triangle.depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+		triangle.depthB = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+		triangle.depthC = z[0] - triangle.depthA * x[0] - triangle.depthB * y[0];
+		triangle.depthMax = (std::max)({ z[0], z[1], z[2] });
+
+		triangle.tileMinX = static_cast<uint16_t>((std::max)(minX, 0.0f) / OcclusionTileWidth);
+		triangle.tileMaxX = static_cast<uint16_t>((std::min)(maxX / OcclusionTileWidth, static_cast<float>(m_tileNumX - 1)));
+		triangle.tileMinY = static_cast<uint16_t>((std::max)(minY, 0.0f) / OcclusionTileHeight);
+		triangle.tileMaxY = static_cast<uint16_t>((std::min)(maxY / OcclusionTileHeight, static_cast<float>(m_tileNumY - 1)));
+
+		m_triangles.push_back(triangle);
+	}
+}
+
+
+void OcclusionBuffer::Rasterize(JobSystem* pJobSystem)
+{
+	// bands own whole rows of tiles, so no tile is written by two threads
+	uint32_t bandNum = pJobSystem != nullptr ? (std::min)(pJobSystem->GetThreadNum() * 2, m_tileNumY) : 1;
+
+	if (bandNum <= 1)
+	{
+		RasterizeBand(0, m_tileNumY - 1);
+		return;
+	}
+
+	pJobSystem->ParallelFor(bandNum, 1, [&](size_t bandBegin, size_t bandEnd)
+		{
+			for (size_t bandIdx = bandBegin; bandIdx < bandEnd; ++bandIdx)
+			{
+				uint32_t tileMinY = static_cast<uint32_t>(m_tileNumY * bandIdx / bandNum);
+				uint32_t tileMaxY = static_cast<uint32_t>(m_tileNumY * (bandIdx + 1) / bandNum - 1);
+
+				RasterizeBand(tileMinY, tileMaxY);
+			}
+		}
+	);
+}
+
+void OcclusionBuffer::RasterizeBand(uint32_t tileMinY, uint32_t tileMaxY)
+{
+	const __m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (const auto& triangle : m_triangles)
+	{
+		uint32_t rowMin = (std::max)(static_cast<uint32_t>(triangle.tileMinY), tileMinY);
+		uint32_t rowMax = (std::min)(static_cast<uint32_t>(triangle.tileMaxY), tileMaxY);
+
+		for (uint32_t tileY = rowMin; tileY <= rowMax; ++tileY)
+		{
+			float pixelY = static_cast<float>(tileY * OcclusionTileHeight);
+
+			for (uint32_t tileX = triangle.tileMinX; tileX <= triangle.tileMaxX; ++tileX)
+			{
+				float pixelX = static_cast<float>(tileX * OcclusionTileWidth);
+
+				__m128 leftX = _mm_add_ps(_mm_set1_ps(pixelX), pixelOffsets);
+				__m128 rightX = _mm_add_ps(leftX, _mm_set1_ps(4.0f));
+
+				__m128 leftEdges[3];
+				__m128 rightEdges[3];
+
+				for (uint32_t e = 0; e < 3; ++e)
+				{
+					__m128 edgeA = _mm_set1_ps(triangle.edgeA[e]);
+
+					leftEdges[e] = _mm_mul_ps(edgeA, leftX);
+					rightEdges[e] = _mm_mul_ps(edgeA, rightX);
+				}
+
+				// one bit per pixel center, rows of 8 from the top
+				uint32_t coverage = 0;
+
+				for (uint32_t row = 0; row < OcclusionTileHeight; ++row)
+				{
+					float y = pixelY + row + 0.5f;
+
+					__m128 isLeftInside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+					__m128 isRightInside = isLeftInside;
+
+					for (uint32_t e = 0; e < 3; ++e)
+					{
+						__m128 rowEdge = _mm_set1_ps(triangle.edgeB[e] * y + triangle.edgeC[e]);
+
+						isLeftInside = _mm_and_ps(isLeftInside, _mm_cmpge_ps(_mm_add_ps(leftEdges[e], rowEdge), zero));
+						isRightInside = _mm_and_ps(isRightInside, _mm_cmpge_ps(_mm_add_ps(rightEdges[e], rowEdge), zero));
+					}
+
+					coverage |= static_cast<uint32_t>(_mm_movemask_ps(isLeftInside)) << (row * OcclusionTileWidth);
+					coverage |= static_cast<uint32_t>(_mm_movemask_ps(isRightInside)) << (row * OcclusionTileWidth + 4);
+				}
+
+				if (coverage == 0)
+				{
+					continue;
+				}
+
+				// the plane is largest at one of the tile corners
+				float cornerX = triangle.depthA > 0.0f ? pixelX + OcclusionTileWidth : pixelX;
+				float cornerY = triangle.depthB > 0.0f ? pixelY + OcclusionTileHeight : pixelY;
+				float depth = (std::min)(triangle.depthA * cornerX + triangle.depthB * cornerY + triangle.depthC, triangle.depthMax);
+
+				UpdateTile(static_cast<size_t>(tileY) * m_tileNumX + tileX, coverage, depth);
+			}
+		}
+	}
+}
+
+void OcclusionBuffer::UpdateTile(size_t tileIdx, uint32_t coverage, float depth)
+{
+	float& tileDepth = m_tileDepths[tileIdx];
+	float& workDepth = m_workDepths[tileIdx];
+	uint32_t& workMask = m_workMasks[tileIdx];
+
+	if (depth >= tileDepth)
+	{
+		return;
+	}
+
+	// a working layer that would barely improve on the full one is dropped for the nearer triangle
+	if (workMask != 0 && workDepth - depth > tileDepth - workDepth)
+	{
+		workMask = 0;
+	}
+
+	workDepth = workMask != 0 ? (std::max)(workDepth, depth) : depth;
+	workMask |= coverage;
+
+	if (workMask == FullTileCoverage)
+	{
+		tileDepth = workDepth;
+		workDepth = 0.0f;
+		workMask = 0;
+	}
+}
+
+
+bool OcclusionBuffer::IsVisible(const OcclusionBox& box, const OcclusionMatrix& vpMatrix) const
+{
+	float width = static_cast<float>(GetWidth());
+	float height = static_cast<float>(GetHeight());
+
+	float minX = FLT_MAX, maxX = -FLT_MAX;
+	float minY = FLT_MAX, maxY = -FLT_MAX;
+	float minDepth = FLT_MAX;
+
+	for (uint32_t corner = 0; corner < 8; ++corner)
+	{
+		ClipPosition clip;
+		transformPoint(
+			vpMatrix,
+			box.center[0] + (corner & 1 ? box.extents[0] : -box.extents[0]),
+			box.center[1] + (corner & 2 ? box.extents[1] : -box.extents[1]),
+			box.center[2] + (corner & 4 ? box.extents[2] : -box.extents[2]),
+			&clip.x
+		);
+
+		// boxes reaching the camera cannot be hidden
+		if (clip.z < 0.0f || clip.w <= 0.0f)
+		{
+			return true;
+		}
+
+		float x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+		float y = (0.5f - clip.y / clip.w * 0.5f) * height;
+
+		minX = (std::min)(minX, x);
+		maxX = (std::max)(maxX, x);
+		minY = (std::min)(minY, y);
+		maxY = (std::max)(maxY, y);
+		minDepth = (std::min)(minDepth, clip.z / clip.w);
+	}
+
+	// outside the screen is for the frustum test to decide
+	if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+	{
+		return true;
+	}
+
+	uint32_t tileMinX = static_cast<uint32_t>((std::max)(minX, 0.0f) / OcclusionTileWidth);
+	uint32_t tileMaxX = static_cast<uint32_t>((std::min)(maxX / OcclusionTileWidth, static_cast<float>(m_tileNumX - 1)));
+	uint32_t tileMinY = static_cast<uint32_t>((std::max)(minY, 0.0f) / OcclusionTileHeight);
+	uint32_t tileMaxY = static_cast<uint32_t>((std::min)(maxY / OcclusionTileHeight, static_cast<float>(m_tileNumY - 1)));
+
+	__m128 boxDepth = _mm_set1_ps(minDepth);
+
+	for (uint32_t tileY = tileMinY; tileY <= tileMaxY; ++tileY)
+	{
+		const float* pRow = m_tileDepths.data() + static_cast<size_t>(tileY) * m_tileNumX;
+		uint32_t tileX = tileMinX;
+
+		for (; tileX + 4 <= tileMaxX + 1; tileX += 4)
+		{
+			if (_mm_movemask_ps(_mm_cmple_ps(boxDepth, _mm_loadu_ps(pRow + tileX))) != 0)
+			{
+				return true;
+			}
+		}
+
+		for (; tileX <= tileMaxX; ++tileX)
+		{
+			if (minDepth <= pRow[tileX])
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void OcclusionBuffer::FilterVisible(
+	const OcclusionBoxArrays& boxes,
+	const OcclusionMatrix& vpMatrix,
+	std::vector<uint32_t>& candidates,
+	JobSystem* pJobSystem
+)
+{
+	m_visibleFlags.resize(candidates.size());
+
+	auto testRange = [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			uint32_t idx = candidates[i];
+
+			OcclusionBox box = {
+				{ boxes.pCenterX[idx], boxes.pCenterY[idx], boxes.pCenterZ[idx] },
+				{ boxes.pExtentX[idx], boxes.pExtentY[idx], boxes.pExtentZ[idx] }
+			};
+
+			m_visibleFlags[i] = IsVisible(box, vpMatrix) ? 1 : 0;
+		}
+	};
+
+	if (pJobSystem != nullptr)
+	{
+		pJobSystem->ParallelFor(candidates.size(), TestChunkSize, testRange);
+	}
+	else
+	{
+		testRange(0, candidates.size());
+	}
+
+	size_t visibleNum = 0;
+
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		if (m_visibleFlags[i] != 0)
+		{
+			candidates[visibleNum++] = candidates[i];
+		}
+	}
+
+	candidates.resize(visibleNum);
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+
+// Coarse CPU depth buffer after masked software occlusion culling (Andersson et al. 2015).
+// There are no per pixel depths, the screen is split into tiles of 8x4 pixels and every
+// tile keeps the farthest depth of a layer covering all of it plus a partially covered
+// working layer with its coverage mask, which becomes the new full layer once complete.
+static constexpr uint32_t OcclusionTileWidth = 8;
+static constexpr uint32_t OcclusionTileHeight = 4;
+
+// Row major matrix of the row vector convention of DirectXMath, clip = (x, y, z, 1) * m, 0 <= z <= w
+struct OcclusionMatrix
+{
+	float m[4][4];
+};
+
+struct OcclusionBox
+{
+	float center[3];
+	float extents[3];
+};
+
+// Boxes of the candidates of FilterVisible in SoA layout, indexed by the candidates
+struct OcclusionBoxArrays
+{
+	const float* pCenterX;
+	const float* pCenterY;
+	const float* pCenterZ;
+	const float* pExtentX;
+	const float* pExtentY;
+	const float* pExtentZ;
+};
+
+struct OcclusionStats
+{
+	size_t occluderNum = 0;
+	size_t occluderTriangleNum = 0;
+	size_t testedNum = 0;
+	size_t occludedNum = 0;
+
+	double rasterTimeMs = 0.0;
+	double testTimeMs = 0.0;
+};
+
+
+class OcclusionBuffer
+{
+public:
+	// The size is rounded up to whole tiles
+	static OcclusionBuffer* Create(uint32_t width, uint32_t height);
+
+	inline uint32_t GetWidth() const { return m_tileNumX * OcclusionTileWidth; }
+	inline uint32_t GetHeight() const { return m_tileNumY * OcclusionTileHeight; }
+
+	void Clear();
+
+	// Sets up the triangles of an indexed triangle list for Rasterize, triangles
+	// crossing the near plane are dropped since occluders may only under-cover.
+	// The positions are packed xyz triples
+	void AddOccluder(
+		const float* pPositions,
+		size_t vertexCount,
+		const uint32_t* pIndices,
+		size_t indexCount,
+		const OcclusionMatrix& mvpMatrix
+	);
+	inline size_t GetTriangleNum() const { return m_triangles.size(); }
+
+	// Rows of tiles are split into bands that are rasterized as jobs
+	void Rasterize(JobSystem* pJobSystem = nullptr);
+
+	// Conservative, a box is occluded only when its nearest depth is behind every tile it touches
+	bool IsVisible(const OcclusionBox& box, const OcclusionMatrix& vpMatrix) const;
+	// Keeps the candidates that are not occluded in their order
+	void FilterVisible(
+		const OcclusionBoxArrays& boxes,
+		const OcclusionMatrix& vpMatrix,
+		std::vector<uint32_t>& candidates,
+		JobSystem* pJobSystem = nullptr
+	);
+
+private:
+	// Screen space triangle with edge functions positive inside and a depth plane
+	struct Triangle
+	{
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+
+		float depthA, depthB, depthC;
+		float depthMax;
+
+		uint16_t tileMinX, tileMaxX;
+		uint16_t tileMinY, tileMaxY;
+	};
+
+	// clip space position of a transformed point
+	struct ClipPosition
+	{
+		float x, y, z, w;
+	};
+
+	OcclusionBuffer();
+
+	bool Init(uint32_t width, uint32_t height);
+
+	void RasterizeBand(uint32_t tileMinY, uint32_t tileMaxY);
+	void UpdateTile(size_t tileIdx, uint32_t coverage, float depth);
+
+private:
+	uint32_t m_tileNumX;
+	uint32_t m_tileNumY;
+
+	// depth of the full layer, depth and coverage of the working layer, 1 is the far plane
+	std::vector<float> m_tileDepths;
+	std::vector<float> m_workDepths;
+	std::vector<uint32_t> m_workMasks;
+
+	std::vector<Triangle> m_triangles;
+	std::vector<ClipPosition> m_clipPositions;
+	std::vector<uint8_t> m_visibleFlags;
+};
@@ -0,0 +1,351 @@
+#include "offsetAllocator.h"
+
+#include <algorithm>
+#include <intrin.h>
+
+
+UINT lowestBit(UINT32 mask)
+{
+	unsigned long bitIdx = 0;
+	_BitScanForward(&bitIdx, mask);
+
+	return static_cast<UINT>(bitIdx);
+}
+
+UINT highestBit(UINT32 mask)
+{
+	unsigned long bitIdx = 0;
+	_BitScanReverse(&bitIdx, mask);
+
+	return static_cast<UINT>(bitIdx);
+}
+
+// Sizes below 8 get a bin each, above them every power of two is split into 8 bins.
+// Free blocks are filed rounded down, requests look from the bin rounded up,
+// so any block found there is large enough.
+UINT sizeToBin(UINT size, bool isRoundUp)
+{
+	if (size < 8)
+	{
+		return size;
+	}
+
+	UINT mantissaShift = highestBit(size) - 3;
+	UINT bin = ((mantissaShift + 1) << 3) | ((size >> mantissaShift) & 7);
+
+	if (isRoundUp && (size & ((1u << mantissaShift) - 1)) != 0)
+	{
+		++bin;
+	}
+
+	return bin;
+}
+
+
+OffsetAllocator::OffsetAllocator()
+	: m_binHeads{}
+	, m_usedLeafBins{}
+	, m_usedTopBins(0)
+	, m_lastNode(InvalidNode)
+	, m_size(0)
+	, m_freeSize(0)
+	, m_freeBlockNum(0)
+{
+	Reset(0);
+}
+
+
+void OffsetAllocator::Reset(UINT size)
+{
+	m_nodes.clear();
+	m_releasedNodes.clear();
+
+	std::fill(std::begin(m_binHeads), std::end(m_binHeads), InvalidNode);
+	std::fill(std::begin(m_usedLeafBins), std::end(m_usedLeafBins), UINT8(0));
+	m_usedTopBins = 0;
+
+	m_lastNode = InvalidNode;
+	m_size = size;
+	m_freeSize = 0;
+	m_freeBlockNum = 0;
+
+	if (size > 0)
+	{
+		m_lastNode = CreateNode(0, size);
+		InsertFreeNode(m_lastNode);
+	}
+}
+
+void OffsetAllocator::Grow(UINT newSize)
+{
+	if (newSize <= m_size)
+	{
+		return;
+	}
+
+	UINT extraSize = newSize - m_size;
+
+	if (m_lastNode != InvalidNode && !m_nodes[m_lastNode].isUsed)
+	{
+		RemoveFreeNode(m_lastNode);
+		m_nodes[m_lastNode].size += extraSize;
+		InsertFreeNode(m_lastNode);
+	}
+	else
+	{
+		UINT32 nodeIdx = CreateNode(m_size, extraSize);
+
+		m_nodes[nodeIdx].neighborPrev = m_lastNode;
+
+		if (m_lastNode != InvalidNode)
+		{
+			m_nodes[m_lastNode].neighborNext = nodeIdx;
+		}
+
+		m_lastNode = nodeIdx;
+		InsertFreeNode(nodeIdx);
+	}
+
+	m_size = newSize;
+}
+
+
+OffsetAllocator::Allocation OffsetAllocator::Allocate(UINT size)
+{
+	Allocation allocation;
+
+	if (size == 0)
+	{
+		return allocation;
+	}
+
+	UINT32 bin = FindFreeBin(sizeToBin(size, true));
+
+	if (bin == InvalidNode)
+	{
+		return allocation;
+	}
+
+	UINT32 nodeIdx = m_binHeads[bin];
+	RemoveFreeNode(nodeIdx);
+
+	UINT remainder = m_nodes[nodeIdx].size - size;
+
+	m_nodes[nodeIdx].size = size;
+	m_nodes[nodeIdx].isUsed = true;
+
+	// the tail goes back as a free block right after the allocation
+	if (remainder > 0)
+	{
+		UINT32 tailIdx = CreateNode(m_nodes[nodeIdx].offset + size, remainder);
+		UINT32 nextIdx = m_nodes[nodeIdx].neighborNext;
+
+		m_nodes[tailIdx].neighborPrev = nodeIdx;
+		m_nodes[tailIdx].neighborNext = nextIdx;
+
+		if (nextIdx != InvalidNode)
+		{
+			m_nodes[nextIdx].neighborPrev = tailIdx;
+		}
+		else
+		{
+			m_lastNode = tailIdx;
+		}
+
+		m_nodes[nodeIdx].neighborNext = tailIdx;
+		InsertFreeNode(tailIdx);
+	}
+
+	allocation.offset = m_nodes[nodeIdx].offset;
+	allocation.node = nodeIdx;
+
+	return allocation;
+}
+
+void OffsetAllocator::Free(const Allocation& allocation)
+{
+	UINT32 nodeIdx = allocation.node;
+
+	if (nodeIdx == InvalidNode || !m_nodes[nodeIdx].isUsed)
+	{
+		return;
+	}
+
+	m_nodes[nodeIdx].isUsed = false;
+
+	UINT32 prevIdx = m_nodes[nodeIdx].neighborPrev;
+
+	if (prevIdx != InvalidNode && !m_nodes[prevIdx].isUsed)
+	{
+		RemoveFreeNode(prevIdx);
+
+		m_nodes[nodeIdx].offset = m_nodes[prevIdx].offset;
+		m_nodes[nodeIdx].size += m_nodes[prevIdx].size;
+		m_nodes[nodeIdx].neighborPrev = m_nodes[prevIdx].neighborPrev;
+
+		if (m_nodes[nodeIdx].neighborPrev != InvalidNode)
+		{
+			m_nodes[m_nodes[nodeIdx].neighborPrev].neighborNext = nodeIdx;
+		}
+
+		ReleaseNode(prevIdx);
+	}
+
+	UINT32 nextIdx = m_nodes[nodeIdx].neighborNext;
+
+	if (nextIdx != InvalidNode && !m_nodes[nextIdx].isUsed)
+	{
+		RemoveFreeNode(nextIdx);
+
+		m_nodes[nodeIdx].size += m_nodes[nextIdx].size;
+		m_nodes[nodeIdx].neighborNext = m_nodes[nextIdx].neighborNext;
+
+		if (m_nodes[nodeIdx].neighborNext != InvalidNode)
+		{
+			m_nodes[m_nodes[nodeIdx].neighborNext].neighborPrev = nodeIdx;
+		}
+		else
+		{
+			m_lastNode = nodeIdx;
+		}
+
+		ReleaseNode(nextIdx);
+	}
+
+	InsertFreeNode(nodeIdx);
+}
+
+
+UINT OffsetAllocator::GetLargestFreeBlock() const
+{
+	if (m_usedTopBins == 0)
+	{
+		return 0;
+	}
+
+	UINT topBin = highestBit(m_usedTopBins);
+	UINT bin = topBin * LeafBinNum + highestBit(m_usedLeafBins[topBin]);
+
+	// the bin only bounds its sizes from below
+	UINT largestSize = 0;
+
+	for (UINT32 nodeIdx = m_binHeads[bin]; nodeIdx != InvalidNode; nodeIdx = m_nodes[nodeIdx].binNext)
+	{
+		largestSize = (std::max)(largestSize, m_nodes[nodeIdx].size);
+	}
+
+	return largestSize;
+}
+
+
+UINT32 OffsetAllocator::CreateNode(UINT offset, UINT size)
+{
+	UINT32 nodeIdx = 0;
+
+	if (!m_releasedNodes.empty())
+	{
+		nodeIdx = m_releasedNodes.back();
+		m_releasedNodes.pop_back();
+	}
+	else
+	{
+		nodeIdx = static_cast<UINT32>(m_nodes.size());
+		m_nodes.emplace_back();
+	}
+
+	Node& node = m_nodes[nodeIdx];
+
+	node.offset = offset;
+	node.size = size;
+	node.binPrev = InvalidNode;
+	node.binNext = InvalidNode;
+	node.neighborPrev = InvalidNode;
+	node.neighborNext = InvalidNode;
+	node.isUsed = false;
+
+	return nodeIdx;
+}
+
+void OffsetAllocator::ReleaseNode(UINT32 nodeIdx)
+{
+	m_releasedNodes.push_back(nodeIdx);
+}
+
+
+void OffsetAllocator::InsertFreeNode(UINT32 nodeIdx)
+{
+	Node& node = m_nodes[nodeIdx];
+	UINT bin = sizeToBin(node.size, false);
+
+	node.binPrev = InvalidNode;
+	node.binNext = m_binHeads[bin];
+
+	if (node.binNext != InvalidNode)
+	{
+		m_nodes[node.binNext].binPrev = nodeIdx;
+	}
+
+	m_binHeads[bin] = nodeIdx;
+	m_usedLeafBins[bin / LeafBinNum] |= 1u << (bin % LeafBinNum);
+	m_usedTopBins |= 1u << (bin / LeafBinNum);
+
+	m_freeSize += node.size;
+	++m_freeBlockNum;
+}
+
+void OffsetAllocator::RemoveFreeNode(UINT32 nodeIdx)
+{
+	const Node& node = m_nodes[nodeIdx];
+
+	if (node.binPrev != InvalidNode)
+	{
+		m_nodes[node.binPrev].binNext = node.binNext;
+	}
+	else
+	{
+		UINT bin = sizeToBin(node.size, false);
+		m_binHeads[bin] = node.binNext;
+
+		if (node.binNext == InvalidNode)
+		{
+			m_usedLeafBins[bin / LeafBinNum] &= ~(1u << (bin % LeafBinNum));
+
+			if (m_usedLeafBins[bin / LeafBinNum] == 0)
+			{
+				m_usedTopBins &= ~(1u << (bin / LeafBinNum));
+			}
+		}
+	}
+
+	if (node.binNext != InvalidNode)
+	{
+		m_nodes[node.binNext].binPrev = node.binPrev;
+	}
+
+	m_freeSize -= node.size;
+	--m_freeBlockNum;
+}
+
+
+UINT32 OffsetAllocator::FindFreeBin(UINT minBin) const
+{
+	UINT topBin = minBin / LeafBinNum;
+	UINT32 leafMask = m_usedLeafBins[topBin] & (0xFFu << (minBin % LeafBinNum));
+
+	if (leafMask != 0)
+	{
+		return topBin * LeafBinNum + lowestBit(leafMask);
+	}
+
+	// any block of a larger top bin fits, take the smallest of them
+	UINT32 topMask = topBin + 1 < TopBinNum ? m_usedTopBins & ~((2u << topBin) - 1) : 0;
+
+	if (topMask == 0)
+	{
+		return InvalidNode;
+	}
+
+	topBin = lowestBit(topMask);
+
+	return topBin * LeafBinNum + lowestBit(m_usedLeafBins[topBin]);
+}
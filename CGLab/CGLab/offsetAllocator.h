@@ -0,0 +1,77 @@
+#pragma once
+#include "framework.h"
+
+
+// Two level segregated fit allocator (TLSF) over a range of abstract units, e.g. the
+// vertices of a buffer. Only offsets are handed out, the memory itself lives elsewhere.
+// Free blocks are binned by a small float of their size (5 bit exponent, 3 bit mantissa),
+// so allocation and freeing take constant time and neighbouring free blocks are merged.
+class OffsetAllocator
+{
+public:
+	static constexpr UINT32 InvalidNode = UINT32_MAX;
+
+	struct Allocation
+	{
+		UINT offset = 0;
+		UINT32 node = InvalidNode;
+	};
+
+public:
+	OffsetAllocator();
+
+	// Forgets every allocation, the whole size is one free block
+	void Reset(UINT size);
+	// Appends free space at the end, the offsets of live allocations do not change
+	void Grow(UINT newSize);
+
+	// node is InvalidNode when there is no free block large enough
+	Allocation Allocate(UINT size);
+	void Free(const Allocation& allocation);
+
+	inline UINT GetSize() const { return m_size; }
+	inline UINT GetFreeSize() const { return m_freeSize; }
+	inline UINT GetFreeBlockNum() const { return m_freeBlockNum; }
+	UINT GetLargestFreeBlock() const;
+
+private:
+	static constexpr UINT TopBinNum = 32;
+	static constexpr UINT LeafBinNum = 8;
+	static constexpr UINT BinNum = TopBinNum * LeafBinNum;
+
+	// Physical neighbours form one list in offset order, free blocks of a bin another one
+	struct Node
+	{
+		UINT offset;
+		UINT size;
+
+		UINT32 binPrev;
+		UINT32 binNext;
+		UINT32 neighborPrev;
+		UINT32 neighborNext;
+
+		bool isUsed;
+	};
+
+	UINT32 CreateNode(UINT offset, UINT size);
+	void ReleaseNode(UINT32 nodeIdx);
+
+	void InsertFreeNode(UINT32 nodeIdx);
+	void RemoveFreeNode(UINT32 nodeIdx);
+
+	UINT32 FindFreeBin(UINT minBin) const;
+
+private:
+	std::vector<Node> m_nodes;
+	std::vector<UINT32> m_releasedNodes;
+
+	UINT32 m_binHeads[BinNum];
+	UINT8 m_usedLeafBins[TopBinNum];
+	UINT32 m_usedTopBins;
+
+	UINT32 m_lastNode;
+
+	UINT m_size;
+	UINT m_freeSize;
+	UINT m_freeBlockNum;
+};
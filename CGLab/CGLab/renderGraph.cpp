@@ -0,0 +1,404 @@
+#include "renderGraph.h"
+
+#include <algorithm>
+
+
+// size of a texture placed in the heap
+uint64_t getAlignedSize(const RenderGraphTextureDesc& desc)
+{
+	return (desc.GetSize() + RenderGraph::HeapAlignment - 1) / RenderGraph::HeapAlignment * RenderGraph::HeapAlignment;
+}
+
+
+bool RenderGraphTextureDesc::IsCompatible(const RenderGraphTextureDesc& other) const
+{
+	return width == other.width
+		&& height == other.height
+		&& arraySize == other.arraySize
+		&& mipLevels == other.mipLevels
+		&& format == other.format
+		&& bindFlags == other.bindFlags;
+}
+
+uint64_t RenderGraphTextureDesc::GetSize() const
+{
+	uint64_t size = 0;
+
+	for (uint32_t mip = 0; mip < mipLevels; ++mip)
+	{
+		uint64_t mipWidth = (std::max)(width >> mip, 1u);
+		uint64_t mipHeight = (std::max)(height >> mip, 1u);
+
+		size += mipWidth * mipHeight;
+	}
+
+	return size * texelSize * arraySize;
+}
+
+
+RenderGraph::RenderGraph()
+{}
+
+
+RenderGraph::ResourceId RenderGraph::CreateTexture(const char* pName, const RenderGraphTextureDesc& desc)
+{
+	return AddTexture(pName, desc, false);
+}
+
+RenderGraph::ResourceId RenderGraph::ImportTexture(const char* pName, const RenderGraphTextureDesc& desc)
+{
+	return AddTexture(pName, desc, true);
+}
+
+RenderGraph::ResourceId RenderGraph::AddTexture(const char* pName, const RenderGraphTextureDesc& desc, bool isImported)
+{
+	m_textures.push_back({ pName, desc, isImported, InvalidIndex, InvalidIndex, InvalidIndex, 0, 0 });
+
+	return static_cast<ResourceId>(m_textures.size() - 1);
+}
+
+
+RenderGraph::PassId RenderGraph::AddPass(const char* pName, PassFunction function)
+{
+	m_passes.push_back({ pName, std::move(function), {}, false, {}, {}, {} });
+
+	return static_cast<PassId>(m_passes.size() - 1);
+}
+
+void RenderGraph::Read(PassId passId, ResourceId resource)
+{
+	m_passes[passId].accesses.push_back({ resource, Access::kRead });
+}
+
+void RenderGraph::Write(PassId passId, ResourceId resource)
+{
+	m_passes[passId].accesses.push_back({ resource, Access::kWrite });
+}
+
+void RenderGraph::Modify(PassId passId, ResourceId resource)
+{
+	m_passes[passId].accesses.push_back({ resource, Access::kModify });
+}
+
+void RenderGraph::Clear()
+{
+	m_textures.clear();
+	m_passes.clear();
+	m_physicalDescs.clear();
+	m_stats = {};
+}
+
+
+bool RenderGraph::Compile()
+{
+	CullPasses();
+
+	if (!FindLifetimes())
+	{
+		return false;
+	}
+
+	AssignPhysicalTextures();
+
+	for (auto& texture : m_textures)
+	{
+		texture.heapSize = texture.physicalIdx != InvalidIndex ? getAlignedSize(texture.desc) : 0;
+	}
+
+	PlaceInHeap();
+
+	m_stats.passNum = m_passes.size();
+
+	for (const auto& pass : m_passes)
+	{
+		m_stats.culledPassNum += pass.isCulled ? 1 : 0;
+		m_stats.barrierNum += pass.barriers.size();
+	}
+
+	return true;
+}
+
+void RenderGraph::PlaceTextures(const std::vector<uint64_t>& heapSizes)
+{
+	for (ResourceId resource = 0; resource < static_cast<ResourceId>(m_textures.size()); ++resource)
+	{
+		Texture& texture = m_textures[resource];
+
+		texture.heapSize = texture.physicalIdx != InvalidIndex
+			? (heapSizes[resource] + HeapAlignment - 1) / HeapAlignment * HeapAlignment
+			: 0;
+	}
+
+	PlaceInHeap();
+}
+
+void RenderGraph::Execute(const std::function<void(PassId)>& beginPass) const
+{
+	for (PassId passId = 0; passId < static_cast<PassId>(m_passes.size()); ++passId)
+	{
+		if (m_passes[passId].isCulled)
+		{
+			continue;
+		}
+
+		beginPass(passId);
+		m_passes[passId].function();
+	}
+}
+
+
+void RenderGraph::CullPasses()
+{
+	// whether a later pass or the owner of an imported texture needs what it holds
+	std::vector<bool> isNeeded(m_textures.size());
+
+	for (size_t textureIdx = 0; textureIdx < m_textures.size(); ++textureIdx)
+	{
+		isNeeded[textureIdx] = m_textures[textureIdx].isImported;
+	}
+
+	for (size_t passIdx = m_passes.size(); passIdx-- > 0;)
+	{
+		Pass& pass = m_passes[passIdx];
+
+		pass.isCulled = std::none_of(pass.accesses.begin(), pass.accesses.end(), [&](const TextureAccess& access)
+		{
+			return access.access != Access::kRead && isNeeded[access.resource];
+		});
+
+		if (pass.isCulled)
+		{
+			continue;
+		}
+
+		// a full write ends the use of the contents before it, reads of the pass start a new one
+		for (const auto& access : pass.accesses)
+		{
+			if (access.access == Access::kWrite && !m_textures[access.resource].isImported)
+			{
+				isNeeded[access.resource] = false;
+			}
+		}
+
+		for (const auto& access : pass.accesses)
+		{
+			if (access.access != Access::kWrite)
+			{
+				isNeeded[access.resource] = true;
+			}
+		}
+	}
+}
+
+bool RenderGraph::FindLifetimes()
+{
+	std::vector<bool> wasRead(m_textures.size(), false);
+
+	for (auto& texture : m_textures)
+	{
+		texture.firstPass = InvalidIndex;
+		texture.lastPass = InvalidIndex;
+	}
+
+	for (PassId passId = 0; passId < static_cast<PassId>(m_passes.size()); ++passId)
+	{
+		Pass& pass = m_passes[passId];
+
+		pass.clears.clear();
+		pass.barriers.clear();
+
+		if (pass.isCulled)
+		{
+			continue;
+		}
+
+		for (const auto& access : pass.accesses)
+		{
+			Texture& texture = m_textures[access.resource];
+			bool isRead = access.access == Access::kRead;
+
+			if (texture.firstPass == InvalidIndex)
+			{
+				// a transient texture holds nothing before its first pass, the memory may have been another one
+				if (!texture.isImported && isRead)
+				{
+					return false;
+				}
+
+				if (!texture.isImported && access.access == Access::kModify)
+				{
+					pass.clears.push_back(access.resource);
+				}
+
+				texture.firstPass = passId;
+			}
+			else if (wasRead[access.resource] != isRead)
+			{
+				pass.barriers.push_back({ access.resource, isRead });
+			}
+
+			texture.lastPass = passId;
+			wasRead[access.resource] = isRead;
+		}
+	}
+
+	return true;
+}
+
+void RenderGraph::AssignPhysicalTextures()
+{
+	m_physicalDescs.clear();
+
+	std::vector<ResourceId> transients;
+
+	for (ResourceId resource = 0; resource < static_cast<ResourceId>(m_textures.size()); ++resource)
+	{
+		m_textures[resource].physicalIdx = InvalidIndex;
+
+		if (!m_textures[resource].isImported && m_textures[resource].firstPass != InvalidIndex)
+		{
+			transients.push_back(resource);
+		}
+	}
+
+	std::stable_sort(transients.begin(), transients.end(), [&](ResourceId left, ResourceId right)
+	{
+		return m_textures[left].firstPass < m_textures[right].firstPass;
+	});
+
+	// the last pass using each physical texture so far
+	std::vector<PassId> physicalLastPasses;
+
+	m_stats.transientNum = transients.size();
+	m_stats.unaliasedSize = 0;
+	m_stats.physicalSize = 0;
+
+	for (ResourceId resource : transients)
+	{
+		Texture& texture = m_textures[resource];
+
+		for (uint32_t physicalIdx = 0; physicalIdx < m_physicalDescs.size(); ++physicalIdx)
+		{
+			if (physicalLastPasses[physicalIdx] < texture.firstPass && m_physicalDescs[physicalIdx].IsCompatible(texture.desc))
+			{
+				texture.physicalIdx = physicalIdx;
+				break;
+			}
+		}
+
+		if (texture.physicalIdx == InvalidIndex)
+		{
+			texture.physicalIdx = static_cast<uint32_t>(m_physicalDescs.size());
+
+			m_physicalDescs.push_back(texture.desc);
+			physicalLastPasses.push_back(texture.lastPass);
+
+			m_stats.physicalSize += getAlignedSize(texture.desc);
+		}
+
+		physicalLastPasses[texture.physicalIdx] = texture.lastPass;
+		m_stats.unaliasedSize += getAlignedSize(texture.desc);
+	}
+
+	m_stats.physicalNum = m_physicalDescs.size();
+}
+
+void RenderGraph::PlaceInHeap()
+{
+	std::vector<ResourceId> transients;
+
+	for (ResourceId resource = 0; resource < static_cast<ResourceId>(m_textures.size()); ++resource)
+	{
+		m_textures[resource].heapOffset = 0;
+
+		if (m_textures[resource].heapSize > 0)
+		{
+			transients.push_back(resource);
+		}
+	}
+
+	// the largest textures are placed first, the small ones fill the gaps between them
+	std::stable_sort(transients.begin(), transients.end(), [&](ResourceId left, ResourceId right)
+	{
+		return m_textures[left].heapSize > m_textures[right].heapSize;
+	});
+
+	struct HeapRange
+	{
+		uint64_t begin;
+		uint64_t end;
+	};
+
+	std::vector<ResourceId> placed;
+	std::vector<HeapRange> taken;
+
+	m_stats.heapSize = 0;
+
+	for (ResourceId resource : transients)
+	{
+		Texture& texture = m_textures[resource];
+		uint64_t size = texture.heapSize;
+
+		// only textures alive at the same time keep their memory apart
+		taken.clear();
+
+		for (ResourceId other : placed)
+		{
+			const Texture& otherTexture = m_textures[other];
+
+			if (otherTexture.firstPass <= texture.lastPass && texture.firstPass <= otherTexture.lastPass)
+			{
+				taken.push_back({ otherTexture.heapOffset, otherTexture.heapOffset + otherTexture.heapSize });
+			}
+		}
+
+		std::sort(taken.begin(), taken.end(), [](const HeapRange& left, const HeapRange& right)
+		{
+			return left.begin < right.begin;
+		});
+
+		uint64_t offset = 0;
+
+		for (const auto& range : taken)
+		{
+			if (offset + size <= range.begin)
+			{
+				break;
+			}
+
+			offset = (std::max)(offset, range.end);
+		}
+
+		texture.heapOffset = offset;
+		placed.push_back(resource);
+
+		m_stats.heapSize = (std::max)(m_stats.heapSize, offset + size);
+	}
+
+	for (auto& pass : m_passes)
+	{
+		pass.aliasBarriers.clear();
+	}
+
+	m_stats.aliasBarrierNum = 0;
+
+	// the first pass of a texture waits for every earlier texture that used a part of its memory
+	for (ResourceId after : placed)
+	{
+		const Texture& texture = m_textures[after];
+
+		for (ResourceId before : placed)
+		{
+			const Texture& otherTexture = m_textures[before];
+
+			bool isOverlapped = otherTexture.heapOffset < texture.heapOffset + texture.heapSize
+				&& texture.heapOffset < otherTexture.heapOffset + otherTexture.heapSize;
+
+			if (isOverlapped && otherTexture.lastPass < texture.firstPass)
+			{
+				m_passes[texture.firstPass].aliasBarriers.push_back({ before, after });
+				++m_stats.aliasBarrierNum;
+			}
+		}
+	}
+}
@@ -0,0 +1,183 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+
+// Size and layout of a texture of the graph. Format and bind flags are values of the backend,
+// the graph only compares them
+struct RenderGraphTextureDesc
+{
+	uint32_t width = 1;
+	uint32_t height = 1;
+	uint32_t arraySize = 1;
+	uint32_t mipLevels = 1;
+
+	uint32_t format = 0;
+	uint32_t bindFlags = 0;
+	// bytes of a texel, for the memory estimates
+	uint32_t texelSize = 4;
+
+	// color, or depth and stencil in x and y, set before the first pass of a frame modifying the texture
+	float clearValue[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	// textures of compatible descs can share one physical texture
+	bool IsCompatible(const RenderGraphTextureDesc& other) const;
+	// bytes of all mips and slices
+	uint64_t GetSize() const;
+};
+
+struct RenderGraphStats
+{
+	size_t passNum = 0;
+	size_t culledPassNum = 0;
+	size_t barrierNum = 0;
+
+	size_t transientNum = 0;
+	size_t physicalNum = 0;
+
+	// every transient texture on its own
+	uint64_t unaliasedSize = 0;
+	// physical textures shared by compatible descs
+	uint64_t physicalSize = 0;
+	// one heap with placed textures, those never alive at once overlap
+	uint64_t heapSize = 0;
+	size_t aliasBarrierNum = 0;
+};
+
+
+// Passes declare the textures they read and write and run in the order they were added.
+// Compile culls the passes whose results nothing uses, finds the lifetimes of the transient
+// textures, shares memory between textures that are never alive at once and records
+// the clears and barriers every pass needs. The graph knows nothing of the backend,
+// which creates the textures and runs the clears and barriers.
+class RenderGraph
+{
+public:
+	using ResourceId = uint32_t;
+	using PassId = uint32_t;
+	using PassFunction = std::function<void()>;
+
+	static constexpr uint32_t InvalidIndex = UINT32_MAX;
+	// placement alignment of the textures in the heap
+	static constexpr uint64_t HeapAlignment = 64 * 1024;
+
+	// the texture becomes readable by shaders or writable as a target
+	struct Barrier
+	{
+		ResourceId resource;
+		bool isRead;
+	};
+
+	// the after texture starts to use heap memory the before texture used
+	struct AliasBarrier
+	{
+		ResourceId before;
+		ResourceId after;
+	};
+
+public:
+	RenderGraph();
+
+	// Lives only between the first and the last pass using it, its memory may be shared
+	ResourceId CreateTexture(const char* pName, const RenderGraphTextureDesc& desc);
+	// Owned outside the graph and kept after the frame, passes writing it are never culled
+	ResourceId ImportTexture(const char* pName, const RenderGraphTextureDesc& desc);
+
+	PassId AddPass(const char* pName, PassFunction function);
+	void Read(PassId passId, ResourceId resource);
+	// the pass covers all of the texture, what it held before is not needed
+	void Write(PassId passId, ResourceId resource);
+	// the pass draws over what the texture holds, a transient texture gets cleared before its first pass
+	void Modify(PassId passId, ResourceId resource);
+
+	void Clear();
+
+	// false when a pass reads a transient texture no pass wrote before
+	bool Compile();
+	// Places the transient textures of a compiled graph again with the heap sizes the backend
+	// reports per texture, 0 keeps a texture out of the heap
+	void PlaceTextures(const std::vector<uint64_t>& heapSizes);
+
+	// Runs the passes left after culling in order, beginPass is called before each one
+	// to run its clears and barriers
+	void Execute(const std::function<void(PassId)>& beginPass) const;
+
+	inline size_t GetTextureNum() const { return m_textures.size(); }
+	inline const char* GetTextureName(ResourceId resource) const { return m_textures[resource].pName; }
+	inline const RenderGraphTextureDesc& GetTextureDesc(ResourceId resource) const { return m_textures[resource].desc; }
+	inline bool IsTextureImported(ResourceId resource) const { return m_textures[resource].isImported; }
+	// InvalidIndex for imported textures and those no remaining pass uses
+	inline uint32_t GetPhysicalTexture(ResourceId resource) const { return m_textures[resource].physicalIdx; }
+	inline uint64_t GetHeapOffset(ResourceId resource) const { return m_textures[resource].heapOffset; }
+	inline uint64_t GetHeapSize(ResourceId resource) const { return m_textures[resource].heapSize; }
+	inline PassId GetFirstPass(ResourceId resource) const { return m_textures[resource].firstPass; }
+	inline PassId GetLastPass(ResourceId resource) const { return m_textures[resource].lastPass; }
+
+	inline size_t GetPhysicalTextureNum() const { return m_physicalDescs.size(); }
+	inline const RenderGraphTextureDesc& GetPhysicalTextureDesc(uint32_t physicalIdx) const { return m_physicalDescs[physicalIdx]; }
+
+	inline size_t GetPassNum() const { return m_passes.size(); }
+	inline const char* GetPassName(PassId passId) const { return m_passes[passId].pName; }
+	inline bool IsPassCulled(PassId passId) const { return m_passes[passId].isCulled; }
+	inline const std::vector<ResourceId>& GetPassClears(PassId passId) const { return m_passes[passId].clears; }
+	inline const std::vector<Barrier>& GetPassBarriers(PassId passId) const { return m_passes[passId].barriers; }
+	inline const std::vector<AliasBarrier>& GetPassAliasBarriers(PassId passId) const { return m_passes[passId].aliasBarriers; }
+
+	inline const RenderGraphStats& GetStats() const { return m_stats; }
+
+private:
+	enum class Access
+	{
+		kRead,
+		kWrite,
+		kModify
+	};
+
+	struct Texture
+	{
+		const char* pName;
+		RenderGraphTextureDesc desc;
+		bool isImported;
+
+		PassId firstPass;
+		PassId lastPass;
+		uint32_t physicalIdx;
+		uint64_t heapOffset;
+		uint64_t heapSize;
+	};
+
+	struct TextureAccess
+	{
+		ResourceId resource;
+		Access access;
+	};
+
+	struct Pass
+	{
+		const char* pName;
+		PassFunction function;
+		std::vector<TextureAccess> accesses;
+
+		bool isCulled;
+		std::vector<ResourceId> clears;
+		std::vector<Barrier> barriers;
+		std::vector<AliasBarrier> aliasBarriers;
+	};
+
+	ResourceId AddTexture(const char* pName, const RenderGraphTextureDesc& desc, bool isImported);
+
+	void CullPasses();
+	bool FindLifetimes();
+	void AssignPhysicalTextures();
+	void PlaceInHeap();
+
+private:
+	std::vector<Texture> m_textures;
+	std::vector<Pass> m_passes;
+
+	std::vector<RenderGraphTextureDesc> m_physicalDescs;
+
+	RenderGraphStats m_stats;
+};
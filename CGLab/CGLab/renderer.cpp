@@ -3,8 +3,10 @@
 #include <dxgi.h>
 #include <DirectXMath.h>
 
+#include <algorithm>
 #include <cmath>
 #include <chrono>
+#include <numeric>
 
 #include "WICTextureLoader.h"
 
@@ -13,36 +15,43 @@
 #include "shaderCompiler.h"
 #include "toneMapping.h"
 #include "camera.h"
-#include "app.h"
+#include "transientTexturePool.h"
 #include "model.h"
+#include "modelLoader.h"
 #include "bloom.h"
 #include "shadowMap.h"
+#include "threadPool.h"
 
 #include "imGui/imgui_impl_dx11.h"
 #include "imGui/imgui_impl_win32.h"
 
 
-struct ConstantBuffer
+struct ObjectConstantBuffer
 {
 	DirectX::XMFLOAT4X4 modelMatrix;
-	DirectX::XMFLOAT4X4 vpMatrix;
-	DirectX::XMFLOAT4 cameraPosition;
-	DirectX::XMFLOAT4 cameraDirection;
+
+	DirectX::XMFLOAT4 positionScale;
+	DirectX::XMFLOAT4 positionOffset;
+	DirectX::XMFLOAT4 texCoordTransform;
+
+	DirectX::XMUINT4 instanceParams; // x - first instance of the draw in the instance buffer
 };
 
 struct PSSMConstantBuffer
 {
-	DirectX::XMFLOAT4X4 modelMatrix;
 	DirectX::XMFLOAT4X4 vpMatrices[PSSMMaxSplitsNum];
 };
 
-struct LightBuffer
+struct ShadowObjectConstantBuffer
 {
-	DirectX::XMFLOAT4 shadowSplitDists;
-	DirectionalLight directionalLight;
+	DirectX::XMFLOAT4X4 modelMatrix;
 
-	DirectX::XMUINT4 lightsCount; // r
-	PointLight lights[MaxLightNum];
+	DirectX::XMFLOAT4 positionScale;
+	DirectX::XMFLOAT4 positionOffset;
+
+	UINT splitIndices[PSSMMaxSplitsNum];
+
+	DirectX::XMUINT4 instanceParams; // x - first instance of the draw in the instance buffer
 };
 
 struct DebugBuffer
@@ -59,6 +68,181 @@ struct PBRBuffer
 };
 
 
+// LOD 0 is kept while the bounding sphere covers at least this part of the half screen height
+static constexpr float LodReferenceSize = 0.5f;
+
+UINT selectLod(
+	const Model::Primitive& primitive,
+	const BoundingVolume& bounds,
+	const DirectX::XMFLOAT4& cameraPosition,
+	float fov,
+	float bias
+)
+{
+	if (primitive.lodCount <= 1)
+	{
+		return 0;
+	}
+
+	float radius = bounds.radius;
+	float distance = DirectX::XMVectorGetX(DirectX::XMVector3Length(
+		DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&bounds.center), DirectX::XMLoadFloat4(&cameraPosition))
+	));
+
+	// every LOD halves the triangle count, so one level per halving of the projected size
+	float lod = bias;
+
+	if (distance > radius)
+	{
+		float screenSize = radius / (distance * tanf(fov / 2.0f));
+		lod += log2f(LodReferenceSize / (std::max)(screenSize, 1e-6f));
+	}
+
+	INT lodIdx = static_cast<INT>(floorf(lod));
+
+	return static_cast<UINT>((std::min)((std::max)(lodIdx, 0), static_cast<INT>(primitive.lodCount) - 1));
+}
+
+// the occlusion buffer is far coarser than the window, occluders are conservative anyway
+static constexpr UINT OcclusionBufferWidth = 320;
+static constexpr UINT OcclusionBufferHeight = 180;
+// smaller primitives hide little and only add triangles to rasterize
+static constexpr float OccluderMinScreenSize = 0.1f;
+
+// Model copies are laid out on a square grid behind the model, this much larger than it
+static constexpr float ModelCopySpacing = 1.25f;
+
+// Textures and sampler of a primitive folded into the material field of its draw key,
+// a collision only costs state changes
+UINT createMaterialKey(const Model::Primitive& primitive)
+{
+	const void* states[] =
+	{
+		primitive.pColorTextureSRV,
+		primitive.pNormalTextureSRV,
+		primitive.pMetalicRoughnessTextureSRV,
+		primitive.pEmissiveTextureSRV,
+		primitive.pSamplerState
+	};
+
+	// FNV-1a over the pointers
+	UINT64 hash = 14695981039346656037ull;
+
+	for (const void* pState : states)
+	{
+		hash = (hash ^ reinterpret_cast<uintptr_t>(pState)) * 1099511628211ull;
+	}
+
+	return static_cast<UINT>((hash ^ (hash >> 16) ^ (hash >> 32) ^ (hash >> 48)) & 0xFFFF);
+}
+
+// Packets are built a chunk per task, large enough to outweigh starting the task
+static constexpr size_t PacketChunkSize = 512;
+
+// Runs task(begin, end) for the chunks of [0, count), on the pool when there is one.
+// Chunks start at multiples of PacketChunkSize, so begin / PacketChunkSize numbers them
+void forEachChunk(ThreadPool* pPool, size_t count, const std::function<void(size_t, size_t)>& task)
+{
+	UINT chunkNum = static_cast<UINT>((count + PacketChunkSize - 1) / PacketChunkSize);
+
+	auto runChunk = [&](UINT chunkIdx)
+	{
+		task(chunkIdx * PacketChunkSize, (std::min)((chunkIdx + 1) * PacketChunkSize, count));
+	};
+
+	if (pPool != nullptr)
+	{
+		pPool->ParallelFor(chunkNum, runChunk);
+	}
+	else
+	{
+		for (UINT chunkIdx = 0; chunkIdx < chunkNum; ++chunkIdx)
+		{
+			runChunk(chunkIdx);
+		}
+	}
+}
+
+// Indices of the non-zero masks in increasing order, every chunk counts its own
+// and writes them behind those of the chunks before it
+void collectMasked(ThreadPool* pPool, const std::vector<UINT8>& masks, std::vector<UINT32>& indices)
+{
+	std::vector<size_t> chunkOffsets((masks.size() + PacketChunkSize - 1) / PacketChunkSize);
+
+	forEachChunk(pPool, masks.size(), [&](size_t begin, size_t end)
+	{
+		chunkOffsets[begin / PacketChunkSize] = static_cast<size_t>(std::count_if(
+			masks.begin() + begin, masks.begin() + end, [](UINT8 mask) { return mask != 0; }
+		));
+	});
+
+	size_t offset = 0;
+
+	for (auto& chunkOffset : chunkOffsets)
+	{
+		size_t chunkCount = chunkOffset;
+		chunkOffset = offset;
+		offset += chunkCount;
+	}
+
+	indices.resize(offset);
+
+	forEachChunk(pPool, masks.size(), [&](size_t begin, size_t end)
+	{
+		size_t indexIdx = chunkOffsets[begin / PacketChunkSize];
+
+		for (size_t maskIdx = begin; maskIdx < end; ++maskIdx)
+		{
+			if (masks[maskIdx] != 0)
+			{
+				indices[indexIdx++] = static_cast<UINT32>(maskIdx);
+			}
+		}
+	});
+}
+
+// Compacts the splits of a caster, the shadow shader maps the instance id to them
+UINT fillSplitIndices(UINT splitMask, UINT splitIndices[PSSMMaxSplitsNum])
+{
+	UINT splitNum = 0;
+
+	for (UINT splitIdx = 0; splitIdx < PSSMMaxSplitsNum; ++splitIdx)
+	{
+		if (splitMask & (1 << splitIdx))
+		{
+			splitIndices[splitNum++] = splitIdx;
+		}
+	}
+
+	return splitNum;
+}
+
+// D3D11 formats and bind flags of the textures of the frame graph
+RenderGraphTextureDesc createFrameTextureDesc(FrameTextureType type, uint32_t width, uint32_t height)
+{
+	const UINT targetFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+	switch (type)
+	{
+	case FrameTextureType::kBackBuffer:
+		return CreateTransientTextureDesc(DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, width, height, D3D11_BIND_RENDER_TARGET);
+	case FrameTextureType::kShadowMap:
+		return CreateTransientTextureDesc(ShadowMap::TextureFormat, width, height, D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE);
+	case FrameTextureType::kDepth:
+		return CreateTransientTextureDesc(DXGI_FORMAT_D24_UNORM_S8_UINT, width, height, D3D11_BIND_DEPTH_STENCIL);
+	case FrameTextureType::kHDR:
+		return CreateTransientTextureDesc(DXGI_FORMAT_R32G32B32A32_FLOAT, width, height, targetFlags);
+	case FrameTextureType::kEmissive:
+		return CreateTransientTextureDesc(DXGI_FORMAT_R8G8B8A8_UNORM, width, height, targetFlags);
+	case FrameTextureType::kBloomBlur:
+		return CreateTransientTextureDesc(Bloom::BlurTextureFormat, width, height, targetFlags);
+	case FrameTextureType::kExposure:
+	default:
+		return CreateTransientTextureDesc(ToneMapping::ExposureTextureFormat, width, height, targetFlags);
+	}
+}
+
+
 Renderer* Renderer::CreateRenderer(HWND hWnd)
 {
 	Renderer* pRenderer = new Renderer();
@@ -86,41 +270,41 @@ Renderer::Renderer()
 	: m_pContext(nullptr)
 	, m_pSwapChain(nullptr)
 	, m_pBackBufferRTV(nullptr)
-	, m_pDepthTexture(nullptr)
-	, m_pDepthTextureDSV(nullptr)
-	, m_pHDRRenderTarget(nullptr)
-	, m_pHDRTextureRTV(nullptr)
-	, m_pHDRTextureSRV(nullptr)
-	, m_pEmissiveTexture(nullptr)
-	, m_pEmissiveTextureRTV(nullptr)
-	, m_pEmissiveTextureSRV(nullptr)
 	, m_pRasterizerState(nullptr)
 	, m_pRasterizerStateFront(nullptr)
 	, m_pDepthStencilState(nullptr)
+	, m_pMinMagMipLinearSampler(nullptr)
+	, m_pMinMagMipLinearSamplerClamp(nullptr)
+	, m_pMinMagMipNearestSampler(nullptr)
+	, m_pShadowMapSampler(nullptr)
+	, m_pEnvironmentSphere(nullptr)
+	, m_pConstantBuffer(nullptr)
+	, m_pPBRBuffer(nullptr)
+	, m_pLightBuffer(nullptr)
+	, m_pPSSMConstantBuffer(nullptr)
+	, m_pDebugParamsBuffer(nullptr)
+	, m_pObjectConstantRing(nullptr)
 	, m_pSceneVShader(nullptr)
 	, m_pScenePShader(nullptr)
 	, m_pSceneColorTextureVShader(nullptr)
 	, m_pSceneColorTexturePShader(nullptr)
 	, m_pSceneColorEmissiveVShader(nullptr)
 	, m_pSceneColorEmissivePShader(nullptr)
+	, m_pSceneColorTextureCompactVShader(nullptr)
+	, m_pSceneColorEmissiveCompactVShader(nullptr)
 	, m_pEnvironmentVShader(nullptr)
 	, m_pEnvironmentPShader(nullptr)
 	, m_pShadowMapVShader(nullptr)
+	, m_pShadowMapInstancedVShader(nullptr)
 	, m_pShadowMapGShader(nullptr)
 	, m_pInputLayout(nullptr)
-	, m_pConstantBuffer(nullptr)
-	, m_pPBRBuffer(nullptr)
-	, m_pLightBuffer(nullptr)
-	, m_pPSSMConstantBuffer(nullptr)
-	, m_pDebugParamsBuffer(nullptr)
-	, m_pMinMagMipLinearSampler(nullptr)
-	, m_pMinMagMipLinearSamplerClamp(nullptr)
-	, m_pMinMagMipNearestSampler(nullptr)
-	, m_pShadowMapSampler(nullptr)
+	, m_pCompactInputLayout(nullptr)
+	, m_pQuantizedInputLayout(nullptr)
+	, m_pPositionInputLayout(nullptr)
+	, m_pQuantizedPositionInputLayout(nullptr)
 	, m_pPBRDFTexture(nullptr)
 	, m_pPBRDFTextureSRV(nullptr)
 	, m_pEnvironment(nullptr)
-	, m_pEnvironmentSphere(nullptr)
 	, m_windowWidth(0)
 	, m_windowHeight(0)
 	, m_projMatrix(DirectX::XMMatrixIdentity())
@@ -133,6 +317,42 @@ Renderer::Renderer()
 	, m_pDirectionalLightShadowMap(nullptr)
 	, m_showPSSMSplits(false)
 	, m_cameraFarPlaneForPSSM(200.0f)
+	, m_pModelLoader(nullptr)
+	, m_lodBias(0.0f)
+	, m_shadowLodBias(1.0f)
+	, m_sceneFullTriangleNum(0)
+	, m_sceneDrawnTriangleNum(0)
+	, m_shadowFullTriangleNum(0)
+	, m_shadowDrawnTriangleNum(0)
+	, m_isMeshletCulling(true)
+	, m_isFrustumCulling(true)
+	, m_isBvhCulling(true)
+	, m_shadowSplitDrawNum(0)
+	, m_pBoundVertexBuffer(nullptr)
+	, m_boundVertexStride(0)
+	, m_pBoundIndexBuffer(nullptr)
+	, m_boundIndexFormat(DXGI_FORMAT_UNKNOWN)
+	, m_geometryBindNum(0)
+	, m_pOcclusionBuffer(nullptr)
+	, m_isOcclusionCulling(true)
+	, m_pInstanceBuffer(nullptr)
+	, m_pInstanceBufferSRV(nullptr)
+	, m_instanceBufferCapacity(0)
+	, m_isInstancing(true)
+	, m_modelCopyNum(0)
+	, m_sceneDrawNum(0)
+	, m_shadowDrawNum(0)
+	, m_isParallelPackets(true)
+	, m_scenePacketTimeMs(0.0)
+	, m_shadowPacketTimeMs(0.0)
+	, m_sceneConstants()
+	, m_lightBufferData()
+	, m_isParallelFrame(true)
+	, m_framePrepareTimeMs(0.0)
+	, m_pTexturePool(nullptr)
+	, m_frameTextures()
+	, m_isBloom(true)
+	, m_isRenderGraphDirty(false)
 {}
 
 Renderer::~Renderer()
@@ -174,11 +394,26 @@ bool Renderer::Init(HWND hWnd)
 		hr = CreateSceneResources();
 	}
 
+	if (SUCCEEDED(hr))
+	{
+		m_pModelLoader = ModelLoader::Create(m_pContext, s_modelUploadBudget);
+
+		if (m_pModelLoader == nullptr)
+		{
+			hr = E_FAIL;
+		}
+	}
+
 	if (SUCCEEDED(hr))
 	{
 		hr = LoadModels();
 	}
 
+	if (SUCCEEDED(hr))
+	{
+		hr = BuildRenderGraph();
+	}
+
 	bool res = SUCCEEDED(hr);
 
 	if (res)
@@ -194,6 +429,11 @@ bool Renderer::Init(HWND hWnd)
 	{
 		res = InitImGui(hWnd);
 	}
+
+	if (res)
+	{
+		BuildFrameGraph();
+	}
 	
 	if (!res)
 	{
@@ -221,9 +461,17 @@ bool Renderer::InitImGui(HWND hWnd)
 
 void Renderer::Release()
 {
+	SafeRelease(m_pInstanceBufferSRV);
+	SafeRelease(m_pInstanceBuffer);
 	SafeRelease(m_pPBRDFTexture);
 	SafeRelease(m_pPBRDFTextureSRV);
+	SafeRelease(m_pQuantizedPositionInputLayout);
+	SafeRelease(m_pPositionInputLayout);
+	SafeRelease(m_pQuantizedInputLayout);
+	SafeRelease(m_pCompactInputLayout);
 	SafeRelease(m_pInputLayout);
+	SafeRelease(m_pSceneColorEmissiveCompactVShader);
+	SafeRelease(m_pSceneColorTextureCompactVShader);
 	SafeRelease(m_pSceneColorEmissivePShader);
 	SafeRelease(m_pSceneColorEmissiveVShader);
 	SafeRelease(m_pSceneColorTexturePShader);
@@ -242,18 +490,11 @@ void Renderer::Release()
 	SafeRelease(m_pEnvironmentPShader);
 	SafeRelease(m_pEnvironmentVShader);
 	SafeRelease(m_pShadowMapGShader);
+	SafeRelease(m_pShadowMapInstancedVShader);
 	SafeRelease(m_pShadowMapVShader);
 	SafeRelease(m_pDepthStencilState);
 	SafeRelease(m_pRasterizerStateFront);
 	SafeRelease(m_pRasterizerState);
-	SafeRelease(m_pEmissiveTextureRTV);
-	SafeRelease(m_pEmissiveTextureSRV);
-	SafeRelease(m_pEmissiveTexture);
-	SafeRelease(m_pHDRTextureSRV);
-	SafeRelease(m_pHDRTextureRTV);
-	SafeRelease(m_pHDRRenderTarget);
-	SafeRelease(m_pDepthTextureDSV);
-	SafeRelease(m_pDepthTexture);
 	SafeRelease(m_pBackBufferRTV);
 	SafeRelease(m_pSwapChain);
 
@@ -263,12 +504,18 @@ void Renderer::Release()
 	delete m_pBloom;
 	delete m_pCamera;
 	delete m_pDirectionalLightShadowMap;
+	delete m_pTexturePool;
+	delete m_pOcclusionBuffer;
+	delete m_pObjectConstantRing;
 
 	for (auto& mesh : m_meshes)
 	{
 		delete mesh;
 	}
 
+	// stops the loader thread before the models it fills are gone
+	delete m_pModelLoader;
+
 	for (auto& model : m_models)
 	{
 		delete model;
@@ -321,91 +568,8 @@ HRESULT Renderer::CreateBackBuffer()
 		hr = pDevice->CreateRenderTargetView(pBackBufferTexture, nullptr, &m_pBackBufferRTV);
 	}
 
-	if (SUCCEEDED(hr))
-	{
-		D3D11_TEXTURE2D_DESC depthTextureDesc = {};
-		depthTextureDesc.Usage = D3D11_USAGE_DEFAULT;
-		depthTextureDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-		depthTextureDesc.Width = m_windowWidth;
-		depthTextureDesc.Height = m_windowHeight;
-		depthTextureDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-		depthTextureDesc.ArraySize = 1;
-		depthTextureDesc.MipLevels = 1;
-		depthTextureDesc.MiscFlags = 0;
-		depthTextureDesc.CPUAccessFlags = 0;
-		depthTextureDesc.SampleDesc.Count = 1;
-		depthTextureDesc.SampleDesc.Quality = 0;
-
-		hr = pDevice->CreateTexture2D(&depthTextureDesc, nullptr, &m_pDepthTexture);
-	}
-
-	if (SUCCEEDED(hr))
-	{
-		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
-		dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-		dsvDesc.Texture2D.MipSlice = 0;
-		dsvDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-		dsvDesc.Flags = 0;
-
-		pDevice->CreateDepthStencilView(m_pDepthTexture, &dsvDesc, &m_pDepthTextureDSV);
-	}
-
 	SafeRelease(pBackBufferTexture);
 
-	if (SUCCEEDED(hr))
-	{
-		D3D11_TEXTURE2D_DESC hdrTextureDesc = {};
-		hdrTextureDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-		hdrTextureDesc.Width = m_windowWidth;
-		hdrTextureDesc.Height = m_windowHeight;
-		hdrTextureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-		hdrTextureDesc.Usage = D3D11_USAGE_DEFAULT;
-		hdrTextureDesc.CPUAccessFlags = 0;
-		hdrTextureDesc.ArraySize = 1;
-		hdrTextureDesc.MipLevels = 1;
-		hdrTextureDesc.SampleDesc.Count = 1;
-		hdrTextureDesc.SampleDesc.Quality = 0;
-
-		hr = pDevice->CreateTexture2D(&hdrTextureDesc, nullptr, &m_pHDRRenderTarget);
-	}
-
-	if (SUCCEEDED(hr))
-	{
-		hr = pDevice->CreateRenderTargetView(m_pHDRRenderTarget, nullptr, &m_pHDRTextureRTV);
-	}
-
-	if (SUCCEEDED(hr))
-	{
-		hr = pDevice->CreateShaderResourceView(m_pHDRRenderTarget, nullptr, &m_pHDRTextureSRV);
-	}
-
-	if (SUCCEEDED(hr))
-	{
-		D3D11_TEXTURE2D_DESC emissiveTextureDesc = {};
-		emissiveTextureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-		emissiveTextureDesc.Width = m_windowWidth;
-		emissiveTextureDesc.Height = m_windowHeight;
-		emissiveTextureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-		emissiveTextureDesc.Usage = D3D11_USAGE_DEFAULT;
-		emissiveTextureDesc.CPUAccessFlags = 0;
-		emissiveTextureDesc.ArraySize = 1;
-		emissiveTextureDesc.MipLevels = 1;
-		emissiveTextureDesc.SampleDesc.Count = 1;
-		emissiveTextureDesc.SampleDesc.Quality = 0;
-
-		hr = pDevice->CreateTexture2D(&emissiveTextureDesc, nullptr, &m_pEmissiveTexture);
-	}
-
-	if (SUCCEEDED(hr))
-	{
-		hr = pDevice->CreateRenderTargetView(m_pEmissiveTexture, nullptr, &m_pEmissiveTextureRTV);
-	}
-
-	if (SUCCEEDED(hr))
-	{
-		hr = pDevice->CreateShaderResourceView(m_pEmissiveTexture, nullptr, &m_pEmissiveTextureSRV);
-	}
-
 	return hr;
 }
 
@@ -510,7 +674,7 @@ HRESULT Renderer::CreatePipelineStateObjects()
 			&m_pSceneColorTextureVShader,
 			&pVSBlob,
 			&m_pSceneColorTexturePShader,
-			"HAS_COLOR_TEXTURE=1"
+			"HAS_COLOR_TEXTURE=1 INSTANCED=1"
 		))
 		{
 			hr = E_FAIL;
@@ -524,7 +688,37 @@ HRESULT Renderer::CreatePipelineStateObjects()
 			&m_pSceneColorEmissiveVShader,
 			&pVSBlob,
 			&m_pSceneColorEmissivePShader,
-			"HAS_COLOR_TEXTURE=1 HAS_EMISSIVE_TEXTURE=1"
+			"HAS_COLOR_TEXTURE=1 HAS_EMISSIVE_TEXTURE=1 INSTANCED=1"
+		))
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	ID3DBlob* pCompactVSBlob = nullptr;
+
+	if (SUCCEEDED(hr))
+	{
+		if (!m_pContext->GetShaderCompiler()->CreateVertexShader(
+			"shaders/simpleShader.hlsl",
+			&m_pSceneColorTextureCompactVShader,
+			&pCompactVSBlob,
+			"HAS_COLOR_TEXTURE=1 COMPACT_VERTEX=1 INSTANCED=1"
+		))
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		SafeRelease(pCompactVSBlob);
+
+		if (!m_pContext->GetShaderCompiler()->CreateVertexShader(
+			"shaders/simpleShader.hlsl",
+			&m_pSceneColorEmissiveCompactVShader,
+			&pCompactVSBlob,
+			"HAS_COLOR_TEXTURE=1 HAS_EMISSIVE_TEXTURE=1 COMPACT_VERTEX=1 INSTANCED=1"
 		))
 		{
 			hr = E_FAIL;
@@ -544,16 +738,35 @@ HRESULT Renderer::CreatePipelineStateObjects()
 		}
 	}
 
+	ID3DBlob* pDepthVSBlob = nullptr;
+
 	if (SUCCEEDED(hr))
 	{
 		if (!m_pContext->GetShaderCompiler()->CreateVertexShader(
 			"shaders/shadowMap.hlsl",
 			&m_pShadowMapVShader,
-			&pVSBlob
+			&pDepthVSBlob
+		))
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		ID3DBlob* pInstancedVSBlob = nullptr;
+
+		if (!m_pContext->GetShaderCompiler()->CreateVertexShader(
+			"shaders/shadowMap.hlsl",
+			&m_pShadowMapInstancedVShader,
+			&pInstancedVSBlob,
+			"INSTANCED=1"
 		))
 		{
 			hr = E_FAIL;
 		}
+
+		SafeRelease(pInstancedVSBlob);
 	}
 
 	if (SUCCEEDED(hr))
@@ -590,6 +803,76 @@ HRESULT Renderer::CreatePipelineStateObjects()
 		);
 	}
 
+	if (SUCCEEDED(hr))
+	{
+		D3D11_INPUT_ELEMENT_DESC inputLayoutDesc[] = {
+			CreateInputElementDesc("POSITION", DXGI_FORMAT_R32G32B32_FLOAT, offsetof(CompactVertex, position)),
+			CreateInputElementDesc("NORMAL", DXGI_FORMAT_R16G16_SNORM, offsetof(CompactVertex, normal)),
+			CreateInputElementDesc("TANGENT", DXGI_FORMAT_R16G16_UINT, offsetof(CompactVertex, tangent)),
+			CreateInputElementDesc("TEXCOORD", DXGI_FORMAT_R16G16_UNORM, offsetof(CompactVertex, texCoord))
+		};
+
+		hr = pDevice->CreateInputLayout(
+			inputLayoutDesc,
+			_countof(inputLayoutDesc),
+			pCompactVSBlob->GetBufferPointer(),
+			pCompactVSBlob->GetBufferSize(),
+			&m_pCompactInputLayout
+		);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		D3D11_INPUT_ELEMENT_DESC inputLayoutDesc[] = {
+			CreateInputElementDesc("POSITION", DXGI_FORMAT_R16G16B16A16_UNORM, offsetof(QuantizedVertex, position)),
+			CreateInputElementDesc("NORMAL", DXGI_FORMAT_R16G16_SNORM, offsetof(QuantizedVertex, normal)),
+			CreateInputElementDesc("TANGENT", DXGI_FORMAT_R16G16_UINT, offsetof(QuantizedVertex, tangent)),
+			CreateInputElementDesc("TEXCOORD", DXGI_FORMAT_R16G16_UNORM, offsetof(QuantizedVertex, texCoord))
+		};
+
+		hr = pDevice->CreateInputLayout(
+			inputLayoutDesc,
+			_countof(inputLayoutDesc),
+			pCompactVSBlob->GetBufferPointer(),
+			pCompactVSBlob->GetBufferSize(),
+			&m_pQuantizedInputLayout
+		);
+	}
+
+	// depth passes read nothing but the position, from a position stream or from the full vertices
+	if (SUCCEEDED(hr))
+	{
+		D3D11_INPUT_ELEMENT_DESC inputLayoutDesc[] = {
+			CreateInputElementDesc("POSITION", DXGI_FORMAT_R32G32B32_FLOAT, 0)
+		};
+
+		hr = pDevice->CreateInputLayout(
+			inputLayoutDesc,
+			_countof(inputLayoutDesc),
+			pDepthVSBlob->GetBufferPointer(),
+			pDepthVSBlob->GetBufferSize(),
+			&m_pPositionInputLayout
+		);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		D3D11_INPUT_ELEMENT_DESC inputLayoutDesc[] = {
+			CreateInputElementDesc("POSITION", DXGI_FORMAT_R16G16B16A16_UNORM, 0)
+		};
+
+		hr = pDevice->CreateInputLayout(
+			inputLayoutDesc,
+			_countof(inputLayoutDesc),
+			pDepthVSBlob->GetBufferPointer(),
+			pDepthVSBlob->GetBufferSize(),
+			&m_pQuantizedPositionInputLayout
+		);
+	}
+
+	SafeRelease(pDepthVSBlob);
+	SafeRelease(pCompactVSBlob);
+
 	return hr;
 }
 
@@ -636,18 +919,17 @@ HRESULT Renderer::CreateCubeResourses(Mesh*& cubeMesh)
 		20, 22, 21, 20, 23, 22
 	};
 
+	GeometryPool* pPool = m_pContext->GetGeometryPool();
+
 	Mesh* mesh = new Mesh();
+	mesh->pGeometryPool = pPool;
 	mesh->indexCount = _countof(indices);
+	ComputeBounds(vertices, _countof(vertices), mesh->boundsMin, mesh->boundsMax);
 
-	D3D11_BUFFER_DESC vertexBufferDesc = CreateDefaultBufferDesc(_countof(vertices) * sizeof(Vertex), D3D11_BIND_VERTEX_BUFFER);
-	D3D11_SUBRESOURCE_DATA vertexBufferData = CreateDefaultSubresourceData(&vertices);
-
-	HRESULT hr = m_pContext->GetDevice()->CreateBuffer(&vertexBufferDesc, &vertexBufferData, &mesh->pVertexBuffer);
+	HRESULT hr = pPool->Upload(sizeof(Vertex), D3D11_BIND_VERTEX_BUFFER, _countof(vertices), vertices, mesh->vertexRange);
 	if (SUCCEEDED(hr))
 	{
-		D3D11_BUFFER_DESC indexBufferDesc = CreateDefaultBufferDesc(mesh->indexCount * sizeof(UINT16), D3D11_BIND_INDEX_BUFFER);
-		D3D11_SUBRESOURCE_DATA indexBufferData = CreateDefaultSubresourceData(&indices);
-		hr = m_pContext->GetDevice()->CreateBuffer(&indexBufferDesc, &indexBufferData, &mesh->pIndexBuffer);
+		hr = pPool->Upload(sizeof(UINT16), D3D11_BIND_INDEX_BUFFER, mesh->indexCount, indices, mesh->indexRange);
 	}
 
 	if (SUCCEEDED(hr))
@@ -676,18 +958,17 @@ HRESULT Renderer::CreatePlaneResourses(Mesh*& planeMesh)
 		0, 1, 2, 0, 2, 3
 	};
 
+	GeometryPool* pPool = m_pContext->GetGeometryPool();
+
 	Mesh* mesh = new Mesh();
+	mesh->pGeometryPool = pPool;
 	mesh->indexCount = _countof(indices);
+	ComputeBounds(vertices, _countof(vertices), mesh->boundsMin, mesh->boundsMax);
 
-	D3D11_BUFFER_DESC vertexBufferDesc = CreateDefaultBufferDesc(_countof(vertices) * sizeof(Vertex), D3D11_BIND_VERTEX_BUFFER);
-	D3D11_SUBRESOURCE_DATA vertexBufferData = CreateDefaultSubresourceData(&vertices);
-
-	HRESULT hr = m_pContext->GetDevice()->CreateBuffer(&vertexBufferDesc, &vertexBufferData, &mesh->pVertexBuffer);
+	HRESULT hr = pPool->Upload(sizeof(Vertex), D3D11_BIND_VERTEX_BUFFER, _countof(vertices), vertices, mesh->vertexRange);
 	if (SUCCEEDED(hr))
 	{
-		D3D11_BUFFER_DESC indexBufferDesc = CreateDefaultBufferDesc(mesh->indexCount * sizeof(UINT16), D3D11_BIND_INDEX_BUFFER);
-		D3D11_SUBRESOURCE_DATA indexBufferData = CreateDefaultSubresourceData(&indices);
-		hr = m_pContext->GetDevice()->CreateBuffer(&indexBufferDesc, &indexBufferData, &mesh->pIndexBuffer);
+		hr = pPool->Upload(sizeof(UINT16), D3D11_BIND_INDEX_BUFFER, mesh->indexCount, indices, mesh->indexRange);
 	}
 
 	if (SUCCEEDED(hr))
@@ -731,11 +1012,21 @@ HRESULT Renderer::CreateSceneResources()
 
 	if (SUCCEEDED(hr))
 	{
-		D3D11_BUFFER_DESC constantBufferDesc = CreateDefaultBufferDesc(sizeof(ConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
+		D3D11_BUFFER_DESC constantBufferDesc = CreateDefaultBufferDesc(sizeof(SceneConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
 
 		hr = m_pContext->GetDevice()->CreateBuffer(&constantBufferDesc, nullptr, &m_pConstantBuffer);
 	}
 
+	if (SUCCEEDED(hr))
+	{
+		m_pObjectConstantRing = ConstantRingBuffer::Create(m_pContext, s_objectConstantRingSize);
+
+		if (m_pObjectConstantRing == nullptr)
+		{
+			hr = E_FAIL;
+		}
+	}
+
 	if (SUCCEEDED(hr))
 	{
 		D3D11_BUFFER_DESC pbrBufferDesc = CreateDefaultBufferDesc(sizeof(PBRBuffer), D3D11_BIND_CONSTANT_BUFFER);
@@ -802,7 +1093,7 @@ HRESULT Renderer::CreateSceneResources()
 
 	if (SUCCEEDED(hr))
 	{
-		m_pToneMapping = ToneMapping::CreateToneMapping(m_pContext, App::MaxWindowSize);
+		m_pToneMapping = ToneMapping::CreateToneMapping(m_pContext);
 
 		if (m_pToneMapping == nullptr)
 		{
@@ -832,7 +1123,7 @@ HRESULT Renderer::CreateSceneResources()
 
 	if (SUCCEEDED(hr))
 	{
-		m_pDirectionalLightShadowMap = ShadowMap::CreateShadowMap(m_pContext, PSSMMaxSplitsNum, 2048u);
+		m_pDirectionalLightShadowMap = ShadowMap::CreateShadowMap(PSSMMaxSplitsNum, 2048u);
 
 		if (m_pDirectionalLightShadowMap == nullptr)
 		{
@@ -842,17 +1133,37 @@ HRESULT Renderer::CreateSceneResources()
 
 	if (SUCCEEDED(hr))
 	{
-		hr = m_pContext->CalculatePreintegratedBRDF(
-			&m_pPBRDFTexture,
-			&m_pPBRDFTextureSRV
-		);
+		m_pTexturePool = TransientTexturePool::Create(m_pContext);
+
+		if (m_pTexturePool == nullptr)
+		{
+			hr = E_FAIL;
+		}
 	}
 
-	return hr;
-}
+	if (SUCCEEDED(hr))
+	{
+		m_pOcclusionBuffer = OcclusionBuffer::Create(OcclusionBufferWidth, OcclusionBufferHeight);
 
-HRESULT Renderer::LoadModels()
-{
+		if (m_pOcclusionBuffer == nullptr)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = m_pContext->CalculatePreintegratedBRDF(
+			&m_pPBRDFTexture,
+			&m_pPBRDFTextureSRV
+		);
+	}
+
+	return hr;
+}
+
+HRESULT Renderer::LoadModels()
+{
 	struct ModelLoadData
 	{
 		std::string modelName;
@@ -881,15 +1192,13 @@ HRESULT Renderer::LoadModels()
 
 	for (const auto& modelLoadData : models)
 	{
-		Model* pModel = m_pContext->LoadModel(
+		// models show up mesh by mesh as ModelLoader uploads them in Render
+		Model* pModel = m_pModelLoader->LoadModelAsync(
 			modelLoadData.modelName,
 			modelLoadData.initMatrix
 		);
 
-		if (pModel != nullptr)
-		{
-			m_models.push_back(pModel);
-		}
+		m_models.push_back(pModel);
 	}
 
 	return S_OK;
@@ -914,14 +1223,6 @@ bool Renderer::Resize(UINT newWidth, UINT newHeight)
 	}
 
 	SafeRelease(m_pBackBufferRTV);
-	SafeRelease(m_pDepthTextureDSV);
-	SafeRelease(m_pDepthTexture);
-	SafeRelease(m_pHDRTextureRTV);
-	SafeRelease(m_pHDRTextureSRV);
-	SafeRelease(m_pHDRRenderTarget);
-	SafeRelease(m_pEmissiveTextureRTV);
-	SafeRelease(m_pEmissiveTextureSRV);
-	SafeRelease(m_pEmissiveTexture);
 
 	HRESULT hr = m_pSwapChain->ResizeBuffers(s_swapChainBuffersNum, newWidth, newHeight, DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, 0);
 
@@ -938,6 +1239,11 @@ bool Renderer::Resize(UINT newWidth, UINT newHeight)
 		hr = m_pBloom->Resize(newWidth, newHeight);
 	}
 
+	if (SUCCEEDED(hr))
+	{
+		hr = BuildRenderGraph();
+	}
+
 	return SUCCEEDED(hr);
 }
 
@@ -946,6 +1252,7 @@ void Renderer::ChangeLightBrightness(UINT lightIdx, FLOAT newBrightness)
 	assert(lightIdx < m_lights.size());
 
 	m_lights[lightIdx].SetBrightness(newBrightness);
+	PrepareLights();
 	FillLightBuffer();
 }
 
@@ -957,13 +1264,7 @@ Camera* Renderer::GetCamera()
 
 void Renderer::FillLightBuffer()
 {
-	static LightBuffer lightBuffer = {};
-	memcpy(&lightBuffer.shadowSplitDists, m_pDirectionalLightShadowMap->GetShadowMapSplitDists().data(), sizeof(DirectX::XMFLOAT4));
-	lightBuffer.directionalLight = m_directionalLight;
-	lightBuffer.lightsCount.x = 0;
-	memcpy(lightBuffer.lights, m_lights.data(), sizeof(PointLight) * m_lights.size());
-
-	m_pContext->GetContext()->UpdateSubresource(m_pLightBuffer, 0, nullptr, &lightBuffer, 0, 0);
+	m_pContext->GetContext()->UpdateSubresource(m_pLightBuffer, 0, nullptr, &m_lightBufferData, 0, 0);
 }
 
 
@@ -1056,6 +1357,207 @@ void Renderer::RenderImGui()
 		}
 	}
 
+	{
+		ImGui::BeginChild("Model streaming", ImVec2(0, 80), true);
+		ImGui::Text("Model streaming:");
+
+		int uploadBudgetKB = static_cast<int>(m_pModelLoader->GetUploadBudget() / 1024);
+		ImGui::SliderInt("Upload budget, KB/frame", &uploadBudgetKB, 64, 65536);
+		m_pModelLoader->SetUploadBudget(static_cast<size_t>(uploadBudgetKB) * 1024);
+
+		ImGui::Text(
+			"Pending models: %u, uploaded last frame: %zu KB",
+			m_pModelLoader->GetPendingModelNum(),
+			m_pModelLoader->GetLastFrameUploadBytes() / 1024
+		);
+
+		ImGui::EndChild();
+	}
+
+	{
+		ImGui::BeginChild("Geometry pool", ImVec2(0, 120), true);
+		ImGui::Text("Geometry pool:");
+
+		GeometryPoolStats poolStats = m_pContext->GetGeometryPool()->GetStats();
+
+		ImGui::Text("Heaps: %u, ranges: %u, free blocks: %u", poolStats.heapNum, poolStats.rangeNum, poolStats.freeBlockNum);
+		ImGui::Text(
+			"Used: %.1f / %.1f MB",
+			poolStats.usedBytes / (1024.0 * 1024.0),
+			poolStats.capacityBytes / (1024.0 * 1024.0)
+		);
+		ImGui::Text("Buffer binds: %zu", m_geometryBindNum);
+
+		if (ImGui::Button("Defragment"))
+		{
+			m_pContext->GetGeometryPool()->Defragment();
+		}
+
+		ImGui::EndChild();
+	}
+
+	{
+		ImGui::BeginChild("Mesh LOD", ImVec2(0, 100), true);
+		ImGui::Text("Mesh LOD:");
+
+		ImGui::SliderFloat("LOD bias", &m_lodBias, -2.0f, float(MaxLodNum));
+		ImGui::SliderFloat("Shadow LOD bias", &m_shadowLodBias, -2.0f, float(MaxLodNum));
+
+		ImGui::Text("Scene triangles: %zu -> %zu", m_sceneFullTriangleNum, m_sceneDrawnTriangleNum);
+		ImGui::Text("Shadow triangles: %zu -> %zu", m_shadowFullTriangleNum, m_shadowDrawnTriangleNum);
+
+		ImGui::EndChild();
+	}
+
+	{
+		ImGui::BeginChild("Frustum culling", ImVec2(0, 160), true);
+		ImGui::Text("Frustum culling:");
+
+		ImGui::Checkbox("Cull instances", &m_isFrustumCulling);
+		ImGui::Checkbox("Use BVH", &m_isBvhCulling);
+
+		ImGui::Text("BVH nodes: %zu", m_instanceBvh.GetNodeNum());
+
+		ImGui::Text("Scene instances: %zu / %zu", m_visibleInstances.size(), m_instanceBounds.count);
+		ImGui::Text("Shadow casters: %zu / %zu", m_shadowVisibleInstances.size(), m_instanceBounds.count);
+		ImGui::Text(
+			"Shadow split draws: %zu / %zu",
+			m_shadowSplitDrawNum,
+			m_shadowVisibleInstances.size() * m_pDirectionalLightShadowMap->GetShadowMapSplitsNum()
+		);
+
+		ImGui::EndChild();
+	}
+
+	{
+		ImGui::BeginChild("Occlusion culling", ImVec2(0, 120), true);
+		ImGui::Text("Occlusion culling:");
+
+		ImGui::Checkbox("Cull occluded instances", &m_isOcclusionCulling);
+
+		ImGui::Text("Occluders: %zu, triangles: %zu", m_occlusionStats.occluderNum, m_occlusionStats.occluderTriangleNum);
+		ImGui::Text("Occluded instances: %zu / %zu", m_occlusionStats.occludedNum, m_occlusionStats.testedNum);
+		ImGui::Text("Raster: %.3f ms, tests: %.3f ms", m_occlusionStats.rasterTimeMs, m_occlusionStats.testTimeMs);
+
+		ImGui::EndChild();
+	}
+
+	{
+		ImGui::BeginChild("Instancing", ImVec2(0, 180), true);
+		ImGui::Text("Instancing:");
+
+		ImGui::Checkbox("Batch instances", &m_isInstancing);
+
+		int modelCopyNum = static_cast<int>(m_modelCopyNum);
+		ImGui::SliderInt("Model copies", &modelCopyNum, 0, s_maxModelCopyNum);
+		m_modelCopyNum = static_cast<UINT>(modelCopyNum);
+
+		ImGui::Text("Scene draws: %zu, instances: %zu", m_sceneDrawNum, m_visibleInstances.size());
+		ImGui::Text("Shadow draws: %zu, instances: %zu", m_shadowDrawNum, m_shadowSplitDrawNum);
+
+		const DrawStateStats& stateStats = m_drawStateCache.GetStats();
+		ImGui::Text("State changes: %zu, redundant skipped: %zu", stateStats.GetSetNum(), stateStats.GetSkippedNum());
+
+		ImGui::Checkbox("Parallel packets", &m_isParallelPackets);
+		ImGui::Text("Packets: scene %.3f ms, shadow %.3f ms", m_scenePacketTimeMs, m_shadowPacketTimeMs);
+
+		ImGui::EndChild();
+	}
+
+	{
+		ImGui::BeginChild("Frame tasks", ImVec2(0, 80.0f + 17.0f * m_frameGraph.GetTaskNum()), true);
+		ImGui::Text("Frame tasks:");
+
+		ImGui::Checkbox("Parallel frame tasks", &m_isParallelFrame);
+
+		for (TaskGraph::TaskId taskId = 0; taskId < m_frameGraph.GetTaskNum(); ++taskId)
+		{
+			ImGui::Text("%s: %.3f ms", m_frameGraph.GetTaskName(taskId), m_frameGraph.GetTaskTimeMs(taskId));
+		}
+
+		ImGui::Text("Prepare: %.3f ms on %u threads", m_framePrepareTimeMs, m_pContext->GetThreadPool()->GetThreadNum());
+
+		ImGui::EndChild();
+	}
+
+	{
+		ImGui::BeginChild("Render graph", ImVec2(0, 97.0f + 17.0f * m_renderGraph.GetPassNum()), true);
+		ImGui::Text("Render graph:");
+
+		if (ImGui::Checkbox("Bloom", &m_isBloom))
+		{
+			m_isRenderGraphDirty = true;
+		}
+
+		for (RenderGraph::PassId passId = 0; passId < m_renderGraph.GetPassNum(); ++passId)
+		{
+			ImGui::Text("%s%s", m_renderGraph.GetPassName(passId), m_renderGraph.IsPassCulled(passId) ? ": culled" : "");
+		}
+
+		const RenderGraphStats& graphStats = m_renderGraph.GetStats();
+
+		ImGui::Text(
+			"Textures: %zu transient, %zu physical, %zu created",
+			graphStats.transientNum,
+			graphStats.physicalNum,
+			m_pTexturePool->GetCreatedNum()
+		);
+		ImGui::Text(
+			"Memory: %.1f MB unaliased, %.1f MB physical, %.1f MB placed in a heap",
+			graphStats.unaliasedSize / (1024.0 * 1024.0),
+			graphStats.physicalSize / (1024.0 * 1024.0),
+			graphStats.heapSize / (1024.0 * 1024.0)
+		);
+		ImGui::Text("Passes culled: %zu, barriers: %zu, alias barriers: %zu", graphStats.culledPassNum, graphStats.barrierNum, graphStats.aliasBarrierNum);
+
+		if (m_pTexturePool->IsTiled())
+		{
+			ImGui::Text("Tiled resources: %.1f MB tile pool", m_pTexturePool->GetTilePoolSize() / (1024.0 * 1024.0));
+		}
+		else
+		{
+			ImGui::Text("Tiled resources: not supported, equal descs share physical textures");
+		}
+
+		ImGui::EndChild();
+	}
+
+	{
+		ImGui::BeginChild("Constant ring", ImVec2(0, 120), true);
+		ImGui::Text("Constant ring:");
+
+		const RingBufferStats& ringStats = m_pObjectConstantRing->GetStats();
+
+		ImGui::Text("Buffer offsets: %s", m_pObjectConstantRing->IsOffsetting() ? "supported" : "not supported, updating one buffer");
+		ImGui::Text("Allocations: %zu, %zu KB", ringStats.allocationNum, ringStats.allocatedBytes / 1024);
+		ImGui::Text(
+			"Used: %zu KB, peak: %zu KB of %u KB",
+			ringStats.usedBytes / 1024,
+			ringStats.peakUsedBytes / 1024,
+			s_objectConstantRingSize / 1024
+		);
+		ImGui::Text("Frames in flight: %zu", ringStats.inFlightFrameNum);
+		ImGui::Text("Overflows: %zu, total: %zu", ringStats.overflowNum, m_pObjectConstantRing->GetTotalOverflowNum());
+
+		ImGui::EndChild();
+	}
+
+	{
+		ImGui::BeginChild("Meshlet culling", ImVec2(0, 80), true);
+		ImGui::Text("Meshlet culling:");
+
+		ImGui::Checkbox("Cull meshlets", &m_isMeshletCulling);
+
+		ImGui::Text(
+			"Meshlets tested: %zu, frustum culled: %zu, cone culled: %zu",
+			m_meshletCullStats.testedNum,
+			m_meshletCullStats.frustumCulledNum,
+			m_meshletCullStats.coneCulledNum
+		);
+
+		ImGui::EndChild();
+	}
+
 	ImGui::End();
 	ImGui::Render();
 	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
@@ -1069,27 +1571,145 @@ void Renderer::Render()
 {
 	ID3D11DeviceContext* pContext = m_pContext->GetContext();
 
-	Update();
+	m_pModelLoader->ProcessUploads();
+	m_pObjectConstantRing->BeginFrame();
 
-	m_pContext->BeginEvent(L"Draw Scene");
+	Update();
+	UpdateInstanceBounds();
 
 	FLOAT width = s_near / tanf(s_fov / 2.0f);
 	FLOAT height = ((FLOAT)m_windowHeight / m_windowWidth) * width;
 	m_projMatrix = DirectX::XMMatrixPerspectiveLH(width, height, s_near, s_far);
 
-	RenderShadowMap();
+	// culling, packets and constants of the frame, the passes below only submit them
+	auto prepareStart = std::chrono::steady_clock::now();
+	m_frameGraph.Run(m_isParallelFrame ? m_pContext->GetThreadPool()->GetJobSystem() : nullptr);
+	m_framePrepareTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - prepareStart).count();
+
+	m_geometryBindNum = 0;
+	m_drawStateCache.ResetStats();
+
+	if (m_isRenderGraphDirty)
+	{
+		HRESULT hr = BuildRenderGraph();
+
+		if (FAILED(hr))
+		{
+			printf("failed to build the render graph, hr = 0x%08x\n", static_cast<unsigned int>(hr));
+
+			m_pObjectConstantRing->EndFrame();
+			return;
+		}
+	}
+
+	pContext->UpdateSubresource(m_pConstantBuffer, 0, nullptr, &m_sceneConstants, 0, 0);
 	FillLightBuffer();
 
-	pContext->ClearState();
+	m_renderGraph.Execute([this](RenderGraph::PassId passId)
+		{
+			m_pTexturePool->BeginPass(m_renderGraph, passId);
+		}
+	);
+
+	m_pObjectConstantRing->EndFrame();
+
+	m_pSwapChain->Present(0, 0);
+}
+
+HRESULT Renderer::BuildRenderGraph()
+{
+	m_isRenderGraphDirty = false;
+	m_renderGraph.Clear();
+
+	FrameGraphDesc desc;
+	desc.width = m_windowWidth;
+	desc.height = m_windowHeight;
+	desc.shadowMapSize = m_pDirectionalLightShadowMap->GetShadowMapTextureSize();
+	desc.shadowSplitNum = m_pDirectionalLightShadowMap->GetShadowMapSplitsNum();
+	desc.bloomBlurWidth = m_pBloom->GetBlurTextureWidth();
+	desc.bloomBlurHeight = m_pBloom->GetBlurTextureHeight();
+	desc.exposureSize = ToneMapping::GetExposureTextureSize(m_windowWidth, m_windowHeight);
+	desc.isBloom = m_isBloom;
+	desc.createTextureDesc = createFrameTextureDesc;
+
+	FramePasses passes;
+
+	passes.shadowMap = [this]()
+	{
+		RenderShadowMap();
+	};
+
+	passes.environment = [this]()
+	{
+		m_pContext->GetContext()->ClearState();
+		SetSceneState();
+		RenderEnvironment();
+	};
+
+	passes.scene = [this]()
+	{
+		RenderScene();
+	};
+
+	passes.bloomMask = [this]()
+	{
+		m_pBloom->RenderBloomMask(
+			m_pTexturePool->GetSRV(m_frameTextures.hdr),
+			m_pTexturePool->GetSRV(m_frameTextures.emissive),
+			m_pTexturePool->GetRTV(m_frameTextures.bloomBlur)
+		);
+	};
+
+	passes.bloomBlur = [this]()
+	{
+		ID3D11ShaderResourceView* blurSRVs[] = { m_pTexturePool->GetSRV(m_frameTextures.bloomBlur), m_pTexturePool->GetSRV(m_frameTextures.bloomBlurTemp) };
+		ID3D11RenderTargetView* blurRTVs[] = { m_pTexturePool->GetRTV(m_frameTextures.bloomBlur), m_pTexturePool->GetRTV(m_frameTextures.bloomBlurTemp) };
+
+		m_pBloom->Blur(blurSRVs, blurRTVs);
+	};
+
+	passes.addBloom = [this]()
+	{
+		m_pBloom->AddBloom(m_pTexturePool->GetSRV(m_frameTextures.bloomBlur), m_pTexturePool->GetRTV(m_frameTextures.hdr));
+	};
+
+	passes.averageBrightness = [this]()
+	{
+		m_pToneMapping->CalculateExposure(
+			m_pTexturePool->GetSRV(m_frameTextures.hdr),
+			m_pTexturePool->GetTexture(m_frameTextures.exposure),
+			m_timeFromLastFrame / 10e6f
+		);
+	};
+
+	passes.toneMapping = [this]()
+	{
+		m_pToneMapping->ToneMap(m_pTexturePool->GetSRV(m_frameTextures.hdr), m_pBackBufferRTV, m_windowWidth, m_windowHeight);
+	};
+
+	passes.imGui = [this]()
+	{
+		m_pContext->GetContext()->OMSetRenderTargets(1, &m_pBackBufferRTV, nullptr);
+		RenderImGui();
+	};
 
-	static constexpr float fillColor[4] = { 0.1f, 0.1f, 0.1f, 1.0f };
-	pContext->ClearRenderTargetView(m_pBackBufferRTV, fillColor);
-	pContext->ClearRenderTargetView(m_pHDRTextureRTV, fillColor);
+	m_frameTextures = AddFramePasses(m_renderGraph, desc, std::move(passes));
 
-	static constexpr float emissiveTextureFillColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-	pContext->ClearRenderTargetView(m_pEmissiveTextureRTV, emissiveTextureFillColor);
+	HRESULT hr = m_renderGraph.Compile() ? m_pTexturePool->Allocate(m_renderGraph) : E_FAIL;
 
-	pContext->ClearDepthStencilView(m_pDepthTextureDSV, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+	// nothing runs on a half built graph, the next frame tries again
+	if (FAILED(hr))
+	{
+		m_renderGraph.Clear();
+		m_isRenderGraphDirty = true;
+	}
+
+	return hr;
+}
+
+void Renderer::SetSceneState()
+{
+	ID3D11DeviceContext* pContext = m_pContext->GetContext();
 
 	D3D11_VIEWPORT viewport = {};
 	viewport.TopLeftY = 0;
@@ -1111,33 +1731,20 @@ void Renderer::Render()
 	pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	pContext->IASetInputLayout(m_pInputLayout);
 	pContext->OMSetDepthStencilState(m_pDepthStencilState, 0);
-
-	RenderEnvironment();
-	RenderScene();
-
-	m_pContext->EndEvent();
-
-	PostProcessing();
-
-	RenderImGui();
-
-	m_pSwapChain->Present(0, 0);
 }
 
 void Renderer::RenderScene()
 {
 	ID3D11DeviceContext* pContext = m_pContext->GetContext();
 
-	ID3D11RenderTargetView* RTVs[] = { m_pHDRTextureRTV, m_pEmissiveTextureRTV };
-	pContext->OMSetRenderTargets(_countof(RTVs), RTVs, m_pDepthTextureDSV);
-
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
+	ID3D11RenderTargetView* RTVs[] = { m_pTexturePool->GetRTV(m_frameTextures.hdr), m_pTexturePool->GetRTV(m_frameTextures.emissive) };
+	pContext->OMSetRenderTargets(_countof(RTVs), RTVs, m_pTexturePool->GetDSV(m_frameTextures.depth));
 
 	pContext->RSSetState(m_pRasterizerState);
 
-	pContext->VSSetShader(m_pSceneVShader, nullptr, 0);
-	pContext->PSSetShader(m_pScenePShader, nullptr, 0);
+	m_drawStateCache.Reset(pContext);
+	m_drawStateCache.SetVertexShader(m_pSceneVShader);
+	m_drawStateCache.SetPixelShader(m_pScenePShader);
 
 	ID3D11ShaderResourceView* SRVs[] =
 	{
@@ -1164,149 +1771,824 @@ void Renderer::RenderScene()
 		m_pDebugParamsBuffer
 	};
 
-	ConstantBuffer constantBuffer = {};
-	DirectX::XMStoreFloat4x4(&constantBuffer.vpMatrix, DirectX::XMMatrixTranspose(m_pCamera->GetViewMatrix() * m_projMatrix));
-	constantBuffer.cameraPosition = m_pCamera->GetPosition();
-	DirectX::XMStoreFloat4(&constantBuffer.cameraDirection, m_pCamera->GetDirection());
+	ObjectConstantBuffer objectConstantBuffer = {};
 
 	pContext->VSSetConstantBuffers(0, _countof(constantBuffers), constantBuffers);
 	pContext->PSSetConstantBuffers(0, _countof(constantBuffers), constantBuffers);
 
-	ID3D11ShaderResourceView* shadowMapSRVs[] = { m_pDirectionalLightShadowMap->GetShadowMapSRVArray() };
+	ID3D11ShaderResourceView* shadowMapSRVs[] = { m_pTexturePool->GetSRV(m_frameTextures.shadowMap) };
 	pContext->PSSetShaderResources(20, _countof(shadowMapSRVs), shadowMapSRVs);
 
-	for (auto& mesh : m_meshes)
+	// the visible built-in meshes come first, the model primitives follow
+	size_t visibleIdx = 0;
+
+	for (; visibleIdx < m_visibleInstances.size() && m_visibleInstances[visibleIdx] < m_meshes.size(); ++visibleIdx)
 	{
-		ID3D11Buffer* vertexBuffers[] = { mesh->pVertexBuffer };
+		const Mesh* mesh = m_meshes[m_visibleInstances[visibleIdx]];
+		INT baseVertex = SetVertexStream(mesh);
 
-		pContext->IASetVertexBuffers(0, 1, vertexBuffers, &stride, &offset);
-		pContext->IASetIndexBuffer(mesh->pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+		DirectX::XMStoreFloat4x4(&objectConstantBuffer.modelMatrix, DirectX::XMMatrixTranspose(mesh->modelMatrix));
+		ConstantAllocation objectConstants = m_pObjectConstantRing->Allocate(&objectConstantBuffer, sizeof(objectConstantBuffer));
 
-		DirectX::XMStoreFloat4x4(&constantBuffer.modelMatrix, DirectX::XMMatrixTranspose(mesh->modelMatrix));
-		pContext->UpdateSubresource(m_pConstantBuffer, 0, nullptr, &constantBuffer, 0, 0);
+		if (!objectConstants.IsValid())
+		{
+			continue;
+		}
 
-		pContext->DrawIndexed(mesh->indexCount, 0, 0);
+		m_pObjectConstantRing->SetVS(4, objectConstants);
+		pContext->DrawIndexed(mesh->indexCount, mesh->indexRange.offset, baseVertex);
 	}
 
-	ID3D11VertexShader* pCachedVS = m_pSceneColorTextureVShader;
-	ID3D11PixelShader* pCachedPS = m_pSceneColorTexturePShader;
+	m_sceneFullTriangleNum = 0;
+	m_sceneDrawnTriangleNum = 0;
+	m_sceneDrawNum = visibleIdx;
 
-	D3D_PRIMITIVE_TOPOLOGY cachedTopology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	if (FAILED(UploadInstances(m_sceneInstanceData)))
+	{
+		return;
+	}
 
-	pContext->VSSetShader(m_pSceneColorTextureVShader, nullptr, 0);
-	pContext->PSSetShader(m_pSceneColorTexturePShader, nullptr, 0);
+	const std::vector<DrawItem>& drawItems = m_sceneDrawList.GetItems();
+	const std::vector<DrawBatch>& batches = m_sceneDrawList.GetBatches();
 
-	for (auto* pModel : m_models)
+	pContext->VSSetShaderResources(30, 1, &m_pInstanceBufferSRV);
+
+	const Mesh* pCachedMesh = nullptr;
+	UINT meshFirstIndex = 0;
+	INT meshBaseVertex = 0;
+
+	for (size_t batchIdx = 0; batchIdx < batches.size(); ++batchIdx)
 	{
-		for (UINT primitiveIdx = 0; primitiveIdx < pModel->PrimitiveNum(); ++primitiveIdx)
+		const DrawBatch& batch = batches[batchIdx];
+		const PrimitiveInstance& instance = m_primitiveInstances[drawItems[batch.firstItem].instanceIdx];
+		const Model::Primitive& primitive = instance.pModel->GetPrimitive(instance.primitiveIdx);
+
+		bool hasEmissive = primitive.pEmissiveTextureSRV != nullptr;
+		bool isCompact = primitive.pMesh->vertexFormat != VertexFormat::Float;
+
+		m_drawStateCache.SetVertexShader(hasEmissive
+			? (isCompact ? m_pSceneColorEmissiveCompactVShader : m_pSceneColorEmissiveVShader)
+			: (isCompact ? m_pSceneColorTextureCompactVShader : m_pSceneColorTextureVShader)
+		);
+		m_drawStateCache.SetPixelShader(hasEmissive ? m_pSceneColorEmissivePShader : m_pSceneColorTexturePShader);
+		m_drawStateCache.SetInputLayout(GetInputLayout(primitive.pMesh->vertexFormat));
+		m_drawStateCache.SetTopology(primitive.topology);
+
+		// primitives of one mesh share its buffers
+		if (pCachedMesh != primitive.pMesh)
 		{
-			const Model::Primitive& primitive = pModel->GetPrimitive(primitiveIdx);
+			pCachedMesh = primitive.pMesh;
 
-			if (cachedTopology != primitive.topology)
-			{
-				cachedTopology = primitive.topology;
-				pContext->IASetPrimitiveTopology(primitive.topology);
-			}
+			meshFirstIndex = primitive.pMesh->indexRange.offset;
+			meshBaseVertex = SetVertexStream(primitive.pMesh);
 
-			if (primitive.pEmissiveTextureSRV != nullptr)
-			{
-				if (pCachedVS != m_pSceneColorEmissiveVShader)
-				{
-					pCachedVS = m_pSceneColorEmissiveVShader;
-					pContext->VSSetShader(m_pSceneColorEmissiveVShader, nullptr, 0);
-				}
+			const VertexDequantization& dequantization = primitive.pMesh->dequantization;
 
-				if (pCachedPS != m_pSceneColorEmissivePShader)
-				{
-					pCachedPS = m_pSceneColorEmissivePShader;
-					pContext->PSSetShader(m_pSceneColorEmissivePShader, nullptr, 0);
-				}
-			}
-			else
-			{
-				if (pCachedVS != m_pSceneColorTextureVShader)
-				{
-					pCachedVS = m_pSceneColorTextureVShader;
-					pContext->VSSetShader(m_pSceneColorTextureVShader, nullptr, 0);
-				}
+			objectConstantBuffer.positionScale = dequantization.positionScale;
+			objectConstantBuffer.positionOffset = dequantization.positionOffset;
+			objectConstantBuffer.texCoordTransform = dequantization.texCoordTransform;
+		}
 
-				if (pCachedPS != m_pSceneColorTexturePShader)
-				{
-					pCachedPS = m_pSceneColorTexturePShader;
-					pContext->PSSetShader(m_pSceneColorTexturePShader, nullptr, 0);
-				}
-			}
+		// SV_InstanceID ignores the start instance of the draw, the shader adds the offset itself
+		objectConstantBuffer.instanceParams.x = batch.firstInstance;
+		ConstantAllocation objectConstants = m_pObjectConstantRing->Allocate(&objectConstantBuffer, sizeof(objectConstantBuffer));
+
+		if (!objectConstants.IsValid())
+		{
+			continue;
+		}
+
+		m_pObjectConstantRing->SetVS(4, objectConstants);
 
-			ID3D11Buffer* vertexBuffers[] = { primitive.pMesh->pVertexBuffer };
+		ID3D11ShaderResourceView* meshTextures[] =
+		{
+			primitive.pColorTextureSRV,
+			primitive.pNormalTextureSRV,
+			primitive.pMetalicRoughnessTextureSRV,
+			primitive.pEmissiveTextureSRV
+		};
+		m_drawStateCache.SetPixelTextures(10, _countof(meshTextures), meshTextures);
+		m_drawStateCache.SetPixelSampler(10, primitive.pSamplerState != nullptr ? primitive.pSamplerState : m_pMinMagMipLinearSampler);
 
-			pContext->IASetVertexBuffers(0, 1, vertexBuffers, &stride, &offset);
-			pContext->IASetIndexBuffer(primitive.pMesh->pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+		const Model::Lod& lod = primitive.lods[GetDrawKeyLod(batch.key)];
+		const BatchMeshlets& batchMeshlets = m_sceneBatchMeshlets[batchIdx];
 
-			DirectX::XMStoreFloat4x4(&constantBuffer.modelMatrix, DirectX::XMMatrixTranspose(primitive.pMesh->modelMatrix));
-			pContext->UpdateSubresource(m_pConstantBuffer, 0, nullptr, &constantBuffer, 0, 0);
+		m_sceneFullTriangleNum += primitive.indexCount / 3 * batch.instanceNum;
 
-			ID3D11ShaderResourceView* meshTextures[] =
+		if (batchMeshlets.isCulled)
+		{
+			for (const auto& range : batchMeshlets.ranges)
 			{
-				primitive.pColorTextureSRV,
-				primitive.pNormalTextureSRV,
-				primitive.pMetalicRoughnessTextureSRV,
-				primitive.pEmissiveTextureSRV
-			};
-			pContext->PSSetShaderResources(10, _countof(meshTextures), meshTextures);
-			pContext->PSSetSamplers(10, 1, &primitive.pSamplerState);
+				m_sceneDrawnTriangleNum += range.indexCount / 3;
+				pContext->DrawIndexedInstanced(range.indexCount, 1, meshFirstIndex + range.firstIndex, meshBaseVertex + primitive.baseVertex, 0);
+			}
+
+			m_sceneDrawNum += batchMeshlets.ranges.size();
+		}
+		else
+		{
+			m_sceneDrawnTriangleNum += lod.indexCount / 3 * batch.instanceNum;
+			pContext->DrawIndexedInstanced(
+				lod.indexCount,
+				batch.instanceNum,
+				meshFirstIndex + lod.firstIndex,
+				meshBaseVertex + primitive.baseVertex,
+				0
+			);
 
-			pContext->DrawIndexed(primitive.pMesh->indexCount, 0, 0);
+			++m_sceneDrawNum;
 		}
 	}
 }
 
-void Renderer::PostProcessing()
+void Renderer::BuildFrameGraph()
 {
-	m_pContext->BeginEvent(L"Post Processing");
+	m_frameGraph.Clear();
 
-	m_pBloom->CalculateBloom(m_pHDRTextureSRV, m_pEmissiveTextureSRV, m_pHDRTextureRTV);
+	TaskGraph::TaskId cascadesTask = m_frameGraph.AddTask("Shadow cascades", [this]() { PrepareShadowCascades(); });
+	TaskGraph::TaskId castersTask = m_frameGraph.AddTask("Shadow casters", [this]() { PrepareShadowCasters(); });
+	TaskGraph::TaskId sceneTask = m_frameGraph.AddTask("Camera culling", [this]() { PrepareScene(); });
+	TaskGraph::TaskId lightsTask = m_frameGraph.AddTask("Lights", [this]() { PrepareLights(); });
+	m_frameGraph.AddTask("View constants", [this]() { PrepareViewConstants(); });
 
-	m_pToneMapping->ToneMap(m_pHDRTextureSRV, m_pBackBufferRTV, m_windowWidth, m_windowHeight, m_timeFromLastFrame / 10e6f);
-
-	m_pContext->EndEvent();
+	// the casters are culled against the split frustums, the light buffer holds their matrices
+	m_frameGraph.AddDependency(cascadesTask, castersTask);
+	m_frameGraph.AddDependency(cascadesTask, lightsTask);
 }
 
-void Renderer::RenderEnvironment()
+void Renderer::PrepareShadowCascades()
 {
-	ID3D11DeviceContext* pContext = m_pContext->GetContext();
+	m_pDirectionalLightShadowMap->CalculatePSSMVpMatricesForDirectionalLight(
+		m_pCamera,
+		s_fov, (float)m_windowHeight / m_windowWidth,
+		s_near, m_cameraFarPlaneForPSSM,
+		m_directionalLight.GetDirection(),
+		m_shadowVpMatrices
+	);
 
-	pContext->OMSetRenderTargets(1, &m_pHDRTextureRTV, m_pDepthTextureDSV);
+	for (UINT i = 0; i < m_pDirectionalLightShadowMap->GetShadowMapSplitsNum(); ++i)
+	{
+		m_directionalLight.SetVpMatrix(i, DirectX::XMMatrixTranspose(m_shadowVpMatrices[i]));
+	}
+}
 
-	m_pContext->BeginEvent(L"Environment");
+void Renderer::PrepareShadowCasters()
+{
+	CullShadowCasters(m_shadowVpMatrices, m_pDirectionalLightShadowMap->GetShadowMapSplitsNum());
 
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
+	DirectX::XMFLOAT4 cameraPosition = m_pCamera->GetPosition();
 
-	ID3D11ShaderResourceView* SRVs[] = { m_pEnvironment->GetTextureSRV(Environment::Type::kColorTexture) };
+	auto packetStart = std::chrono::steady_clock::now();
+	ThreadPool* pPool = GetPacketPool();
 
-	pContext->PSSetShaderResources(0, _countof(SRVs), SRVs);
-	pContext->RSSetState(m_pRasterizerStateFront);
-	pContext->PSSetSamplers(0, 1, &m_pMinMagMipLinearSampler);
+	m_shadowDrawList.Clear();
+
+	size_t firstModelIdx = std::lower_bound(
+		m_shadowVisibleInstances.begin(), m_shadowVisibleInstances.end(), static_cast<UINT32>(m_meshes.size())
+	) - m_shadowVisibleInstances.begin();
+	DrawItem* pItems = m_shadowDrawList.AddItems(m_shadowVisibleInstances.size() - firstModelIdx);
+
+	forEachChunk(pPool, m_shadowVisibleInstances.size() - firstModelIdx, [&](size_t begin, size_t end)
+	{
+		for (size_t itemIdx = begin; itemIdx < end; ++itemIdx)
+		{
+			UINT32 instanceIdx = m_shadowVisibleInstances[firstModelIdx + itemIdx];
+			const PrimitiveInstance& instance = m_primitiveInstances[instanceIdx - m_meshes.size()];
+			const Model::Primitive& primitive = instance.pModel->GetPrimitive(instance.primitiveIdx);
+
+			UINT lodIdx = selectLod(primitive, instance.bounds, cameraPosition, s_fov, m_shadowLodBias);
+
+			// a single shader without textures, only the primitive matters
+			pItems[itemIdx] =
+			{
+				CreateDrawKey(DrawPass::kShadow, 0, 0, instance.primitiveKey, lodIdx, 0.0f),
+				instanceIdx - static_cast<UINT32>(m_meshes.size()),
+				m_shadowSplitMasks[instanceIdx]
+			};
+		}
+	});
+
+	m_shadowDrawList.Build(m_isInstancing ? UINT32_MAX : 1, pPool);
+
+	const std::vector<DrawItem>& drawItems = m_shadowDrawList.GetItems();
+	std::vector<DrawBatch>& batches = m_shadowDrawList.GetBatches();
+
+	// every caster becomes one instance per split it overlaps,
+	// the batches are counted first to know where their instances go
+	forEachChunk(pPool, batches.size(), [&](size_t begin, size_t end)
+	{
+		UINT splitIndices[PSSMMaxSplitsNum];
+
+		for (size_t batchIdx = begin; batchIdx < end; ++batchIdx)
+		{
+			DrawBatch& batch = batches[batchIdx];
+			batch.instanceNum = 0;
+
+			for (UINT32 itemIdx = batch.firstItem; itemIdx < batch.firstItem + batch.itemCount; ++itemIdx)
+			{
+				batch.instanceNum += fillSplitIndices(drawItems[itemIdx].param, splitIndices);
+			}
+		}
+	});
+
+	UINT32 shadowInstanceNum = 0;
+
+	for (auto& batch : batches)
+	{
+		batch.firstInstance = shadowInstanceNum;
+		shadowInstanceNum += batch.instanceNum;
+	}
+
+	m_shadowInstanceData.resize(shadowInstanceNum);
+
+	forEachChunk(pPool, batches.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t batchIdx = begin; batchIdx < end; ++batchIdx)
+		{
+			const DrawBatch& batch = batches[batchIdx];
+			UINT32 shadowInstanceIdx = batch.firstInstance;
+
+			for (UINT32 itemIdx = batch.firstItem; itemIdx < batch.firstItem + batch.itemCount; ++itemIdx)
+			{
+				const PrimitiveInstance& instance = m_primitiveInstances[drawItems[itemIdx].instanceIdx];
+				const Mesh* pMesh = instance.pModel->GetPrimitive(instance.primitiveIdx).pMesh;
+
+				InstanceData instanceData = {};
+				DirectX::XMStoreFloat4x4(&instanceData.modelMatrix, DirectX::XMMatrixTranspose(
+					pMesh->modelMatrix * DirectX::XMMatrixTranslation(instance.offset.x, instance.offset.y, instance.offset.z)
+				));
+
+				UINT splitIndices[PSSMMaxSplitsNum];
+				UINT splitNum = fillSplitIndices(drawItems[itemIdx].param, splitIndices);
+
+				for (UINT splitIdx = 0; splitIdx < splitNum; ++splitIdx)
+				{
+					instanceData.params.x = splitIndices[splitIdx];
+					m_shadowInstanceData[shadowInstanceIdx++] = instanceData;
+				}
+			}
+		}
+	});
+
+	m_shadowPacketTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - packetStart).count();
+}
+
+void Renderer::PrepareScene()
+{
+	DirectX::XMMATRIX vpMatrix = m_pCamera->GetViewMatrix() * m_projMatrix;
+	CullInstances(vpMatrix, FrustumPlaneNum, m_sceneViewMasks, m_visibleInstances);
+	CullOccludedInstances(vpMatrix);
+
+	DirectX::XMFLOAT4 cameraPosition = m_pCamera->GetPosition();
+	m_meshletCullStats = {};
+
+	auto packetStart = std::chrono::steady_clock::now();
+	ThreadPool* pPool = GetPacketPool();
+
+	// one packet per instance, the sorted packets of a primitive and LOD go into one draw
+	m_sceneDrawList.Clear();
+
+	// the built-in meshes are drawn on their own
+	size_t firstModelIdx = std::lower_bound(
+		m_visibleInstances.begin(), m_visibleInstances.end(), static_cast<UINT32>(m_meshes.size())
+	) - m_visibleInstances.begin();
+	DrawItem* pItems = m_sceneDrawList.AddItems(m_visibleInstances.size() - firstModelIdx);
+
+	forEachChunk(pPool, m_visibleInstances.size() - firstModelIdx, [&](size_t begin, size_t end)
+	{
+		for (size_t itemIdx = begin; itemIdx < end; ++itemIdx)
+		{
+			UINT32 instanceIdx = m_visibleInstances[firstModelIdx + itemIdx] - static_cast<UINT32>(m_meshes.size());
+			const PrimitiveInstance& instance = m_primitiveInstances[instanceIdx];
+			const Model::Primitive& primitive = instance.pModel->GetPrimitive(instance.primitiveIdx);
+
+			UINT permutation = (primitive.pEmissiveTextureSRV != nullptr ? 2 : 0) | (primitive.pMesh->vertexFormat != VertexFormat::Float ? 1 : 0);
+			UINT lodIdx = selectLod(primitive, instance.bounds, cameraPosition, s_fov, m_lodBias);
+
+			// front to back within equal state
+			float distance = DirectX::XMVectorGetX(DirectX::XMVector3Length(
+				DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&instance.bounds.center), DirectX::XMLoadFloat4(&cameraPosition))
+			));
+
+			pItems[itemIdx] =
+			{
+				CreateDrawKey(DrawPass::kScene, permutation, createMaterialKey(primitive), instance.primitiveKey, lodIdx, distance / s_far),
+				instanceIdx,
+				0
+			};
+		}
+	});
+
+	m_sceneDrawList.Build(m_isInstancing ? UINT32_MAX : 1, pPool);
+
+	const std::vector<DrawItem>& drawItems = m_sceneDrawList.GetItems();
+	const std::vector<DrawBatch>& batches = m_sceneDrawList.GetBatches();
+	m_sceneInstanceData.resize(drawItems.size());
+
+	forEachChunk(pPool, drawItems.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t itemIdx = begin; itemIdx < end; ++itemIdx)
+		{
+			const PrimitiveInstance& instance = m_primitiveInstances[drawItems[itemIdx].instanceIdx];
+			const Mesh* pMesh = instance.pModel->GetPrimitive(instance.primitiveIdx).pMesh;
+
+			DirectX::XMMATRIX modelMatrix = pMesh->modelMatrix * DirectX::XMMatrixTranslation(instance.offset.x, instance.offset.y, instance.offset.z);
+
+			DirectX::XMStoreFloat4x4(&m_sceneInstanceData[itemIdx].modelMatrix, DirectX::XMMatrixTranspose(modelMatrix));
+			m_sceneInstanceData[itemIdx].params = {};
+		}
+	});
+
+	m_sceneBatchMeshlets.resize(batches.size());
+	m_meshletChunkStats.assign((batches.size() + PacketChunkSize - 1) / PacketChunkSize, {});
+
+	forEachChunk(pPool, batches.size(), [&](size_t begin, size_t end)
+	{
+		MeshletCullStats& chunkStats = m_meshletChunkStats[begin / PacketChunkSize];
+
+		for (size_t batchIdx = begin; batchIdx < end; ++batchIdx)
+		{
+			const DrawBatch& batch = batches[batchIdx];
+			const PrimitiveInstance& instance = m_primitiveInstances[drawItems[batch.firstItem].instanceIdx];
+			const Model::Primitive& primitive = instance.pModel->GetPrimitive(instance.primitiveIdx);
+
+			BatchMeshlets& batchMeshlets = m_sceneBatchMeshlets[batchIdx];
+			batchMeshlets.ranges.clear();
+
+			// meshlets only cover the full detail range and are culled for a single transform
+			batchMeshlets.isCulled = m_isMeshletCulling
+				&& GetDrawKeyLod(batch.key) == 0
+				&& primitive.meshletCount > 0
+				&& batch.instanceNum == 1;
+
+			if (!batchMeshlets.isCulled)
+			{
+				continue;
+			}
+
+			DirectX::XMMATRIX modelMatrix = DirectX::XMMatrixTranspose(
+				DirectX::XMLoadFloat4x4(&m_sceneInstanceData[batch.firstInstance].modelMatrix)
+			);
+			MeshletCullView cullView = CreateMeshletCullView(modelMatrix, vpMatrix, cameraPosition);
+
+			CullMeshlets(
+				instance.pModel->GetMeshlets() + primitive.firstMeshlet,
+				primitive.meshletCount,
+				cullView,
+				batchMeshlets.ranges,
+				&chunkStats
+			);
+		}
+	});
+
+	for (const auto& chunkStats : m_meshletChunkStats)
+	{
+		m_meshletCullStats.testedNum += chunkStats.testedNum;
+		m_meshletCullStats.frustumCulledNum += chunkStats.frustumCulledNum;
+		m_meshletCullStats.coneCulledNum += chunkStats.coneCulledNum;
+	}
+
+	m_scenePacketTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - packetStart).count();
+}
+
+void Renderer::PrepareLights()
+{
+	memcpy(&m_lightBufferData.shadowSplitDists, m_pDirectionalLightShadowMap->GetShadowMapSplitDists().data(), sizeof(DirectX::XMFLOAT4));
+	m_lightBufferData.directionalLight = m_directionalLight;
+	m_lightBufferData.lightsCount.x = 0;
+	memcpy(m_lightBufferData.lights, m_lights.data(), sizeof(PointLight) * m_lights.size());
+}
+
+void Renderer::PrepareViewConstants()
+{
+	DirectX::XMStoreFloat4x4(&m_sceneConstants.vpMatrix, DirectX::XMMatrixTranspose(m_pCamera->GetViewMatrix() * m_projMatrix));
+	m_sceneConstants.cameraPosition = m_pCamera->GetPosition();
+	DirectX::XMStoreFloat4(&m_sceneConstants.cameraDirection, m_pCamera->GetDirection());
+}
+
+
+void Renderer::UpdateInstanceBounds()
+{
+	size_t primitiveNum = 0;
+
+	for (auto* pModel : m_models)
+	{
+		primitiveNum += pModel->PrimitiveNum();
+	}
+
+	const Model* pCopiedModel = m_models.empty() ? nullptr : m_models.back();
+
+	if (pCopiedModel != nullptr)
+	{
+		primitiveNum += static_cast<size_t>(m_modelCopyNum) * pCopiedModel->PrimitiveNum();
+	}
+
+	// primitives only ever get added while models stream in or copies are added, their bounds do not change
+	bool isAdded = m_instanceBounds.count != m_meshes.size() + primitiveNum;
+
+	if (isAdded)
+	{
+		m_instanceBounds.Resize(m_meshes.size() + primitiveNum);
+		m_primitiveInstances.clear();
+
+		auto addInstances = [this](const Model* pModel, UINT firstPrimitiveKey, const DirectX::XMFLOAT3& offset)
+		{
+			for (UINT primitiveIdx = 0; primitiveIdx < pModel->PrimitiveNum(); ++primitiveIdx)
+			{
+				BoundingVolume bounds = pModel->GetPrimitive(primitiveIdx).worldBounds;
+				bounds.center = { bounds.center.x + offset.x, bounds.center.y + offset.y, bounds.center.z + offset.z };
+
+				m_instanceBounds.Set(m_meshes.size() + m_primitiveInstances.size(), bounds);
+				m_primitiveInstances.push_back({ pModel, primitiveIdx, firstPrimitiveKey + primitiveIdx, offset, bounds });
+			}
+		};
+
+		UINT primitiveKey = 0;
+		UINT copiedPrimitiveKey = 0;
+
+		for (const auto* pModel : m_models)
+		{
+			copiedPrimitiveKey = primitiveKey;
+
+			addInstances(pModel, primitiveKey, { 0.0f, 0.0f, 0.0f });
+			primitiveKey += pModel->PrimitiveNum();
+		}
+
+		if (pCopiedModel != nullptr && m_modelCopyNum > 0 && pCopiedModel->PrimitiveNum() > 0)
+		{
+			DirectX::XMVECTOR boundsMin = DirectX::XMVectorReplicate(FLT_MAX);
+			DirectX::XMVECTOR boundsMax = DirectX::XMVectorReplicate(-FLT_MAX);
+
+			for (UINT primitiveIdx = 0; primitiveIdx < pCopiedModel->PrimitiveNum(); ++primitiveIdx)
+			{
+				const BoundingVolume& bounds = pCopiedModel->GetPrimitive(primitiveIdx).worldBounds;
+
+				DirectX::XMVECTOR center = DirectX::XMLoadFloat3(&bounds.center);
+				DirectX::XMVECTOR extents = DirectX::XMLoadFloat3(&bounds.extents);
+
+				boundsMin = DirectX::XMVectorMin(boundsMin, DirectX::XMVectorSubtract(center, extents));
+				boundsMax = DirectX::XMVectorMax(boundsMax, DirectX::XMVectorAdd(center, extents));
+			}
+
+			DirectX::XMFLOAT3 size;
+			DirectX::XMStoreFloat3(&size, DirectX::XMVectorSubtract(boundsMax, boundsMin));
+
+			float spacing = (std::max)(size.x, size.z) * ModelCopySpacing;
+			UINT gridSize = static_cast<UINT>(ceilf(sqrtf(static_cast<float>(m_modelCopyNum))));
+			for (UINT copyIdx = 0; copyIdx < m_modelCopyNum; ++copyIdx)
+			{
+				float column = static_cast<float>(copyIdx % gridSize) - (gridSize - 1) / 2.0f;
+				float row = static_cast<float>(copyIdx / gridSize + 1);
+
+				addInstances(pCopiedModel, copiedPrimitiveKey, { column * spacing, 0.0f, row * spacing });
+			}
+		}
+	}
+
+	// the built-in meshes may move every frame
+	bool isMoved = false;
+
+	for (size_t meshIdx = 0; meshIdx < m_meshes.size(); ++meshIdx)
+	{
+		const Mesh* pMesh = m_meshes[meshIdx];
+
+		isMoved = m_instanceBounds.Update(meshIdx, TransformBounds(pMesh->boundsMin, pMesh->boundsMax, pMesh->modelMatrix)) || isMoved;
+	}
+
+	if (isAdded)
+	{
+		m_instanceBvh.Build(m_instanceBounds, m_pContext->GetThreadPool());
+	}
+	else if (isMoved)
+	{
+		m_instanceBvh.Refit(m_instanceBounds);
+	}
+}
+
+void Renderer::CullInstances(
+	const DirectX::XMMATRIX& vpMatrix,
+	UINT planeNum,
+	std::vector<UINT8>& viewMasks,
+	std::vector<UINT32>& visible
+) const
+{
+	visible.clear();
+
+	if (!m_isFrustumCulling)
+	{
+		visible.resize(m_instanceBounds.count);
+		std::iota(visible.begin(), visible.end(), 0);
+
+		return;
+	}
+
+	DirectX::XMFLOAT4 planes[FrustumPlaneNum];
+	ExtractFrustumPlanes(vpMatrix, planes);
+
+	if (!m_isBvhCulling)
+	{
+		CullBounds(m_instanceBounds, planes, planeNum, visible);
+		return;
+	}
+
+	m_instanceBvh.QueryFrustums(planes, 1, planeNum, viewMasks);
+	collectMasked(GetPacketPool(), viewMasks, visible);
+}
+
+void Renderer::CullOccludedInstances(const DirectX::XMMATRIX& vpMatrix)
+{
+	m_occlusionStats = {};
+
+	if (!m_isOcclusionCulling)
+	{
+		return;
+	}
+
+	auto rasterStart = std::chrono::steady_clock::now();
+
+	m_pOcclusionBuffer->Clear();
+
+	const DirectX::XMFLOAT4& cameraPosition = m_pCamera->GetPosition();
+	float tanHalfFov = tanf(s_fov / 2.0f);
+
+	for (UINT32 instanceIdx : m_visibleInstances)
+	{
+		if (instanceIdx < m_meshes.size())
+		{
+			continue;
+		}
+
+		const PrimitiveInstance& instance = m_primitiveInstances[instanceIdx - m_meshes.size()];
+		const Model::Primitive& primitive = instance.pModel->GetPrimitive(instance.primitiveIdx);
+
+		if (primitive.occluderIndexCount == 0)
+		{
+			continue;
+		}
+
+		const BoundingVolume& bounds = instance.bounds;
+
+		float distance = DirectX::XMVectorGetX(DirectX::XMVector3Length(
+			DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&bounds.center), DirectX::XMLoadFloat4(&cameraPosition))
+		));
+
+		if (distance > bounds.radius && bounds.radius / (distance * tanHalfFov) < OccluderMinScreenSize)
+		{
+			continue;
+		}
+
+		m_pOcclusionBuffer->AddOccluder(
+			&instance.pModel->GetOccluderPositions()[primitive.firstOccluderVertex].x,
+			primitive.occluderVertexCount,
+			instance.pModel->GetOccluderIndices() + primitive.firstOccluderIndex,
+			primitive.occluderIndexCount,
+			ToOcclusionMatrix(DirectX::XMMatrixTranslation(instance.offset.x, instance.offset.y, instance.offset.z) * vpMatrix)
+		);
+
+		++m_occlusionStats.occluderNum;
+	}
+
+	m_occlusionStats.occluderTriangleNum = m_pOcclusionBuffer->GetTriangleNum();
+	m_pOcclusionBuffer->Rasterize(m_pContext->GetThreadPool()->GetJobSystem());
+
+	auto testStart = std::chrono::steady_clock::now();
+
+	m_occlusionStats.testedNum = m_visibleInstances.size();
+	m_pOcclusionBuffer->FilterVisible(
+		m_instanceBounds.GetOcclusionBoxes(),
+		ToOcclusionMatrix(vpMatrix),
+		m_visibleInstances,
+		m_pContext->GetThreadPool()->GetJobSystem()
+	);
+	m_occlusionStats.occludedNum = m_occlusionStats.testedNum - m_visibleInstances.size();
+
+	auto testEnd = std::chrono::steady_clock::now();
+
+	m_occlusionStats.rasterTimeMs = std::chrono::duration<double, std::milli>(testStart - rasterStart).count();
+	m_occlusionStats.testTimeMs = std::chrono::duration<double, std::milli>(testEnd - testStart).count();
+}
+
+void Renderer::CullShadowCasters(const DirectX::XMMATRIX* pVpMatrices, UINT splitsNum)
+{
+	// casters in front of a split still throw shadows into it, so the near planes are not tested
+	if (m_isFrustumCulling && m_isBvhCulling)
+	{
+		DirectX::XMFLOAT4 planes[PSSMMaxSplitsNum * FrustumPlaneNum];
+
+		for (UINT splitIdx = 0; splitIdx < splitsNum; ++splitIdx)
+		{
+			ExtractFrustumPlanes(pVpMatrices[splitIdx], planes + splitIdx * FrustumPlaneNum);
+		}
+
+		// all splits share one traversal
+		m_instanceBvh.QueryFrustums(planes, splitsNum, FrustumPlaneNum - 1, m_shadowSplitMasks);
+	}
+	else
+	{
+		m_shadowSplitMasks.assign(m_instanceBounds.count, 0);
+
+		for (UINT splitIdx = 0; splitIdx < splitsNum; ++splitIdx)
+		{
+			CullInstances(pVpMatrices[splitIdx], FrustumPlaneNum - 1, m_splitViewMasks, m_splitVisibleInstances);
+
+			for (UINT32 instanceIdx : m_splitVisibleInstances)
+			{
+				m_shadowSplitMasks[instanceIdx] |= 1 << splitIdx;
+			}
+		}
+	}
+
+	collectMasked(GetPacketPool(), m_shadowSplitMasks, m_shadowVisibleInstances);
+}
+
+ThreadPool* Renderer::GetPacketPool() const
+{
+	return m_isParallelPackets ? m_pContext->GetThreadPool() : nullptr;
+}
+
+HRESULT Renderer::UploadInstances(const std::vector<InstanceData>& instanceData)
+{
+	if (instanceData.empty())
+	{
+		return S_OK;
+	}
+
+	if (m_instanceBufferCapacity < instanceData.size())
+	{
+		UINT capacity = (std::max)(static_cast<UINT>(instanceData.size()), m_instanceBufferCapacity * 2);
+
+		SafeRelease(m_pInstanceBufferSRV);
+		SafeRelease(m_pInstanceBuffer);
+		m_instanceBufferCapacity = 0;
+
+		D3D11_BUFFER_DESC bufferDesc = CreateDefaultBufferDesc(capacity * sizeof(InstanceData), D3D11_BIND_SHADER_RESOURCE);
+		bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		bufferDesc.StructureByteStride = sizeof(InstanceData);
+
+		HRESULT hr = m_pContext->GetDevice()->CreateBuffer(&bufferDesc, nullptr, &m_pInstanceBuffer);
+
+		if (SUCCEEDED(hr))
+		{
+			D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+			srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+			srvDesc.Buffer.FirstElement = 0;
+			srvDesc.Buffer.NumElements = capacity;
+
+			hr = m_pContext->GetDevice()->CreateShaderResourceView(m_pInstanceBuffer, &srvDesc, &m_pInstanceBufferSRV);
+		}
+
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+
+		m_instanceBufferCapacity = capacity;
+	}
+
+	ID3D11DeviceContext* pContext = m_pContext->GetContext();
+
+	// the shadow and scene passes both discard, the draws of the first one keep their copy
+	D3D11_MAPPED_SUBRESOURCE mappedBuffer = {};
+	HRESULT hr = pContext->Map(m_pInstanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedBuffer);
+
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	memcpy(mappedBuffer.pData, instanceData.data(), instanceData.size() * sizeof(InstanceData));
+	pContext->Unmap(m_pInstanceBuffer, 0);
+
+	return S_OK;
+}
+
+ID3D11InputLayout* Renderer::GetInputLayout(VertexFormat format) const
+{
+	switch (format)
+	{
+	case VertexFormat::Compact:
+		return m_pCompactInputLayout;
+
+	case VertexFormat::Quantized:
+		return m_pQuantizedInputLayout;
+
+	default:
+		break;
+	}
+
+	return m_pInputLayout;
+}
+
+ID3D11InputLayout* Renderer::GetDepthInputLayout(VertexFormat format) const
+{
+	return format == VertexFormat::Quantized ? m_pQuantizedPositionInputLayout : m_pPositionInputLayout;
+}
+
+INT Renderer::SetVertexStream(const Mesh* pMesh)
+{
+	GeometryPool* pPool = m_pContext->GetGeometryPool();
+
+	BindGeometry(
+		pPool->GetBuffer(pMesh->vertexRange),
+		GetVertexStride(pMesh->vertexFormat),
+		pPool->GetBuffer(pMesh->indexRange),
+		pMesh->indexFormat
+	);
+
+	return static_cast<INT>(pMesh->vertexRange.offset);
+}
+
+INT Renderer::SetDepthVertexStream(const Mesh* pMesh)
+{
+	// without a position stream the positions are fetched from the full vertices
+	if (pMesh->positionRange.count == 0)
+	{
+		return SetVertexStream(pMesh);
+	}
+
+	GeometryPool* pPool = m_pContext->GetGeometryPool();
+
+	BindGeometry(
+		pPool->GetBuffer(pMesh->positionRange),
+		GetPositionStride(pMesh->vertexFormat),
+		pPool->GetBuffer(pMesh->indexRange),
+		pMesh->indexFormat
+	);
+
+	return static_cast<INT>(pMesh->positionRange.offset);
+}
+
+void Renderer::BindGeometry(ID3D11Buffer* pVertexBuffer, UINT stride, ID3D11Buffer* pIndexBuffer, DXGI_FORMAT indexFormat)
+{
+	ID3D11DeviceContext* pContext = m_pContext->GetContext();
+
+	if (m_pBoundVertexBuffer != pVertexBuffer || m_boundVertexStride != stride)
+	{
+		UINT offset = 0;
+		pContext->IASetVertexBuffers(0, 1, &pVertexBuffer, &stride, &offset);
+
+		m_pBoundVertexBuffer = pVertexBuffer;
+		m_boundVertexStride = stride;
+		++m_geometryBindNum;
+	}
+
+	if (m_pBoundIndexBuffer != pIndexBuffer || m_boundIndexFormat != indexFormat)
+	{
+		pContext->IASetIndexBuffer(pIndexBuffer, indexFormat, 0);
+
+		m_pBoundIndexBuffer = pIndexBuffer;
+		m_boundIndexFormat = indexFormat;
+		++m_geometryBindNum;
+	}
+}
+
+void Renderer::ResetGeometryBinding()
+{
+	m_pBoundVertexBuffer = nullptr;
+	m_boundVertexStride = 0;
+	m_pBoundIndexBuffer = nullptr;
+	m_boundIndexFormat = DXGI_FORMAT_UNKNOWN;
+}
+
+void Renderer::RenderEnvironment()
+{
+	ID3D11DeviceContext* pContext = m_pContext->GetContext();
+
+	ID3D11RenderTargetView* pHDRTextureRTV = m_pTexturePool->GetRTV(m_frameTextures.hdr);
+	pContext->OMSetRenderTargets(1, &pHDRTextureRTV, m_pTexturePool->GetDSV(m_frameTextures.depth));
+
+	m_pContext->BeginEvent(L"Environment");
+
+	ID3D11ShaderResourceView* SRVs[] = { m_pEnvironment->GetTextureSRV(Environment::Type::kColorTexture) };
+
+	pContext->PSSetShaderResources(0, _countof(SRVs), SRVs);
+	pContext->RSSetState(m_pRasterizerStateFront);
+	pContext->PSSetSamplers(0, 1, &m_pMinMagMipLinearSampler);
 
 	pContext->VSSetShader(m_pEnvironmentVShader, nullptr, 0);
 	pContext->PSSetShader(m_pEnvironmentPShader, nullptr, 0);
 
-	ID3D11Buffer* vertexBuffers[] = { m_pEnvironmentSphere->pVertexBuffer };
-
-	pContext->IASetVertexBuffers(0, 1, vertexBuffers, &stride, &offset);
-	pContext->IASetIndexBuffer(m_pEnvironmentSphere->pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	// the state was cleared before the environment, the scene keeps the binds after it
+	ResetGeometryBinding();
+	INT baseVertex = SetVertexStream(m_pEnvironmentSphere);
 
 	ID3D11Buffer* constantBuffers[] = { m_pConstantBuffer };
-	ConstantBuffer constantBuffer = {};
+	ObjectConstantBuffer objectConstantBuffer = {};
 
-	DirectX::XMStoreFloat4x4(&constantBuffer.modelMatrix, DirectX::XMMatrixTranspose(m_pEnvironmentSphere->modelMatrix));
-	DirectX::XMStoreFloat4x4(&constantBuffer.vpMatrix, DirectX::XMMatrixTranspose(m_pCamera->GetViewMatrix() * m_projMatrix));
-	constantBuffer.cameraPosition = m_pCamera->GetPosition();
-	pContext->UpdateSubresource(m_pConstantBuffer, 0, nullptr, &constantBuffer, 0, 0);
+	DirectX::XMStoreFloat4x4(&objectConstantBuffer.modelMatrix, DirectX::XMMatrixTranspose(m_pEnvironmentSphere->modelMatrix));
 
 	pContext->VSSetConstantBuffers(0, _countof(constantBuffers), constantBuffers);
 	pContext->PSSetConstantBuffers(0, _countof(constantBuffers), constantBuffers);
-	pContext->DrawIndexed(m_pEnvironmentSphere->indexCount, 0, 0);
+	ConstantAllocation objectConstants = m_pObjectConstantRing->Allocate(&objectConstantBuffer, sizeof(objectConstantBuffer));
+
+	if (objectConstants.IsValid())
+	{
+		m_pObjectConstantRing->SetVS(4, objectConstants);
+		pContext->DrawIndexed(m_pEnvironmentSphere->indexCount, m_pEnvironmentSphere->indexRange.offset, baseVertex);
+	}
 
 	m_pContext->EndEvent();
 }
@@ -1318,25 +2600,18 @@ void Renderer::RenderShadowMap()
 	m_pContext->BeginEvent(L"Shadow Map");
 
 	pContext->ClearState();
-	m_pDirectionalLightShadowMap->Clear(m_pContext);
-
-	DirectX::XMMATRIX vpMatrices[PSSMMaxSplitsNum];
-	m_pDirectionalLightShadowMap->CalculatePSSMVpMatricesForDirectionalLight(
-		m_pCamera,
-		s_fov, (float)m_windowHeight / m_windowWidth,
-		s_near, m_cameraFarPlaneForPSSM,
-		m_directionalLight.GetDirection(),
-		vpMatrices
-	);
+	ResetGeometryBinding();
 
 	PSSMConstantBuffer pssmConstBuffer = {};
 	for (UINT i = 0; i < m_pDirectionalLightShadowMap->GetShadowMapSplitsNum(); ++i)
 	{
-		m_directionalLight.SetVpMatrix(i, DirectX::XMMatrixTranspose(vpMatrices[i]));
 		pssmConstBuffer.vpMatrices[i] = m_directionalLight.GetVpMatrix(i);
 	}
 
-	pContext->OMSetRenderTargets(0, nullptr, m_pDirectionalLightShadowMap->GetShadowMapDSVArray());
+	pContext->UpdateSubresource(m_pPSSMConstantBuffer, 0, nullptr, &pssmConstBuffer, 0, 0);
+	ShadowObjectConstantBuffer objectConstantBuffer = {};
+
+	pContext->OMSetRenderTargets(0, nullptr, m_pTexturePool->GetDSV(m_frameTextures.shadowMap));
 
 	D3D11_VIEWPORT viewport = {};
 	viewport.TopLeftX = 0.0f;
@@ -1356,66 +2631,118 @@ void Renderer::RenderShadowMap()
 	pContext->RSSetScissorRects(1, &rect);
 	pContext->RSSetState(m_pRasterizerState);
 
-	pContext->IASetInputLayout(m_pInputLayout);
-	pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	m_drawStateCache.Reset(pContext);
+	m_drawStateCache.SetInputLayout(m_pPositionInputLayout);
+	m_drawStateCache.SetTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	pContext->OMSetDepthStencilState(m_pDepthStencilState, 0);
 
-	pContext->VSSetShader(m_pShadowMapVShader, nullptr, 0);
+	m_drawStateCache.SetVertexShader(m_pShadowMapVShader);
 	pContext->GSSetShader(m_pShadowMapGShader, nullptr, 0);
 
 	pContext->VSSetConstantBuffers(0, 1, &m_pPSSMConstantBuffer);
 
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
+	UINT splitsNum = m_pDirectionalLightShadowMap->GetShadowMapSplitsNum();
 
-	for (auto& mesh : m_meshes)
+	m_shadowSplitDrawNum = 0;
+	m_shadowDrawNum = 0;
+
+	size_t visibleIdx = 0;
+
+	for (; visibleIdx < m_shadowVisibleInstances.size() && m_shadowVisibleInstances[visibleIdx] < m_meshes.size(); ++visibleIdx)
 	{
+		UINT32 instanceIdx = m_shadowVisibleInstances[visibleIdx];
+		const Mesh* mesh = m_meshes[instanceIdx];
+
 		if (!mesh->hasShadow)
 		{
 			continue;
 		}
 
-		pContext->IASetVertexBuffers(0, 1, &mesh->pVertexBuffer, &stride, &offset);
-		pContext->IASetIndexBuffer(mesh->pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+		INT baseVertex = SetDepthVertexStream(mesh);
 
-		DirectX::XMStoreFloat4x4(&pssmConstBuffer.modelMatrix, DirectX::XMMatrixTranspose(mesh->modelMatrix));
-		pContext->UpdateSubresource(m_pPSSMConstantBuffer, 0, nullptr, &pssmConstBuffer, 0, 0);
+		UINT instanceNum = fillSplitIndices(m_shadowSplitMasks[instanceIdx], objectConstantBuffer.splitIndices);
 
-		pContext->DrawIndexedInstanced(
-			mesh->indexCount,
-			m_pDirectionalLightShadowMap->GetShadowMapSplitsNum(),
-			0, 0, 0
-		);
+		DirectX::XMStoreFloat4x4(&objectConstantBuffer.modelMatrix, DirectX::XMMatrixTranspose(mesh->modelMatrix));
+		objectConstantBuffer.positionScale = mesh->dequantization.positionScale;
+		objectConstantBuffer.positionOffset = mesh->dequantization.positionOffset;
+		ConstantAllocation objectConstants = m_pObjectConstantRing->Allocate(&objectConstantBuffer, sizeof(objectConstantBuffer));
+
+		if (!objectConstants.IsValid())
+		{
+			continue;
+		}
+
+		m_pObjectConstantRing->SetVS(1, objectConstants);
+
+		pContext->DrawIndexedInstanced(mesh->indexCount, instanceNum, mesh->indexRange.offset, baseVertex, 0);
+		m_shadowSplitDrawNum += instanceNum;
+		++m_shadowDrawNum;
 	}
 
-	D3D_PRIMITIVE_TOPOLOGY cachedTopology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	m_shadowFullTriangleNum = 0;
+	m_shadowDrawnTriangleNum = 0;
 
-	for (auto* pModel : m_models)
+	if (FAILED(UploadInstances(m_shadowInstanceData)))
 	{
-		for (UINT primitiveIdx = 0; primitiveIdx < pModel->PrimitiveNum(); ++primitiveIdx)
-		{
-			const Model::Primitive& primitive = pModel->GetPrimitive(primitiveIdx);
+		m_pContext->EndEvent();
+		return;
+	}
 
-			if (cachedTopology != primitive.topology)
-			{
-				cachedTopology = primitive.topology;
-				pContext->IASetPrimitiveTopology(primitive.topology);
-			}
+	const std::vector<DrawItem>& drawItems = m_shadowDrawList.GetItems();
+	const std::vector<DrawBatch>& batches = m_shadowDrawList.GetBatches();
+
+	m_drawStateCache.SetVertexShader(m_pShadowMapInstancedVShader);
+	pContext->VSSetShaderResources(0, 1, &m_pInstanceBufferSRV);
 
-			ID3D11Buffer* vertexBuffers[] = { primitive.pMesh->pVertexBuffer };
+	const Mesh* pCachedMesh = nullptr;
+	UINT meshFirstIndex = 0;
+	INT meshBaseVertex = 0;
 
-			pContext->IASetVertexBuffers(0, 1, vertexBuffers, &stride, &offset);
-			pContext->IASetIndexBuffer(primitive.pMesh->pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	for (const auto& batch : batches)
+	{
+		const PrimitiveInstance& instance = m_primitiveInstances[drawItems[batch.firstItem].instanceIdx];
+		const Model::Primitive& primitive = instance.pModel->GetPrimitive(instance.primitiveIdx);
 
-			DirectX::XMStoreFloat4x4(&pssmConstBuffer.modelMatrix, DirectX::XMMatrixTranspose(primitive.pMesh->modelMatrix));
-			pContext->UpdateSubresource(m_pPSSMConstantBuffer, 0, nullptr, &pssmConstBuffer, 0, 0);
+		m_drawStateCache.SetInputLayout(GetDepthInputLayout(primitive.pMesh->vertexFormat));
+		m_drawStateCache.SetTopology(primitive.topology);
 
-			pContext->DrawIndexedInstanced(
-				primitive.pMesh->indexCount,
-				m_pDirectionalLightShadowMap->GetShadowMapSplitsNum(),
-				0, 0, 0
-			);
+		if (pCachedMesh != primitive.pMesh)
+		{
+			pCachedMesh = primitive.pMesh;
+
+			meshFirstIndex = primitive.pMesh->indexRange.offset;
+			meshBaseVertex = SetDepthVertexStream(primitive.pMesh);
+
+			objectConstantBuffer.positionScale = primitive.pMesh->dequantization.positionScale;
+			objectConstantBuffer.positionOffset = primitive.pMesh->dequantization.positionOffset;
 		}
+
+		objectConstantBuffer.instanceParams.x = batch.firstInstance;
+		ConstantAllocation objectConstants = m_pObjectConstantRing->Allocate(&objectConstantBuffer, sizeof(objectConstantBuffer));
+
+		if (!objectConstants.IsValid())
+		{
+			continue;
+		}
+
+		m_pObjectConstantRing->SetVS(1, objectConstants);
+
+		const Model::Lod& lod = primitive.lods[GetDrawKeyLod(batch.key)];
+
+		// the full count draws every caster into every split
+		m_shadowFullTriangleNum += primitive.indexCount / 3 * splitsNum * batch.itemCount;
+		m_shadowDrawnTriangleNum += lod.indexCount / 3 * batch.instanceNum;
+		m_shadowSplitDrawNum += batch.instanceNum;
+
+		pContext->DrawIndexedInstanced(
+			lod.indexCount,
+			batch.instanceNum,
+			meshFirstIndex + lod.firstIndex,
+			meshBaseVertex + primitive.baseVertex,
+			0
+		);
+
+		++m_shadowDrawNum;
 	}
 
 	m_pContext->EndEvent();
@@ -5,6 +5,14 @@
 #include "common.h"
 #include "environment.h"
 #include "rendererContext.h"
+#include "meshlet.h"
+#include "frustumCulling.h"
+#include "instanceBvh.h"
+#include "occlusionCulling.h"
+#include "drawBatch.h"
+#include "constantRingBuffer.h"
+#include "taskGraph.h"
+#include "frameGraph.h"
 
 struct IDXGIFactory;
 struct ID3D11Device;
@@ -28,6 +36,10 @@ class ToneMapping;
 class Camera;
 class Bloom;
 class ShadowMap;
+class ModelLoader;
+
+enum class VertexFormat;
+class TransientTexturePool;
 
 static constexpr UINT MaxLightNum = 3;
 
@@ -49,6 +61,8 @@ public:
 	inline RendererContext* GetContext() const { return m_pContext; }
 
 private:
+	struct InstanceData;
+
 	Renderer();
 	~Renderer();
 
@@ -71,10 +85,50 @@ private:
 	HRESULT SetResourceName(ID3D11Resource* pResource, const std::string& name);
 
 	void Update();
+
+	// The CPU work of a frame is split into the tasks of m_frameGraph, the passes only submit its results
+	void BuildFrameGraph();
+	void PrepareShadowCascades();
+	void PrepareShadowCasters();
+	void PrepareScene();
+	void PrepareLights();
+	void PrepareViewConstants();
+
 	void RenderScene();
 	void RenderEnvironment();
 	void RenderShadowMap();
-	void PostProcessing();
+
+	// The passes of a frame and the textures they share, rebuilt on resizes and setting changes
+	HRESULT BuildRenderGraph();
+	void SetSceneState();
+
+	ID3D11InputLayout* GetInputLayout(VertexFormat format) const;
+	ID3D11InputLayout* GetDepthInputLayout(VertexFormat format) const;
+	// Return the base vertex of the bound stream, the pool ranges of all meshes share the buffers
+	INT SetVertexStream(const Mesh* pMesh);
+	INT SetDepthVertexStream(const Mesh* pMesh);
+	// Skips the binds of the buffers that are already set
+	void BindGeometry(ID3D11Buffer* pVertexBuffer, UINT stride, ID3D11Buffer* pIndexBuffer, DXGI_FORMAT indexFormat);
+	void ResetGeometryBinding();
+
+	void UpdateInstanceBounds();
+	// Visible instances of one view, sorted. Only writes the vectors of the caller,
+	// so the views of a frame may be culled by concurrent tasks
+	void CullInstances(
+		const DirectX::XMMATRIX& vpMatrix,
+		UINT planeNum,
+		std::vector<UINT8>& viewMasks,
+		std::vector<UINT32>& visible
+	) const;
+	// Casters of any split with the mask of the splits each one overlaps
+	void CullShadowCasters(const DirectX::XMMATRIX* pVpMatrices, UINT splitsNum);
+	// Rasterizes the large visible primitives on the CPU and drops the instances they hide
+	void CullOccludedInstances(const DirectX::XMMATRIX& vpMatrix);
+
+	// Grows the instance buffer to the instances of a pass and fills it
+	HRESULT UploadInstances(const std::vector<InstanceData>& instanceData);
+	// The pool the packets of a pass are built on, none builds them on the render thread
+	ThreadPool* GetPacketPool() const;
 
 	void FillLightBuffer();
 
@@ -85,21 +139,54 @@ private:
 	static constexpr FLOAT s_far = 1000.0f;
 	static constexpr FLOAT s_fov = PI / 2.0f;
 
+	static constexpr size_t s_modelUploadBudget = 4 * 1024 * 1024;
+
+	// copies of the last model show off the instanced draws
+	static constexpr int s_maxModelCopyNum = 10000;
+
+	// per draw constants of a few frames in flight
+	static constexpr UINT s_objectConstantRingSize = 4 * 1024 * 1024;
+
+	struct PrimitiveInstance
+	{
+		const Model* pModel;
+		UINT primitiveIdx;
+		// number of the primitive among those of all models, shared by its copies
+		UINT primitiveKey;
+
+		// zero for the model itself, the place of a copy otherwise
+		DirectX::XMFLOAT3 offset;
+		BoundingVolume bounds;
+	};
+
+	// element of the instance buffer, matches InstanceData of the shaders
+	struct InstanceData
+	{
+		DirectX::XMFLOAT4X4 modelMatrix;
+		DirectX::XMUINT4 params; // x - shadow split
+	};
+
+	struct SceneConstantBuffer
+	{
+		DirectX::XMFLOAT4X4 vpMatrix;
+		DirectX::XMFLOAT4 cameraPosition;
+		DirectX::XMFLOAT4 cameraDirection;
+	};
+
+	struct LightBuffer
+	{
+		DirectX::XMFLOAT4 shadowSplitDists;
+		DirectionalLight directionalLight;
+
+		DirectX::XMUINT4 lightsCount; // r
+		PointLight lights[MaxLightNum];
+	};
+
 private:
 	RendererContext* m_pContext;
 
 	IDXGISwapChain* m_pSwapChain;
 	ID3D11RenderTargetView* m_pBackBufferRTV;
-	ID3D11Texture2D* m_pDepthTexture;
-	ID3D11DepthStencilView* m_pDepthTextureDSV;
-
-	ID3D11Texture2D* m_pHDRRenderTarget;
-	ID3D11RenderTargetView* m_pHDRTextureRTV;
-	ID3D11ShaderResourceView* m_pHDRTextureSRV;
-
-	ID3D11Texture2D* m_pEmissiveTexture;
-	ID3D11RenderTargetView* m_pEmissiveTextureRTV;
-	ID3D11ShaderResourceView* m_pEmissiveTextureSRV;
 
 	ID3D11RasterizerState* m_pRasterizerState;
 	ID3D11RasterizerState* m_pRasterizerStateFront;
@@ -117,6 +204,7 @@ private:
 	ID3D11Buffer* m_pLightBuffer;
 	ID3D11Buffer* m_pPSSMConstantBuffer;
 	ID3D11Buffer* m_pDebugParamsBuffer;
+	ConstantRingBuffer* m_pObjectConstantRing;
 
 	ID3D11VertexShader* m_pSceneVShader;
 	ID3D11PixelShader* m_pScenePShader;
@@ -127,13 +215,22 @@ private:
 	ID3D11VertexShader* m_pSceneColorEmissiveVShader;
 	ID3D11PixelShader* m_pSceneColorEmissivePShader;
 
+	// model variants reading CompactVertex and QuantizedVertex buffers
+	ID3D11VertexShader* m_pSceneColorTextureCompactVShader;
+	ID3D11VertexShader* m_pSceneColorEmissiveCompactVShader;
+
 	ID3D11VertexShader* m_pEnvironmentVShader;
 	ID3D11PixelShader* m_pEnvironmentPShader;
 
 	ID3D11VertexShader* m_pShadowMapVShader;
+	ID3D11VertexShader* m_pShadowMapInstancedVShader;
 	ID3D11GeometryShader* m_pShadowMapGShader;
 
 	ID3D11InputLayout* m_pInputLayout;
+	ID3D11InputLayout* m_pCompactInputLayout;
+	ID3D11InputLayout* m_pQuantizedInputLayout;
+	ID3D11InputLayout* m_pPositionInputLayout;
+	ID3D11InputLayout* m_pQuantizedPositionInputLayout;
 
 	ID3D11Texture2D* m_pPBRDFTexture;
 	ID3D11ShaderResourceView* m_pPBRDFTextureSRV;
@@ -164,4 +261,83 @@ private:
 	DirectionalLight m_directionalLight;
 
 	std::vector<Model*> m_models;
+	ModelLoader* m_pModelLoader;
+
+	float m_lodBias;
+	float m_shadowLodBias;
+
+	size_t m_sceneFullTriangleNum;
+	size_t m_sceneDrawnTriangleNum;
+	size_t m_shadowFullTriangleNum;
+	size_t m_shadowDrawnTriangleNum;
+
+	// meshlets of a scene batch, only batches of a single full detail instance are culled
+	struct BatchMeshlets
+	{
+		bool isCulled;
+		std::vector<IndexRange> ranges;
+	};
+
+	bool m_isMeshletCulling;
+	MeshletCullStats m_meshletCullStats;
+	std::vector<BatchMeshlets> m_sceneBatchMeshlets;
+	std::vector<MeshletCullStats> m_meshletChunkStats;
+
+	// world bounds of the built-in meshes followed by those of m_primitiveInstances
+	BoundsSoA m_instanceBounds;
+	std::vector<PrimitiveInstance> m_primitiveInstances;
+	InstanceBvh m_instanceBvh;
+
+	bool m_isFrustumCulling;
+	bool m_isBvhCulling;
+	std::vector<UINT8> m_sceneViewMasks;
+	std::vector<UINT32> m_visibleInstances;
+	std::vector<UINT32> m_shadowVisibleInstances;
+	std::vector<UINT8> m_shadowSplitMasks;
+	std::vector<UINT8> m_splitViewMasks;
+	std::vector<UINT32> m_splitVisibleInstances;
+	size_t m_shadowSplitDrawNum;
+
+	ID3D11Buffer* m_pBoundVertexBuffer;
+	UINT m_boundVertexStride;
+	ID3D11Buffer* m_pBoundIndexBuffer;
+	DXGI_FORMAT m_boundIndexFormat;
+	size_t m_geometryBindNum;
+
+	OcclusionBuffer* m_pOcclusionBuffer;
+	bool m_isOcclusionCulling;
+	OcclusionStats m_occlusionStats;
+
+	ID3D11Buffer* m_pInstanceBuffer;
+	ID3D11ShaderResourceView* m_pInstanceBufferSRV;
+	UINT m_instanceBufferCapacity;
+	// the passes upload their instances in turn, so both are kept until submitted
+	std::vector<InstanceData> m_sceneInstanceData;
+	std::vector<InstanceData> m_shadowInstanceData;
+
+	bool m_isInstancing;
+	UINT m_modelCopyNum;
+	DrawList m_sceneDrawList;
+	DrawList m_shadowDrawList;
+	DrawStateCache m_drawStateCache;
+	size_t m_sceneDrawNum;
+	size_t m_shadowDrawNum;
+
+	bool m_isParallelPackets;
+	double m_scenePacketTimeMs;
+	double m_shadowPacketTimeMs;
+
+	DirectX::XMMATRIX m_shadowVpMatrices[PSSMMaxSplitsNum];
+	SceneConstantBuffer m_sceneConstants;
+	LightBuffer m_lightBufferData;
+
+	TaskGraph m_frameGraph;
+	bool m_isParallelFrame;
+	double m_framePrepareTimeMs;
+
+	RenderGraph m_renderGraph;
+	TransientTexturePool* m_pTexturePool;
+	FrameTextures m_frameTextures;
+	bool m_isBloom;
+	bool m_isRenderGraphDirty;
 };
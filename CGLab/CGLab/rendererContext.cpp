@@ -9,6 +9,11 @@
 
 #include "preintegratedBRDF.h"
 #include "model.h"
+#include "modelCooker.h"
+#include "threadPool.h"
+#include "geometryPool.h"
+
+#include <chrono>
 
 
 RendererContext* RendererContext::CreateContext(IDXGIFactory* pFactory)
@@ -32,6 +37,10 @@ RendererContext::RendererContext()
 	, m_pShaderCompiler(nullptr)
 	, m_pHDRITextureLoader(nullptr)
 	, m_pPreintegratedBRDFBuilder(nullptr)
+	, m_pThreadPool(nullptr)
+	, m_pGeometryPool(nullptr)
+	, m_placeholderTextures{}
+	, m_placeholderTextureSRVs{}
 #if _DEBUG
 	, m_isDebug(true)
 #else
@@ -41,10 +50,17 @@ RendererContext::RendererContext()
 
 RendererContext::~RendererContext()
 {
-	delete m_pGLTFLoader;
 	delete m_pHDRITextureLoader;
 	delete m_pShaderCompiler;
 	delete m_pPreintegratedBRDFBuilder;
+	delete m_pThreadPool;
+	delete m_pGeometryPool;
+
+	for (UINT i = 0; i < static_cast<UINT>(PlaceholderTexture::Count); ++i)
+	{
+		SafeRelease(m_placeholderTextureSRVs[i]);
+		SafeRelease(m_placeholderTextures[i]);
+	}
 
 	SafeRelease(m_pAnnotation);
 	SafeRelease(m_pContext);
@@ -155,12 +171,64 @@ bool RendererContext::Init(IDXGIFactory* pFactory)
 
 	if (SUCCEEDED(hr))
 	{
-		m_pGLTFLoader = new tinygltf::TinyGLTF();
+		m_pThreadPool = ThreadPool::Create();
+
+		if (m_pThreadPool == nullptr)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		m_pGeometryPool = GeometryPool::Create(this);
+
+		if (m_pGeometryPool == nullptr)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = CreatePlaceholderTextures();
 	}
 
 	return SUCCEEDED(hr);
 }
 
+HRESULT RendererContext::CreatePlaceholderTextures()
+{
+	// white albedo, flat normal, rough dielectric, no emission
+	static constexpr UINT32 texels[] =
+	{
+		0xFFFFFFFF,
+		0xFFFF8080,
+		0xFF00FF00,
+		0xFF000000
+	};
+
+	HRESULT hr = S_OK;
+
+	for (UINT i = 0; i < static_cast<UINT>(PlaceholderTexture::Count) && SUCCEEDED(hr); ++i)
+	{
+		D3D11_TEXTURE2D_DESC textureDesc = CreateDefaultTexture2DDesc(DXGI_FORMAT_R8G8B8A8_UNORM, 1, 1, D3D11_BIND_SHADER_RESOURCE);
+		textureDesc.Usage = D3D11_USAGE_IMMUTABLE;
+
+		D3D11_SUBRESOURCE_DATA textureData = CreateDefaultSubresourceData(&texels[i]);
+		textureData.SysMemPitch = sizeof(UINT32);
+
+		hr = m_pDevice->CreateTexture2D(&textureDesc, &textureData, &m_placeholderTextures[i]);
+
+		if (SUCCEEDED(hr))
+		{
+			hr = m_pDevice->CreateShaderResourceView(m_placeholderTextures[i], nullptr, &m_placeholderTextureSRVs[i]);
+		}
+	}
+
+	return hr;
+}
+
 void RendererContext::BeginEvent(LPCWSTR eventName) const
 {
 	if (m_pAnnotation != nullptr)
@@ -349,18 +417,14 @@ HRESULT RendererContext::CreateSphereMesh(UINT16 latitudeBands, UINT16 longitude
 	}
 
 	Mesh* mesh = new Mesh();
+	mesh->pGeometryPool = m_pGeometryPool;
 	mesh->indexCount = (UINT)indices.size();
+	ComputeBounds(vertices.data(), vertices.size(), mesh->boundsMin, mesh->boundsMax);
 
-	D3D11_BUFFER_DESC vertexBufferDesc = CreateDefaultBufferDesc((UINT)vertices.size() * sizeof(Vertex), D3D11_BIND_VERTEX_BUFFER);
-	D3D11_SUBRESOURCE_DATA vertexBufferData = CreateDefaultSubresourceData(vertices.data());
-
-	HRESULT hr = m_pDevice->CreateBuffer(&vertexBufferDesc, &vertexBufferData, &mesh->pVertexBuffer);
+	HRESULT hr = m_pGeometryPool->Upload(sizeof(Vertex), D3D11_BIND_VERTEX_BUFFER, (UINT)vertices.size(), vertices.data(), mesh->vertexRange);
 	if (SUCCEEDED(hr))
 	{
-		D3D11_BUFFER_DESC indexBufferDesc = CreateDefaultBufferDesc(mesh->indexCount * sizeof(UINT16), D3D11_BIND_INDEX_BUFFER);
-		D3D11_SUBRESOURCE_DATA indexBufferData = CreateDefaultSubresourceData(indices.data());
-
-		hr = m_pDevice->CreateBuffer(&indexBufferDesc, &indexBufferData, &mesh->pIndexBuffer);
+		hr = m_pGeometryPool->Upload(sizeof(UINT16), D3D11_BIND_INDEX_BUFFER, mesh->indexCount, indices.data(), mesh->indexRange);
 	}
 
 	if (SUCCEEDED(hr))
@@ -379,25 +443,28 @@ Model* RendererContext::LoadModel(const std::string& gltfModelFileName, const Di
 {
 	Model* pModel = nullptr;
 
-	std::string err;
-	std::string warn;
-	tinygltf::Model model;
+	ModelLoadStats stats = {};
+	auto loadStart = std::chrono::steady_clock::now();
 
-	if (m_pGLTFLoader->LoadASCIIFromFile(&model, &err, &warn, gltfModelFileName + "/scene.gltf"))
-	{
-		pModel = Model::CreateModel(this, model, gltfModelFileName, initMatrix);
-	}
-	else
+	MeshCache* pCache = nullptr;
+	CookedModel cookedModel;
+
+	if (ModelCooker::LoadCooked(gltfModelFileName, pCache, cookedModel, stats))
 	{
-		if (!err.empty())
-		{
-			printf("erros: %s\n", err.c_str());
-		}
-		if (!warn.empty())
-		{
-			printf("warnings: %s\n", warn.c_str());
-		}
+		pModel = Model::CreateModel(
+			this,
+			pCache != nullptr ? pCache->GetView() : cookedModel.GetView(),
+			gltfModelFileName,
+			initMatrix,
+			&stats
+		);
 	}
 
+	delete pCache;
+
+	stats.totalTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+
+	PrintModelLoadStats(gltfModelFileName, stats);
+
 	return pModel;
-}
+}
\ No newline at end of file
@@ -12,6 +12,8 @@ struct ID3D11ShaderResourceView;
 
 class PreintegratedBRDFBuilder;
 class HDRITextureLoader;
+class ThreadPool;
+class GeometryPool;
 class Model;
 struct Mesh;
 
@@ -25,6 +27,18 @@ struct Vertex
 };
 
 
+// 1x1 stand-ins bound while the real texture is still streaming in
+// and for materials without the texture
+enum class PlaceholderTexture
+{
+	Color,
+	Normal,
+	MetalicRoughness,
+	Emissive,
+	Count
+};
+
+
 class RendererContext
 {
 public:
@@ -35,6 +49,12 @@ public:
 	inline ID3D11Device* GetDevice() const { return m_pDevice; }
 	inline ID3D11DeviceContext* GetContext() const { return m_pContext; }
 	inline ShaderCompiler* GetShaderCompiler() const { return m_pShaderCompiler; }
+	inline ThreadPool* GetThreadPool() const { return m_pThreadPool; }
+	inline GeometryPool* GetGeometryPool() const { return m_pGeometryPool; }
+	inline ID3D11ShaderResourceView* GetPlaceholderTextureSRV(PlaceholderTexture type) const
+	{
+		return m_placeholderTextureSRVs[static_cast<UINT>(type)];
+	}
 
 	void BeginEvent(LPCWSTR eventName) const;
 	void EndEvent() const;
@@ -77,6 +97,8 @@ private:
 
 	bool Init(IDXGIFactory* pFactory);
 
+	HRESULT CreatePlaceholderTextures();
+
 private:
 	ID3D11Device* m_pDevice;
 	ID3D11DeviceContext* m_pContext;
@@ -88,7 +110,11 @@ private:
 
 	PreintegratedBRDFBuilder* m_pPreintegratedBRDFBuilder;
 
-	tinygltf::TinyGLTF* m_pGLTFLoader;
+	ThreadPool* m_pThreadPool;
+	GeometryPool* m_pGeometryPool;
+
+	ID3D11Texture2D* m_placeholderTextures[static_cast<UINT>(PlaceholderTexture::Count)];
+	ID3D11ShaderResourceView* m_placeholderTextureSRVs[static_cast<UINT>(PlaceholderTexture::Count)];
 
 	bool m_isDebug;
 };
@@ -0,0 +1,121 @@
+#include "ringBufferAllocator.h"
+
+#include <algorithm>
+
+
+size_t alignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+
+RingBufferAllocator::RingBufferAllocator(size_t size)
+	: m_size(0)
+	, m_head(0)
+	, m_tail(0)
+	, m_usedSize(0)
+	, m_frameSize(0)
+{
+	Reset(size);
+}
+
+
+void RingBufferAllocator::Reset(size_t size)
+{
+	m_size = size;
+	m_head = 0;
+	m_tail = 0;
+	m_usedSize = 0;
+	m_frameSize = 0;
+	m_frames.clear();
+
+	m_stats = {};
+}
+
+
+size_t RingBufferAllocator::Allocate(size_t size, size_t alignment)
+{
+	size_t offset = alignUp(m_head, alignment);
+
+	// with head and tail at one place the ring is either empty or full
+	bool isFull = m_usedSize == m_size;
+	bool isAllocated = false;
+
+	if (!isFull && size > 0)
+	{
+		if (m_head >= m_tail)
+		{
+			// the free space is the end of the ring and its start up to the tail
+			if (offset + size <= m_size)
+			{
+				isAllocated = true;
+			}
+			else if (size <= m_tail)
+			{
+				// the end is skipped and only freed with the frame
+				offset = 0;
+				Take(m_size - m_head);
+				isAllocated = true;
+			}
+		}
+		else if (offset + size <= m_tail)
+		{
+			isAllocated = true;
+		}
+	}
+
+	if (!isAllocated)
+	{
+		++m_stats.overflowNum;
+		return InvalidOffset;
+	}
+
+	Take(offset + size - m_head);
+
+	++m_stats.allocationNum;
+	m_stats.allocatedBytes += size;
+
+	return offset;
+}
+
+void RingBufferAllocator::Take(size_t size)
+{
+	m_head += size;
+
+	if (m_head >= m_size)
+	{
+		m_head -= m_size;
+	}
+
+	m_usedSize += size;
+	m_frameSize += size;
+
+	m_stats.usedBytes = m_usedSize;
+	m_stats.peakUsedBytes = (std::max)(m_stats.peakUsedBytes, m_usedSize);
+}
+
+
+void RingBufferAllocator::FinishFrame(uint64_t fenceValue)
+{
+	m_frames.push_back({ fenceValue, m_head, m_frameSize });
+	m_frameSize = 0;
+
+	m_stats.allocationNum = 0;
+	m_stats.allocatedBytes = 0;
+	m_stats.overflowNum = 0;
+	m_stats.inFlightFrameNum = m_frames.size();
+}
+
+void RingBufferAllocator::ReleaseCompleted(uint64_t completedFenceValue)
+{
+	while (!m_frames.empty() && m_frames.front().fenceValue <= completedFenceValue)
+	{
+		m_tail = m_frames.front().head;
+		m_usedSize -= m_frames.front().size;
+
+		m_frames.pop_front();
+	}
+
+	m_stats.usedBytes = m_usedSize;
+	m_stats.inFlightFrameNum = m_frames.size();
+}
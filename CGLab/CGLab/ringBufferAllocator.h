@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+
+struct RingBufferStats
+{
+	// since the last finished frame
+	size_t allocationNum = 0;
+	size_t allocatedBytes = 0;
+	size_t overflowNum = 0;
+
+	// space the GPU may still read, including the end skipped by wraps
+	size_t usedBytes = 0;
+	size_t peakUsedBytes = 0;
+	size_t inFlightFrameNum = 0;
+};
+
+
+// Offsets into a ring of bytes that is filled frame after frame, e.g. a dynamic buffer
+// written with no-overwrite maps. The space of a frame is handed back only once its fence
+// has completed, so nothing is overwritten while the GPU may read it. Knows nothing of the
+// graphics API, the owner maps the offsets to its buffer and signals the fences.
+class RingBufferAllocator
+{
+public:
+	static constexpr size_t InvalidOffset = SIZE_MAX;
+
+	explicit RingBufferAllocator(size_t size = 0);
+
+	// Forgets every allocation and frame
+	void Reset(size_t size);
+
+	// alignment has to be a power of two, InvalidOffset when the free space is too small
+	size_t Allocate(size_t size, size_t alignment);
+
+	// Everything allocated since the last call belongs to the frame signalling fenceValue,
+	// fence values have to increase
+	void FinishFrame(uint64_t fenceValue);
+	// Frees the frames with fence values up to completedFenceValue
+	void ReleaseCompleted(uint64_t completedFenceValue);
+
+	inline size_t GetSize() const { return m_size; }
+	inline const RingBufferStats& GetStats() const { return m_stats; }
+
+private:
+	struct Frame
+	{
+		uint64_t fenceValue;
+		// the tail of the ring once the frame is released
+		size_t head;
+		size_t size;
+	};
+
+	void Take(size_t size);
+
+private:
+	size_t m_size;
+
+	// allocations go to the head, the tail is the start of the oldest space in use
+	size_t m_head;
+	size_t m_tail;
+	size_t m_usedSize;
+
+	size_t m_frameSize;
+	std::deque<Frame> m_frames;
+
+	RingBufferStats m_stats;
+};
@@ -2,12 +2,16 @@ TextureCube EnvironmentCubeMap : register(t0);
 
 SamplerState MinMagLinearSampler : register(s0);
 
-cbuffer ConstantBuffer : register(b0)
+cbuffer SceneBuffer : register(b0)
 {
-    float4x4 modelMatrix;
     float4x4 vpMatrix;
 }
 
+cbuffer ObjectBuffer : register(b4)
+{
+    float4x4 modelMatrix;
+}
+
 
 struct VSIn
 {
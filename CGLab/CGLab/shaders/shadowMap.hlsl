@@ -2,19 +2,41 @@ static const uint MaxSplitsNum = 4u;
 
 
 cbuffer PSSMConstantBuffer : register(b0)
+{
+    float4x4 vpMatrix[MaxSplitsNum];
+}
+
+// written for every draw into the constant ring
+cbuffer ObjectBuffer : register(b1)
 {
     float4x4 modelMatrix;
     
-    float4x4 vpMatrix[MaxSplitsNum];
+    float4 positionScale;
+    float4 positionOffset;
+    
+    // split of every instance, a caster is drawn only into the splits it overlaps
+    uint4 splitIndices;
+    
+    uint4 instanceParams; // x - first instance of the draw in Instances
 }
 
 
+#if INSTANCED
+// every instance is one caster in one split, modelMatrix and splitIndices are not used
+struct InstanceData
+{
+    float4x4 modelMatrix;
+    uint4 params; // x - split
+};
+
+StructuredBuffer<InstanceData> Instances : register(t0);
+#endif
+
+
+// fed from the position stream of a mesh or the position of its full vertices
 struct VSIn
 {
     float3 position : POSITION;
-    float3 normal   : NORMAL;
-    float4 tangent  : TANGENT;
-    float2 texCoord : TEXCOORD;
     
     uint instanceId : SV_INSTANCEID;
 };
@@ -23,7 +45,7 @@ struct VSIn
 struct VSOut
 {
     float4 position : SV_POSITION;
-    uint instanceId : SV_INSTANCEID;
+    uint splitIdx   : SPLIT_INDEX;
 };
 
 
@@ -36,10 +58,22 @@ struct GSOut
 
 VSOut VS(VSIn input)
 {
+    float3 position = input.position * positionScale.xyz + positionOffset.xyz;
+    
+#if INSTANCED
+    InstanceData instance = Instances[instanceParams.x + input.instanceId];
+    
+    float4x4 worldMatrix = instance.modelMatrix;
+    uint splitIdx = instance.params.x;
+#else
+    float4x4 worldMatrix = modelMatrix;
+    uint splitIdx = splitIndices[input.instanceId];
+#endif
+    
     VSOut output = (VSOut)0;
-    output.position = mul(float4(input.position, 1.0f), modelMatrix);
-    output.position = mul(output.position, vpMatrix[input.instanceId]);
-    output.instanceId = input.instanceId;
+    output.position = mul(float4(position, 1.0f), worldMatrix);
+    output.position = mul(output.position, vpMatrix[splitIdx]);
+    output.splitIdx = splitIdx;
     
     return output;
 }
@@ -49,7 +83,7 @@ VSOut VS(VSIn input)
 void GS(triangle VSOut input[3], inout TriangleStream<GSOut> triStream)
 {
     GSOut p = (GSOut)0;
-    p.rtIdx = input[0].instanceId;
+    p.rtIdx = input[0].splitIdx;
     
     p.position = input[0].position;
     triStream.Append(p);
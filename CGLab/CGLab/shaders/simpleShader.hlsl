@@ -9,15 +9,26 @@ Texture2D BRDFLut                   : register(t2);
 
 Texture2DArray ShadowMapArray       : register(t20);
 
-cbuffer ConstantBuffer : register(b0)
+cbuffer SceneBuffer : register(b0)
 {
-    float4x4 modelMatrix;
     float4x4 vpMatrix;
     
     float3 cameraPosition;
     float3 cameraDirection;
 }
 
+// written for every draw into the constant ring
+cbuffer ObjectBuffer : register(b4)
+{
+    float4x4 modelMatrix;
+    
+    float4 positionScale;
+    float4 positionOffset;
+    float4 texCoordTransform; // xy - scale, zw - offset
+    
+    uint4 instanceParams; // x - first instance of the draw in Instances
+}
+
 struct DirectionalLight
 {
     float4 direction;
@@ -70,6 +81,27 @@ Texture2D EmmisiveTexture           : register(t13);
 SamplerState MeshTextureSampler     : register(s10);
 
 
+#if INSTANCED
+// transforms of the instanced draws of a frame, modelMatrix is not used
+struct InstanceData
+{
+    float4x4 modelMatrix;
+    uint4 params;
+};
+
+StructuredBuffer<InstanceData> Instances : register(t30);
+#endif
+
+
+#if COMPACT_VERTEX
+struct VSIn
+{
+    float3 position : POSITION;
+    float2 normal   : NORMAL;   // octahedral
+    uint2 tangent   : TANGENT;  // octahedral, lowest bit of y - bitangent sign
+    float2 texCoord : TEXCOORD;
+};
+#else
 struct VSIn
 {
     float3 position : POSITION;
@@ -77,6 +109,7 @@ struct VSIn
     float4 tangent  : TANGENT;
     float2 texCoord : TEXCOORD;
 };
+#endif
 
 
 struct VSOut
@@ -96,16 +129,47 @@ struct PSOut
 };
 
 
-VSOut VS(VSIn input)
+float3 OctahedralDecode(float2 oct)
+{
+    float3 direction = float3(oct, 1.0f - abs(oct.x) - abs(oct.y));
+    float t = saturate(-direction.z);
+    direction.xy += direction.xy >= 0.0f ? -t : t;
+    
+    return normalize(direction);
+}
+
+
+VSOut VS(VSIn input, uint instanceId : SV_INSTANCEID)
 {
+#if INSTANCED
+    float4x4 worldMatrix = Instances[instanceParams.x + instanceId].modelMatrix;
+#else
+    float4x4 worldMatrix = modelMatrix;
+#endif
+    
+#if COMPACT_VERTEX
+    float3 position = input.position * positionScale.xyz + positionOffset.xyz;
+    float3 normal = OctahedralDecode(input.normal);
+    float4 tangent = float4(
+        OctahedralDecode(float2(input.tangent.x / 65535.0f, (input.tangent.y >> 1) / 32767.0f) * 2.0f - 1.0f),
+        (input.tangent.y & 1u) != 0u ? -1.0f : 1.0f
+    );
+    float2 texCoord = input.texCoord * texCoordTransform.xy + texCoordTransform.zw;
+#else
+    float3 position = input.position;
+    float3 normal = input.normal;
+    float4 tangent = input.tangent;
+    float2 texCoord = input.texCoord;
+#endif
+    
     VSOut output;
-    output.worldPosition = mul(float4(input.position, 1.0f), modelMatrix);
+    output.worldPosition = mul(float4(position, 1.0f), worldMatrix);
     output.position = mul(output.worldPosition, vpMatrix);
-    output.worldNormal = normalize(mul(float4(input.normal, 0.0f), modelMatrix).xyz);
+    output.worldNormal = normalize(mul(float4(normal, 0.0f), worldMatrix).xyz);
     
 #if HAS_COLOR_TEXTURE
-    output.worldTangent = normalize(mul(input.tangent, modelMatrix).xyz);
-    output.texCoord = input.texCoord;
+    output.worldTangent = normalize(mul(tangent, worldMatrix).xyz);
+    output.texCoord = texCoord;
 #endif
     
     return output;
@@ -1,92 +1,18 @@
 #include "shadowMap.h"
-#include "rendererContext.h"
 #include "camera.h"
 
 
-ShadowMap* ShadowMap::CreateShadowMap(RendererContext* pContext, UINT splitNum, UINT size)
+ShadowMap* ShadowMap::CreateShadowMap(UINT splitNum, UINT size)
 {
-	ShadowMap* pShadowMap = new ShadowMap(splitNum, size);
-
-	if (pShadowMap->Init(pContext))
-	{
-		return pShadowMap;
-	}
-
-	delete pShadowMap;
-	return nullptr;
+	return new ShadowMap(splitNum, size);
 }
 
 ShadowMap::ShadowMap(UINT splitNum, UINT size)
-	: m_pPSShadowMap(nullptr)
-	, m_pPSShadowMapDSV(nullptr)
-	, m_pPSShadowMapSRV(nullptr)
-	, m_splitsNum(splitNum)
+	: m_splitsNum(splitNum)
 	, m_size(size)
 	, m_lambda(0.5f)
 {}
 
-ShadowMap::~ShadowMap()
-{
-	SafeRelease(m_pPSShadowMapSRV);
-	SafeRelease(m_pPSShadowMapDSV);
-	SafeRelease(m_pPSShadowMap);
-}
-
-bool ShadowMap::Init(RendererContext* pContext)
-{
-	ID3D11Device* pDevice = pContext->GetDevice();
-
-
-	D3D11_TEXTURE2D_DESC psShadowMapDesc = CreateDefaultTexture2DDesc(
-		DXGI_FORMAT_R24G8_TYPELESS,
-		m_size, m_size,
-		D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE
-	);
-	psShadowMapDesc.ArraySize = m_splitsNum;
-
-	HRESULT hr = pDevice->CreateTexture2D(&psShadowMapDesc, nullptr, &m_pPSShadowMap);
-
-	if (SUCCEEDED(hr))
-	{
-		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
-		dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
-		dsvDesc.Texture2DArray.ArraySize = m_splitsNum;
-		dsvDesc.Texture2DArray.FirstArraySlice = 0;
-		dsvDesc.Texture2DArray.MipSlice = 0;
-		dsvDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-		dsvDesc.Flags = 0;
-
-		hr = pDevice->CreateDepthStencilView(m_pPSShadowMap, &dsvDesc, &m_pPSShadowMapDSV);
-	}
-
-	if (SUCCEEDED(hr))
-	{
-		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
-		srvDesc.Texture2DArray.FirstArraySlice = 0;
-		srvDesc.Texture2DArray.ArraySize = m_splitsNum;
-		srvDesc.Texture2DArray.MipLevels = 1;
-		srvDesc.Texture2DArray.MostDetailedMip = 0;
-		srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
-
-		hr = pDevice->CreateShaderResourceView(m_pPSShadowMap, &srvDesc, &m_pPSShadowMapSRV);
-	}
-
-	return SUCCEEDED(hr); 
-}
-
-
-ID3D11DepthStencilView* ShadowMap::GetShadowMapDSVArray() const
-{
-	return m_pPSShadowMapDSV;
-}
-
-
-ID3D11ShaderResourceView* ShadowMap::GetShadowMapSRVArray() const
-{
-	return m_pPSShadowMapSRV;
-}
-
 
 void ShadowMap::CalculateProjMatrixForDirectionalLight(const Box& size, DirectX::XMMATRIX& projMatrix) const
 {
@@ -247,12 +173,6 @@ void ShadowMap::BuildProjMatrixForDirectionalLight(
 }
 
 
-void ShadowMap::Clear(RendererContext* pContext)
-{
-	pContext->GetContext()->ClearDepthStencilView(m_pPSShadowMapDSV, D3D11_CLEAR_DEPTH, 1.0f, 0u);
-}
-
-
 void ShadowMap::SetLogUniformSplitsInterpolationValue(float lambda)
 {
 	lambda = max(0.0f, lambda);
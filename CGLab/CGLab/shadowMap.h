@@ -1,13 +1,15 @@
 #pragma once
 #include "framework.h"
 
-class RendererContext;
 class Camera;
 
 
+// Split matrices of the PSSM shadows, the render graph owns the texture array of the splits
 class ShadowMap
 {
 public:
+	static constexpr DXGI_FORMAT TextureFormat = DXGI_FORMAT_R24G8_TYPELESS;
+
 	struct Box
 	{
 		Box() = default;
@@ -19,12 +21,7 @@ public:
 	};
 
 public:
-	static ShadowMap* CreateShadowMap(RendererContext* pContext, UINT splitNum, UINT size = 2048u);
-
-	~ShadowMap();
-
-	ID3D11DepthStencilView* GetShadowMapDSVArray() const;
-	ID3D11ShaderResourceView* GetShadowMapSRVArray() const;
+	static ShadowMap* CreateShadowMap(UINT splitNum, UINT size = 2048u);
 
 	inline const std::vector<float>& GetShadowMapSplitDists() const { return m_splitsDists; }
 
@@ -43,8 +40,6 @@ public:
 		DirectX::XMMATRIX* pVpMatrices
 	);
 
-	void Clear(RendererContext* pContext);
-
 	inline UINT GetShadowMapSplitsNum() const { return m_splitsNum; }
 	inline UINT GetShadowMapTextureSize() const { return m_size; }
 
@@ -54,7 +49,6 @@ public:
 private:
 	ShadowMap(UINT splitNum, UINT size);
 
-	bool Init(RendererContext* pContext);
 	void CalculateSplitsDists(float nearPlane, float farPlane);
 
 	void BuildProjMatrixForDirectionalLight(
@@ -65,10 +59,6 @@ private:
 	) const;
 
 private:
-	ID3D11Texture2D* m_pPSShadowMap;
-	ID3D11DepthStencilView* m_pPSShadowMapDSV;
-	ID3D11ShaderResourceView* m_pPSShadowMapSRV;
-
 	UINT m_splitsNum;
 	std::vector<float> m_splitsDists;
 	UINT m_size;
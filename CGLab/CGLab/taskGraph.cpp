@@ -0,0 +1,89 @@
+#include "taskGraph.h"
+#include "jobSystem.h"
+
+#include <chrono>
+
+
+TaskGraph::TaskGraph()
+	: m_pendingCapacity(0)
+{}
+
+
+TaskGraph::TaskId TaskGraph::AddTask(const char* pName, std::function<void()> function)
+{
+	m_tasks.push_back({ pName, std::move(function), {}, 0, 0.0 });
+
+	return static_cast<TaskId>(m_tasks.size() - 1);
+}
+
+void TaskGraph::AddDependency(TaskId before, TaskId after)
+{
+	m_tasks[before].successors.push_back(after);
+	++m_tasks[after].dependencyNum;
+}
+
+void TaskGraph::Clear()
+{
+	m_tasks.clear();
+}
+
+
+void TaskGraph::Run(JobSystem* pJobSystem)
+{
+	if (m_pendingCapacity < m_tasks.size())
+	{
+		m_pendingCapacity = m_tasks.size();
+		m_pendingNums = std::make_unique<std::atomic<uint32_t>[]>(m_pendingCapacity);
+	}
+
+	for (size_t taskIdx = 0; taskIdx < m_tasks.size(); ++taskIdx)
+	{
+		m_pendingNums[taskIdx].store(m_tasks[taskIdx].dependencyNum, std::memory_order_relaxed);
+	}
+
+	// started tasks count themselves before the tasks starting them are done, so the counter
+	// only gets to zero once the whole graph has run
+	JobCounter counter;
+
+	for (TaskId taskId = 0; taskId < static_cast<TaskId>(m_tasks.size()); ++taskId)
+	{
+		if (m_tasks[taskId].dependencyNum == 0)
+		{
+			RunTask(pJobSystem, taskId, &counter);
+		}
+	}
+
+	if (pJobSystem != nullptr)
+	{
+		pJobSystem->Wait(counter);
+	}
+}
+
+void TaskGraph::RunTask(JobSystem* pJobSystem, TaskId taskId, JobCounter* pCounter)
+{
+	auto runTask = [this, pJobSystem, taskId, pCounter]()
+	{
+		Task& task = m_tasks[taskId];
+
+		auto start = std::chrono::steady_clock::now();
+		task.function();
+		task.timeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		for (TaskId successor : task.successors)
+		{
+			if (m_pendingNums[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				RunTask(pJobSystem, successor, pCounter);
+			}
+		}
+	};
+
+	if (pJobSystem != nullptr)
+	{
+		pJobSystem->Run(runTask, pCounter);
+	}
+	else
+	{
+		runTask();
+	}
+}
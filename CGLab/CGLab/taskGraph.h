@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class JobSystem;
+struct JobCounter;
+
+
+// Tasks with the tasks they have to wait for, built once and run every frame.
+// A task is started as soon as its last dependency is done, by the job that finished it.
+// The dependencies must not form a cycle.
+class TaskGraph
+{
+public:
+	using TaskId = uint32_t;
+
+	TaskGraph();
+
+	TaskId AddTask(const char* pName, std::function<void()> function);
+	// after only starts once before is done
+	void AddDependency(TaskId before, TaskId after);
+	void Clear();
+
+	// Runs every task once and returns when all are done, on the calling thread when pJobSystem is null
+	void Run(JobSystem* pJobSystem);
+
+	inline size_t GetTaskNum() const { return m_tasks.size(); }
+	inline const char* GetTaskName(TaskId taskId) const { return m_tasks[taskId].pName; }
+	// time the task took in the last run
+	inline double GetTaskTimeMs(TaskId taskId) const { return m_tasks[taskId].timeMs; }
+
+private:
+	struct Task
+	{
+		const char* pName;
+		std::function<void()> function;
+
+		std::vector<TaskId> successors;
+		uint32_t dependencyNum;
+
+		double timeMs;
+	};
+
+	void RunTask(JobSystem* pJobSystem, TaskId taskId, JobCounter* pCounter);
+
+private:
+	std::vector<Task> m_tasks;
+
+	// dependencies of every task not done yet in the current run
+	std::unique_ptr<std::atomic<uint32_t>[]> m_pendingNums;
+	size_t m_pendingCapacity;
+};
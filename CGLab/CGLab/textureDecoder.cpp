@@ -0,0 +1,134 @@
+#include "textureDecoder.h"
+#include "threadPool.h"
+#include "model.h"
+
+#include <chrono>
+
+
+TextureDecoder* TextureDecoder::Create(
+	const CookedModelView& cookedModel,
+	const std::string& pathToModel,
+	ModelLoadStats* pStats
+)
+{
+	TextureDecoder* pDecoder = new TextureDecoder();
+
+	if (pDecoder->Init(cookedModel, pathToModel, pStats))
+	{
+		return pDecoder;
+	}
+
+	delete pDecoder;
+	return nullptr;
+}
+
+
+TextureDecoder::TextureDecoder()
+{}
+
+TextureDecoder::~TextureDecoder()
+{
+	for (auto& sourceFile : m_sourceFiles)
+	{
+		delete sourceFile.second;
+	}
+}
+
+
+bool TextureDecoder::Init(const CookedModelView& cookedModel, const std::string& pathToModel, ModelLoadStats* pStats)
+{
+	m_sources.resize(cookedModel.images.Size(), { nullptr, 0 });
+
+	for (UINT i = 0; i < cookedModel.images.Size(); ++i)
+	{
+		const CookedImage& cookedImage = cookedModel.images[i];
+		ImageSource& source = m_sources[i];
+
+		if (cookedImage.fileNameOffset == CookedInlineImage)
+		{
+			source = { cookedModel.blobs.pData + cookedImage.dataOffset, cookedImage.dataSize };
+			continue;
+		}
+
+		auto it = m_sourceFiles.find(cookedImage.fileNameOffset);
+
+		if (it == m_sourceFiles.end())
+		{
+			MappedFile* pFile = MappedFile::Open(pathToModel + "/" + cookedModel.GetString(cookedImage.fileNameOffset));
+
+			if (pFile != nullptr && pStats != nullptr)
+			{
+				pStats->bytesMapped += pFile->GetSize();
+				++pStats->filesMapped;
+			}
+
+			it = m_sourceFiles.emplace(cookedImage.fileNameOffset, pFile).first;
+		}
+
+		const MappedFile* pFile = it->second;
+
+		if (pFile == nullptr || cookedImage.dataOffset > pFile->GetSize())
+		{
+			continue;
+		}
+
+		// zero size stands for the rest of the file
+		UINT64 size = cookedImage.dataSize != 0 ? cookedImage.dataSize : pFile->GetSize() - cookedImage.dataOffset;
+
+		if (size <= pFile->GetSize() - cookedImage.dataOffset)
+		{
+			source = { pFile->GetData() + cookedImage.dataOffset, size };
+		}
+	}
+
+	return true;
+}
+
+
+void TextureDecoder::Decode(ThreadPool* pPool, std::vector<DecodedImage>& images) const
+{
+	images.clear();
+	images.resize(m_sources.size());
+
+	if (pPool == nullptr)
+	{
+		for (UINT i = 0; i < ImageNum(); ++i)
+		{
+			DecodeImage(i, images[i]);
+		}
+		return;
+	}
+
+	pPool->ParallelFor(ImageNum(), [&](UINT imageIdx) { DecodeImage(imageIdx, images[imageIdx]); });
+}
+
+bool TextureDecoder::DecodeImage(UINT imageIdx, DecodedImage& image) const
+{
+	const ImageSource& source = m_sources[imageIdx];
+
+	if (source.pData == nullptr)
+	{
+		image.error = "image source is missing";
+		return false;
+	}
+
+	auto decodeStart = std::chrono::steady_clock::now();
+
+	std::string warn;
+
+	image.isDecoded = tinygltf::LoadImageData(
+		&image.image,
+		static_cast<int>(imageIdx),
+		&image.error,
+		&warn,
+		0,
+		0,
+		source.pData,
+		static_cast<int>(source.size),
+		nullptr
+	);
+
+	image.decodeTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodeStart).count();
+
+	return image.isDecoded;
+}
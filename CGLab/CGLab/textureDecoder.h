@@ -0,0 +1,55 @@
+#pragma once
+#include "framework.h"
+#include "meshCache.h"
+
+class ThreadPool;
+struct ModelLoadStats;
+
+
+struct DecodedImage
+{
+	tinygltf::Image image;
+	bool isDecoded = false;
+	double decodeTimeMs = 0.0;
+	std::string error;
+};
+
+
+// Resolves the encoded bytes of every cooked image up front, so the
+// images can then be decoded on any number of threads
+class TextureDecoder
+{
+public:
+	static TextureDecoder* Create(
+		const CookedModelView& cookedModel,
+		const std::string& pathToModel,
+		ModelLoadStats* pStats = nullptr
+	);
+
+	~TextureDecoder();
+
+	inline UINT ImageNum() const { return static_cast<UINT>(m_sources.size()); }
+
+	// Results are stored by image index, independent of the thread count
+	void Decode(ThreadPool* pPool, std::vector<DecodedImage>& images) const;
+
+	bool DecodeImage(UINT imageIdx, DecodedImage& image) const;
+
+private:
+	struct ImageSource
+	{
+		const UINT8* pData;
+		UINT64 size;
+	};
+
+private:
+	TextureDecoder();
+
+	bool Init(const CookedModelView& cookedModel, const std::string& pathToModel, ModelLoadStats* pStats);
+
+private:
+	std::vector<ImageSource> m_sources;
+
+	// several images usually share one source file
+	std::unordered_map<UINT32, MappedFile*> m_sourceFiles;
+};
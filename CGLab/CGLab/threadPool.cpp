@@ -0,0 +1,53 @@
+#include "threadPool.h"
+#include "jobSystem.h"
+
+
+ThreadPool* ThreadPool::Create(UINT threadNum)
+{
+	ThreadPool* pPool = new ThreadPool();
+
+	if (pPool->Init(threadNum))
+	{
+		return pPool;
+	}
+
+	delete pPool;
+	return nullptr;
+}
+
+
+ThreadPool::ThreadPool()
+	: m_pJobSystem(nullptr)
+{}
+
+ThreadPool::~ThreadPool()
+{
+	delete m_pJobSystem;
+}
+
+
+bool ThreadPool::Init(UINT threadNum)
+{
+	m_pJobSystem = JobSystem::Create(threadNum);
+
+	return m_pJobSystem != nullptr;
+}
+
+
+UINT ThreadPool::GetThreadNum() const
+{
+	return m_pJobSystem->GetThreadNum();
+}
+
+void ThreadPool::ParallelFor(UINT count, const std::function<void(UINT)>& task)
+{
+	// callers already hand over chunks of work, so every index is a job
+	m_pJobSystem->ParallelFor(count, 1, [&task](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				task(static_cast<UINT>(i));
+			}
+		}
+	);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "framework.h"
+
+class JobSystem;
+
+
+// Fixed set of worker threads for data parallel CPU work, backed by a work stealing JobSystem.
+// ParallelFor is called from one owner thread at a time or from jobs of the pool,
+// the calling thread takes part in the work.
+class ThreadPool
+{
+public:
+	// threadNum counts the calling thread, 0 picks the hardware thread count
+	static ThreadPool* Create(UINT threadNum = 0);
+
+	~ThreadPool();
+
+	UINT GetThreadNum() const;
+	inline JobSystem* GetJobSystem() const { return m_pJobSystem; }
+
+	// Runs task(i) for every i in [0, count) and returns when all of them are done
+	void ParallelFor(UINT count, const std::function<void(UINT)>& task);
+
+private:
+	ThreadPool();
+
+	bool Init(UINT threadNum);
+
+private:
+	JobSystem* m_pJobSystem;
+};
@@ -7,6 +7,7 @@
 #include "common.h"
 #include "shaderCompiler.h"
 #include "rendererContext.h"
+#include "transientTexturePool.h"
 
 
 struct ExposureBuffer
@@ -14,9 +15,9 @@ struct ExposureBuffer
 	DirectX::XMFLOAT4 exposure;
 };
 
-ToneMapping* ToneMapping::CreateToneMapping(RendererContext* pContext, UINT maxWindowSize)
+ToneMapping* ToneMapping::CreateToneMapping(RendererContext* pContext)
 {
-	ToneMapping* pToneMapping = new ToneMapping(pContext, maxWindowSize);
+	ToneMapping* pToneMapping = new ToneMapping(pContext);
 
 	HRESULT hr = pToneMapping->CreatePipelineStateObjects();
 
@@ -36,23 +37,19 @@ ToneMapping* ToneMapping::CreateToneMapping(RendererContext* pContext, UINT maxW
 }
 
 
-ToneMapping::ToneMapping(RendererContext* pContext, UINT maxWindowSize)
+ToneMapping::ToneMapping(RendererContext* pContext)
 	: m_pContext(pContext)
 	, m_pRasterizerState(nullptr)
 	, m_pMinMagLinearSampler(nullptr)
 	, m_pToneMappingVS(nullptr)
 	, m_pToneMappingPS(nullptr)
-	, m_adaptedBrightness(1.0f)
-	, m_textureSize(MinPower2(maxWindowSize, maxWindowSize))
-	, m_mipsNum(GetPowerOf2(m_textureSize))
-	, m_mostDetailedMip(0)
-	, m_pExposureTexture(nullptr)
 	, m_pExposureDstTexture(nullptr)
 	, m_pAverageBrightnessVS(nullptr)
 	, m_pAverageBrightnessPS(nullptr)
 	, m_pDownSampleVS(nullptr)
 	, m_pDownSamplePS(nullptr)
 	, m_pExposureBuffer(nullptr)
+	, m_adaptedBrightness(1.0f)
 {}
 
 ToneMapping::~ToneMapping()
@@ -62,22 +59,11 @@ ToneMapping::~ToneMapping()
 	SafeRelease(m_pToneMappingVS);
 	SafeRelease(m_pMinMagLinearSampler);
 	SafeRelease(m_pRasterizerState);
-	SafeRelease(m_pExposureTexture);
 	SafeRelease(m_pAverageBrightnessVS);
 	SafeRelease(m_pAverageBrightnessPS);
 	SafeRelease(m_pDownSampleVS);
 	SafeRelease(m_pDownSamplePS);
 	SafeRelease(m_pExposureDstTexture);
-
-	for (auto& srv : m_exposureTextureSRVs)
-	{
-		SafeRelease(srv);
-	}
-
-	for (auto& rtv : m_exposureTextureRTVs)
-	{
-		SafeRelease(rtv);
-	}
 }
 
 
@@ -175,23 +161,6 @@ HRESULT ToneMapping::CreateResources()
 
 	HRESULT hr = pDevice->CreateBuffer(&constantBufferDesc, nullptr, &m_pExposureBuffer);
 
-	if (SUCCEEDED(hr))
-	{
-		D3D11_TEXTURE2D_DESC exposureDesc = {};
-		exposureDesc.Format = DXGI_FORMAT_R32_FLOAT;
-		exposureDesc.Width = m_textureSize;
-		exposureDesc.Height = m_textureSize;
-		exposureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-		exposureDesc.Usage = D3D11_USAGE_DEFAULT;
-		exposureDesc.CPUAccessFlags = 0;
-		exposureDesc.ArraySize = 1;
-		exposureDesc.MipLevels = m_mipsNum + 1;
-		exposureDesc.SampleDesc.Count = 1;
-		exposureDesc.SampleDesc.Quality = 0;
-
-		hr = pDevice->CreateTexture2D(&exposureDesc, nullptr, &m_pExposureTexture);
-	}
-
 	if (SUCCEEDED(hr))
 	{
 		D3D11_TEXTURE2D_DESC exposureDstDesc = {};
@@ -209,53 +178,6 @@ HRESULT ToneMapping::CreateResources()
 		hr = pDevice->CreateTexture2D(&exposureDstDesc, nullptr, &m_pExposureDstTexture);
 	}
 
-	if (SUCCEEDED(hr))
-	{
-		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-		srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
-		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-		srvDesc.Texture2D.MipLevels = 1;
-		srvDesc.Texture2D.MostDetailedMip = 0;
-
-		for (UINT i = 0, textureSize = m_textureSize; textureSize > 0; textureSize >>= 1, ++i)
-		{
-			srvDesc.Texture2D.MostDetailedMip = i;
-
-			ID3D11ShaderResourceView* pSrv = nullptr;
-			hr = pDevice->CreateShaderResourceView(m_pExposureTexture, &srvDesc, &pSrv);
-
-			if (FAILED(hr))
-			{
-				break;
-			}
-
-			m_exposureTextureSRVs.push_back(pSrv);
-		}
-	}
-
-	if (SUCCEEDED(hr))
-	{
-		D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
-		rtvDesc.Format = DXGI_FORMAT_R32_FLOAT;
-		rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-		rtvDesc.Texture2D.MipSlice = 0;
-
-		for (UINT i = 0, textureSize = m_textureSize; textureSize > 0; textureSize >>= 1, ++i)
-		{
-			rtvDesc.Texture2D.MipSlice = i;
-
-			ID3D11RenderTargetView* pRtv = nullptr;
-			hr = pDevice->CreateRenderTargetView(m_pExposureTexture, &rtvDesc, &pRtv);
-
-			if (FAILED(hr))
-			{
-				break;
-			}
-
-			m_exposureTextureRTVs.push_back(pRtv);
-		}
-	}
-
 	return hr;
 }
 
@@ -266,14 +188,9 @@ FLOAT ToneMapping::EyeAdaptation(FLOAT currentExposure, FLOAT deltaTime) const
 }
 
 
-UINT ToneMapping::DefaineMostDetailedMip(UINT width, UINT height) const
+UINT ToneMapping::GetExposureTextureSize(UINT renderTargetWidth, UINT renderTargetHeight)
 {
-	UINT textureSize = MinPower2(width, height);
-	UINT pow2 = GetPowerOf2(textureSize);
-
-	assert(pow2 <= m_mipsNum);
-
-	return m_mipsNum - pow2;
+	return MinPower2(renderTargetWidth, renderTargetHeight);
 }
 
 
@@ -287,21 +204,17 @@ void ToneMapping::Update(FLOAT averageBrightness, FLOAT deltaTime)
 	m_pContext->GetContext()->UpdateSubresource(m_pExposureBuffer, 0, nullptr, &exposureBuffer, 0, 0);
 }
 
-FLOAT ToneMapping::CalculateAverageBrightness(
-	ID3D11ShaderResourceView* pSrcTextureSRV,
-	UINT renderTargetWidth,
-	UINT renderTargetHeight
-	)
+FLOAT ToneMapping::CalculateAverageBrightness(ID3D11ShaderResourceView* pSrcTextureSRV, const TransientTexture& exposureTexture)
 {
 	ID3D11DeviceContext* pContext = m_pContext->GetContext();
 
 	m_pContext->BeginEvent(L"Average Brightness");
 
-	UINT textureSize = MinPower2(renderTargetWidth, renderTargetHeight);
+	UINT textureSize = exposureTexture.desc.width;
 
 	pContext->ClearState();
 
-	pContext->OMSetRenderTargets(1, &m_exposureTextureRTVs[m_mostDetailedMip], nullptr);
+	pContext->OMSetRenderTargets(1, &exposureTexture.RTVs[0], nullptr);
 
 	D3D11_VIEWPORT viewport = {};
 	viewport.TopLeftY = 0;
@@ -335,7 +248,7 @@ FLOAT ToneMapping::CalculateAverageBrightness(
 	pContext->VSSetShader(m_pDownSampleVS, nullptr, 0);
 	pContext->PSSetShader(m_pDownSamplePS, nullptr, 0);
 
-	UINT i = m_mostDetailedMip;
+	UINT i = 0;
 
 	for (UINT n = textureSize >> 1; n > 0; n >>= 1, ++i)
 	{
@@ -345,17 +258,17 @@ FLOAT ToneMapping::CalculateAverageBrightness(
 		rect.right = n;
 		rect.bottom = n;
 
-		pContext->OMSetRenderTargets(1, &m_exposureTextureRTVs[(size_t)i + 1], nullptr);
+		pContext->OMSetRenderTargets(1, &exposureTexture.RTVs[(size_t)i + 1], nullptr);
 
 		pContext->RSSetViewports(1, &viewport);
 		pContext->RSSetScissorRects(1, &rect);
 
-		pContext->PSSetShaderResources(0, 1, &m_exposureTextureSRVs[i]);
+		pContext->PSSetShaderResources(0, 1, &exposureTexture.SRVs[i]);
 
 		pContext->Draw(4, 0);
 	}
 
-	pContext->CopySubresourceRegion(m_pExposureDstTexture, 0, 0, 0, 0, m_pExposureTexture, i, nullptr);
+	pContext->CopySubresourceRegion(m_pExposureDstTexture, 0, 0, 0, 0, exposureTexture.pTexture, i, nullptr);
 
 	D3D11_MAPPED_SUBRESOURCE resourceDesc = {};
 	auto hr = pContext->Map(m_pExposureDstTexture, 0, D3D11_MAP_READ, 0, &resourceDesc);
@@ -369,20 +282,20 @@ FLOAT ToneMapping::CalculateAverageBrightness(
 }
 
 
+void ToneMapping::CalculateExposure(ID3D11ShaderResourceView* pSrcTextureSRV, const TransientTexture& exposureTexture, FLOAT deltaTime)
+{
+	Update(CalculateAverageBrightness(pSrcTextureSRV, exposureTexture), deltaTime);
+}
+
 HRESULT ToneMapping::ToneMap(
 	ID3D11ShaderResourceView* pSrcTextureSRV,
 	ID3D11RenderTargetView* pDstTextureRTV,
 	UINT renderTargetWidth,
-	UINT renderTargetHeight,
-	FLOAT deltaTime
+	UINT renderTargetHeight
 )
 {
 	ID3D11DeviceContext* pContext = m_pContext->GetContext();
 
-	m_mostDetailedMip = DefaineMostDetailedMip(renderTargetWidth, renderTargetHeight);
-
-	Update(CalculateAverageBrightness(pSrcTextureSRV, renderTargetWidth, renderTargetHeight), deltaTime);
-
 	m_pContext->BeginEvent(L"Tone Mapping");
 
 	pContext->ClearState();
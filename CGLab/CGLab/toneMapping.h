@@ -16,25 +16,34 @@ struct ID3D11Buffer;
 struct ID3DUserDefinedAnnotation;
 
 class ShaderCompiler;
+struct TransientTexture;
 
 
 class ToneMapping
 {
 public:
-	static ToneMapping* CreateToneMapping(RendererContext* pContext, UINT maxWindowSize);
+	// the exposure texture is a square with all mips, the render graph owns it
+	static constexpr DXGI_FORMAT ExposureTextureFormat = DXGI_FORMAT_R32_FLOAT;
+
+	static ToneMapping* CreateToneMapping(RendererContext* pContext);
 
 	~ToneMapping();
 
+	// largest power of 2 fitting into the render target
+	static UINT GetExposureTextureSize(UINT renderTargetWidth, UINT renderTargetHeight);
+
+	// Downsamples the brightness of the source into the exposure texture and adapts the exposure to it
+	void CalculateExposure(ID3D11ShaderResourceView* pSrcTextureSRV, const TransientTexture& exposureTexture, FLOAT deltaTime);
+
 	HRESULT ToneMap(
 		ID3D11ShaderResourceView* pSrcTextureSRV,
 		ID3D11RenderTargetView* pDstTextureRTV,
 		UINT renderTargetWidth,
-		UINT renderTargetHeight,
-		FLOAT deltaTime
+		UINT renderTargetHeight
 	);
 
 private:
-	ToneMapping(RendererContext* pContext, UINT maxWindowSize);
+	ToneMapping(RendererContext* pContext);
 
 	HRESULT CreatePipelineStateObjects();
 	HRESULT CreateResources();
@@ -43,12 +52,7 @@ private:
 
 	void Update(FLOAT currentExposure, FLOAT deltaTime);
 
-	FLOAT CalculateAverageBrightness(
-		ID3D11ShaderResourceView* pSrcTextureSRV,
-		UINT renderTargetWidth,
-		UINT renderTargetHeight);
-
-	UINT DefaineMostDetailedMip(UINT width, UINT height) const;
+	FLOAT CalculateAverageBrightness(ID3D11ShaderResourceView* pSrcTextureSRV, const TransientTexture& exposureTexture);
 
 private:
 	RendererContext* m_pContext;
@@ -59,10 +63,7 @@ private:
 	ID3D11VertexShader* m_pToneMappingVS;
 	ID3D11PixelShader* m_pToneMappingPS;
 
-	ID3D11Texture2D* m_pExposureTexture;
 	ID3D11Texture2D* m_pExposureDstTexture;
-	std::vector<ID3D11ShaderResourceView*> m_exposureTextureSRVs;
-	std::vector<ID3D11RenderTargetView*> m_exposureTextureRTVs;
 
 	ID3D11VertexShader* m_pAverageBrightnessVS;
 	ID3D11PixelShader* m_pAverageBrightnessPS;
@@ -70,10 +71,6 @@ private:
 	ID3D11VertexShader* m_pDownSampleVS;
 	ID3D11PixelShader* m_pDownSamplePS;
 
-	UINT m_textureSize;
-	UINT m_mipsNum;
-	UINT m_mostDetailedMip;
-
 	ID3D11Buffer* m_pExposureBuffer;
 	FLOAT m_adaptedBrightness;
 };
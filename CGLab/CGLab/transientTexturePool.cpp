@@ -0,0 +1,401 @@
+#include "transientTexturePool.h"
+#include "rendererContext.h"
+
+#include <d3d11_2.h>
+#include <algorithm>
+
+
+static constexpr UINT TileSize = D3D11_2_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+
+
+UINT getTexelSize(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		return 16;
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		return 8;
+	default:
+		// 8 bit color, 32 bit depth and single channel float formats
+		return 4;
+	}
+}
+
+DXGI_FORMAT getDepthViewFormat(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R24G8_TYPELESS:
+		return DXGI_FORMAT_D24_UNORM_S8_UINT;
+	case DXGI_FORMAT_R32_TYPELESS:
+		return DXGI_FORMAT_D32_FLOAT;
+	default:
+		return format;
+	}
+}
+
+DXGI_FORMAT getShaderViewFormat(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R24G8_TYPELESS:
+		return DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+	case DXGI_FORMAT_R32_TYPELESS:
+		return DXGI_FORMAT_R32_FLOAT;
+	default:
+		return format;
+	}
+}
+
+
+RenderGraphTextureDesc CreateTransientTextureDesc(DXGI_FORMAT format, UINT width, UINT height, UINT bindFlags)
+{
+	RenderGraphTextureDesc desc;
+	desc.width = width;
+	desc.height = height;
+	desc.format = static_cast<uint32_t>(format);
+	desc.bindFlags = bindFlags;
+	desc.texelSize = getTexelSize(format);
+
+	return desc;
+}
+
+
+TransientTexturePool* TransientTexturePool::Create(RendererContext* pContext)
+{
+	TransientTexturePool* pPool = new TransientTexturePool(pContext);
+	pPool->Init();
+
+	return pPool;
+}
+
+
+TransientTexturePool::TransientTexturePool(RendererContext* pContext)
+	: m_pContext(pContext)
+	, m_pDevice2(nullptr)
+	, m_pContext2(nullptr)
+	, m_pTilePool(nullptr)
+	, m_tilePoolSize(0)
+	, m_createdNum(0)
+{}
+
+TransientTexturePool::~TransientTexturePool()
+{
+	for (auto& texture : m_textures)
+	{
+		ReleaseTexture(texture);
+	}
+
+	SafeRelease(m_pTilePool);
+	SafeRelease(m_pContext2);
+	SafeRelease(m_pDevice2);
+}
+
+
+void TransientTexturePool::Init()
+{
+	D3D11_FEATURE_DATA_D3D11_OPTIONS1 options = {};
+	HRESULT hr = m_pContext->GetDevice()->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS1, &options, sizeof(options));
+
+	if (FAILED(hr) || options.TiledResourcesTier == D3D11_TILED_RESOURCES_NOT_SUPPORTED)
+	{
+		return;
+	}
+
+	if (FAILED(m_pContext->GetDevice()->QueryInterface(IID_PPV_ARGS(&m_pDevice2)))
+		|| FAILED(m_pContext->GetContext()->QueryInterface(IID_PPV_ARGS(&m_pContext2))))
+	{
+		SafeRelease(m_pDevice2);
+		SafeRelease(m_pContext2);
+	}
+}
+
+
+HRESULT TransientTexturePool::Allocate(RenderGraph& graph)
+{
+	return IsTiled() ? AllocateTiled(graph) : AllocatePhysical(graph);
+}
+
+HRESULT TransientTexturePool::AllocatePhysical(const RenderGraph& graph)
+{
+	std::vector<TransientTexture> oldTextures = std::move(m_textures);
+
+	m_textures.clear();
+	m_textures.resize(graph.GetPhysicalTextureNum());
+
+	HRESULT hr = S_OK;
+
+	for (UINT physicalIdx = 0; physicalIdx < m_textures.size() && SUCCEEDED(hr); ++physicalIdx)
+	{
+		const RenderGraphTextureDesc& desc = graph.GetPhysicalTextureDesc(physicalIdx);
+
+		auto oldTexture = std::find_if(oldTextures.begin(), oldTextures.end(), [&](const TransientTexture& texture)
+		{
+			return texture.pTexture != nullptr && texture.desc.IsCompatible(desc);
+		});
+
+		if (oldTexture != oldTextures.end())
+		{
+			m_textures[physicalIdx] = std::move(*oldTexture);
+			*oldTexture = {};
+		}
+		else
+		{
+			hr = CreateTexture(desc, false, m_textures[physicalIdx]);
+		}
+	}
+
+	for (auto& texture : oldTextures)
+	{
+		ReleaseTexture(texture);
+	}
+
+	m_physicalIndices.resize(graph.GetTextureNum());
+
+	for (RenderGraph::ResourceId resource = 0; resource < graph.GetTextureNum(); ++resource)
+	{
+		m_physicalIndices[resource] = graph.GetPhysicalTexture(resource);
+	}
+
+	return hr;
+}
+
+HRESULT TransientTexturePool::AllocateTiled(RenderGraph& graph)
+{
+	std::vector<TransientTexture> oldTextures = std::move(m_textures);
+
+	m_textures.clear();
+	m_textures.resize(graph.GetTextureNum());
+	m_physicalIndices.resize(graph.GetTextureNum());
+
+	std::vector<uint64_t> heapSizes(graph.GetTextureNum(), 0);
+
+	HRESULT hr = S_OK;
+
+	for (RenderGraph::ResourceId resource = 0; resource < graph.GetTextureNum() && SUCCEEDED(hr); ++resource)
+	{
+		m_physicalIndices[resource] = resource;
+
+		if (graph.GetPhysicalTexture(resource) == RenderGraph::InvalidIndex)
+		{
+			continue;
+		}
+
+		const RenderGraphTextureDesc& desc = graph.GetTextureDesc(resource);
+
+		auto oldTexture = std::find_if(oldTextures.begin(), oldTextures.end(), [&](const TransientTexture& texture)
+		{
+			return texture.pTexture != nullptr && texture.desc.IsCompatible(desc);
+		});
+
+		if (oldTexture != oldTextures.end())
+		{
+			m_textures[resource] = std::move(*oldTexture);
+			*oldTexture = {};
+		}
+		else
+		{
+			hr = CreateTexture(desc, true, m_textures[resource]);
+		}
+
+		heapSizes[resource] = static_cast<uint64_t>(m_textures[resource].tileNum) * TileSize;
+	}
+
+	for (auto& texture : oldTextures)
+	{
+		ReleaseTexture(texture);
+	}
+
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	graph.PlaceTextures(heapSizes);
+
+	return MapTiles(graph);
+}
+
+HRESULT TransientTexturePool::MapTiles(const RenderGraph& graph)
+{
+	UINT64 heapSize = (std::max)(graph.GetStats().heapSize, static_cast<uint64_t>(TileSize));
+	HRESULT hr = S_OK;
+
+	// the pool only grows, so switching back to a smaller graph does not reallocate it
+	if (m_pTilePool == nullptr)
+	{
+		D3D11_BUFFER_DESC tilePoolDesc = CreateDefaultBufferDesc(static_cast<UINT>(heapSize), 0);
+		tilePoolDesc.MiscFlags = D3D11_RESOURCE_MISC_TILE_POOL;
+
+		hr = m_pContext->GetDevice()->CreateBuffer(&tilePoolDesc, nullptr, &m_pTilePool);
+		m_tilePoolSize = SUCCEEDED(hr) ? heapSize : 0;
+	}
+	else if (heapSize > m_tilePoolSize)
+	{
+		hr = m_pContext2->ResizeTilePool(m_pTilePool, heapSize);
+		m_tilePoolSize = SUCCEEDED(hr) ? heapSize : m_tilePoolSize;
+	}
+
+	for (RenderGraph::ResourceId resource = 0; resource < graph.GetTextureNum() && SUCCEEDED(hr); ++resource)
+	{
+		const TransientTexture& texture = m_textures[resource];
+
+		if (texture.tileNum == 0)
+		{
+			continue;
+		}
+
+		// all tiles of the texture, packed mips included, in one range from its heap offset
+		D3D11_TILED_RESOURCE_COORDINATE coordinate = {};
+		D3D11_TILE_REGION_SIZE regionSize = {};
+		regionSize.NumTiles = texture.tileNum;
+		regionSize.bUseBox = FALSE;
+
+		UINT rangeFlags = 0;
+		UINT tilePoolOffset = static_cast<UINT>(graph.GetHeapOffset(resource) / TileSize);
+		UINT rangeTileNum = texture.tileNum;
+
+		hr = m_pContext2->UpdateTileMappings(texture.pTexture, 1, &coordinate, &regionSize, m_pTilePool, 1, &rangeFlags, &tilePoolOffset, &rangeTileNum, 0);
+	}
+
+	return hr;
+}
+
+void TransientTexturePool::BeginPass(const RenderGraph& graph, RenderGraph::PassId passId)
+{
+	ID3D11DeviceContext* pContext = m_pContext->GetContext();
+
+	// the runtime tracks the hazards itself, a texture still bound as a target only
+	// has to be unbound before it is read
+	for (const auto& barrier : graph.GetPassBarriers(passId))
+	{
+		if (barrier.isRead)
+		{
+			pContext->OMSetRenderTargets(0, nullptr, nullptr);
+			break;
+		}
+	}
+
+	// the heap offsets of a graph placed without tiled resources are never mapped
+	for (const auto& barrier : graph.GetPassAliasBarriers(passId))
+	{
+		if (IsTiled())
+		{
+			m_pContext2->TiledResourceBarrier(GetTexture(barrier.before).pTexture, GetTexture(barrier.after).pTexture);
+		}
+	}
+
+	for (RenderGraph::ResourceId resource : graph.GetPassClears(passId))
+	{
+		const TransientTexture& texture = GetTexture(resource);
+		const float* clearValue = graph.GetTextureDesc(resource).clearValue;
+
+		if (texture.pDSV != nullptr)
+		{
+			pContext->ClearDepthStencilView(texture.pDSV, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, clearValue[0], static_cast<UINT8>(clearValue[1]));
+		}
+		else
+		{
+			pContext->ClearRenderTargetView(texture.RTVs[0], clearValue);
+		}
+	}
+}
+
+
+HRESULT TransientTexturePool::CreateTexture(const RenderGraphTextureDesc& desc, bool isTiled, TransientTexture& texture)
+{
+	ID3D11Device* pDevice = m_pContext->GetDevice();
+
+	DXGI_FORMAT format = static_cast<DXGI_FORMAT>(desc.format);
+
+	D3D11_TEXTURE2D_DESC textureDesc = CreateDefaultTexture2DDesc(format, desc.width, desc.height, desc.bindFlags);
+	textureDesc.ArraySize = desc.arraySize;
+	textureDesc.MipLevels = desc.mipLevels;
+	textureDesc.MiscFlags = isTiled ? D3D11_RESOURCE_MISC_TILED : 0;
+
+	texture.desc = desc;
+	texture.tileNum = 0;
+
+	HRESULT hr = pDevice->CreateTexture2D(&textureDesc, nullptr, &texture.pTexture);
+
+	// formats and bind flags the tier can not tile keep memory of their own
+	if (FAILED(hr) && isTiled)
+	{
+		textureDesc.MiscFlags = 0;
+		hr = pDevice->CreateTexture2D(&textureDesc, nullptr, &texture.pTexture);
+	}
+	else if (isTiled)
+	{
+		m_pDevice2->GetResourceTiling(texture.pTexture, &texture.tileNum, nullptr, nullptr, nullptr, 0, nullptr);
+	}
+
+	// the array views begin with the fields of the single texture ones
+	bool isArray = desc.arraySize > 1;
+
+	if (SUCCEEDED(hr) && (desc.bindFlags & D3D11_BIND_DEPTH_STENCIL))
+	{
+		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+		dsvDesc.Format = getDepthViewFormat(format);
+		dsvDesc.ViewDimension = isArray ? D3D11_DSV_DIMENSION_TEXTURE2DARRAY : D3D11_DSV_DIMENSION_TEXTURE2D;
+		dsvDesc.Texture2DArray.MipSlice = 0;
+		dsvDesc.Texture2DArray.FirstArraySlice = 0;
+		dsvDesc.Texture2DArray.ArraySize = desc.arraySize;
+
+		hr = pDevice->CreateDepthStencilView(texture.pTexture, &dsvDesc, &texture.pDSV);
+	}
+
+	for (UINT mip = 0; mip < desc.mipLevels && SUCCEEDED(hr) && (desc.bindFlags & D3D11_BIND_RENDER_TARGET); ++mip)
+	{
+		D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
+		rtvDesc.Format = format;
+		rtvDesc.ViewDimension = isArray ? D3D11_RTV_DIMENSION_TEXTURE2DARRAY : D3D11_RTV_DIMENSION_TEXTURE2D;
+		rtvDesc.Texture2DArray.MipSlice = mip;
+		rtvDesc.Texture2DArray.FirstArraySlice = 0;
+		rtvDesc.Texture2DArray.ArraySize = desc.arraySize;
+
+		ID3D11RenderTargetView* pRTV = nullptr;
+		hr = pDevice->CreateRenderTargetView(texture.pTexture, &rtvDesc, &pRTV);
+
+		texture.RTVs.push_back(pRTV);
+	}
+
+	for (UINT mip = 0; mip < desc.mipLevels && SUCCEEDED(hr) && (desc.bindFlags & D3D11_BIND_SHADER_RESOURCE); ++mip)
+	{
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = getShaderViewFormat(format);
+		srvDesc.ViewDimension = isArray ? D3D11_SRV_DIMENSION_TEXTURE2DARRAY : D3D11_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2DArray.MostDetailedMip = mip;
+		srvDesc.Texture2DArray.MipLevels = 1;
+		srvDesc.Texture2DArray.FirstArraySlice = 0;
+		srvDesc.Texture2DArray.ArraySize = desc.arraySize;
+
+		ID3D11ShaderResourceView* pSRV = nullptr;
+		hr = pDevice->CreateShaderResourceView(texture.pTexture, &srvDesc, &pSRV);
+
+		texture.SRVs.push_back(pSRV);
+	}
+
+	++m_createdNum;
+
+	return hr;
+}
+
+void TransientTexturePool::ReleaseTexture(TransientTexture& texture)
+{
+	for (auto& pRTV : texture.RTVs)
+	{
+		SafeRelease(pRTV);
+	}
+
+	for (auto& pSRV : texture.SRVs)
+	{
+		SafeRelease(pSRV);
+	}
+
+	texture.RTVs.clear();
+	texture.SRVs.clear();
+
+	SafeRelease(texture.pDSV);
+	SafeRelease(texture.pTexture);
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "framework.h"
+#include "renderGraph.h"
+
+class RendererContext;
+struct ID3D11Device2;
+struct ID3D11DeviceContext2;
+
+
+// Desc of a render graph texture with the texel size of a D3D11 format
+RenderGraphTextureDesc CreateTransientTextureDesc(DXGI_FORMAT format, UINT width, UINT height, UINT bindFlags);
+
+
+// Physical texture of the render graph with a render target and shader resource view per mip
+struct TransientTexture
+{
+	ID3D11Texture2D* pTexture = nullptr;
+	ID3D11DepthStencilView* pDSV = nullptr;
+	std::vector<ID3D11RenderTargetView*> RTVs;
+	std::vector<ID3D11ShaderResourceView*> SRVs;
+
+	RenderGraphTextureDesc desc;
+	// 64KB tiles the texture maps from the tile pool, 0 when it has memory of its own
+	UINT tileNum = 0;
+};
+
+
+// D3D11 side of the render graph. D3D11 has no placed resources, with tiled resources (D3D11.2)
+// every transient texture is a tiled texture mapped to its heap offset in one tile pool,
+// so textures whose lifetimes do not overlap share memory whatever their descs are.
+// A texture that can not be tiled gets memory of its own. Without tiled resources textures
+// share memory only as one physical texture of a compatible desc.
+// Typeless depth formats get depth and shader resource views of the matching formats.
+class TransientTexturePool
+{
+public:
+	static TransientTexturePool* Create(RendererContext* pContext);
+
+	~TransientTexturePool();
+
+	// Creates the textures of a compiled graph, those matching textures of the last graph are kept.
+	// With tiled resources the graph places the textures again with their sizes in tiles
+	HRESULT Allocate(RenderGraph& graph);
+	// Unbinds the targets of the textures the pass is going to read, waits for the textures
+	// that used the memory of those starting in the pass and clears those it uses first
+	void BeginPass(const RenderGraph& graph, RenderGraph::PassId passId);
+
+	inline const TransientTexture& GetTexture(RenderGraph::ResourceId resource) const { return m_textures[m_physicalIndices[resource]]; }
+	inline ID3D11RenderTargetView* GetRTV(RenderGraph::ResourceId resource, UINT mip = 0) const { return GetTexture(resource).RTVs[mip]; }
+	inline ID3D11ShaderResourceView* GetSRV(RenderGraph::ResourceId resource, UINT mip = 0) const { return GetTexture(resource).SRVs[mip]; }
+	inline ID3D11DepthStencilView* GetDSV(RenderGraph::ResourceId resource) const { return GetTexture(resource).pDSV; }
+
+	// textures created by Allocate calls so far
+	inline size_t GetCreatedNum() const { return m_createdNum; }
+	inline bool IsTiled() const { return m_pContext2 != nullptr; }
+	inline UINT64 GetTilePoolSize() const { return m_tilePoolSize; }
+
+private:
+	TransientTexturePool(RendererContext* pContext);
+
+	void Init();
+
+	HRESULT AllocatePhysical(const RenderGraph& graph);
+	HRESULT AllocateTiled(RenderGraph& graph);
+	HRESULT MapTiles(const RenderGraph& graph);
+
+	HRESULT CreateTexture(const RenderGraphTextureDesc& desc, bool isTiled, TransientTexture& texture);
+	void ReleaseTexture(TransientTexture& texture);
+
+private:
+	RendererContext* m_pContext;
+	ID3D11Device2* m_pDevice2;
+	ID3D11DeviceContext2* m_pContext2;
+
+	ID3D11Buffer* m_pTilePool;
+	UINT64 m_tilePoolSize;
+
+	// one per physical texture of the graph, or per texture with tiled resources
+	std::vector<TransientTexture> m_textures;
+	std::vector<UINT> m_physicalIndices;
+
+	size_t m_createdNum;
+};
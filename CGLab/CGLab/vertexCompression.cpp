@@ -0,0 +1,311 @@
+#include "vertexCompression.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+
+static_assert(sizeof(CompactVertex) == 24, "unexpected CompactVertex layout");
+static_assert(sizeof(QuantizedVertex) == 20, "unexpected QuantizedVertex layout");
+
+static constexpr float RadToDeg = 180.0f / DirectX::XM_PI;
+
+static constexpr UINT NormalCodeMax = 65534;		// snorm16, [-32767, 32767]
+static constexpr UINT TangentCodeMaxX = 65535;
+static constexpr UINT TangentCodeMaxY = 32767;	// the lowest bit is the bitangent sign
+static constexpr UINT Unorm16Max = 65535;
+
+
+DirectX::XMVECTOR decodeOctahedral(UINT x, UINT y, UINT xMax, UINT yMax)
+{
+	float u = x * 2.0f / xMax - 1.0f;
+	float v = y * 2.0f / yMax - 1.0f;
+	float z = 1.0f - fabsf(u) - fabsf(v);
+
+	// lower hemisphere is folded over the diagonals
+	float t = (std::max)(-z, 0.0f);
+	u += u >= 0.0f ? -t : t;
+	v += v >= 0.0f ? -t : t;
+
+	return DirectX::XMVector3Normalize(DirectX::XMVectorSet(u, v, z, 0.0f));
+}
+
+// Code on a [0, xMax] x [0, yMax] grid spanning [-1, 1]. Of the four codes around the
+// projected direction the one that decodes closest to it is kept.
+void encodeOctahedral(DirectX::FXMVECTOR direction, UINT xMax, UINT yMax, UINT& x, UINT& y)
+{
+	DirectX::XMFLOAT3 d;
+	DirectX::XMStoreFloat3(&d, direction);
+
+	float l1 = fabsf(d.x) + fabsf(d.y) + fabsf(d.z);
+	float u = d.x / l1;
+	float v = d.y / l1;
+
+	if (d.z < 0.0f)
+	{
+		float foldedU = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		float foldedV = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		u = foldedU;
+		v = foldedV;
+	}
+
+	UINT baseX = static_cast<UINT>((std::min)(floorf((u * 0.5f + 0.5f) * xMax), static_cast<float>(xMax)));
+	UINT baseY = static_cast<UINT>((std::min)(floorf((v * 0.5f + 0.5f) * yMax), static_cast<float>(yMax)));
+
+	float bestDot = -2.0f;
+
+	for (UINT i = 0; i < 4; ++i)
+	{
+		UINT codeX = (std::min)(baseX + (i & 1), xMax);
+		UINT codeY = (std::min)(baseY + (i >> 1), yMax);
+
+		float dot = DirectX::XMVectorGetX(DirectX::XMVector3Dot(decodeOctahedral(codeX, codeY, xMax, yMax), direction));
+
+		if (dot > bestDot)
+		{
+			bestDot = dot;
+			x = codeX;
+			y = codeY;
+		}
+	}
+}
+
+float angleDeg(DirectX::FXMVECTOR a, DirectX::FXMVECTOR b)
+{
+	// atan2 stays accurate for the tiny angles quantization produces
+	float sinAngle = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVector3Cross(a, b)));
+	float cosAngle = DirectX::XMVectorGetX(DirectX::XMVector3Dot(a, b));
+
+	return atan2f(sinAngle, cosAngle) * RadToDeg;
+}
+
+UINT16 quantizeUnorm16(float value, float offset, float scale)
+{
+	float normalized = scale > 0.0f ? (value - offset) / scale : 0.0f;
+
+	return static_cast<UINT16>((std::min)((std::max)(normalized, 0.0f), 1.0f) * Unorm16Max + 0.5f);
+}
+
+float dequantizeUnorm16(UINT16 code, float offset, float scale)
+{
+	return static_cast<float>(code) / Unorm16Max * scale + offset;
+}
+
+DirectX::XMVECTOR loadDirection(const DirectX::XMFLOAT3& direction, DirectX::FXMVECTOR fallback)
+{
+	DirectX::XMVECTOR vector = DirectX::XMLoadFloat3(&direction);
+
+	if (DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(vector)) < 1e-12f)
+	{
+		return fallback;
+	}
+
+	return DirectX::XMVector3Normalize(vector);
+}
+
+
+template <class CompressedVertex>
+void encodeAttributes(
+	const Vertex& vertex,
+	const VertexDequantization& dequantization,
+	CompressedVertex& compressed,
+	VertexCompressionStats* pStats
+)
+{
+	UINT x = 0;
+	UINT y = 0;
+
+	DirectX::XMVECTOR normal = loadDirection(vertex.normal, DirectX::XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f));
+	encodeOctahedral(normal, NormalCodeMax, NormalCodeMax, x, y);
+
+	compressed.normal[0] = static_cast<INT16>(static_cast<INT32>(x) - static_cast<INT32>(NormalCodeMax / 2));
+	compressed.normal[1] = static_cast<INT16>(static_cast<INT32>(y) - static_cast<INT32>(NormalCodeMax / 2));
+
+	float normalError = angleDeg(decodeOctahedral(x, y, NormalCodeMax, NormalCodeMax), normal);
+
+	DirectX::XMFLOAT3 tangentDirection = { vertex.tangent.x, vertex.tangent.y, vertex.tangent.z };
+	DirectX::XMVECTOR tangent = loadDirection(tangentDirection, DirectX::XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f));
+	encodeOctahedral(tangent, TangentCodeMaxX, TangentCodeMaxY, x, y);
+
+	compressed.tangent[0] = static_cast<UINT16>(x);
+	compressed.tangent[1] = static_cast<UINT16>((y << 1) | (vertex.tangent.w < 0.0f ? 1u : 0u));
+
+	float tangentError = angleDeg(decodeOctahedral(x, y, TangentCodeMaxX, TangentCodeMaxY), tangent);
+
+	const DirectX::XMFLOAT4& uvTransform = dequantization.texCoordTransform;
+
+	compressed.texCoord[0] = quantizeUnorm16(vertex.texCoord.x, uvTransform.z, uvTransform.x);
+	compressed.texCoord[1] = quantizeUnorm16(vertex.texCoord.y, uvTransform.w, uvTransform.y);
+
+	float texCoordError = (std::max)(
+		fabsf(dequantizeUnorm16(compressed.texCoord[0], uvTransform.z, uvTransform.x) - vertex.texCoord.x),
+		fabsf(dequantizeUnorm16(compressed.texCoord[1], uvTransform.w, uvTransform.y) - vertex.texCoord.y)
+	);
+
+	if (pStats != nullptr)
+	{
+		pStats->maxNormalErrorDeg = (std::max)(pStats->maxNormalErrorDeg, normalError);
+		pStats->normalErrorSumDeg += normalError;
+		pStats->maxTangentErrorDeg = (std::max)(pStats->maxTangentErrorDeg, tangentError);
+		pStats->maxTexCoordErrorTexels = (std::max)(
+			pStats->maxTexCoordErrorTexels,
+			texCoordError * VertexCompressionStats::VertexErrorTextureSize
+		);
+	}
+}
+
+
+UINT GetVertexStride(VertexFormat format)
+{
+	switch (format)
+	{
+	case VertexFormat::Compact:
+		return sizeof(CompactVertex);
+
+	case VertexFormat::Quantized:
+		return sizeof(QuantizedVertex);
+
+	default:
+		break;
+	}
+
+	return sizeof(Vertex);
+}
+
+UINT GetPositionStride(VertexFormat format)
+{
+	return format == VertexFormat::Quantized ? sizeof(QuantizedVertex::position) : sizeof(DirectX::XMFLOAT3);
+}
+
+const char* GetVertexFormatName(VertexFormat format)
+{
+	switch (format)
+	{
+	case VertexFormat::Compact:
+		return "compact";
+
+	case VertexFormat::Quantized:
+		return "quantized";
+
+	default:
+		break;
+	}
+
+	return "float";
+}
+
+
+void CompressVertices(
+	const Vertex* pVertices,
+	size_t vertexCount,
+	VertexFormat format,
+	std::vector<BYTE>& data,
+	VertexDequantization& dequantization,
+	VertexCompressionStats* pStats
+)
+{
+	dequantization = VertexDequantization();
+	data.resize(vertexCount * GetVertexStride(format));
+
+	if (vertexCount == 0 || format == VertexFormat::Float)
+	{
+		memcpy(data.data(), pVertices, data.size());
+		return;
+	}
+
+	DirectX::XMVECTOR positionMin = DirectX::XMVectorReplicate(FLT_MAX);
+	DirectX::XMVECTOR positionMax = DirectX::XMVectorReplicate(-FLT_MAX);
+	DirectX::XMVECTOR texCoordMin = DirectX::XMVectorReplicate(FLT_MAX);
+	DirectX::XMVECTOR texCoordMax = DirectX::XMVectorReplicate(-FLT_MAX);
+
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		DirectX::XMVECTOR position = DirectX::XMLoadFloat3(&pVertices[v].position);
+		DirectX::XMVECTOR texCoord = DirectX::XMLoadFloat2(&pVertices[v].texCoord);
+
+		positionMin = DirectX::XMVectorMin(positionMin, position);
+		positionMax = DirectX::XMVectorMax(positionMax, position);
+		texCoordMin = DirectX::XMVectorMin(texCoordMin, texCoord);
+		texCoordMax = DirectX::XMVectorMax(texCoordMax, texCoord);
+	}
+
+	DirectX::XMFLOAT2 uvMin;
+	DirectX::XMFLOAT2 uvExtent;
+	DirectX::XMStoreFloat2(&uvMin, texCoordMin);
+	DirectX::XMStoreFloat2(&uvExtent, DirectX::XMVectorSubtract(texCoordMax, texCoordMin));
+
+	dequantization.texCoordTransform = { uvExtent.x, uvExtent.y, uvMin.x, uvMin.y };
+
+	if (format == VertexFormat::Quantized)
+	{
+		DirectX::XMStoreFloat4(&dequantization.positionScale, DirectX::XMVectorSubtract(positionMax, positionMin));
+		DirectX::XMStoreFloat4(&dequantization.positionOffset, positionMin);
+		dequantization.positionScale.w = 0.0f;
+		dequantization.positionOffset.w = 0.0f;
+	}
+
+	const DirectX::XMFLOAT4& scale = dequantization.positionScale;
+	const DirectX::XMFLOAT4& offset = dequantization.positionOffset;
+
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		const Vertex& vertex = pVertices[v];
+
+		if (format == VertexFormat::Compact)
+		{
+			CompactVertex& compressed = reinterpret_cast<CompactVertex*>(data.data())[v];
+
+			compressed.position = vertex.position;
+			encodeAttributes(vertex, dequantization, compressed, pStats);
+			continue;
+		}
+
+		QuantizedVertex& compressed = reinterpret_cast<QuantizedVertex*>(data.data())[v];
+
+		compressed.position[0] = quantizeUnorm16(vertex.position.x, offset.x, scale.x);
+		compressed.position[1] = quantizeUnorm16(vertex.position.y, offset.y, scale.y);
+		compressed.position[2] = quantizeUnorm16(vertex.position.z, offset.z, scale.z);
+		compressed.position[3] = 0;
+
+		encodeAttributes(vertex, dequantization, compressed, pStats);
+
+		if (pStats != nullptr)
+		{
+			float positionError = (std::max)({
+				fabsf(dequantizeUnorm16(compressed.position[0], offset.x, scale.x) - vertex.position.x),
+				fabsf(dequantizeUnorm16(compressed.position[1], offset.y, scale.y) - vertex.position.y),
+				fabsf(dequantizeUnorm16(compressed.position[2], offset.z, scale.z) - vertex.position.z)
+			});
+
+			pStats->maxPositionError = (std::max)(pStats->maxPositionError, positionError);
+		}
+	}
+
+	if (pStats != nullptr)
+	{
+		pStats->vertexCount += vertexCount;
+		pStats->sourceBytes += vertexCount * sizeof(Vertex);
+		pStats->compressedBytes += data.size();
+	}
+}
+
+
+void ExtractPositionStream(
+	const void* pVertexData,
+	size_t vertexCount,
+	VertexFormat format,
+	std::vector<BYTE>& positions
+)
+{
+	UINT vertexStride = GetVertexStride(format);
+	UINT positionStride = GetPositionStride(format);
+
+	positions.resize(vertexCount * positionStride);
+
+	const BYTE* pSource = static_cast<const BYTE*>(pVertexData);
+
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		memcpy(positions.data() + v * positionStride, pSource + v * vertexStride, positionStride);
+	}
+}
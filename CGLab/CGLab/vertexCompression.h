@@ -0,0 +1,84 @@
+#pragma once
+#include "framework.h"
+#include "rendererContext.h"
+
+
+// Vertex buffer layouts of model meshes. Models are cooked with float vertices
+// and converted on upload, the built-in meshes always stay Float.
+enum class VertexFormat
+{
+	Float,		// Vertex, 48 bytes
+	Compact,	// CompactVertex, 24 bytes
+	Quantized	// QuantizedVertex, 20 bytes
+};
+
+// Normal and tangent are octahedral encoded, the normal as R16G16_SNORM and the
+// tangent as R16G16_UINT with the bitangent sign in the lowest bit of y.
+// UVs are R16G16_UNORM relative to the UV bounds of the mesh.
+struct CompactVertex
+{
+	DirectX::XMFLOAT3 position;
+	INT16 normal[2];
+	UINT16 tangent[2];
+	UINT16 texCoord[2];
+};
+
+// CompactVertex with the position as R16G16B16A16_UNORM relative to the mesh bounds
+struct QuantizedVertex
+{
+	UINT16 position[4];
+	INT16 normal[2];
+	UINT16 tangent[2];
+	UINT16 texCoord[2];
+};
+
+// What the vertex shader needs to restore positions and UVs of a compressed mesh
+struct VertexDequantization
+{
+	DirectX::XMFLOAT4 positionScale = { 1.0f, 1.0f, 1.0f, 0.0f };
+	DirectX::XMFLOAT4 positionOffset = { 0.0f, 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT4 texCoordTransform = { 1.0f, 1.0f, 0.0f, 0.0f }; // xy - scale, zw - offset
+};
+
+// Largest errors of the decoded vertices against the source ones.
+// UV errors are given in texels of a VertexErrorTextureSize texture.
+struct VertexCompressionStats
+{
+	static constexpr UINT VertexErrorTextureSize = 4096;
+
+	size_t vertexCount = 0;
+	size_t sourceBytes = 0;
+	size_t compressedBytes = 0;
+
+	float maxNormalErrorDeg = 0.0f;
+	double normalErrorSumDeg = 0.0;
+	float maxTangentErrorDeg = 0.0f;
+
+	float maxTexCoordErrorTexels = 0.0f;
+	float maxPositionError = 0.0f;
+};
+
+
+UINT GetVertexStride(VertexFormat format);
+const char* GetVertexFormatName(VertexFormat format);
+
+// Every layout starts with the position, float3 or unorm16x4
+UINT GetPositionStride(VertexFormat format);
+
+// Converts float vertices into a Compact or Quantized vertex buffer
+void CompressVertices(
+	const Vertex* pVertices,
+	size_t vertexCount,
+	VertexFormat format,
+	std::vector<BYTE>& data,
+	VertexDequantization& dequantization,
+	VertexCompressionStats* pStats = nullptr
+);
+
+// Copies the positions of a vertex buffer of the given format into a tightly packed stream
+void ExtractPositionStream(
+	const void* pVertexData,
+	size_t vertexCount,
+	VertexFormat format,
+	std::vector<BYTE>& positions
+);
@@ -0,0 +1,473 @@
+#include "vertexInterleave.h"
+
+#include <intrin.h>
+#include <immintrin.h>
+#include <cfloat>
+
+// SIMD kernels store whole 16 byte registers and rely on every
+// store being overwritten by the next field of the same vertex
+static_assert(sizeof(Vertex) == 48, "unexpected Vertex layout");
+static_assert(offsetof(Vertex, normal) == 12, "unexpected Vertex layout");
+static_assert(offsetof(Vertex, tangent) == 24, "unexpected Vertex layout");
+static_assert(offsetof(Vertex, texCoord) == 40, "unexpected Vertex layout");
+
+
+struct StreamConstants
+{
+	float scale = 1.0f;
+	float minValue = -FLT_MAX;
+};
+
+StreamConstants defineStreamConstants(const AttributeStream& stream)
+{
+	StreamConstants constants;
+
+	if (!stream.normalized)
+	{
+		return constants;
+	}
+
+	switch (stream.componentType)
+	{
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		constants.scale = 1.0f / 255.0f;
+		break;
+
+	case TINYGLTF_COMPONENT_TYPE_BYTE:
+		constants.scale = 1.0f / 127.0f;
+		constants.minValue = -1.0f;
+		break;
+
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+		constants.scale = 1.0f / 65535.0f;
+		break;
+
+	case TINYGLTF_COMPONENT_TYPE_SHORT:
+		constants.scale = 1.0f / 32767.0f;
+		constants.minValue = -1.0f;
+		break;
+
+	default:
+		break;
+	}
+
+	return constants;
+}
+
+UINT32 loadUInt32(const UINT8* pData)
+{
+	UINT32 value;
+	memcpy(&value, pData, sizeof(value));
+
+	return value;
+}
+
+
+void loadAttributeScalar(const AttributeStream& stream, const StreamConstants& constants, size_t idx, float* pOut)
+{
+	const UINT8* pData = stream.pData + idx * stream.stride;
+
+	for (UINT i = 0; i < stream.componentNum; ++i)
+	{
+		float value = 0.0f;
+
+		switch (stream.componentType)
+		{
+		case TINYGLTF_COMPONENT_TYPE_FLOAT:
+			memcpy(&value, pData + i * sizeof(float), sizeof(float));
+			break;
+
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+			value = static_cast<float>(pData[i]);
+			break;
+
+		case TINYGLTF_COMPONENT_TYPE_BYTE:
+			value = static_cast<float>(static_cast<INT8>(pData[i]));
+			break;
+
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+		{
+			UINT16 component;
+			memcpy(&component, pData + i * sizeof(UINT16), sizeof(UINT16));
+			value = static_cast<float>(component);
+			break;
+		}
+
+		case TINYGLTF_COMPONENT_TYPE_SHORT:
+		{
+			INT16 component;
+			memcpy(&component, pData + i * sizeof(INT16), sizeof(INT16));
+			value = static_cast<float>(component);
+			break;
+		}
+
+		default:
+			break;
+		}
+
+		pOut[i] = (std::max)(value * constants.scale, constants.minValue);
+	}
+}
+
+void interleaveScalar(const VertexStreams& streams, size_t count, Vertex* pVertices)
+{
+	StreamConstants positionConstants = defineStreamConstants(streams.position);
+	StreamConstants normalConstants = defineStreamConstants(streams.normal);
+	StreamConstants tangentConstants = defineStreamConstants(streams.tangent);
+	StreamConstants texCoordConstants = defineStreamConstants(streams.texCoord);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		Vertex& vertex = pVertices[i];
+
+		loadAttributeScalar(streams.position, positionConstants, i, &vertex.position.x);
+		loadAttributeScalar(streams.normal, normalConstants, i, &vertex.normal.x);
+		loadAttributeScalar(streams.tangent, tangentConstants, i, &vertex.tangent.x);
+		loadAttributeScalar(streams.texCoord, texCoordConstants, i, &vertex.texCoord.x);
+	}
+}
+
+
+struct StreamConstantsSSE
+{
+	__m128 scale;
+	__m128 minValue;
+	StreamConstants constants;
+};
+
+StreamConstantsSSE defineStreamConstantsSSE(const AttributeStream& stream)
+{
+	StreamConstants constants = defineStreamConstants(stream);
+
+	return { _mm_set1_ps(constants.scale), _mm_set1_ps(constants.minValue), constants };
+}
+
+// Loads up to 4 components of element idx, lanes past componentNum are undefined.
+// Elements too close to the end of the stream for a full register load go through the scalar path.
+__m128 loadAttributeSSE(const AttributeStream& stream, const StreamConstantsSSE& constants, size_t idx)
+{
+	const size_t offset = idx * stream.stride;
+	const UINT8* pData = stream.pData + offset;
+	const __m128i zero = _mm_setzero_si128();
+
+	__m128i components;
+
+	switch (stream.componentType)
+	{
+	case TINYGLTF_COMPONENT_TYPE_FLOAT:
+		if (offset + 4 * sizeof(float) <= stream.size)
+		{
+			return _mm_loadu_ps(reinterpret_cast<const float*>(pData));
+		}
+		break;
+
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		if (offset + 4 <= stream.size)
+		{
+			components = _mm_cvtsi32_si128(static_cast<int>(loadUInt32(pData)));
+			components = _mm_unpacklo_epi16(_mm_unpacklo_epi8(components, zero), zero);
+
+			return _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(components), constants.scale), constants.minValue);
+		}
+		break;
+
+	case TINYGLTF_COMPONENT_TYPE_BYTE:
+		if (offset + 4 <= stream.size)
+		{
+			components = _mm_cvtsi32_si128(static_cast<int>(loadUInt32(pData)));
+			components = _mm_srai_epi32(_mm_unpacklo_epi16(zero, _mm_unpacklo_epi8(zero, components)), 24);
+
+			return _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(components), constants.scale), constants.minValue);
+		}
+		break;
+
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+		if (offset + 4 * sizeof(UINT16) <= stream.size)
+		{
+			components = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pData)), zero);
+
+			return _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(components), constants.scale), constants.minValue);
+		}
+		break;
+
+	case TINYGLTF_COMPONENT_TYPE_SHORT:
+		if (offset + 4 * sizeof(INT16) <= stream.size)
+		{
+			components = _mm_srai_epi32(_mm_unpacklo_epi16(zero, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pData))), 16);
+
+			return _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(components), constants.scale), constants.minValue);
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	float values[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	loadAttributeScalar(stream, constants.constants, idx, values);
+
+	return _mm_loadu_ps(values);
+}
+
+void storeVertexSSE(Vertex& vertex, __m128 position, __m128 normal, __m128 tangent, __m128 texCoord)
+{
+	_mm_storeu_ps(&vertex.position.x, position);
+	_mm_storeu_ps(&vertex.normal.x, normal);
+	_mm_storeu_ps(&vertex.tangent.x, tangent);
+	_mm_storel_pi(reinterpret_cast<__m64*>(&vertex.texCoord.x), texCoord);
+}
+
+void interleaveSSE(const VertexStreams& streams, size_t count, Vertex* pVertices)
+{
+	StreamConstantsSSE positionConstants = defineStreamConstantsSSE(streams.position);
+	StreamConstantsSSE normalConstants = defineStreamConstantsSSE(streams.normal);
+	StreamConstantsSSE tangentConstants = defineStreamConstantsSSE(streams.tangent);
+	StreamConstantsSSE texCoordConstants = defineStreamConstantsSSE(streams.texCoord);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		storeVertexSSE(
+			pVertices[i],
+			loadAttributeSSE(streams.position, positionConstants, i),
+			loadAttributeSSE(streams.normal, normalConstants, i),
+			loadAttributeSSE(streams.tangent, tangentConstants, i),
+			loadAttributeSSE(streams.texCoord, texCoordConstants, i)
+		);
+	}
+}
+
+
+struct StreamConstantsAVX
+{
+	__m256 scale;
+	__m256 minValue;
+	StreamConstantsSSE constantsSSE;
+};
+
+StreamConstantsAVX defineStreamConstantsAVX(const AttributeStream& stream)
+{
+	StreamConstants constants = defineStreamConstants(stream);
+
+	return {
+		_mm256_set1_ps(constants.scale),
+		_mm256_set1_ps(constants.minValue),
+		defineStreamConstantsSSE(stream)
+	};
+}
+
+// Loads elements idx and idx + 1 into the low and high halves
+__m256 loadAttributePairAVX2(const AttributeStream& stream, const StreamConstantsAVX& constants, size_t idx)
+{
+	const size_t offset = (idx + 1) * stream.stride;
+	const UINT8* pData = stream.pData + idx * stream.stride;
+
+	__m128i components;
+
+	switch (stream.componentType)
+	{
+	case TINYGLTF_COMPONENT_TYPE_FLOAT:
+		if (offset + 4 * sizeof(float) <= stream.size)
+		{
+			return _mm256_loadu2_m128(
+				reinterpret_cast<const float*>(pData + stream.stride),
+				reinterpret_cast<const float*>(pData)
+			);
+		}
+		break;
+
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+	case TINYGLTF_COMPONENT_TYPE_BYTE:
+		if (offset + 4 <= stream.size)
+		{
+			components = _mm_unpacklo_epi32(
+				_mm_cvtsi32_si128(static_cast<int>(loadUInt32(pData))),
+				_mm_cvtsi32_si128(static_cast<int>(loadUInt32(pData + stream.stride)))
+			);
+
+			__m256i values = stream.componentType == TINYGLTF_COMPONENT_TYPE_BYTE ?
+				_mm256_cvtepi8_epi32(components) :
+				_mm256_cvtepu8_epi32(components);
+
+			return _mm256_max_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(values), constants.scale), constants.minValue);
+		}
+		break;
+
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+	case TINYGLTF_COMPONENT_TYPE_SHORT:
+		if (offset + 4 * sizeof(UINT16) <= stream.size)
+		{
+			components = _mm_unpacklo_epi64(
+				_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pData)),
+				_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pData + stream.stride))
+			);
+
+			__m256i values = stream.componentType == TINYGLTF_COMPONENT_TYPE_SHORT ?
+				_mm256_cvtepi16_epi32(components) :
+				_mm256_cvtepu16_epi32(components);
+
+			return _mm256_max_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(values), constants.scale), constants.minValue);
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return _mm256_set_m128(
+		loadAttributeSSE(stream, constants.constantsSSE, idx + 1),
+		loadAttributeSSE(stream, constants.constantsSSE, idx)
+	);
+}
+
+void interleaveAVX2(const VertexStreams& streams, size_t count, Vertex* pVertices)
+{
+	StreamConstantsAVX positionConstants = defineStreamConstantsAVX(streams.position);
+	StreamConstantsAVX normalConstants = defineStreamConstantsAVX(streams.normal);
+	StreamConstantsAVX tangentConstants = defineStreamConstantsAVX(streams.tangent);
+	StreamConstantsAVX texCoordConstants = defineStreamConstantsAVX(streams.texCoord);
+
+	size_t pairCount = count - count % 2;
+
+	for (size_t i = 0; i < pairCount; i += 2)
+	{
+		__m256 positions = loadAttributePairAVX2(streams.position, positionConstants, i);
+		__m256 normals = loadAttributePairAVX2(streams.normal, normalConstants, i);
+		__m256 tangents = loadAttributePairAVX2(streams.tangent, tangentConstants, i);
+		__m256 texCoords = loadAttributePairAVX2(streams.texCoord, texCoordConstants, i);
+
+		storeVertexSSE(
+			pVertices[i],
+			_mm256_castps256_ps128(positions),
+			_mm256_castps256_ps128(normals),
+			_mm256_castps256_ps128(tangents),
+			_mm256_castps256_ps128(texCoords)
+		);
+
+		storeVertexSSE(
+			pVertices[i + 1],
+			_mm256_extractf128_ps(positions, 1),
+			_mm256_extractf128_ps(normals, 1),
+			_mm256_extractf128_ps(tangents, 1),
+			_mm256_extractf128_ps(texCoords, 1)
+		);
+	}
+
+	if (pairCount < count)
+	{
+		storeVertexSSE(
+			pVertices[pairCount],
+			loadAttributeSSE(streams.position, positionConstants.constantsSSE, pairCount),
+			loadAttributeSSE(streams.normal, normalConstants.constantsSSE, pairCount),
+			loadAttributeSSE(streams.tangent, tangentConstants.constantsSSE, pairCount),
+			loadAttributeSSE(streams.texCoord, texCoordConstants.constantsSSE, pairCount)
+		);
+	}
+
+	_mm256_zeroupper();
+}
+
+
+InterleaveKernel detectInterleaveKernel()
+{
+	int info[4] = {};
+
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	bool hasSSE2 = (info[3] & (1 << 26)) != 0;
+	bool hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+	bool hasAVX = (info[2] & (1 << 28)) != 0;
+
+	if (maxLeaf >= 7 && hasOSXSAVE && hasAVX && (_xgetbv(0) & 0x6) == 0x6)
+	{
+		__cpuidex(info, 7, 0);
+
+		if ((info[1] & (1 << 5)) != 0)
+		{
+			return InterleaveKernel::AVX2;
+		}
+	}
+
+	return hasSSE2 ? InterleaveKernel::SSE : InterleaveKernel::Scalar;
+}
+
+
+InterleaveKernel GetBestInterleaveKernel()
+{
+	static const InterleaveKernel kernel = detectInterleaveKernel();
+
+	return kernel;
+}
+
+const char* GetInterleaveKernelName(InterleaveKernel kernel)
+{
+	switch (kernel)
+	{
+	case InterleaveKernel::Scalar:
+		return "scalar";
+
+	case InterleaveKernel::SSE:
+		return "SSE";
+
+	case InterleaveKernel::AVX2:
+		return "AVX2";
+
+	default:
+		break;
+	}
+
+	return "unknown";
+}
+
+bool IsValidAttributeStream(const AttributeStream& stream, UINT componentNum, size_t count)
+{
+	size_t componentSize = 0;
+
+	switch (stream.componentType)
+	{
+	case TINYGLTF_COMPONENT_TYPE_FLOAT:
+		componentSize = sizeof(float);
+		break;
+
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+	case TINYGLTF_COMPONENT_TYPE_BYTE:
+		componentSize = sizeof(UINT8);
+		break;
+
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+	case TINYGLTF_COMPONENT_TYPE_SHORT:
+		componentSize = sizeof(UINT16);
+		break;
+
+	default:
+		return false;
+	}
+
+	size_t elementSize = componentSize * stream.componentNum;
+
+	if (stream.pData == nullptr || stream.componentNum != componentNum || stream.stride < elementSize)
+	{
+		return false;
+	}
+
+	return count == 0 || stream.stride * (count - 1) + elementSize <= stream.size;
+}
+
+void InterleaveVertices(const VertexStreams& streams, size_t count, Vertex* pVertices, InterleaveKernel kernel)
+{
+	switch (kernel)
+	{
+	case InterleaveKernel::AVX2:
+		interleaveAVX2(streams, count, pVertices);
+		break;
+
+	case InterleaveKernel::SSE:
+		interleaveSSE(streams, count, pVertices);
+		break;
+
+	default:
+		interleaveScalar(streams, count, pVertices);
+		break;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "framework.h"
+#include "rendererContext.h"
+
+
+// Strided vertex attribute, components are converted to float when read.
+// size is the number of bytes readable from pData.
+struct AttributeStream
+{
+	const UINT8* pData = nullptr;
+	size_t size = 0;
+	size_t stride = 0;
+
+	int componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+	UINT componentNum = 0;
+	bool normalized = false;
+};
+
+struct VertexStreams
+{
+	AttributeStream position;
+	AttributeStream normal;
+	AttributeStream tangent;
+	AttributeStream texCoord;
+};
+
+
+enum class InterleaveKernel
+{
+	Scalar,
+	SSE,
+	AVX2
+};
+
+InterleaveKernel GetBestInterleaveKernel();
+const char* GetInterleaveKernelName(InterleaveKernel kernel);
+
+bool IsValidAttributeStream(const AttributeStream& stream, UINT componentNum, size_t count);
+
+// Gathers all streams and writes the interleaved vertices in a single pass
+void InterleaveVertices(
+	const VertexStreams& streams,
+	size_t count,
+	Vertex* pVertices,
+	InterleaveKernel kernel = GetBestInterleaveKernel()
+);
@@ -0,0 +1,103 @@
+#include "testing.h"
+#include "jobSystem.h"
+
+#include <atomic>
+#include <memory>
+
+
+TEST(ParallelForCoversRangeOnce)
+{
+	std::unique_ptr<JobSystem> jobSystem(JobSystem::Create(4));
+
+	const size_t count = 10000;
+	std::vector<std::atomic<int>> hits(count);
+
+	jobSystem->ParallelFor(count, 7, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				hits[i].fetch_add(1);
+			}
+		}
+	);
+
+	for (const auto& hit : hits)
+	{
+		CHECK(hit.load() == 1);
+	}
+}
+
+// a grain of one queues a job per item, far more than the job slots of a thread
+TEST(ParallelForWrapsJobPool)
+{
+	for (uint32_t threadNum : { 1u, 2u, 4u })
+	{
+		std::unique_ptr<JobSystem> jobSystem(JobSystem::Create(threadNum));
+
+		const size_t counts[] = { 2 * JobSystem::JobPoolSize, 100000 };
+
+		for (size_t count : counts)
+		{
+			std::atomic<size_t> sum(0);
+
+			jobSystem->ParallelFor(count, 1, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; ++i)
+					{
+						sum.fetch_add(i, std::memory_order_relaxed);
+					}
+				}
+			);
+
+			CHECK(sum.load() == count * (count - 1) / 2);
+		}
+	}
+}
+
+// every job queued at once keeps its slot busy until the counter is waited for
+TEST(RunMoreJobsThanPoolSize)
+{
+	std::unique_ptr<JobSystem> jobSystem(JobSystem::Create(2));
+
+	const size_t jobNum = 4 * JobSystem::JobPoolSize;
+
+	std::atomic<size_t> doneNum(0);
+	JobCounter counter;
+
+	for (size_t i = 0; i < jobNum; ++i)
+	{
+		jobSystem->Run([&]() { doneNum.fetch_add(1); }, &counter);
+	}
+
+	jobSystem->Wait(counter);
+
+	CHECK(doneNum.load() == jobNum);
+}
+
+// jobs waiting for nested loops hold their slots while the nested jobs wrap the pool
+TEST(NestedParallelForWrapsJobPool)
+{
+	std::unique_ptr<JobSystem> jobSystem(JobSystem::Create(3));
+
+	const size_t outerNum = 16;
+	const size_t innerNum = JobSystem::JobPoolSize;
+
+	std::atomic<size_t> doneNum(0);
+
+	jobSystem->ParallelFor(outerNum, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				jobSystem->ParallelFor(innerNum, 1, [&](size_t innerBegin, size_t innerEnd)
+					{
+						doneNum.fetch_add(innerEnd - innerBegin);
+					}
+				);
+			}
+		}
+	);
+
+	CHECK(doneNum.load() == outerNum * innerNum);
+}
+
+TEST_MAIN()
@@ -0,0 +1,184 @@
+#include "testing.h"
+#include "occlusionCulling.h"
+#include "jobSystem.h"
+
+#include <memory>
+
+
+// 64x64 buffer looking down +z from the origin with a 90 degree field of view
+static constexpr uint32_t BufferSize = 64;
+static constexpr float NearPlane = 0.1f;
+static constexpr float FarPlane = 100.0f;
+
+OcclusionMatrix getVpMatrix()
+{
+	float depthScale = FarPlane / (FarPlane - NearPlane);
+
+	return { {
+		{ 1.0f, 0.0f, 0.0f, 0.0f },
+		{ 0.0f, 1.0f, 0.0f, 0.0f },
+		{ 0.0f, 0.0f, depthScale, 1.0f },
+		{ 0.0f, 0.0f, -NearPlane * depthScale, 0.0f }
+	} };
+}
+
+// quad facing the camera, its depths may differ between the left and right side
+void addQuad(OcclusionBuffer& buffer, float minX, float minY, float maxX, float maxY, float leftZ, float rightZ)
+{
+	const float positions[] =
+	{
+		minX, minY, leftZ,
+		minX, maxY, leftZ,
+		maxX, maxY, rightZ,
+		maxX, minY, rightZ
+	};
+	const uint32_t indices[] = { 0, 1, 2, 0, 2, 3 };
+
+	buffer.AddOccluder(positions, 4, indices, 6, getVpMatrix());
+}
+
+OcclusionBox makeBox(float x, float y, float z, float extent)
+{
+	return { { x, y, z }, { extent, extent, extent } };
+}
+
+
+TEST(EmptyBufferHidesNothing)
+{
+	std::unique_ptr<OcclusionBuffer> buffer(OcclusionBuffer::Create(BufferSize, BufferSize));
+	buffer->Rasterize();
+
+	CHECK(buffer->IsVisible(makeBox(0.0f, 0.0f, 50.0f, 1.0f), getVpMatrix()));
+}
+
+TEST(OccluderHidesBoxBehind)
+{
+	std::unique_ptr<OcclusionBuffer> buffer(OcclusionBuffer::Create(BufferSize, BufferSize));
+
+	// covers all of the screen at z = 5
+	addQuad(*buffer, -10.0f, -10.0f, 10.0f, 10.0f, 5.0f, 5.0f);
+	buffer->Rasterize();
+
+	CHECK(buffer->GetTriangleNum() == 2);
+	CHECK(!buffer->IsVisible(makeBox(0.0f, 0.0f, 20.0f, 1.0f), getVpMatrix()));
+	CHECK(!buffer->IsVisible(makeBox(-15.0f, 12.0f, 40.0f, 2.0f), getVpMatrix()));
+}
+
+TEST(BoxInFrontStaysVisible)
+{
+	std::unique_ptr<OcclusionBuffer> buffer(OcclusionBuffer::Create(BufferSize, BufferSize));
+
+	addQuad(*buffer, -10.0f, -10.0f, 10.0f, 10.0f, 5.0f, 5.0f);
+	buffer->Rasterize();
+
+	CHECK(buffer->IsVisible(makeBox(0.0f, 0.0f, 3.0f, 0.5f), getVpMatrix()));
+	// reaching through the occluder
+	CHECK(buffer->IsVisible(makeBox(0.0f, 0.0f, 5.0f, 1.0f), getVpMatrix()));
+}
+
+TEST(BoxCrossingNearPlaneIsVisible)
+{
+	std::unique_ptr<OcclusionBuffer> buffer(OcclusionBuffer::Create(BufferSize, BufferSize));
+
+	addQuad(*buffer, -10.0f, -10.0f, 10.0f, 10.0f, 5.0f, 5.0f);
+	buffer->Rasterize();
+
+	CHECK(buffer->IsVisible(makeBox(0.0f, 0.0f, NearPlane, 0.5f), getVpMatrix()));
+	CHECK(buffer->IsVisible(makeBox(0.0f, 0.0f, -3.0f, 1.0f), getVpMatrix()));
+}
+
+TEST(OccluderCrossingNearPlaneIsDropped)
+{
+	std::unique_ptr<OcclusionBuffer> buffer(OcclusionBuffer::Create(BufferSize, BufferSize));
+
+	// the left side is behind the camera, clipping it is not worth it for an occluder
+	addQuad(*buffer, -10.0f, -10.0f, 10.0f, 10.0f, -1.0f, 10.0f);
+	buffer->Rasterize();
+
+	CHECK(buffer->GetTriangleNum() == 0);
+	CHECK(buffer->IsVisible(makeBox(0.0f, 0.0f, 50.0f, 1.0f), getVpMatrix()));
+}
+
+TEST(PartiallyCoveredBoxIsVisible)
+{
+	std::unique_ptr<OcclusionBuffer> buffer(OcclusionBuffer::Create(BufferSize, BufferSize));
+
+	// the left half of the screen
+	addQuad(*buffer, -10.0f, -10.0f, 0.0f, 10.0f, 5.0f, 5.0f);
+	buffer->Rasterize();
+
+	CHECK(buffer->IsVisible(makeBox(0.0f, 0.0f, 20.0f, 2.0f), getVpMatrix()));
+	CHECK(buffer->IsVisible(makeBox(10.0f, 0.0f, 20.0f, 1.0f), getVpMatrix()));
+	CHECK(!buffer->IsVisible(makeBox(-10.0f, 0.0f, 20.0f, 1.0f), getVpMatrix()));
+}
+
+TEST(PartiallyCoveredTileHidesNothing)
+{
+	std::unique_ptr<OcclusionBuffer> buffer(OcclusionBuffer::Create(BufferSize, BufferSize));
+
+	// a few pixels, smaller than one tile
+	addQuad(*buffer, -0.25f, -0.25f, 0.25f, 0.25f, 5.0f, 5.0f);
+	buffer->Rasterize();
+
+	CHECK(buffer->GetTriangleNum() == 2);
+	CHECK(buffer->IsVisible(makeBox(0.0f, 0.0f, 50.0f, 0.1f), getVpMatrix()));
+}
+
+TEST(TilesCoveredByManyOccludersMerge)
+{
+	std::unique_ptr<OcclusionBuffer> buffer(OcclusionBuffer::Create(BufferSize, BufferSize));
+
+	// strips that only cover the tiles together
+	for (int strip = 0; strip < 8; ++strip)
+	{
+		float minX = -10.0f + strip * 2.5f;
+		addQuad(*buffer, minX, -10.0f, minX + 2.5f, 10.0f, 5.0f, 5.0f);
+	}
+	buffer->Rasterize();
+
+	CHECK(!buffer->IsVisible(makeBox(0.0f, 0.0f, 20.0f, 1.0f), getVpMatrix()));
+}
+
+TEST(ParallelFilterMatchesSerialTests)
+{
+	std::unique_ptr<OcclusionBuffer> buffer(OcclusionBuffer::Create(BufferSize, BufferSize));
+	std::unique_ptr<JobSystem> jobSystem(JobSystem::Create(3));
+
+	addQuad(*buffer, -10.0f, -10.0f, 0.0f, 10.0f, 5.0f, 5.0f);
+	buffer->Rasterize(jobSystem.get());
+
+	std::vector<float> centerX, centerY, centerZ, extents;
+
+	for (int z = 0; z < 10; ++z)
+	{
+		for (int x = -20; x <= 20; ++x)
+		{
+			centerX.push_back(x * 1.5f);
+			centerY.push_back(0.0f);
+			centerZ.push_back(2.0f + z * 4.0f);
+			extents.push_back(0.5f);
+		}
+	}
+
+	OcclusionBoxArrays boxes = { centerX.data(), centerY.data(), centerZ.data(), extents.data(), extents.data(), extents.data() };
+
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> expected;
+
+	for (uint32_t idx = 0; idx < centerX.size(); ++idx)
+	{
+		candidates.push_back(idx);
+
+		if (buffer->IsVisible(makeBox(centerX[idx], centerY[idx], centerZ[idx], extents[idx]), getVpMatrix()))
+		{
+			expected.push_back(idx);
+		}
+	}
+
+	buffer->FilterVisible(boxes, getVpMatrix(), candidates, jobSystem.get());
+
+	CHECK(candidates == expected);
+	CHECK(expected.size() < centerX.size());
+}
+
+TEST_MAIN()
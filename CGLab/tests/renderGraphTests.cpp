@@ -0,0 +1,438 @@
+#include "testing.h"
+#include "renderGraph.h"
+#include "frameGraph.h"
+
+#include <algorithm>
+#include <string>
+
+
+RenderGraphTextureDesc makeDesc(uint32_t width, uint32_t height, uint32_t format = 1, uint32_t texelSize = 4)
+{
+	RenderGraphTextureDesc desc;
+	desc.width = width;
+	desc.height = height;
+	desc.format = format;
+	desc.bindFlags = 1;
+	desc.texelSize = texelSize;
+
+	return desc;
+}
+
+uint64_t getExpectedHeapSize(const RenderGraphTextureDesc& desc)
+{
+	return (desc.GetSize() + RenderGraph::HeapAlignment - 1) / RenderGraph::HeapAlignment * RenderGraph::HeapAlignment;
+}
+
+bool isAlive(const RenderGraph& graph, RenderGraph::ResourceId resource, RenderGraph::PassId passId)
+{
+	return !graph.IsTextureImported(resource)
+		&& graph.GetFirstPass(resource) != RenderGraph::InvalidIndex
+		&& graph.GetFirstPass(resource) <= passId
+		&& passId <= graph.GetLastPass(resource);
+}
+
+// bytes of the transient textures alive during the busiest pass
+uint64_t getPeakSize(const RenderGraph& graph)
+{
+	uint64_t peakSize = 0;
+
+	for (RenderGraph::PassId passId = 0; passId < graph.GetPassNum(); ++passId)
+	{
+		uint64_t passSize = 0;
+
+		for (RenderGraph::ResourceId resource = 0; resource < graph.GetTextureNum(); ++resource)
+		{
+			passSize += isAlive(graph, resource, passId) ? graph.GetHeapSize(resource) : 0;
+		}
+
+		peakSize = (std::max)(peakSize, passSize);
+	}
+
+	return peakSize;
+}
+
+bool hasAliasBarrier(const RenderGraph& graph, RenderGraph::ResourceId before, RenderGraph::ResourceId after)
+{
+	const auto& barriers = graph.GetPassAliasBarriers(graph.GetFirstPass(after));
+
+	return std::any_of(barriers.begin(), barriers.end(), [&](const RenderGraph::AliasBarrier& barrier)
+	{
+		return barrier.before == before && barrier.after == after;
+	});
+}
+
+// textures alive during the same pass share neither heap memory nor a physical texture,
+// those sharing memory at different times are separated by alias barriers
+bool isPlacementValid(const RenderGraph& graph)
+{
+	for (RenderGraph::ResourceId left = 0; left < graph.GetTextureNum(); ++left)
+	{
+		for (RenderGraph::ResourceId right = left + 1; right < graph.GetTextureNum(); ++right)
+		{
+			bool isAliveTogether = false;
+			uint64_t leftBegin = graph.GetHeapOffset(left);
+			uint64_t rightBegin = graph.GetHeapOffset(right);
+			bool isOverlapped = leftBegin < rightBegin + graph.GetHeapSize(right) && rightBegin < leftBegin + graph.GetHeapSize(left);
+
+			for (RenderGraph::PassId passId = 0; passId < graph.GetPassNum(); ++passId)
+			{
+				isAliveTogether = isAliveTogether || (isAlive(graph, left, passId) && isAlive(graph, right, passId));
+			}
+
+			if (isAliveTogether && (isOverlapped || graph.GetPhysicalTexture(left) == graph.GetPhysicalTexture(right)))
+			{
+				return false;
+			}
+
+			// the later of two textures sharing memory waits for the earlier one
+			if (isOverlapped && !isAliveTogether && !hasAliasBarrier(graph, left, right) && !hasAliasBarrier(graph, right, left))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+TEST(CullsPassesWithUnusedResults)
+{
+	RenderGraph graph;
+
+	RenderGraph::ResourceId output = graph.ImportTexture("Output", makeDesc(64, 64));
+	RenderGraph::ResourceId first = graph.CreateTexture("First", makeDesc(64, 64));
+	RenderGraph::ResourceId second = graph.CreateTexture("Second", makeDesc(64, 64));
+
+	// the second pass only feeds a texture nobody reads, so the first one is not needed either
+	RenderGraph::PassId writeFirst = graph.AddPass("Write first", []() {});
+	graph.Write(writeFirst, first);
+
+	RenderGraph::PassId writeSecond = graph.AddPass("Write second", []() {});
+	graph.Read(writeSecond, first);
+	graph.Write(writeSecond, second);
+
+	RenderGraph::PassId present = graph.AddPass("Present", []() {});
+	graph.Modify(present, output);
+
+	CHECK(graph.Compile());
+
+	CHECK(graph.IsPassCulled(writeFirst));
+	CHECK(graph.IsPassCulled(writeSecond));
+	CHECK(!graph.IsPassCulled(present));
+	CHECK(graph.GetStats().culledPassNum == 2);
+	CHECK(graph.GetStats().transientNum == 0);
+	CHECK(graph.GetPhysicalTexture(first) == RenderGraph::InvalidIndex);
+}
+
+TEST(FullWriteEndsTheUseOfOlderContents)
+{
+	RenderGraph graph;
+
+	RenderGraph::ResourceId output = graph.ImportTexture("Output", makeDesc(64, 64));
+	RenderGraph::ResourceId texture = graph.CreateTexture("Texture", makeDesc(64, 64));
+
+	// overwritten before anything reads it
+	RenderGraph::PassId lost = graph.AddPass("Lost", []() {});
+	graph.Modify(lost, texture);
+
+	RenderGraph::PassId write = graph.AddPass("Write", []() {});
+	graph.Write(write, texture);
+
+	RenderGraph::PassId read = graph.AddPass("Read", []() {});
+	graph.Read(read, texture);
+	graph.Write(read, output);
+
+	CHECK(graph.Compile());
+
+	CHECK(graph.IsPassCulled(lost));
+	CHECK(!graph.IsPassCulled(write));
+	CHECK(graph.GetFirstPass(texture) == write);
+	CHECK(graph.GetLastPass(texture) == read);
+}
+
+TEST(ReadingUnwrittenTextureFailsToCompile)
+{
+	RenderGraph graph;
+
+	RenderGraph::ResourceId output = graph.ImportTexture("Output", makeDesc(64, 64));
+	RenderGraph::ResourceId texture = graph.CreateTexture("Texture", makeDesc(64, 64));
+
+	RenderGraph::PassId pass = graph.AddPass("Read", []() {});
+	graph.Read(pass, texture);
+	graph.Write(pass, output);
+
+	CHECK(!graph.Compile());
+}
+
+TEST(ClearsAndBarriers)
+{
+	RenderGraph graph;
+
+	RenderGraph::ResourceId output = graph.ImportTexture("Output", makeDesc(64, 64));
+	RenderGraph::ResourceId modified = graph.CreateTexture("Modified", makeDesc(64, 64));
+	RenderGraph::ResourceId written = graph.CreateTexture("Written", makeDesc(64, 64));
+
+	RenderGraph::PassId first = graph.AddPass("First", []() {});
+	graph.Modify(first, modified);
+	graph.Write(first, written);
+
+	RenderGraph::PassId second = graph.AddPass("Second", []() {});
+	graph.Read(second, written);
+	graph.Modify(second, modified);
+
+	RenderGraph::PassId third = graph.AddPass("Third", []() {});
+	graph.Read(third, modified);
+	graph.Modify(third, written);
+	graph.Write(third, output);
+
+	CHECK(graph.Compile());
+
+	// only a transient texture drawn over before any full write is cleared
+	CHECK(graph.GetPassClears(first) == std::vector<RenderGraph::ResourceId>{ modified });
+	CHECK(graph.GetPassClears(second).empty());
+	CHECK(graph.GetPassClears(third).empty());
+
+	CHECK(graph.GetPassBarriers(first).empty());
+	CHECK(graph.GetPassBarriers(second).size() == 1);
+	CHECK(graph.GetPassBarriers(second)[0].resource == written);
+	CHECK(graph.GetPassBarriers(second)[0].isRead);
+
+	CHECK(graph.GetPassBarriers(third).size() == 2);
+	CHECK(graph.GetPassBarriers(third)[0].resource == modified);
+	CHECK(graph.GetPassBarriers(third)[0].isRead);
+	CHECK(graph.GetPassBarriers(third)[1].resource == written);
+	CHECK(!graph.GetPassBarriers(third)[1].isRead);
+
+	CHECK(graph.GetStats().barrierNum == 3);
+}
+
+TEST(DisjointTexturesShareMemory)
+{
+	RenderGraph graph;
+
+	RenderGraph::ResourceId output = graph.ImportTexture("Output", makeDesc(256, 256));
+	RenderGraph::ResourceId a = graph.CreateTexture("A", makeDesc(256, 256));
+	RenderGraph::ResourceId b = graph.CreateTexture("B", makeDesc(256, 256));
+	RenderGraph::ResourceId c = graph.CreateTexture("C", makeDesc(256, 256));
+	RenderGraph::ResourceId small = graph.CreateTexture("Small", makeDesc(128, 128, 2));
+
+	// a -> b -> c, each texture is dead once the next one is written
+	RenderGraph::PassId pass = graph.AddPass("A", []() {});
+	graph.Write(pass, a);
+
+	pass = graph.AddPass("B", []() {});
+	graph.Read(pass, a);
+	graph.Write(pass, b);
+
+	pass = graph.AddPass("C", []() {});
+	graph.Read(pass, b);
+	graph.Write(pass, c);
+
+	pass = graph.AddPass("Small", []() {});
+	graph.Read(pass, c);
+	graph.Write(pass, small);
+
+	pass = graph.AddPass("Output", []() {});
+	graph.Read(pass, small);
+	graph.Write(pass, output);
+
+	CHECK(graph.Compile());
+	CHECK(isPlacementValid(graph));
+
+	const RenderGraphStats& stats = graph.GetStats();
+	uint64_t textureSize = getExpectedHeapSize(makeDesc(256, 256));
+
+	// a and c have the same desc and never live at once
+	CHECK(graph.GetPhysicalTexture(a) == graph.GetPhysicalTexture(c));
+	CHECK(graph.GetPhysicalTexture(a) != graph.GetPhysicalTexture(b));
+	CHECK(stats.physicalNum == 3);
+
+	CHECK(graph.GetHeapOffset(a) == graph.GetHeapOffset(c));
+	CHECK(stats.unaliasedSize == 3 * textureSize + getExpectedHeapSize(makeDesc(128, 128)));
+	CHECK(stats.heapSize == 2 * textureSize);
+	CHECK(stats.heapSize == getPeakSize(graph));
+
+	// c takes the memory of a, the small texture the memory of b
+	CHECK(graph.GetPassAliasBarriers(0).empty());
+	CHECK(graph.GetPassAliasBarriers(1).empty());
+	CHECK(graph.GetPassAliasBarriers(2).size() == 1);
+	CHECK(graph.GetPassAliasBarriers(2)[0].before == a);
+	CHECK(graph.GetPassAliasBarriers(2)[0].after == c);
+	CHECK(graph.GetPassAliasBarriers(3).size() == 1);
+	CHECK(graph.GetPassAliasBarriers(3)[0].before == b);
+	CHECK(graph.GetPassAliasBarriers(3)[0].after == small);
+	CHECK(stats.aliasBarrierNum == 2);
+}
+
+TEST(PlaceTexturesWithBackendSizes)
+{
+	RenderGraph graph;
+
+	RenderGraph::ResourceId output = graph.ImportTexture("Output", makeDesc(256, 256));
+	RenderGraph::ResourceId a = graph.CreateTexture("A", makeDesc(256, 256));
+	RenderGraph::ResourceId b = graph.CreateTexture("B", makeDesc(256, 256));
+	RenderGraph::ResourceId c = graph.CreateTexture("C", makeDesc(256, 256));
+
+	RenderGraph::PassId pass = graph.AddPass("A", []() {});
+	graph.Write(pass, a);
+
+	pass = graph.AddPass("B", []() {});
+	graph.Read(pass, a);
+	graph.Write(pass, b);
+
+	pass = graph.AddPass("C", []() {});
+	graph.Read(pass, b);
+	graph.Write(pass, c);
+
+	pass = graph.AddPass("Output", []() {});
+	graph.Read(pass, c);
+	graph.Write(pass, output);
+
+	CHECK(graph.Compile());
+
+	// b could not be placed, the sizes of the others round up to the alignment
+	std::vector<uint64_t> heapSizes(graph.GetTextureNum(), 0);
+	heapSizes[a] = 3 * RenderGraph::HeapAlignment + 1;
+	heapSizes[c] = 2 * RenderGraph::HeapAlignment;
+
+	graph.PlaceTextures(heapSizes);
+
+	CHECK(isPlacementValid(graph));
+	CHECK(graph.GetHeapSize(output) == 0);
+	CHECK(graph.GetHeapSize(a) == 4 * RenderGraph::HeapAlignment);
+	CHECK(graph.GetHeapSize(b) == 0);
+	CHECK(graph.GetHeapSize(c) == 2 * RenderGraph::HeapAlignment);
+
+	// without b in between a and c share memory
+	CHECK(graph.GetHeapOffset(a) == 0);
+	CHECK(graph.GetHeapOffset(c) == 0);
+	CHECK(graph.GetStats().heapSize == 4 * RenderGraph::HeapAlignment);
+	CHECK(graph.GetPassAliasBarriers(1).empty());
+	CHECK(graph.GetPassAliasBarriers(2).size() == 1);
+	CHECK(graph.GetStats().aliasBarrierNum == 1);
+}
+
+TEST(ExecuteRunsKeptPassesInOrder)
+{
+	RenderGraph graph;
+	std::string order;
+
+	RenderGraph::ResourceId output = graph.ImportTexture("Output", makeDesc(64, 64));
+	RenderGraph::ResourceId texture = graph.CreateTexture("Texture", makeDesc(64, 64));
+	RenderGraph::ResourceId unused = graph.CreateTexture("Unused", makeDesc(64, 64));
+
+	RenderGraph::PassId pass = graph.AddPass("A", [&]() { order += "a"; });
+	graph.Modify(pass, texture);
+
+	pass = graph.AddPass("Culled", [&]() { order += "x"; });
+	graph.Write(pass, unused);
+
+	pass = graph.AddPass("B", [&]() { order += "b"; });
+	graph.Read(pass, texture);
+	graph.Write(pass, output);
+
+	CHECK(graph.Compile());
+
+	graph.Execute([&](RenderGraph::PassId passId) { order += std::to_string(passId); });
+
+	CHECK(order == "0a2b");
+}
+
+
+// texel sizes of the D3D11 formats the renderer picks
+RenderGraphTextureDesc createFrameTextureDesc(FrameTextureType type, uint32_t width, uint32_t height)
+{
+	bool isFloat4 = type == FrameTextureType::kHDR || type == FrameTextureType::kBloomBlur;
+
+	return makeDesc(width, height, static_cast<uint32_t>(type), isFloat4 ? 16 : 4);
+}
+
+FrameGraphDesc getFrameGraphDesc(uint32_t width, uint32_t height, bool isBloom)
+{
+	FrameGraphDesc desc;
+	desc.width = width;
+	desc.height = height;
+	desc.shadowMapSize = 2048;
+	desc.shadowSplitNum = 4;
+	desc.bloomBlurWidth = width / 2;
+	desc.bloomBlurHeight = height / 2;
+	desc.exposureSize = 1024;
+	desc.isBloom = isBloom;
+	desc.createTextureDesc = createFrameTextureDesc;
+
+	return desc;
+}
+
+TEST(FrameLayoutAliasing)
+{
+	RenderGraph graph;
+	FrameTextures textures = AddFramePasses(graph, getFrameGraphDesc(1920, 1080, true), FramePasses());
+
+	CHECK(graph.Compile());
+	CHECK(isPlacementValid(graph));
+
+	const RenderGraphStats& stats = graph.GetStats();
+
+	CHECK(stats.passNum == 9);
+	CHECK(stats.culledPassNum == 0);
+	CHECK(stats.transientNum == 7);
+	CHECK(graph.GetTextureDesc(textures.exposure).mipLevels == 11);
+
+	// the depth, shadow map and emissive textures are dead before the bloom blur and the exposure chain
+	CHECK(stats.unaliasedSize == 139264000);
+	CHECK(stats.heapSize == 116981760);
+	CHECK(stats.heapSize == getPeakSize(graph));
+	CHECK(stats.aliasBarrierNum > 0);
+
+	// a backend that can not place the depth texture
+	std::vector<uint64_t> heapSizes(graph.GetTextureNum());
+
+	for (RenderGraph::ResourceId resource = 0; resource < graph.GetTextureNum(); ++resource)
+	{
+		heapSizes[resource] = resource != textures.depth ? graph.GetHeapSize(resource) : 0;
+	}
+
+	graph.PlaceTextures(heapSizes);
+
+	CHECK(isPlacementValid(graph));
+	CHECK(graph.GetStats().heapSize == getPeakSize(graph));
+	CHECK(graph.GetStats().heapSize < 116981760);
+}
+
+TEST(FrameLayoutWithoutBloom)
+{
+	RenderGraph graph;
+	FrameTextures textures = AddFramePasses(graph, getFrameGraphDesc(1920, 1080, false), FramePasses());
+
+	CHECK(graph.Compile());
+	CHECK(isPlacementValid(graph));
+
+	const RenderGraphStats& stats = graph.GetStats();
+
+	CHECK(stats.passNum == 6);
+	CHECK(stats.transientNum == 5);
+	CHECK(graph.GetPhysicalTexture(textures.bloomBlur) == RenderGraph::InvalidIndex);
+	CHECK(graph.GetPhysicalTexture(textures.bloomBlurTemp) == RenderGraph::InvalidIndex);
+	CHECK(stats.heapSize == getPeakSize(graph));
+}
+
+TEST(FrameLayoutAtOtherSizes)
+{
+	const uint32_t sizes[][2] = { { 800, 600 }, { 1280, 720 }, { 2560, 1440 }, { 3840, 2160 } };
+
+	for (const auto& size : sizes)
+	{
+		for (bool isBloom : { true, false })
+		{
+			RenderGraph graph;
+			AddFramePasses(graph, getFrameGraphDesc(size[0], size[1], isBloom), FramePasses());
+
+			CHECK(graph.Compile());
+			CHECK(isPlacementValid(graph));
+			CHECK(graph.GetStats().heapSize <= graph.GetStats().unaliasedSize);
+		}
+	}
+}
+
+TEST_MAIN()
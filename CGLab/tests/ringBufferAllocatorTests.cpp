@@ -0,0 +1,243 @@
+#include "testing.h"
+#include "ringBufferAllocator.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+// ConstantRingBuffer allocates multiples of 16 constants of 16 bytes at offsets aligned the same way
+static constexpr size_t ConstantAlignment = 256;
+static constexpr size_t ConstantSize = 16;
+
+size_t alignConstants(size_t size)
+{
+	return (size + ConstantAlignment - 1) / ConstantAlignment * ConstantAlignment;
+}
+
+
+TEST(AllocatesAlignedOffsets)
+{
+	RingBufferAllocator allocator(4096);
+
+	const size_t sizes[] = { 64, 100, 256, 16, 500 };
+	size_t expectedOffset = 0;
+
+	for (size_t size : sizes)
+	{
+		size_t offset = allocator.Allocate(alignConstants(size), ConstantAlignment);
+
+		CHECK(offset == expectedOffset);
+		CHECK(offset % ConstantAlignment == 0);
+		// first constant and constant count of the bound range
+		CHECK((offset / ConstantSize) % 16 == 0);
+		CHECK((alignConstants(size) / ConstantSize) % 16 == 0);
+
+		expectedOffset += alignConstants(size);
+	}
+
+	CHECK(allocator.GetStats().allocationNum == 5);
+	CHECK(allocator.GetStats().allocatedBytes == expectedOffset);
+	CHECK(allocator.GetStats().overflowNum == 0);
+}
+
+TEST(AlignsOffsetsAfterUnalignedSizes)
+{
+	RingBufferAllocator allocator(4096);
+
+	CHECK(allocator.Allocate(10, 1) == 0);
+	CHECK(allocator.Allocate(100, ConstantAlignment) == 256);
+	CHECK(allocator.Allocate(4, 16) == 368);
+
+	// the padding is used space too
+	CHECK(allocator.GetStats().usedBytes == 372);
+	CHECK(allocator.GetStats().allocatedBytes == 114);
+}
+
+TEST(WrapsAroundToTheStart)
+{
+	RingBufferAllocator allocator(1024);
+
+	CHECK(allocator.Allocate(512, ConstantAlignment) == 0);
+	CHECK(allocator.Allocate(256, ConstantAlignment) == 512);
+	allocator.FinishFrame(1);
+	allocator.ReleaseCompleted(1);
+
+	CHECK(allocator.GetStats().usedBytes == 0);
+
+	// 256 bytes are left at the end, the allocation goes to the start and the end is skipped
+	CHECK(allocator.Allocate(512, ConstantAlignment) == 0);
+	CHECK(allocator.GetStats().usedBytes == 768);
+
+	CHECK(allocator.Allocate(256, ConstantAlignment) == 512);
+	CHECK(allocator.GetStats().usedBytes == 1024);
+	CHECK(allocator.Allocate(ConstantAlignment, ConstantAlignment) == RingBufferAllocator::InvalidOffset);
+
+	// the skipped end is freed with the frame that skipped it
+	allocator.FinishFrame(2);
+	allocator.ReleaseCompleted(2);
+
+	CHECK(allocator.GetStats().usedBytes == 0);
+	CHECK(allocator.GetStats().peakUsedBytes == 1024);
+	CHECK(allocator.Allocate(256, ConstantAlignment) == 768);
+}
+
+TEST(AlignmentPastTheEndWraps)
+{
+	RingBufferAllocator allocator(1024);
+
+	CHECK(allocator.Allocate(1000, 1) == 0);
+	allocator.FinishFrame(1);
+	allocator.ReleaseCompleted(1);
+
+	// aligning the head of 1000 reaches the end of the ring
+	CHECK(allocator.Allocate(256, ConstantAlignment) == 0);
+	CHECK(allocator.GetStats().usedBytes == 24 + 256);
+}
+
+TEST(ReusesSpaceOnlyAfterFenceCompletes)
+{
+	RingBufferAllocator allocator(1024);
+
+	for (uint64_t fenceValue = 1; fenceValue <= 4; ++fenceValue)
+	{
+		CHECK(allocator.Allocate(256, ConstantAlignment) == (fenceValue - 1) * 256);
+		allocator.FinishFrame(fenceValue);
+	}
+
+	CHECK(allocator.GetStats().inFlightFrameNum == 4);
+	CHECK(allocator.Allocate(256, ConstantAlignment) == RingBufferAllocator::InvalidOffset);
+
+	// nothing has completed yet
+	allocator.ReleaseCompleted(0);
+	CHECK(allocator.Allocate(256, ConstantAlignment) == RingBufferAllocator::InvalidOffset);
+
+	// the first two frames are done, the other two may still be read
+	allocator.ReleaseCompleted(2);
+	CHECK(allocator.GetStats().inFlightFrameNum == 2);
+	CHECK(allocator.GetStats().usedBytes == 512);
+
+	CHECK(allocator.Allocate(256, ConstantAlignment) == 0);
+	CHECK(allocator.Allocate(256, ConstantAlignment) == 256);
+	CHECK(allocator.Allocate(256, ConstantAlignment) == RingBufferAllocator::InvalidOffset);
+	allocator.FinishFrame(5);
+
+	// fences complete in order, a later value frees all frames before it
+	allocator.ReleaseCompleted(4);
+	CHECK(allocator.GetStats().inFlightFrameNum == 1);
+	CHECK(allocator.Allocate(512, ConstantAlignment) == 512);
+}
+
+TEST(AllocationLargerThanFreeSpaceOverflows)
+{
+	RingBufferAllocator allocator(1024);
+
+	CHECK(allocator.Allocate(768, ConstantAlignment) == 0);
+
+	// 256 bytes are free, the constants go through the fallback buffer
+	CHECK(allocator.Allocate(512, ConstantAlignment) == RingBufferAllocator::InvalidOffset);
+	CHECK(allocator.GetStats().overflowNum == 1);
+	CHECK(allocator.GetStats().usedBytes == 768);
+
+	// the ring is untouched by the overflow
+	CHECK(allocator.Allocate(256, ConstantAlignment) == 768);
+	CHECK(allocator.GetStats().allocationNum == 2);
+
+	allocator.FinishFrame(1);
+	CHECK(allocator.GetStats().overflowNum == 0);
+}
+
+TEST(AllocationLargerThanRingOverflows)
+{
+	RingBufferAllocator allocator(1024);
+
+	CHECK(allocator.Allocate(2048, ConstantAlignment) == RingBufferAllocator::InvalidOffset);
+	CHECK(allocator.Allocate(1024 + ConstantAlignment, ConstantAlignment) == RingBufferAllocator::InvalidOffset);
+	CHECK(allocator.GetStats().overflowNum == 2);
+	CHECK(allocator.GetStats().usedBytes == 0);
+
+	// the whole ring fits while it is empty from the start
+	CHECK(allocator.Allocate(1024, ConstantAlignment) == 0);
+	CHECK(allocator.GetStats().usedBytes == 1024);
+}
+
+TEST(EmptyRingOverflows)
+{
+	RingBufferAllocator allocator;
+
+	CHECK(allocator.GetSize() == 0);
+	CHECK(allocator.Allocate(256, ConstantAlignment) == RingBufferAllocator::InvalidOffset);
+
+	allocator.Reset(512);
+
+	CHECK(allocator.Allocate(256, ConstantAlignment) == 0);
+	CHECK(allocator.GetStats().overflowNum == 0);
+}
+
+TEST(InFlightAllocationsNeverOverlap)
+{
+	static constexpr size_t RingSize = 64 * 1024;
+	static constexpr uint64_t FramesInFlight = 3;
+
+	struct Allocation
+	{
+		uint64_t fenceValue;
+		size_t offset;
+		size_t size;
+	};
+
+	RingBufferAllocator allocator(RingSize);
+	std::vector<Allocation> allocations;
+	std::mt19937 random(7);
+	std::uniform_int_distribution<size_t> sizeDistribution(1, 1024);
+	std::uniform_int_distribution<size_t> countDistribution(0, 40);
+
+	size_t overflowNum = 0;
+
+	for (uint64_t fenceValue = 1; fenceValue <= 2000; ++fenceValue)
+	{
+		// the GPU runs a few frames behind
+		if (fenceValue > FramesInFlight)
+		{
+			uint64_t completedFenceValue = fenceValue - FramesInFlight;
+			allocator.ReleaseCompleted(completedFenceValue);
+
+			allocations.erase(std::remove_if(allocations.begin(), allocations.end(), [&](const Allocation& allocation)
+			{
+				return allocation.fenceValue <= completedFenceValue;
+			}), allocations.end());
+		}
+
+		size_t count = countDistribution(random);
+
+		for (size_t idx = 0; idx < count; ++idx)
+		{
+			size_t size = alignConstants(sizeDistribution(random));
+			size_t offset = allocator.Allocate(size, ConstantAlignment);
+
+			if (offset == RingBufferAllocator::InvalidOffset)
+			{
+				++overflowNum;
+				continue;
+			}
+
+			CHECK(offset % ConstantAlignment == 0);
+			CHECK(offset + size <= RingSize);
+
+			for (const auto& other : allocations)
+			{
+				CHECK(offset + size <= other.offset || other.offset + other.size <= offset);
+			}
+
+			allocations.push_back({ fenceValue, offset, size });
+		}
+
+		allocator.FinishFrame(fenceValue);
+	}
+
+	// some frames did not fit, so the full ring was exercised too
+	CHECK(overflowNum > 0);
+	CHECK(allocator.GetStats().peakUsedBytes <= RingSize);
+}
+
+TEST_MAIN()
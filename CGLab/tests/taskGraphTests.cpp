@@ -0,0 +1,300 @@
+#include "testing.h"
+#include "taskGraph.h"
+#include "jobSystem.h"
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+
+// Order in which the tasks of a graph started and finished, filled by the tasks themselves
+struct TaskLog
+{
+	explicit TaskLog(size_t taskNum)
+		: starts(taskNum)
+		, ends(taskNum)
+		, runNums(taskNum)
+	{
+		Reset();
+	}
+
+	void Reset()
+	{
+		clock.store(0);
+
+		for (size_t taskIdx = 0; taskIdx < starts.size(); ++taskIdx)
+		{
+			starts[taskIdx].store(0);
+			ends[taskIdx].store(0);
+			runNums[taskIdx].store(0);
+		}
+	}
+
+	std::function<void()> CreateTask(size_t taskIdx)
+	{
+		return [this, taskIdx]()
+		{
+			starts[taskIdx].store(clock.fetch_add(1) + 1);
+			runNums[taskIdx].fetch_add(1);
+			ends[taskIdx].store(clock.fetch_add(1) + 1);
+		};
+	}
+
+	std::atomic<uint64_t> clock;
+	std::vector<std::atomic<uint64_t>> starts;
+	std::vector<std::atomic<uint64_t>> ends;
+	std::vector<std::atomic<uint32_t>> runNums;
+};
+
+bool isRunOnce(const TaskLog& log)
+{
+	for (const auto& runNum : log.runNums)
+	{
+		if (runNum.load() != 1)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool isOrdered(const TaskLog& log, const std::vector<std::pair<TaskGraph::TaskId, TaskGraph::TaskId>>& dependencies)
+{
+	for (const auto& dependency : dependencies)
+	{
+		if (log.ends[dependency.first].load() >= log.starts[dependency.second].load())
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Layers of tasks, every task depends on a few tasks of the layer before it
+void addLayers(
+	TaskGraph& graph,
+	TaskLog& log,
+	size_t layerNum,
+	size_t layerSize,
+	std::vector<std::pair<TaskGraph::TaskId, TaskGraph::TaskId>>& dependencies
+)
+{
+	for (size_t layer = 0; layer < layerNum; ++layer)
+	{
+		for (size_t idx = 0; idx < layerSize; ++idx)
+		{
+			TaskGraph::TaskId taskId = graph.AddTask("Layer", log.CreateTask(graph.GetTaskNum()));
+
+			if (layer == 0)
+			{
+				continue;
+			}
+
+			TaskGraph::TaskId firstOfPrevious = static_cast<TaskGraph::TaskId>((layer - 1) * layerSize);
+			TaskGraph::TaskId before[] =
+			{
+				static_cast<TaskGraph::TaskId>(firstOfPrevious + idx),
+				static_cast<TaskGraph::TaskId>(firstOfPrevious + (idx * 7 + 3) % layerSize)
+			};
+
+			graph.AddDependency(before[0], taskId);
+			dependencies.push_back({ before[0], taskId });
+
+			if (before[1] != before[0])
+			{
+				graph.AddDependency(before[1], taskId);
+				dependencies.push_back({ before[1], taskId });
+			}
+		}
+	}
+}
+
+
+TEST(RunsTasksAfterTheirDependencies)
+{
+	std::unique_ptr<JobSystem> jobSystem(JobSystem::Create(4));
+
+	for (JobSystem* pJobSystem : { static_cast<JobSystem*>(nullptr), jobSystem.get() })
+	{
+		// added in reverse, so the order of AddTask does not decide the order of the run
+		TaskGraph graph;
+		TaskLog log(4);
+
+		TaskGraph::TaskId present = graph.AddTask("Present", log.CreateTask(0));
+		TaskGraph::TaskId draw = graph.AddTask("Draw", log.CreateTask(1));
+		TaskGraph::TaskId cull = graph.AddTask("Cull", log.CreateTask(2));
+		TaskGraph::TaskId update = graph.AddTask("Update", log.CreateTask(3));
+
+		std::vector<std::pair<TaskGraph::TaskId, TaskGraph::TaskId>> dependencies =
+		{
+			{ update, cull },
+			{ cull, draw },
+			{ draw, present }
+		};
+
+		for (const auto& dependency : dependencies)
+		{
+			graph.AddDependency(dependency.first, dependency.second);
+		}
+
+		graph.Run(pJobSystem);
+
+		CHECK(isRunOnce(log));
+		CHECK(isOrdered(log, dependencies));
+		CHECK(log.clock.load() == 8);
+	}
+}
+
+TEST(FanInWaitsForEveryFanOutTask)
+{
+	static constexpr size_t FanOutNum = 64;
+
+	std::unique_ptr<JobSystem> jobSystem(JobSystem::Create(4));
+
+	TaskGraph graph;
+	std::atomic<size_t> doneNum(0);
+	std::atomic<size_t> doneNumAtJoin(0);
+	std::atomic<size_t> joinNum(0);
+	std::atomic<bool> isRootDone(false);
+	std::atomic<size_t> earlyNum(0);
+
+	TaskGraph::TaskId root = graph.AddTask("Root", [&]() { isRootDone.store(true); });
+	TaskGraph::TaskId join = graph.AddTask("Join", [&]()
+	{
+		doneNumAtJoin.store(doneNum.load());
+		joinNum.fetch_add(1);
+	});
+
+	for (size_t idx = 0; idx < FanOutNum; ++idx)
+	{
+		TaskGraph::TaskId taskId = graph.AddTask("Fan out", [&]()
+		{
+			earlyNum.fetch_add(isRootDone.load() ? 0 : 1);
+			doneNum.fetch_add(1);
+		});
+
+		graph.AddDependency(root, taskId);
+		graph.AddDependency(taskId, join);
+	}
+
+	for (int frame = 0; frame < 50; ++frame)
+	{
+		isRootDone.store(false);
+		doneNum.store(0);
+		doneNumAtJoin.store(0);
+
+		graph.Run(jobSystem.get());
+
+		// the join count starts over every run
+		CHECK(earlyNum.load() == 0);
+		CHECK(doneNum.load() == FanOutNum);
+		CHECK(doneNumAtJoin.load() == FanOutNum);
+		CHECK(joinNum.load() == static_cast<size_t>(frame + 1));
+	}
+}
+
+TEST(ReusesAndRebuildsAcrossFrames)
+{
+	std::unique_ptr<JobSystem> jobSystem(JobSystem::Create(3));
+
+	TaskGraph graph;
+	TaskLog smallLog(4 * 8);
+	std::vector<std::pair<TaskGraph::TaskId, TaskGraph::TaskId>> dependencies;
+
+	addLayers(graph, smallLog, 4, 8, dependencies);
+
+	for (int frame = 0; frame < 100; ++frame)
+	{
+		smallLog.Reset();
+		graph.Run(jobSystem.get());
+
+		CHECK(isRunOnce(smallLog));
+		CHECK(isOrdered(smallLog, dependencies));
+	}
+
+	// a larger graph after Clear needs more pending counts than the first one
+	graph.Clear();
+	dependencies.clear();
+
+	CHECK(graph.GetTaskNum() == 0);
+
+	TaskLog largeLog(6 * 32);
+	addLayers(graph, largeLog, 6, 32, dependencies);
+
+	CHECK(graph.GetTaskNum() == 6 * 32);
+
+	for (int frame = 0; frame < 20; ++frame)
+	{
+		largeLog.Reset();
+		graph.Run(jobSystem.get());
+
+		CHECK(isRunOnce(largeLog));
+		CHECK(isOrdered(largeLog, dependencies));
+	}
+
+	// and a smaller one again reuses them
+	graph.Clear();
+	dependencies.clear();
+
+	TaskLog shrunkLog(2 * 4);
+	addLayers(graph, shrunkLog, 2, 4, dependencies);
+
+	graph.Run(jobSystem.get());
+
+	CHECK(isRunOnce(shrunkLog));
+	CHECK(isOrdered(shrunkLog, dependencies));
+}
+
+// more ready tasks than job slots, each stealing from the others with nested loops,
+// wraps the job pool while older jobs still hold their slots
+TEST(CompletesUnderStealContention)
+{
+	static constexpr size_t LayerNum = 3;
+	static const size_t LayerSize = 2 * JobSystem::JobPoolSize;
+
+	for (uint32_t threadNum : { 1u, 2u, 4u })
+	{
+		std::unique_ptr<JobSystem> jobSystem(JobSystem::Create(threadNum));
+
+		TaskGraph graph;
+		TaskLog log(LayerNum * LayerSize);
+		std::vector<std::pair<TaskGraph::TaskId, TaskGraph::TaskId>> dependencies;
+		std::atomic<size_t> nestedNum(0);
+
+		addLayers(graph, log, LayerNum, LayerSize, dependencies);
+
+		// every tenth task runs a nested loop, whose wait steals the tasks it unblocks
+		for (TaskGraph::TaskId taskId = 0; taskId < graph.GetTaskNum(); taskId += 10)
+		{
+			TaskGraph::TaskId nestedId = graph.AddTask("Nested", [&]()
+			{
+				jobSystem->ParallelFor(64, 1, [&](size_t begin, size_t end)
+					{
+						nestedNum.fetch_add(end - begin);
+					}
+				);
+			});
+
+			graph.AddDependency(taskId, nestedId);
+		}
+
+		size_t nestedTaskNum = graph.GetTaskNum() - LayerNum * LayerSize;
+
+		for (int frame = 0; frame < 3; ++frame)
+		{
+			log.Reset();
+			nestedNum.store(0);
+
+			graph.Run(jobSystem.get());
+
+			CHECK(isRunOnce(log));
+			CHECK(isOrdered(log, dependencies));
+			CHECK(nestedNum.load() == nestedTaskNum * 64);
+		}
+	}
+}
+
+TEST_MAIN()
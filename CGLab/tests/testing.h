@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+
+// Minimal test runner, a test fails on its first failed check and the process exit code counts the failures
+namespace testing
+{
+	struct Test
+	{
+		const char* pName;
+		std::function<void()> function;
+	};
+
+	struct Failure
+	{
+		const char* pExpression;
+		const char* pFile;
+		int line;
+	};
+
+	inline std::vector<Test>& GetTests()
+	{
+		static std::vector<Test> tests;
+		return tests;
+	}
+
+	struct Registrar
+	{
+		Registrar(const char* pName, std::function<void()> function)
+		{
+			GetTests().push_back({ pName, std::move(function) });
+		}
+	};
+
+	inline int RunTests()
+	{
+		int failedNum = 0;
+
+		for (const auto& test : GetTests())
+		{
+			try
+			{
+				test.function();
+				printf("[ OK ] %s\n", test.pName);
+			}
+			catch (const Failure& failure)
+			{
+				printf("[FAIL] %s\n       %s:%d: %s\n", test.pName, failure.pFile, failure.line, failure.pExpression);
+				++failedNum;
+			}
+		}
+
+		printf("%zu tests, %d failed\n", GetTests().size(), failedNum);
+
+		return failedNum;
+	}
+}
+
+#define TEST(name) \
+	void name(); \
+	static testing::Registrar s_##name##Registrar(#name, name); \
+	void name()
+
+#define CHECK(expression) \
+	do \
+	{ \
+		if (!(expression)) \
+		{ \
+			throw testing::Failure{ #expression, __FILE__, __LINE__ }; \
+		} \
+	} while (false)
+
+#define TEST_MAIN() \
+	int main() \
+	{ \
+		return testing::RunTests(); \
+	}